@@ -0,0 +1,121 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TROJITA_CONCURRENTRINGBUFFER_H
+#define TROJITA_CONCURRENTRINGBUFFER_H
+
+#include <atomic>
+#include <vector>
+#include <QtGlobal>
+
+namespace Common
+{
+
+/** @short Bounded FIFO for handing items over from one thread to another without locking
+
+This is a sibling of the RingBuffer which is safe to use by exactly one producer thread and exactly one consumer
+thread at the same time. Unlike the RingBuffer, it never overwrites the items which were not consumed yet; when
+it is full, tryAppend() fails and counts the rejected item, so that the producer never gets blocked.
+
+The producer may only call tryAppend(), the consumer may only call tryTakeFirst(). The remaining functions are
+safe to call from either side, but their result is merely a snapshot.
+*/
+template<typename T>
+class ConcurrentRingBuffer
+{
+public:
+    /** @short Instantiate a ring buffer holding up to size elements */
+    explicit ConcurrentRingBuffer(const int size): buf_(size + 1), head_(0), tail_(0), rejected_(0)
+    {
+        Q_ASSERT(size >= 1);
+    }
+
+    /** @short Append an item unless the buffer is full; to be called by the producer */
+    bool tryAppend(const T &what)
+    {
+        const int tail = tail_.load(std::memory_order_relaxed);
+        const int next = increment(tail);
+        if (next == head_.load(std::memory_order_acquire)) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        buf_[tail] = what;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /** @short Move the oldest item into @arg what, returning false if there is none; to be called by the consumer */
+    bool tryTakeFirst(T &what)
+    {
+        const int head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        what = buf_[head];
+        // Do not keep the payload alive in the buffer
+        buf_[head] = T();
+        head_.store(increment(head), std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    /** @short Number of items which are waiting for the consumer */
+    int size() const
+    {
+        const int n = static_cast<int>(buf_.size());
+        return (tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire) + n) % n;
+    }
+
+    int capacity() const
+    {
+        return static_cast<int>(buf_.size()) - 1;
+    }
+
+    /** @short How many items were rejected by tryAppend() because the buffer was full */
+    quint64 rejectedCount() const
+    {
+        return rejected_.load(std::memory_order_relaxed);
+    }
+
+private:
+    int increment(const int pos) const
+    {
+        return pos + 1 == static_cast<int>(buf_.size()) ? 0 : pos + 1;
+    }
+
+    // One slot is always kept empty so that a full buffer can be told apart from an empty one
+    std::vector<T> buf_;
+    std::atomic<int> head_;
+    std::atomic<int> tail_;
+    std::atomic<quint64> rejected_;
+
+    ConcurrentRingBuffer(const ConcurrentRingBuffer &); // don't implement
+    ConcurrentRingBuffer &operator=(const ConcurrentRingBuffer &); // don't implement
+};
+
+}
+
+#endif // TROJITA_CONCURRENTRINGBUFFER_H
@@ -22,16 +22,16 @@
 
 #include <QDateTime>
 #include <QDebug>
-#include <QFile>
-#include <QTextStream>
 #include "FileLogger.h"
+#include "LogWriterThread.h"
 #include "../Imap/Model/Utils.h"
 
 namespace Common
 {
 
 FileLogger::FileLogger(QObject *parent) :
-    QObject(parent), m_fileLog(0), m_consoleLog(false), m_autoFlush(false)
+    QObject(parent), m_fileLog(0), m_consoleLog(false), m_autoFlush(false), m_maxFileSize(0), m_keptFiles(0),
+    m_compress(false), m_droppedMessages(0)
 {
 }
 
@@ -41,14 +41,18 @@ void FileLogger::setFileLogging(const bool enabled, const QString &fileName)
         if (m_fileLog)
             return;
 
-        QFile *logFile = new QFile(fileName, this);
-        logFile->open(QIODevice::Truncate | QIODevice::WriteOnly);
-        m_fileLog = new QTextStream(logFile);
+        QString realFileName = fileName;
+        bool compress = m_compress && LogWriterThread::isCompressionSupported();
+        if (compress && !realFileName.endsWith(QLatin1String(".gz")))
+            realFileName += QLatin1String(".gz");
+        m_fileLog = new LogWriterThread(this, realFileName, m_maxFileSize, m_keptFiles, compress);
+        m_fileLog->setAutoFlush(m_autoFlush);
+        m_fileLog->start(QThread::LowPriority);
     } else {
         if (m_fileLog) {
-            QIODevice *dev = m_fileLog->device();
+            m_droppedMessages += m_fileLog->droppedCount();
+            // This waits till everything which was logged so far is written
             delete m_fileLog;
-            delete dev;
             m_fileLog = 0;
         }
     }
@@ -59,6 +63,22 @@ FileLogger::~FileLogger()
     delete m_fileLog;
 }
 
+void FileLogger::setRotation(const qint64 maxFileSize, const int keptFiles)
+{
+    m_maxFileSize = maxFileSize;
+    m_keptFiles = keptFiles;
+}
+
+void FileLogger::setCompression(const bool compress)
+{
+    m_compress = compress;
+}
+
+quint64 FileLogger::droppedMessages() const
+{
+    return m_droppedMessages + (m_fileLog ? m_fileLog->droppedCount() : 0);
+}
+
 void FileLogger::escapeCrLf(QString &s)
 {
     s.replace(QLatin1Char('\r'), 0x240d /* SYMBOL FOR CARRIAGE RETURN */)
@@ -70,29 +90,23 @@ void FileLogger::slotImapLogged(uint parser, Common::LogMessage message)
     if (!m_fileLog && !m_consoleLog)
         return;
 
-    QString formatted = formatMessage(parser, message);
-    escapeCrLf(formatted);
-
-    if (m_fileLog) {
-        *m_fileLog << formatted << "\n";
-        if (m_autoFlush)
-            m_fileLog->flush();
-    }
+    // The formatting is left to the writer thread
+    if (m_fileLog)
+        m_fileLog->enqueue(parser, message);
 
     enum {CUTOFF=200};
     if (m_consoleLog) {
         if (message.message.size() > CUTOFF) {
-            // Got to reformat the message
             message.truncatedBytes = message.message.size() - CUTOFF;
             message.message = message.message.left(CUTOFF);
-            formatted = formatMessage(parser, message);
-            escapeCrLf(formatted);
         }
+        QString formatted = formatMessage(parser, message);
+        escapeCrLf(formatted);
         qDebug() << formatted.toUtf8().constData() << "\n";
     }
 }
 
-QString FileLogger::formatMessage(uint parser, const Common::LogMessage &message) const
+QString FileLogger::formatMessage(uint parser, const Common::LogMessage &message)
 {
     using namespace Common;
     QString direction;
@@ -126,16 +140,16 @@ QString FileLogger::formatMessage(uint parser, const Common::LogMessage &message
             direction + message.source + QLatin1Char(' ') + message.message.trimmed();
 }
 
-/** @short Enable flushing the on-disk log after each message
+/** @short Enable flushing the on-disk log after each batch of messages
 
 Automatically flushing the log will make sure that all messages are actually stored in the log even in the event of a program
-crash, but at the cost of a rather high overhead.
+crash, except for those which were logged during the last fraction of a second before the crash.
 */
 void FileLogger::setAutoFlush(const bool autoFlush)
 {
     m_autoFlush = autoFlush;
-    if (m_autoFlush && m_fileLog)
-        m_fileLog->flush();
+    if (m_fileLog)
+        m_fileLog->setAutoFlush(autoFlush);
 }
 
 void FileLogger::setConsoleLogging(const bool enabled)
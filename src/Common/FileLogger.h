@@ -25,11 +25,16 @@
 
 #include "Logging.h"
 
-class QTextStream;
-
 namespace Common
 {
 
+class LogWriterThread;
+
+/** @short Write the log messages into a file and/or onto the console
+
+The file is written from a LogWriterThread, so that the thread which logs the messages (typically the GUI thread)
+does not have to wait for the disk. The console output remains synchronous.
+*/
 class FileLogger : public QObject
 {
     Q_OBJECT
@@ -37,6 +42,26 @@ public:
     explicit FileLogger(QObject *parent = 0);
     virtual ~FileLogger();
 
+    /** @short Rotate the log file once it grows over @arg maxFileSize bytes, keeping @arg keptFiles old ones
+
+    A @arg maxFileSize of zero, which is the default, disables the rotation. Takes effect upon the next
+    setFileLogging().
+    */
+    void setRotation(const qint64 maxFileSize, const int keptFiles);
+
+    /** @short Compress the log file with gzip; this is a no-op when built without zlib
+
+    The ".gz" suffix gets appended to the file name unless it is there already. Takes effect upon the next
+    setFileLogging().
+    */
+    void setCompression(const bool compress);
+
+    /** @short How many messages could not be written to the file because the disk was not fast enough */
+    quint64 droppedMessages() const;
+
+    static QString formatMessage(uint parser, const Common::LogMessage &message);
+    static void escapeCrLf(QString &s);
+
 public slots:
     /** @short An IMAP model wants to log something */
     void slotImapLogged(uint parser, Common::LogMessage message);
@@ -49,13 +74,15 @@ public slots:
     void setAutoFlush(const bool autoFlush);
 
 protected:
-    QString formatMessage(uint parser, const Common::LogMessage &message) const;
-    void escapeCrLf(QString &s);
-
-    QTextStream *m_fileLog;
+    LogWriterThread *m_fileLog;
 
     bool m_consoleLog;
     bool m_autoFlush;
+    qint64 m_maxFileSize;
+    int m_keptFiles;
+    bool m_compress;
+    /** @short Drops reported by the writers which are gone already */
+    quint64 m_droppedMessages;
 };
 
 }
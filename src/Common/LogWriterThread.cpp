@@ -0,0 +1,277 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstring>
+#include <QDebug>
+#include <QFile>
+#include "configure.cmake.h"
+#include "FileLogger.h"
+#include "LogWriterThread.h"
+
+#ifdef TROJITA_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+/** @short How many messages can wait for the writer */
+const int maxQueuedMessages = 16384;
+/** @short Upper limit on the memory which the waiting messages can occupy */
+const qint64 maxQueuedBytes = 32 * 1024 * 1024;
+/** @short How often to write the accumulated messages when nobody asks for that explicitly */
+const unsigned long batchIntervalMsec = 250;
+/** @short Do not build batches larger than this */
+const int maxBatchSize = 1024 * 1024;
+
+qint64 approximateSize(const Common::LogMessage &message)
+{
+    return (message.message.size() + message.source.size()) * static_cast<qint64>(sizeof(QChar)) + sizeof(Common::LogMessage);
+}
+
+}
+
+namespace Common
+{
+
+LogWriterThread::LogWriterThread(QObject *parent, const QString &fileName, const qint64 maxFileSize, const int keptFiles,
+                                 const bool compress):
+    QThread(parent), m_queue(maxQueuedMessages), m_queuedBytes(0), m_droppedForSize(0), m_stopRequested(false),
+    m_flushRequested(false), m_autoFlush(false), m_fileName(fileName), m_maxFileSize(maxFileSize), m_keptFiles(keptFiles),
+    m_compress(compress && isCompressionSupported()), m_file(0), m_zStream(0), m_reportedDrops(0)
+{
+}
+
+LogWriterThread::~LogWriterThread()
+{
+    m_stopRequested = true;
+    wakeUp();
+    wait();
+}
+
+bool LogWriterThread::isCompressionSupported()
+{
+#ifdef TROJITA_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool LogWriterThread::enqueue(const uint parser, const LogMessage &message)
+{
+    const qint64 size = approximateSize(message);
+    if (m_queuedBytes.fetch_add(size) + size > maxQueuedBytes) {
+        m_queuedBytes -= size;
+        ++m_droppedForSize;
+        return false;
+    }
+
+    Entry entry;
+    entry.parser = parser;
+    entry.message = message;
+    if (!m_queue.tryAppend(entry)) {
+        m_queuedBytes -= size;
+        return false;
+    }
+
+    if (m_queue.size() > m_queue.capacity() / 2)
+        wakeUp();
+    return true;
+}
+
+void LogWriterThread::requestFlush()
+{
+    m_flushRequested = true;
+    wakeUp();
+}
+
+void LogWriterThread::setAutoFlush(const bool autoFlush)
+{
+    m_autoFlush = autoFlush;
+    if (autoFlush)
+        requestFlush();
+}
+
+quint64 LogWriterThread::droppedCount() const
+{
+    return m_queue.rejectedCount() + m_droppedForSize.load();
+}
+
+void LogWriterThread::wakeUp()
+{
+    QMutexLocker locker(&m_wakeUpMutex);
+    m_wakeUpCondition.wakeAll();
+}
+
+void LogWriterThread::run()
+{
+    if (!openFile())
+        return;
+
+    while (true) {
+        // Whatever got enqueued before the stop request will still make it to the disk
+        const bool stopping = m_stopRequested;
+
+        QByteArray batch;
+        Entry entry;
+        while (m_queue.tryTakeFirst(entry)) {
+            QString formatted = FileLogger::formatMessage(entry.parser, entry.message);
+            FileLogger::escapeCrLf(formatted);
+            batch += formatted.toUtf8();
+            batch += '\n';
+            m_queuedBytes -= approximateSize(entry.message);
+            // Split the batch so that the rotation happens close to the requested size
+            if (batch.size() > maxBatchSize || (m_maxFileSize > 0 && m_file && m_file->pos() + batch.size() >= m_maxFileSize)) {
+                writeBatch(batch, false);
+                batch.clear();
+            }
+        }
+
+        const quint64 dropped = droppedCount();
+        if (dropped != m_reportedDrops) {
+            batch += QStringLiteral("*** %1 log messages were dropped because the disk could not keep up\n")
+                    .arg(dropped - m_reportedDrops).toUtf8();
+            m_reportedDrops = dropped;
+        }
+
+        const bool flush = m_flushRequested.exchange(false) || m_autoFlush || stopping;
+        if (!batch.isEmpty() || flush)
+            writeBatch(batch, flush);
+
+        if (stopping)
+            break;
+
+        QMutexLocker locker(&m_wakeUpMutex);
+        if (!m_stopRequested && !m_flushRequested)
+            m_wakeUpCondition.wait(&m_wakeUpMutex, batchIntervalMsec);
+    }
+
+    closeFile();
+}
+
+bool LogWriterThread::openFile()
+{
+    Q_ASSERT(!m_file);
+    m_file = new QFile(m_fileName);
+    if (!m_file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Cannot write the log into" << m_fileName << ":" << m_file->errorString();
+        delete m_file;
+        m_file = 0;
+        return false;
+    }
+
+#ifdef TROJITA_HAVE_ZLIB
+    if (m_compress) {
+        z_stream *zStream = new z_stream;
+        memset(zStream, 0, sizeof(z_stream));
+        // 16 on top of the window size asks for the gzip wrapper
+        if (deflateInit2(zStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+            m_zStream = zStream;
+        } else {
+            qDebug() << "Cannot initialize zlib, the log will not be compressed";
+            delete zStream;
+        }
+    }
+#endif
+    return true;
+}
+
+void LogWriterThread::closeFile()
+{
+    if (!m_file)
+        return;
+
+#ifdef TROJITA_HAVE_ZLIB
+    if (m_zStream) {
+        z_stream *zStream = static_cast<z_stream *>(m_zStream);
+        char out[16384];
+        int res;
+        do {
+            zStream->next_out = reinterpret_cast<Bytef *>(out);
+            zStream->avail_out = sizeof(out);
+            res = deflate(zStream, Z_FINISH);
+            m_file->write(out, sizeof(out) - zStream->avail_out);
+        } while (res == Z_OK);
+        deflateEnd(zStream);
+        delete zStream;
+        m_zStream = 0;
+    }
+#endif
+
+    m_file->close();
+    delete m_file;
+    m_file = 0;
+}
+
+QString LogWriterThread::rotatedFileName(const int number) const
+{
+    if (m_compress && m_fileName.endsWith(QLatin1String(".gz")))
+        return m_fileName.left(m_fileName.size() - 3) + QStringLiteral(".%1.gz").arg(number);
+    return m_fileName + QStringLiteral(".%1").arg(number);
+}
+
+void LogWriterThread::rotate()
+{
+    closeFile();
+    QFile::remove(rotatedFileName(m_keptFiles));
+    for (int i = m_keptFiles - 1; i >= 1; --i) {
+        QFile::rename(rotatedFileName(i), rotatedFileName(i + 1));
+    }
+    if (m_keptFiles > 0)
+        QFile::rename(m_fileName, rotatedFileName(1));
+    openFile();
+}
+
+void LogWriterThread::writeBatch(const QByteArray &data, const bool flush)
+{
+    if (!m_file)
+        return;
+
+#ifdef TROJITA_HAVE_ZLIB
+    if (m_zStream) {
+        z_stream *zStream = static_cast<z_stream *>(m_zStream);
+        zStream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+        zStream->avail_in = data.size();
+        char out[16384];
+        do {
+            zStream->next_out = reinterpret_cast<Bytef *>(out);
+            zStream->avail_out = sizeof(out);
+            // A sync flush makes everything written so far readable even if we crash later on
+            deflate(zStream, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+            m_file->write(out, sizeof(out) - zStream->avail_out);
+        } while (zStream->avail_out == 0);
+    } else
+#endif
+    {
+        m_file->write(data);
+    }
+
+    if (flush)
+        m_file->flush();
+
+    // QFile::size() would flush the buffers, the position is just as good for a file which we only append to
+    if (m_maxFileSize > 0 && m_file->pos() >= m_maxFileSize)
+        rotate();
+}
+
+}
@@ -0,0 +1,120 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef COMMON_LOGWRITERTHREAD_H
+#define COMMON_LOGWRITERTHREAD_H
+
+#include <atomic>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include "ConcurrentRingBuffer.h"
+#include "Logging.h"
+
+class QFile;
+
+namespace Common
+{
+
+/** @short Background thread which formats the log messages and writes them into a file
+
+The messages are handed over through a ConcurrentRingBuffer, so the thread which logs them only has to copy a few
+implicitly shared strings and never waits for the disk. The writer wakes up periodically, takes whatever has
+accumulated and writes it in a single batch.
+
+The amount of memory used by the pending messages is bounded both by their number and by their total size. When
+the disk cannot keep up, new messages are dropped; their number is reported by droppedCount() and a note about
+them is written into the log.
+
+When the file grows over the configured size, it is rotated by appending a number to its name. With zlib
+available, the output can be compressed into the gzip format, in which case the size limit applies to the
+compressed data.
+*/
+class LogWriterThread : public QThread
+{
+    Q_OBJECT
+public:
+    /** @short Prepare writing into @arg fileName; call start() to actually begin
+
+    A @arg maxFileSize of zero disables the rotation. At most @arg keptFiles rotated files are preserved.
+    */
+    LogWriterThread(QObject *parent, const QString &fileName, const qint64 maxFileSize, const int keptFiles, const bool compress);
+    /** @short Write all pending messages and stop the thread */
+    virtual ~LogWriterThread();
+
+    /** @short Queue a message for writing; returns false if it had to be dropped */
+    bool enqueue(const uint parser, const LogMessage &message);
+
+    /** @short Make sure that everything which has been enqueued so far reaches the disk soon */
+    void requestFlush();
+
+    /** @short Write every batch to the disk immediately, do not leave it in the buffers of the file */
+    void setAutoFlush(const bool autoFlush);
+
+    /** @short Number of messages which were dropped because the queue was full */
+    quint64 droppedCount() const;
+
+    /** @short Was the compression requested and is it actually available? */
+    static bool isCompressionSupported();
+
+protected:
+    virtual void run();
+
+private:
+    struct Entry {
+        uint parser;
+        LogMessage message;
+        Entry(): parser(0) {}
+    };
+
+    /** @short Shorten the waiting for the next batch */
+    void wakeUp();
+
+    bool openFile();
+    void closeFile();
+    void rotate();
+    QString rotatedFileName(const int number) const;
+    void writeBatch(const QByteArray &data, const bool flush);
+
+    ConcurrentRingBuffer<Entry> m_queue;
+    std::atomic<qint64> m_queuedBytes;
+    std::atomic<quint64> m_droppedForSize;
+    std::atomic<bool> m_stopRequested;
+    std::atomic<bool> m_flushRequested;
+    std::atomic<bool> m_autoFlush;
+    QMutex m_wakeUpMutex;
+    QWaitCondition m_wakeUpCondition;
+
+    // The rest is only touched from within the writer thread
+    QString m_fileName;
+    qint64 m_maxFileSize;
+    int m_keptFiles;
+    bool m_compress;
+    QFile *m_file;
+    void *m_zStream;
+    quint64 m_reportedDrops;
+};
+
+}
+
+#endif // COMMON_LOGWRITERTHREAD_H
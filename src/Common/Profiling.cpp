@@ -0,0 +1,245 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "Profiling.h"
+
+#ifdef TROJITA_HAVE_PROFILING
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <QMutex>
+#include <QStringList>
+#include <QVector>
+
+namespace {
+
+/** @short Upper limit on the number of the distinct sites; the extra ones are ignored */
+const int maxSites = 64;
+
+/** @short Number of histogram buckets
+
+Values below 4 have a bucket of their own, the bigger ones get four buckets per power of two, which keeps the
+relative error of the reported percentiles under 25 %.
+*/
+const int bucketCount = 256;
+
+int bucketForValue(const quint64 value)
+{
+    if (value < 4)
+        return static_cast<int>(value);
+    int exponent = 63;
+    while (!(value & (Q_UINT64_C(1) << exponent)))
+        --exponent;
+    int sub = static_cast<int>((value >> (exponent - 2)) & 3);
+    return 4 * (exponent - 1) + sub;
+}
+
+quint64 bucketUpperBound(const int bucket)
+{
+    if (bucket < 4)
+        return bucket;
+    int exponent = bucket / 4 + 1;
+    int sub = bucket % 4;
+    return ((Q_UINT64_C(4) + sub) << (exponent - 2)) + (Q_UINT64_C(1) << (exponent - 2)) - 1;
+}
+
+/** @short Statistics of a single site as seen by a single thread
+
+Only the owning thread writes into these; the atomics are here so that summary() can read them at any time.
+*/
+struct SiteStats {
+    std::atomic<quint64> count;
+    std::atomic<quint64> totalNsec;
+    std::atomic<quint64> maxNsec;
+    std::atomic<quint64> sum;
+    std::atomic<quint32> buckets[bucketCount];
+
+    SiteStats(): count(0), totalNsec(0), maxNsec(0), sum(0)
+    {
+        for (int i = 0; i < bucketCount; ++i)
+            buckets[i] = 0;
+    }
+};
+
+struct ThreadStats {
+    SiteStats sites[maxSites];
+};
+
+/** @short Names of the sites and the per-thread buffers, which are never freed */
+struct Registry {
+    QMutex mutex;
+    QVector<const char *> names;
+    QVector<ThreadStats *> threads;
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+SiteStats *statsForSite(const int index)
+{
+    if (index < 0)
+        return 0;
+    static thread_local ThreadStats *threadStats = 0;
+    if (!threadStats) {
+        threadStats = new ThreadStats();
+        Registry &r = registry();
+        QMutexLocker locker(&r.mutex);
+        r.threads << threadStats;
+    }
+    return &threadStats->sites[index];
+}
+
+QString formatNsec(const quint64 nsec)
+{
+    return QString::number(nsec / 1000.0, 'f', 1);
+}
+
+}
+
+namespace Common
+{
+namespace Profiling
+{
+
+Site::Site(const char *name)
+{
+    Registry &r = registry();
+    QMutexLocker locker(&r.mutex);
+    int index = -1;
+    for (int i = 0; i < r.names.size() && index == -1; ++i) {
+        if (!strcmp(r.names[i], name))
+            index = i;
+    }
+    if (index == -1 && r.names.size() < maxSites) {
+        index = r.names.size();
+        r.names << name;
+    }
+    m_index = index;
+}
+
+void Site::recordDuration(const quint64 nsec)
+{
+    SiteStats *stats = statsForSite(m_index);
+    if (!stats)
+        return;
+    stats->count.fetch_add(1, std::memory_order_relaxed);
+    stats->totalNsec.fetch_add(nsec, std::memory_order_relaxed);
+    if (nsec > stats->maxNsec.load(std::memory_order_relaxed))
+        stats->maxNsec.store(nsec, std::memory_order_relaxed);
+    stats->buckets[bucketForValue(nsec)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Site::recordValue(const quint64 value)
+{
+    SiteStats *stats = statsForSite(m_index);
+    if (!stats)
+        return;
+    stats->count.fetch_add(1, std::memory_order_relaxed);
+    stats->sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+bool isEnabled()
+{
+    return true;
+}
+
+QString summary()
+{
+    Registry &r = registry();
+    QMutexLocker locker(&r.mutex);
+
+    QStringList lines;
+    lines << QStringLiteral("site\tcount\ttotal [ms]\tavg [us]\tp50 [us]\tp99 [us]\tmax [us]\tsum");
+    for (int site = 0; site < r.names.size(); ++site) {
+        quint64 count = 0, totalNsec = 0, maxNsec = 0, sum = 0;
+        QVector<quint64> buckets(bucketCount, 0);
+        Q_FOREACH(const ThreadStats *thread, r.threads) {
+            const SiteStats &stats = thread->sites[site];
+            count += stats.count.load(std::memory_order_relaxed);
+            totalNsec += stats.totalNsec.load(std::memory_order_relaxed);
+            maxNsec = std::max(maxNsec, stats.maxNsec.load(std::memory_order_relaxed));
+            sum += stats.sum.load(std::memory_order_relaxed);
+            for (int i = 0; i < bucketCount; ++i)
+                buckets[i] += stats.buckets[i].load(std::memory_order_relaxed);
+        }
+        if (!count)
+            continue;
+
+        quint64 timed = 0;
+        Q_FOREACH(const quint64 num, buckets) {
+            timed += num;
+        }
+        quint64 p50 = 0, p99 = 0, seen = 0;
+        bool havePercentile50 = false;
+        for (int i = 0; i < bucketCount && timed; ++i) {
+            seen += buckets[i];
+            if (!havePercentile50 && seen * 100 >= timed * 50) {
+                p50 = bucketUpperBound(i);
+                havePercentile50 = true;
+            }
+            if (seen * 100 >= timed * 99) {
+                p99 = bucketUpperBound(i);
+                break;
+            }
+        }
+
+        lines << QStringLiteral("%1\t%2\t%3\t%4\t%5\t%6\t%7\t%8").arg(
+                     QString::fromUtf8(r.names[site]), QString::number(count),
+                     QString::number(totalNsec / 1000000.0, 'f', 3),
+                     timed ? formatNsec(totalNsec / timed) : QStringLiteral("-"),
+                     timed ? formatNsec(std::min(p50, maxNsec)) : QStringLiteral("-"),
+                     timed ? formatNsec(std::min(p99, maxNsec)) : QStringLiteral("-"),
+                     timed ? formatNsec(maxNsec) : QStringLiteral("-"),
+                     QString::number(sum));
+    }
+    return lines.join(QLatin1Char('\n'));
+}
+
+}
+}
+
+#else
+
+namespace Common
+{
+namespace Profiling
+{
+
+bool isEnabled()
+{
+    return false;
+}
+
+QString summary()
+{
+    return QStringLiteral("Trojita was built without WITH_PROFILING");
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,126 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef COMMON_PROFILING_H
+#define COMMON_PROFILING_H
+
+#include <QString>
+#include "configure.cmake.h"
+
+/** @short Lightweight profiling of the hot code paths
+
+The TROJITA_PROFILE_SCOPE(name) macro measures the time spent in the rest of the enclosing scope, the
+TROJITA_PROFILE_COUNT(name, value) accumulates an arbitrary value such as the number of bytes. Each distinct
+name is a "site"; the statistics are kept per site in buffers which belong to the calling thread, so the
+threads never contend for a lock and the overhead is a couple of clock reads and atomic increments.
+
+The macros only do something when Trojita is configured with WITH_PROFILING. Otherwise they expand to nothing
+and summary() merely reports that the profiling is not available.
+*/
+
+#ifdef TROJITA_HAVE_PROFILING
+
+#include <chrono>
+
+namespace Common
+{
+namespace Profiling
+{
+
+/** @short One place in the code whose statistics are tracked; meant to be a function-local static object */
+class Site
+{
+public:
+    /** @short The @arg name has to stay valid for the lifetime of the program */
+    explicit Site(const char *name);
+
+    /** @short Account for one pass through this site which took @arg nsec nanoseconds */
+    void recordDuration(const quint64 nsec);
+    /** @short Add @arg value to the sum tracked by this site */
+    void recordValue(const quint64 value);
+
+private:
+    int m_index;
+};
+
+/** @short Measure the time spent between the construction and destruction of this object */
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Site &site): m_site(site), m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        m_site.recordDuration(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - m_start).count());
+    }
+
+private:
+    Site &m_site;
+    std::chrono::steady_clock::time_point m_start;
+
+    ScopedTimer(const ScopedTimer &); // don't implement
+    ScopedTimer &operator=(const ScopedTimer &); // don't implement
+};
+
+}
+}
+
+#define TROJITA_PROFILING_CONCAT2(a, b) a##b
+#define TROJITA_PROFILING_CONCAT(a, b) TROJITA_PROFILING_CONCAT2(a, b)
+
+#define TROJITA_PROFILE_SCOPE(name) \
+    static Common::Profiling::Site TROJITA_PROFILING_CONCAT(trojitaProfilingSite, __LINE__)(name); \
+    Common::Profiling::ScopedTimer TROJITA_PROFILING_CONCAT(trojitaProfilingTimer, __LINE__)( \
+        TROJITA_PROFILING_CONCAT(trojitaProfilingSite, __LINE__))
+
+#define TROJITA_PROFILE_COUNT(name, value) \
+    do { \
+        static Common::Profiling::Site trojitaProfilingSite(name); \
+        trojitaProfilingSite.recordValue(value); \
+    } while (0)
+
+#else
+
+#define TROJITA_PROFILE_SCOPE(name)
+#define TROJITA_PROFILE_COUNT(name, value) do {} while (0)
+
+#endif
+
+namespace Common
+{
+namespace Profiling
+{
+
+/** @short Is the profiling compiled in? */
+bool isEnabled();
+
+/** @short Human-readable table of the statistics of all sites, merged over all threads */
+QString summary();
+
+}
+}
+
+#endif // COMMON_PROFILING_H
@@ -37,6 +37,7 @@
 #include "Cryptography/MimeticUtils.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/Utils.h"
 
 using namespace Imap::Mailbox;
 
@@ -608,13 +609,13 @@ GpgMeSigned::~GpgMeSigned()
 
 void GpgMeSigned::handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
-    Q_ASSERT(topLeft == bottomRight);
     if (!m_plaintextPart.isValid()) {
         forwardFailure(tr("Signed message is gone"), QString(), QStringLiteral("state-offline"));
         return;
     }
+    // Body parts are reported one by one, but the enclosing message might be a part of a bigger range of updated messages
     if (topLeft != m_plaintextPart && topLeft != m_plaintextMimePart && topLeft != m_signaturePart &&
-            topLeft != m_enclosingMessage) {
+            !Imap::isIndexInRange(m_enclosingMessage, topLeft, bottomRight)) {
         return;
     }
     Q_ASSERT(m_plaintextPart.isValid());
@@ -746,7 +747,6 @@ GpgMeEncrypted::~GpgMeEncrypted()
 
 void GpgMeEncrypted::handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
-    Q_ASSERT(topLeft == bottomRight);
     if (!m_encPart.isValid()) {
         m_statusTLDR = tr("Encrypted message is gone");
         m_statusLong = QString();
@@ -754,7 +754,7 @@ void GpgMeEncrypted::handleDataChanged(const QModelIndex &topLeft, const QModelI
         emitDataChanged();
         return;
     }
-    if (topLeft != m_versionPart && topLeft != m_encPart && topLeft != m_enclosingMessage) {
+    if (topLeft != m_versionPart && topLeft != m_encPart && !Imap::isIndexInRange(m_enclosingMessage, topLeft, bottomRight)) {
         return;
     }
     Q_ASSERT(m_versionPart.isValid());
@@ -80,7 +80,8 @@ LocallyParsedMimePart::LocallyParsedMimePart(MessageModel *model, MessagePart *p
 void LocallyParsedMimePart::messageMaybeAvailable(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
     Q_ASSERT(m_children.empty());
-    Q_ASSERT(topLeft == bottomRight);
+    // Only the body parts are interesting here; these are always reported one by one
+    Q_UNUSED(bottomRight);
     Q_ASSERT(m_sourceHeaderIndex.isValid() == m_sourceTextIndex.isValid());
 
     if (!m_sourceHeaderIndex.isValid()) {
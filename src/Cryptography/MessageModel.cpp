@@ -27,6 +27,7 @@
 #include "Common/MetaTypes.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/Utils.h"
 
 namespace Cryptography {
 
@@ -59,6 +60,13 @@ void MessageModel::mapDataChanged(const QModelIndex &topLeft, const QModelIndex
                     createIndex(topLeft.row(), topLeft.column(), *topLeftIt),
                     createIndex(bottomRight.row(), bottomRight.column(), *bottomRightIt)
                     );
+    } else if (topLeft != bottomRight && Imap::isIndexInRange(m_message, topLeft, bottomRight)) {
+        // Messages which got updated together are reported as a range; only the message shown by this model is interesting
+        auto messageIt = m_map.constFind(m_message);
+        if (messageIt != m_map.constEnd()) {
+            QModelIndex changed = createIndex(m_message.row(), m_message.column(), *messageIt);
+            emit dataChanged(changed, changed);
+        }
     }
 }
 
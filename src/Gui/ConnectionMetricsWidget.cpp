@@ -0,0 +1,127 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <QHeaderView>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include "ConnectionMetricsWidget.h"
+#include "Imap/Model/Model.h"
+
+namespace Gui {
+
+namespace {
+
+QString formatMsec(const QVariant &msec)
+{
+    int value = msec.toInt();
+    return value < 0 ? QStringLiteral("> 10000") : QString::number(value);
+}
+
+}
+
+ConnectionMetricsWidget::ConnectionMetricsWidget(QWidget *parent) :
+    QWidget(parent)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    m_tree = new QTreeWidget(this);
+    m_tree->setUniformRowHeights(true);
+    m_tree->setHeaderLabels(QStringList() << tr("Item") << tr("Count") << tr("Average [ms]")
+                            << tr("Median [ms]") << tr("95th percentile [ms]") << tr("Max [ms]"));
+    m_tree->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    layout->addWidget(m_tree);
+
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setInterval(1000);
+    connect(m_refreshTimer, &QTimer::timeout, this, &ConnectionMetricsWidget::refresh);
+}
+
+void ConnectionMetricsWidget::setImapModel(Imap::Mailbox::Model *model)
+{
+    m_model = model;
+    refresh();
+}
+
+void ConnectionMetricsWidget::refresh()
+{
+    m_tree->clear();
+    if (!m_model)
+        return;
+
+    Q_FOREACH(const QVariant &connection, m_model->connectionMetrics()) {
+        QVariantMap metrics = connection.toMap();
+        auto top = new QTreeWidgetItem(m_tree);
+        top->setText(0, tr("Connection %1: %2").arg(metrics[QStringLiteral("parserId")].toUInt())
+                     .arg(metrics[QStringLiteral("connectionState")].toString()));
+        if (metrics.contains(QStringLiteral("maintainingTask")))
+            top->setToolTip(0, metrics[QStringLiteral("maintainingTask")].toString());
+
+        auto traffic = new QTreeWidgetItem(top, QStringList() << tr("Traffic"));
+        new QTreeWidgetItem(traffic, QStringList() << tr("Received: %1 bytes (%2 on the wire)")
+                            .arg(metrics[QStringLiteral("bytesReceived")].toLongLong())
+                            .arg(metrics[QStringLiteral("wireBytesReceived")].toLongLong()));
+        new QTreeWidgetItem(traffic, QStringList() << tr("Sent: %1 bytes (%2 on the wire)")
+                            .arg(metrics[QStringLiteral("bytesSent")].toLongLong())
+                            .arg(metrics[QStringLiteral("wireBytesSent")].toLongLong()));
+        new QTreeWidgetItem(traffic, QStringList() << tr("Queued: %1, in flight: %2, active tasks: %3")
+                            .arg(metrics[QStringLiteral("commandsQueued")].toInt())
+                            .arg(metrics[QStringLiteral("commandsInFlight")].toInt())
+                            .arg(metrics[QStringLiteral("activeTasks")].toInt()));
+
+        auto commands = new QTreeWidgetItem(top, QStringList() << tr("Command latency"));
+        QVariantMap latency = metrics[QStringLiteral("commandLatency")].toMap();
+        for (auto it = latency.constBegin(); it != latency.constEnd(); ++it) {
+            QVariantMap histogram = it->toMap();
+            int count = histogram[QStringLiteral("count")].toInt();
+            qint64 total = histogram[QStringLiteral("totalUsec")].toLongLong();
+            new QTreeWidgetItem(commands, QStringList() << it.key() << QString::number(count)
+                                << QString::number(count ? total / count / 1000.0 : 0, 'f', 1)
+                                << formatMsec(histogram[QStringLiteral("p50Msec")])
+                                << formatMsec(histogram[QStringLiteral("p95Msec")])
+                                << QString::number(histogram[QStringLiteral("maxUsec")].toLongLong() / 1000.0, 'f', 1));
+        }
+
+        auto responses = new QTreeWidgetItem(top, QStringList() << tr("Responses"));
+        QVariantMap responseCounts = metrics[QStringLiteral("responseCounts")].toMap();
+        for (auto it = responseCounts.constBegin(); it != responseCounts.constEnd(); ++it) {
+            new QTreeWidgetItem(responses, QStringList() << it.key() << QString::number(it->toInt()));
+        }
+    }
+    m_tree->expandToDepth(1);
+}
+
+void ConnectionMetricsWidget::showEvent(QShowEvent *e)
+{
+    refresh();
+    m_refreshTimer->start();
+    QWidget::showEvent(e);
+}
+
+void ConnectionMetricsWidget::hideEvent(QHideEvent *e)
+{
+    m_refreshTimer->stop();
+    QWidget::hideEvent(e);
+}
+
+}
@@ -0,0 +1,69 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef GUI_CONNECTIONMETRICSWIDGET_H
+#define GUI_CONNECTIONMETRICSWIDGET_H
+
+#include <QPointer>
+#include <QWidget>
+
+class QTimer;
+class QTreeWidget;
+
+namespace Imap {
+namespace Mailbox {
+class Model;
+}
+}
+
+namespace Gui {
+
+/** @short Live statistics of the IMAP connections
+
+Shows the per-command latency, traffic volume and queue depth of each connection as reported by
+Imap::Mailbox::Model::connectionMetrics(). The data are only polled while the widget is visible.
+*/
+class ConnectionMetricsWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit ConnectionMetricsWidget(QWidget *parent = 0);
+
+    void setImapModel(Imap::Mailbox::Model *model);
+
+private slots:
+    void refresh();
+
+private:
+    QTreeWidget *m_tree;
+    QTimer *m_refreshTimer;
+    QPointer<Imap::Mailbox::Model> m_model;
+
+    virtual void showEvent(QShowEvent *e);
+    virtual void hideEvent(QHideEvent *e);
+};
+
+}
+
+#endif // GUI_CONNECTIONMETRICSWIDGET_H
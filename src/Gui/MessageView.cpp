@@ -145,6 +145,11 @@ void MessageView::unsetPreviousMessage()
 {
     clearWaitingConns();
     m_loadingItems.clear();
+    if (message.isValid()) {
+        Imap::Mailbox::Model *model = dynamic_cast<Imap::Mailbox::Model *>(const_cast<QAbstractItemModel *>(message.model()));
+        Q_ASSERT(model);
+        model->unpinMessageData(message);
+    }
     message = QModelIndex();
     markAsReadTimer->stop();
     if (auto w = bodyWidget()) {
@@ -189,6 +194,10 @@ void MessageView::setMessage(const QModelIndex &index)
     unsetPreviousMessage();
 
     message = messageIndex;
+    // Whatever is on display shall not be evicted from memory
+    Imap::Mailbox::Model *model = dynamic_cast<Imap::Mailbox::Model *>(const_cast<QAbstractItemModel *>(message.model()));
+    Q_ASSERT(model);
+    model->pinMessageData(message);
     messageModel = new Cryptography::MessageModel(this, message);
     messageModel->setObjectName(QStringLiteral("cryptoMessageModel-%1-%2")
                                 .arg(message.data(Imap::Mailbox::RoleMailboxName).toString(),
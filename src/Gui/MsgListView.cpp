@@ -29,15 +29,18 @@
 #include <QHeaderView>
 #include <QKeyEvent>
 #include <QPainter>
+#include <QScrollBar>
 #include <QSignalMapper>
 #include <QTimer>
+#include "Imap/Model/Model.h"
 #include "Imap/Model/MsgListModel.h"
 #include "Imap/Model/PrettyMsgListModel.h"
 
 namespace Gui
 {
 
-MsgListView::MsgListView(QWidget *parent): QTreeView(parent), m_autoActivateAfterKeyNavigation(true), m_autoResizeSections(true)
+MsgListView::MsgListView(QWidget *parent): QTreeView(parent), m_lastScrollValue(0), m_scrollVelocity(0),
+    m_autoActivateAfterKeyNavigation(true), m_autoResizeSections(true)
 {
     connect(header(), &QHeaderView::geometriesChanged, this, &MsgListView::slotFixSize);
     connect(this, &QTreeView::expanded, this, &MsgListView::slotExpandWholeSubtree);
@@ -61,6 +64,12 @@ MsgListView::MsgListView(QWidget *parent): QTreeView(parent), m_autoActivateAfte
     m_naviActivationTimer = new QTimer(this);
     m_naviActivationTimer->setSingleShot(true);
     connect(m_naviActivationTimer, &QTimer::timeout, this, &MsgListView::slotCurrentActivated);
+
+    m_fetchWindowTimer = new QTimer(this);
+    m_fetchWindowTimer->setSingleShot(true);
+    m_fetchWindowTimer->setInterval(0);
+    connect(m_fetchWindowTimer, &QTimer::timeout, this, &MsgListView::slotUpdateFetchWindow);
+    connect(verticalScrollBar(), &QAbstractSlider::valueChanged, this, &MsgListView::slotVerticalScrolled);
 }
 
 // left might collapse a thread, question is whether ending there (on closing the thread) should be
@@ -397,12 +406,104 @@ void MsgListView::setModel(QAbstractItemModel *model)
             disconnect(prettyModel, &Imap::Mailbox::PrettyMsgListModel::sortingPreferenceChanged,
                        this, &MsgListView::slotHandleSortCriteriaChanged);
         }
+        this->model()->disconnect(m_fetchWindowTimer);
     }
     QTreeView::setModel(model);
     if (Imap::Mailbox::PrettyMsgListModel *prettyModel = findPrettyMsgListModel(model)) {
         connect(prettyModel, &Imap::Mailbox::PrettyMsgListModel::sortingPreferenceChanged,
                 this, &MsgListView::slotHandleSortCriteriaChanged);
     }
+    if (model) {
+        // Sorting, threading and a switch to another mailbox change what is visible without any scrolling
+        connect(model, &QAbstractItemModel::layoutChanged,
+                m_fetchWindowTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+        connect(model, &QAbstractItemModel::modelReset,
+                m_fetchWindowTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    }
+    m_scrollVelocity = 0;
+    m_fetchWindowTimer->start();
+}
+
+/** @short Overridden from QTreeView in order to include the new arrivals in the fetch window */
+void MsgListView::rowsInserted(const QModelIndex &parent, int start, int end)
+{
+    QTreeView::rowsInserted(parent, start, end);
+    m_fetchWindowTimer->start();
+}
+
+/** @short Overridden from QTreeView because a taller view shows more rows */
+void MsgListView::resizeEvent(QResizeEvent *event)
+{
+    QTreeView::resizeEvent(event);
+    m_fetchWindowTimer->start();
+}
+
+void MsgListView::slotVerticalScrolled(int value)
+{
+    int delta = value - m_lastScrollValue;
+    m_lastScrollValue = value;
+    if (verticalScrollMode() == ScrollPerPixel) {
+        delta /= qMax(1, rowHeight(indexAt(QPoint(0, 0))));
+    }
+
+    if (!m_lastScrollTime.isValid() || m_lastScrollTime.elapsed() > 500) {
+        // scrolling has just started
+        m_scrollVelocity = 0;
+    } else if (m_lastScrollTime.elapsed() > 0) {
+        // smooth out the jitter of the individual wheel steps
+        m_scrollVelocity = (m_scrollVelocity + delta * 1000.0 / m_lastScrollTime.elapsed()) / 2;
+    }
+    if (m_scrollVelocity == 0 && delta) {
+        // remember at least the direction
+        m_scrollVelocity = delta > 0 ? 1 : -1;
+    }
+    m_lastScrollTime.start();
+
+    m_fetchWindowTimer->start();
+}
+
+/** @short Walk the visible rows and the rows which will get scrolled into view soon, and pass them to the Model
+
+The number of rows prefetched ahead of the scrolling direction corresponds to roughly half a second of scrolling at the
+current speed, but never less than a single page.
+*/
+void MsgListView::slotUpdateFetchWindow()
+{
+    QModelIndex first = indexAt(QPoint(0, 0));
+    if (!first.isValid())
+        return;
+    first = first.sibling(first.row(), 0);
+
+    const Imap::Mailbox::Model *constModel = 0;
+    Imap::Mailbox::Model::realTreeItem(first, &constModel);
+    if (!constModel)
+        return;
+    Imap::Mailbox::Model *model = const_cast<Imap::Mailbox::Model *>(constModel);
+
+    QModelIndexList window;
+    QModelIndex last = first;
+    const int bottom = viewport()->height();
+    for (QModelIndex index = first; index.isValid() && visualRect(index).top() < bottom; index = indexBelow(index)) {
+        window << index;
+        last = index;
+    }
+
+    const int pageSize = window.size();
+    const bool upwards = m_scrollVelocity < 0;
+    int ahead = qBound(pageSize, qRound(qAbs(m_scrollVelocity) / 2), 10 * pageSize);
+    for (QModelIndex index = upwards ? indexAbove(first) : indexBelow(last); index.isValid() && ahead > 0; --ahead) {
+        window << index;
+        index = upwards ? indexAbove(index) : indexBelow(index);
+    }
+
+    // keep a bit of context behind us as well
+    int behind = pageSize / 2;
+    for (QModelIndex index = upwards ? indexBelow(last) : indexAbove(first); index.isValid() && behind > 0; --behind) {
+        window << index;
+        index = upwards ? indexBelow(index) : indexAbove(index);
+    }
+
+    model->setMessageFetchWindow(this, window);
 }
 
 void MsgListView::slotHandleSortCriteriaChanged(int column, Qt::SortOrder order)
@@ -22,6 +22,7 @@
 #ifndef MSGLISTVIEW_H
 #define MSGLISTVIEW_H
 
+#include <QElapsedTimer>
 #include <QHeaderView>
 #include <QTreeView>
 
@@ -57,6 +58,9 @@ protected:
     void keyReleaseEvent(QKeyEvent *ke);
     virtual void startDrag(Qt::DropActions supportedActions);
     bool event(QEvent *event);
+    void resizeEvent(QResizeEvent *event);
+protected slots:
+    void rowsInserted(const QModelIndex &parent, int start, int end);
 private slots:
     void slotFixSize();
     /** @short Expand all items below current root index */
@@ -70,11 +74,20 @@ private slots:
     /** @short conditionally emits activated(currentIndex()) for keyboard events */
     void slotCurrentActivated();
     void slotHandleNewColumns(int oldCount, int newCount);
+    /** @short Keep track of the scrolling speed */
+    void slotVerticalScrolled(int value);
+    /** @short Tell the model which messages are visible and which are going to be shown next */
+    void slotUpdateFetchWindow();
 private:
     static Imap::Mailbox::PrettyMsgListModel *findPrettyMsgListModel(QAbstractItemModel *model);
 
     QSignalMapper *headerFieldsMapper;
     QTimer *m_naviActivationTimer;
+    QTimer *m_fetchWindowTimer;
+    QElapsedTimer m_lastScrollTime;
+    int m_lastScrollValue;
+    /** @short Scrolling speed in rows per second, negative when scrolling up */
+    qreal m_scrollVelocity;
     bool m_autoActivateAfterKeyNavigation;
     bool m_autoResizeSections;
 
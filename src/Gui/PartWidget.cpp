@@ -320,7 +320,7 @@ QWidget *AsynchronousPartWidget::addingOneWidget(const QModelIndex &index, UiUti
 
 void AsynchronousPartWidget::handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
-    Q_ASSERT(topLeft == bottomRight);
+    // Body parts are always reported one by one, only the messages get merged into ranges
     Q_UNUSED(bottomRight);
     if (topLeft == m_partIndex || !m_partIndex.isValid())
         updateStatusIndicator();
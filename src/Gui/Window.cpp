@@ -78,6 +78,7 @@
 #include "Plugins/PluginManager.h"
 #include "CompleteMessageWidget.h"
 #include "ComposeWidget.h"
+#include "ConnectionMetricsWidget.h"
 #include "MailBoxTreeView.h"
 #include "MessageListWidget.h"
 #include "MessageView.h"
@@ -308,6 +309,12 @@ void MainWindow::createActions()
     connect(showImapLogger, &QAction::toggled, imapLoggerDock, &QWidget::setVisible);
     connect(imapLoggerDock, &QDockWidget::visibilityChanged, showImapLogger, &QAction::setChecked);
 
+    //: a debugging tool showing command latency and traffic statistics of each IMAP connection
+    showConnectionMetrics = new QAction(tr("Show IMAP connection &statistics"), this);
+    showConnectionMetrics->setCheckable(true);
+    connect(showConnectionMetrics, &QAction::toggled, connectionMetricsDock, &QWidget::setVisible);
+    connect(connectionMetricsDock, &QDockWidget::visibilityChanged, showConnectionMetrics, &QAction::setChecked);
+
     //: file to save the debug log into
     logPersistent = new QAction(tr("Log &into %1").arg(Imap::Mailbox::persistentLogFileName()), this);
     logPersistent->setCheckable(true);
@@ -631,6 +638,7 @@ void MainWindow::createMenus()
     ADD_ACTION(debugMenu, showTaskView);
     ADD_ACTION(debugMenu, showMimeView);
     ADD_ACTION(debugMenu, showImapLogger);
+    ADD_ACTION(debugMenu, showConnectionMetrics);
     ADD_ACTION(debugMenu, logPersistent);
     ADD_ACTION(debugMenu, showImapCapabilities);
     imapMenu->addSeparator();
@@ -775,6 +783,14 @@ void MainWindow::createWidgets()
     imapLoggerDock->setWidget(imapLogger);
     addDockWidget(Qt::BottomDockWidgetArea, imapLoggerDock);
 
+    connectionMetricsDock = new QDockWidget(tr("IMAP Statistics"), this);
+    connectionMetricsDock->setObjectName(QStringLiteral("connectionMetricsDock"));
+    connectionMetrics = new ConnectionMetricsWidget(connectionMetricsDock);
+    connectionMetricsDock->hide();
+    connectionMetricsDock->setWidget(connectionMetrics);
+    addDockWidget(Qt::BottomDockWidgetArea, connectionMetricsDock);
+    tabifyDockWidget(imapLoggerDock, connectionMetricsDock);
+
     busyParsersIndicator = new TaskProgressIndicator(this);
 }
 
@@ -835,6 +851,7 @@ void MainWindow::setupModels()
 
     connect(imapModel(), &Imap::Mailbox::Model::logged, imapLogger, &ProtocolLoggerWidget::slotImapLogged);
     connect(imapModel(), &Imap::Mailbox::Model::connectionStateChanged, imapLogger, &ProtocolLoggerWidget::onConnectionClosed);
+    connectionMetrics->setImapModel(imapModel());
 
     auto nw = qobject_cast<Imap::Mailbox::NetworkWatcher *>(m_imapAccess->networkWatcher());
     Q_ASSERT(nw);
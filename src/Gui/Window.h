@@ -81,6 +81,7 @@ namespace Gui
 
 class CompleteMessageWidget;
 class ComposeWidget;
+class ConnectionMetricsWidget;
 class MailBoxTreeView;
 class MessageListWidget;
 class ProtocolLoggerWidget;
@@ -259,6 +260,8 @@ private:
 
     ProtocolLoggerWidget *imapLogger;
     QDockWidget *imapLoggerDock;
+    ConnectionMetricsWidget *connectionMetrics;
+    QDockWidget *connectionMetricsDock;
 
     QPointer<QSplitter> m_mainHSplitter;
     QPointer<QSplitter> m_mainVSplitter;
@@ -280,6 +283,7 @@ private:
     QAction *showTaskView;
     QAction *showMimeView;
     QAction *showImapLogger;
+    QAction *showConnectionMetrics;
     QAction *logPersistent;
     QAction *showImapCapabilities;
     QAction *showMenuBar;
@@ -31,10 +31,12 @@
 #include "AppVersion/SetCoreApplication.h"
 #include "Common/Application.h"
 #include "Common/MetaTypes.h"
+#include "Common/Profiling.h"
 #include "Common/SettingsNames.h"
 #include "Gui/Util.h"
 #include "Gui/Window.h"
 #include "IPC/IPC.h"
+#include "Imap/Model/ImapAccess.h"
 #include "UiUtils/IconLoader.h"
 
 #include "static_plugins.h"
@@ -87,6 +89,8 @@ int main(int argc, char **argv)
     bool logToDisk = false;
 
     QString profileName;
+    QString sessionTraceFile;
+    QString taskTraceFile;
 
     QString url;
 
@@ -117,6 +121,24 @@ int main(int argc, char **argv)
                 }
             } else if (arg == QLatin1String("--log-to-disk")) {
                 logToDisk = true;
+            } else if (arg == QLatin1String("--record-imap-session")) {
+                if (i+1 == arguments.size() || arguments.at(i+1).startsWith(QLatin1Char('-'))) {
+                    qErr << QObject::tr("Error: File for the IMAP session trace was not specified") << endl;
+                    error = true;
+                    break;
+                } else {
+                    sessionTraceFile = arguments.at(i+1);
+                    ++i;
+                }
+            } else if (arg == QLatin1String("--trace-imap-tasks")) {
+                if (i+1 == arguments.size() || arguments.at(i+1).startsWith(QLatin1Char('-'))) {
+                    qErr << QObject::tr("Error: File for the IMAP task trace was not specified") << endl;
+                    error = true;
+                    break;
+                } else {
+                    taskTraceFile = arguments.at(i+1);
+                    ++i;
+                }
             } else {
                 qErr << QObject::tr("Warning: Unknown option '%1'").arg(arg) << endl;
             }
@@ -149,6 +171,10 @@ int main(int argc, char **argv)
             "  -c, --compose            Compose new email (default when url is provided)\n"
             "  -p, --profile <profile>  Set profile (cannot start with char '-')\n"
             "  --log-to-disk            Activate debug traffic logging to disk by default\n"
+            "  --record-imap-session <file>\n"
+            "                           Record the IMAP traffic into a trace for offline replaying\n"
+            "  --trace-imap-tasks <file>\n"
+            "                           Record the IMAP tasks in the Chrome trace event format\n"
             "\n"
             "Arguments:\n"
             "  url                      Mailto: url address for composing new email\n"
@@ -211,5 +237,18 @@ int main(int argc, char **argv)
         win.enableLoggingToDisk();
     }
 
-    return app.exec();
+    if (!sessionTraceFile.isEmpty()) {
+        win.imapAccess()->setSessionTraceFile(sessionTraceFile);
+    }
+
+    if (!taskTraceFile.isEmpty()) {
+        win.imapAccess()->setTaskTraceFile(taskTraceFile);
+    }
+
+    int res = app.exec();
+    if (Common::Profiling::isEnabled()) {
+        qErr << Common::Profiling::summary() << "\n";
+        qErr.flush();
+    }
+    return res;
 }
@@ -20,10 +20,14 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QObject>
 #include <QUrl>
 
+#include "Common/Profiling.h"
 #include "Gui/Window.h"
+#include "Imap/Model/Model.h"
 
 #include "MainWindowBridge.h"
 
@@ -51,4 +55,25 @@ void MainWindowBridge::composeMail(const QString &url)
         m_window->slotComposeMailUrl(QUrl::fromEncoded(url.toUtf8()));
 }
 
+QString MainWindowBridge::connectionMetrics() const
+{
+    auto model = m_window->imapModel();
+    if (!model)
+        return QStringLiteral("[]");
+    return QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(model->connectionMetrics())).toJson());
+}
+
+QString MainWindowBridge::memoryUsage() const
+{
+    auto model = m_window->imapModel();
+    if (!model)
+        return QStringLiteral("[]");
+    return QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(model->memoryUsage())).toJson());
+}
+
+QString MainWindowBridge::profilingSummary() const
+{
+    return Common::Profiling::summary();
+}
+
 }
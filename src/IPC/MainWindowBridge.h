@@ -43,6 +43,12 @@ public slots:
     void showMainWindow();
     void showAddressbookWindow();
     void composeMail(const QString &url);
+    /** @short Statistics of all IMAP connections as a JSON array, see Imap::Mailbox::Model::connectionMetrics() */
+    QString connectionMetrics() const;
+    /** @short Approximate memory usage of each mailbox as a JSON array, see Imap::Mailbox::Model::memoryUsage() */
+    QString memoryUsage() const;
+    /** @short Timings and counters of the instrumented code paths, see Common::Profiling::summary() */
+    QString profilingSummary() const;
 
 private:
     Gui::MainWindow *m_window;
@@ -45,6 +45,7 @@ AbstractCache::MessageDataBundle::MessageDataBundle(
     , hdrReferences(hdrReferences)
     , hdrListPost(hdrListPost)
     , hdrListPostNo(hdrListPostNo)
+    , attachments(ATTACHMENTS_UNKNOWN)
 {
 }
 
@@ -52,6 +53,7 @@ AbstractCache::MessageDataBundle::MessageDataBundle()
     : uid(0)
     , size(0)
     , hdrListPostNo(false)
+    , attachments(ATTACHMENTS_UNKNOWN)
 {
 }
 
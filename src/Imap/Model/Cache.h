@@ -70,6 +70,15 @@ public:
         /** @short Is the List-Post set to "NO"? */
         bool hdrListPostNo;
 
+        /** @short Does the message contain any attachments? */
+        typedef enum {
+            ATTACHMENTS_UNKNOWN, /**< @short Not determined yet, e.g. for data stored by older versions */
+            ATTACHMENTS_NONE, /**< @short There are no attachments */
+            ATTACHMENTS_PRESENT /**< @short At least one attachment is present */
+        } AttachmentState;
+        /** @short Presence of attachments, as determined from the BODYSTRUCTURE at the time it got fetched */
+        AttachmentState attachments;
+
         MessageDataBundle();
         MessageDataBundle(const uint uid, const Imap::Message::Envelope &envelope, const QDateTime &internalDate,
                           const quint64 size, const QByteArray &serializedBodyStructure, const QList<QByteArray> &hdrReferences,
@@ -80,7 +89,7 @@ public:
             return uid == other.uid && envelope == other.envelope && internalDate == other.internalDate &&
                     serializedBodyStructure == other.serializedBodyStructure && size == other.size &&
                     hdrReferences == other.hdrReferences && hdrListPost == other.hdrListPost &&
-                    hdrListPostNo == other.hdrListPostNo;
+                    hdrListPostNo == other.hdrListPostNo && attachments == other.attachments;
         }
     };
 
@@ -22,6 +22,7 @@
 
 #include "ImapAccess.h"
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QSslKey>
 #include <QSettings>
@@ -37,7 +38,9 @@
 #include "Imap/Model/MsgListModel.h"
 #include "Imap/Model/NetworkWatcher.h"
 #include "Imap/Model/OneMessageModel.h"
+#include "Imap/Model/SessionTrace.h"
 #include "Imap/Model/SubtreeModel.h"
+#include "Imap/Model/TaskTrace.h"
 #include "Imap/Model/SystemNetworkWatcher.h"
 #include "Imap/Model/ThreadingMsgListModel.h"
 #include "Imap/Model/Utils.h"
@@ -350,6 +353,9 @@ void ImapAccess::doConnect()
     m_imapModel->setCapabilitiesBlacklist(m_settings->value(Common::SettingsNames::imapBlacklistedCapabilities).toStringList());
     m_imapModel->setProperty("trojita-imap-id-no-versions", !m_settings->value(Common::SettingsNames::interopRevealVersions, true).toBool());
     m_imapModel->setProperty("trojita-imap-idle-renewal", m_settings->value(Common::SettingsNames::imapIdleRenewal).toUInt() * 60 * 1000);
+    m_imapModel->setProperty("trojita-imap-parallel-fetch-connections", m_settings->value(Common::SettingsNames::imapParallelFetchConnections, 0).toInt());
+    m_imapModel->setProperty("trojita-imap-max-mailbox-connections", m_settings->value(Common::SettingsNames::imapMaxMailboxConnections, 1).toInt());
+    m_imapModel->setProperty("trojita-imap-dedicated-idle-connection", m_settings->value(Common::SettingsNames::imapDedicatedIdleConnection, false).toBool());
     m_imapModel->setNumberRefreshInterval(numberRefreshInterval());
     connect(m_imapModel, &Mailbox::Model::alertReceived, this, &ImapAccess::alertReceived);
     connect(m_imapModel, &Mailbox::Model::imapError, this, &ImapAccess::imapError);
@@ -357,6 +363,8 @@ void ImapAccess::doConnect()
     //connect(m_imapModel, &Mailbox::Model::logged, this, &ImapAccess::slotLogged);
     connect(m_imapModel, &Mailbox::Model::needsSslDecision, this, &ImapAccess::slotSslErrors);
     connect(m_imapModel, &Mailbox::Model::requireStartTlsInFuture, this, &ImapAccess::onRequireStartTlsInFuture);
+    attachSessionTrace();
+    attachTaskTrace();
 
     if (m_settings->value(Common::SettingsNames::imapNeedsNetwork, true).toBool()) {
         m_netWatcher = new Imap::Mailbox::SystemNetworkWatcher(this, m_imapModel);
@@ -402,6 +410,46 @@ void ImapAccess::doConnect()
     emit modelsChanged();
 }
 
+void ImapAccess::setSessionTraceFile(const QString &fileName)
+{
+    m_sessionTraceFile = fileName;
+    attachSessionTrace();
+}
+
+void ImapAccess::attachSessionTrace()
+{
+    if (!m_imapModel || m_sessionTraceFile.isEmpty())
+        return;
+
+    QFile *file = new QFile(m_sessionTraceFile);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Cannot record the IMAP session into" << m_sessionTraceFile << ":" << file->errorString();
+        delete file;
+        return;
+    }
+    m_imapModel->setSessionTrace(new Imap::Mailbox::SessionTraceWriter(m_imapModel, file));
+}
+
+void ImapAccess::setTaskTraceFile(const QString &fileName)
+{
+    m_taskTraceFile = fileName;
+    attachTaskTrace();
+}
+
+void ImapAccess::attachTaskTrace()
+{
+    if (!m_imapModel || m_taskTraceFile.isEmpty())
+        return;
+
+    QFile *file = new QFile(m_taskTraceFile);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Cannot record the IMAP tasks into" << m_taskTraceFile << ":" << file->errorString();
+        delete file;
+        return;
+    }
+    m_imapModel->setTaskTrace(new Imap::Mailbox::TaskTraceWriter(m_imapModel, file));
+}
+
 void ImapAccess::onCacheError(const QString &message)
 {
     if (m_imapModel) {
@@ -125,6 +125,19 @@ public:
 
     Q_INVOKABLE void nukeCache();
 
+    /** @short Record the IMAP traffic of this account into a session trace stored in @arg fileName
+
+    The recording applies to the current connection as well as to all connections made after a reconfiguration,
+    each of which overwrites the file.
+    */
+    void setSessionTraceFile(const QString &fileName);
+
+    /** @short Record the lifecycle of the IMAP tasks of this account as a Chrome trace into @arg fileName
+
+    Just like with setSessionTraceFile(), each reconfiguration overwrites the file.
+    */
+    void setTaskTraceFile(const QString &fileName);
+
     Q_INVOKABLE QString mailboxListShortMailboxName() const;
     Q_INVOKABLE QString mailboxListMailboxName() const;
 
@@ -154,6 +167,9 @@ private slots:
     void desiredNetworkPolicyChanged(const Imap::Mailbox::NetworkPolicy policy);
 
 private:
+    void attachSessionTrace();
+    void attachTaskTrace();
+
     QSettings *m_settings;
     Imap::Mailbox::Model *m_imapModel;
     Imap::Mailbox::MailboxModel *m_mailboxModel;
@@ -181,6 +197,8 @@ private:
 
     QString m_accountName;
     QString m_cacheDir;
+    QString m_sessionTraceFile;
+    QString m_taskTraceFile;
 };
 
 }
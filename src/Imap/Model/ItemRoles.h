@@ -65,6 +65,8 @@ enum {
     If the server doesn't support RFC5258, this can return wrong answer.
     */
     RoleMailboxIsSubscribed,
+    /** @short Approximate heap usage of the mailbox and its messages in bytes, see TreeItemMailbox::memoryUsage() */
+    RoleMailboxMemoryUsage,
 
     /** @short UID of the message */
     RoleMessageUid,
@@ -130,6 +132,8 @@ enum {
     The returned value might be a bit fuzzy.
     */
     RoleMessageHasAttachments,
+    /** @short Approximate heap usage of the message metadata and of its downloaded parts in bytes */
+    RoleMessageMemoryUsage,
 
     /** @short Contents of a message part */
     RolePartData,
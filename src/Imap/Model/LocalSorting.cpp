@@ -0,0 +1,258 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <iterator>
+#include "LocalSorting.h"
+#include "Imap/Parser/Message.h"
+
+namespace {
+
+/** @short If there's a subj-blob from RFC 5256 at the @arg pos, return the position after it and the following whitespace */
+int skipBlob(const QString &s, int pos)
+{
+    if (pos >= s.size() || s[pos] != QLatin1Char('['))
+        return -1;
+    for (++pos; pos < s.size(); ++pos) {
+        if (s[pos] == QLatin1Char('['))
+            return -1;
+        if (s[pos] == QLatin1Char(']')) {
+            ++pos;
+            while (pos < s.size() && s[pos] == QLatin1Char(' '))
+                ++pos;
+            return pos;
+        }
+    }
+    return -1;
+}
+
+/** @short If the subject starts with a subj-leader ("Re:", "[list] Fwd:" etc), return its length */
+int skipLeader(const QString &s)
+{
+    int pos = 0;
+    int afterBlob;
+    while ((afterBlob = skipBlob(s, pos)) != -1)
+        pos = afterBlob;
+
+    if (s.midRef(pos, 2).compare(QLatin1String("re"), Qt::CaseInsensitive) == 0) {
+        pos += 2;
+    } else if (s.midRef(pos, 3).compare(QLatin1String("fwd"), Qt::CaseInsensitive) == 0) {
+        pos += 3;
+    } else if (s.midRef(pos, 2).compare(QLatin1String("fw"), Qt::CaseInsensitive) == 0) {
+        pos += 2;
+    } else {
+        return 0;
+    }
+    while (pos < s.size() && s[pos] == QLatin1Char(' '))
+        ++pos;
+    afterBlob = skipBlob(s, pos);
+    if (afterBlob != -1)
+        pos = afterBlob;
+    if (pos < s.size() && s[pos] == QLatin1Char(':'))
+        return pos + 1;
+    return 0;
+}
+
+/** @short Text which represents the first address in the list for the purpose of sorting */
+QString addressKey(const QList<Imap::Message::MailAddress> &addresses)
+{
+    if (addresses.isEmpty())
+        return QString();
+    const Imap::Message::MailAddress &address = addresses.front();
+    if (!address.name.isEmpty())
+        return address.name.toCaseFolded();
+    return (address.mailbox + QLatin1Char('@') + address.host).toCaseFolded();
+}
+
+}
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+LocalSorting::LocalSorting(const Key key): m_key(key)
+{
+}
+
+LocalSorting::Key LocalSorting::key() const
+{
+    return m_key;
+}
+
+void LocalSorting::setKey(const Key key)
+{
+    m_key = key;
+    clear();
+}
+
+void LocalSorting::clear()
+{
+    m_sorted.clear();
+    m_pending.clear();
+    m_knownUids.clear();
+    m_removedUids.clear();
+}
+
+bool LocalSorting::contains(const uint uid) const
+{
+    return m_knownUids.contains(uid);
+}
+
+void LocalSorting::addMessage(const uint uid, const Message::Envelope &envelope, const QDateTime &internalDate, const quint64 size)
+{
+    if (m_knownUids.contains(uid))
+        return;
+    if (m_removedUids.contains(uid)) {
+        // The old entry must not be merged with the new one
+        purgeRemoved();
+    }
+    m_knownUids.insert(uid);
+
+    Entry entry;
+    entry.uid = uid;
+    entry.number = 0;
+    switch (m_key) {
+    case KEY_ARRIVAL:
+        entry.number = internalDate.isValid() ? internalDate.toMSecsSinceEpoch() : 0;
+        break;
+    case KEY_CC:
+        entry.text = addressKey(envelope.cc);
+        break;
+    case KEY_DATE:
+        if (envelope.date.isValid()) {
+            entry.number = envelope.date.toMSecsSinceEpoch();
+        } else if (internalDate.isValid()) {
+            entry.number = internalDate.toMSecsSinceEpoch();
+        }
+        break;
+    case KEY_FROM:
+        entry.text = addressKey(envelope.from);
+        break;
+    case KEY_SIZE:
+        entry.number = size;
+        break;
+    case KEY_SUBJECT:
+        entry.text = baseSubject(envelope.subject).toCaseFolded();
+        break;
+    case KEY_TO:
+        entry.text = addressKey(envelope.to);
+        break;
+    }
+    m_pending.append(entry);
+}
+
+void LocalSorting::removeMessage(const uint uid)
+{
+    if (m_knownUids.remove(uid))
+        m_removedUids.insert(uid);
+}
+
+/** @short Drop the entries of the removed messages */
+void LocalSorting::purgeRemoved()
+{
+    if (m_removedUids.isEmpty())
+        return;
+    auto isRemoved = [this](const Entry &entry) {
+        return m_removedUids.contains(entry.uid);
+    };
+    m_sorted.erase(std::remove_if(m_sorted.begin(), m_sorted.end(), isRemoved), m_sorted.end());
+    m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), isRemoved), m_pending.end());
+    m_removedUids.clear();
+}
+
+bool LocalSorting::entryLessThan(const Entry &a, const Entry &b)
+{
+    if (a.number != b.number)
+        return a.number < b.number;
+    int cmp = a.text.compare(b.text);
+    if (cmp != 0)
+        return cmp < 0;
+    return a.uid < b.uid;
+}
+
+Imap::Uids LocalSorting::sortedUids()
+{
+    purgeRemoved();
+    if (!m_pending.isEmpty()) {
+        std::sort(m_pending.begin(), m_pending.end(), entryLessThan);
+        if (m_sorted.isEmpty()) {
+            m_sorted.swap(m_pending);
+        } else {
+            QVector<Entry> merged;
+            merged.reserve(m_sorted.size() + m_pending.size());
+            std::merge(m_sorted.constBegin(), m_sorted.constEnd(), m_pending.constBegin(), m_pending.constEnd(),
+                       std::back_inserter(merged), entryLessThan);
+            m_sorted.swap(merged);
+            m_pending.clear();
+        }
+    }
+
+    Imap::Uids res;
+    res.reserve(m_sorted.size());
+    for (auto it = m_sorted.constBegin(); it != m_sorted.constEnd(); ++it)
+        res.append(it->uid);
+    return res;
+}
+
+QString LocalSorting::baseSubject(const QString &subject)
+{
+    // (1) All whitespace is collapsed into a single space; the leading and trailing one goes away as well
+    QString s = subject.simplified();
+
+    while (true) {
+        // (2) Remove all trailing "(fwd)"
+        while (s.endsWith(QLatin1String("(fwd)"), Qt::CaseInsensitive)) {
+            s.chop(5);
+            s = s.trimmed();
+        }
+
+        // (3), (4) and (5): remove the "Re:" and friends, and all the "[blobs]" as long as something remains afterwards
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            int leader = skipLeader(s);
+            if (leader) {
+                s = s.mid(leader).trimmed();
+                changed = true;
+            }
+            int afterBlob = skipBlob(s, 0);
+            if (afterBlob != -1 && afterBlob < s.size()) {
+                s = s.mid(afterBlob);
+                changed = true;
+            }
+        }
+
+        // (6) A "[fwd: subject]" gets unwrapped, and the whole process starts again
+        if (s.startsWith(QLatin1String("[fwd:"), Qt::CaseInsensitive) && s.endsWith(QLatin1Char(']'))) {
+            s = s.mid(5, s.size() - 6).trimmed();
+            continue;
+        }
+        return s;
+    }
+}
+
+}
+
+}
@@ -0,0 +1,121 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAP_MODEL_LOCALSORTING_H
+#define IMAP_MODEL_LOCALSORTING_H
+
+#include <QDateTime>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include "Imap/Parser/Uids.h"
+
+namespace Imap
+{
+
+namespace Message
+{
+class Envelope;
+}
+
+namespace Mailbox
+{
+
+/** @short Client-side sorting of messages for servers without the SORT extension and for the offline mode
+
+The sort key of each message is computed just once, when the message is added, and the messages which were already
+sorted are never sorted again. New arrivals are sorted among themselves and merged into the existing order.
+
+The order follows the rules of RFC 5256 (the base subject extraction, the Date header falling back to the INTERNALDATE,
+ties resolved through the UID) with the exception of the address-based keys, which use the display name whenever there
+is one, like the DISPLAYFROM and DISPLAYTO from RFC 5957 do.
+*/
+class LocalSorting
+{
+public:
+    /** @short Sorting criteria, a subset of the ThreadingMsgListModel::SortCriterium */
+    typedef enum {
+        KEY_ARRIVAL,
+        KEY_CC,
+        KEY_DATE,
+        KEY_FROM,
+        KEY_SIZE,
+        KEY_SUBJECT,
+        KEY_TO
+    } Key;
+
+    explicit LocalSorting(const Key key = KEY_ARRIVAL);
+
+    Key key() const;
+
+    /** @short Change the sort criterium; this forgets about all messages */
+    void setKey(const Key key);
+
+    /** @short Forget about all messages */
+    void clear();
+
+    /** @short Compute the sort key of a message and schedule it for merging into the sorted order
+
+    Adding a message whose UID is already known has no effect.
+    */
+    void addMessage(const uint uid, const Message::Envelope &envelope, const QDateTime &internalDate, const quint64 size);
+
+    /** @short Forget about a message which is gone from the mailbox
+
+    The message is dropped from the sorted order upon the next sortedUids(), so that a burst of expunges is cheap.
+    */
+    void removeMessage(const uint uid);
+
+    bool contains(const uint uid) const;
+
+    /** @short UIDs of all messages in the ascending order */
+    Imap::Uids sortedUids();
+
+    /** @short Extract the base subject as defined by RFC 5256, section 2.1 */
+    static QString baseSubject(const QString &subject);
+
+private:
+    struct Entry {
+        uint uid;
+        qint64 number;
+        QString text;
+    };
+
+    static bool entryLessThan(const Entry &a, const Entry &b);
+    void purgeRemoved();
+
+    Key m_key;
+    /** @short Messages which are already in their final order */
+    QVector<Entry> m_sorted;
+    /** @short Messages which were added since the last call to sortedUids() */
+    QVector<Entry> m_pending;
+    QSet<uint> m_knownUids;
+    /** @short Messages which were removed, but which might still be present in m_sorted or m_pending */
+    QSet<uint> m_removedUids;
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_LOCALSORTING_H */
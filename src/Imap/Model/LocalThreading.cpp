@@ -0,0 +1,267 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "LocalThreading.h"
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+LocalThreading::LocalThreading()
+{
+}
+
+QByteArray LocalThreading::normalizedMessageId(const QByteArray &messageId)
+{
+    QByteArray res = messageId.trimmed();
+    if (res.startsWith('<') && res.endsWith('>'))
+        res = res.mid(1, res.size() - 2);
+    return res;
+}
+
+int LocalThreading::createContainer()
+{
+    if (!m_freeContainers.isEmpty())
+        return m_freeContainers.takeLast();
+    m_containers.append(Container());
+    return m_containers.size() - 1;
+}
+
+int LocalThreading::containerForMessageId(const QByteArray &messageId)
+{
+    auto it = m_containersById.constFind(messageId);
+    if (it != m_containersById.constEnd())
+        return *it;
+    int container = createContainer();
+    m_containers[container].messageId = messageId;
+    m_containersById.insert(messageId, container);
+    return container;
+}
+
+/** @short Would making the @arg parent a parent of the @arg child introduce a loop? */
+bool LocalThreading::wouldCreateLoop(const int child, const int parent) const
+{
+    for (int ancestor = parent; ancestor != -1; ancestor = m_containers[ancestor].parent) {
+        if (ancestor == child)
+            return true;
+    }
+    return false;
+}
+
+void LocalThreading::setParent(const int container, const int parent)
+{
+    const int oldParent = m_containers[container].parent;
+    if (oldParent == parent)
+        return;
+
+    if (oldParent != -1) {
+        int *link = &m_containers[oldParent].firstChild;
+        while (*link != container) {
+            Q_ASSERT(*link != -1);
+            link = &m_containers[*link].nextSibling;
+        }
+        *link = m_containers[container].nextSibling;
+    }
+
+    m_containers[container].parent = parent;
+    if (parent == -1) {
+        m_containers[container].nextSibling = -1;
+        return;
+    }
+    m_containers[container].nextSibling = m_containers[parent].firstChild;
+    m_containers[parent].firstChild = container;
+}
+
+void LocalThreading::addMessage(const uint uid, const QByteArray &messageId, const QList<QByteArray> &references,
+                                const QList<QByteArray> &inReplyTo)
+{
+    if (!uid || m_containersByUid.contains(uid))
+        return;
+
+    // Step 1A: find the container of this message. When two messages share the same Message-Id, the second one is treated
+    // as if it had none.
+    int own = -1;
+    QByteArray id = normalizedMessageId(messageId);
+    if (!id.isEmpty()) {
+        own = containerForMessageId(id);
+        if (m_containers[own].uid)
+            own = -1;
+    }
+    if (own == -1)
+        own = createContainer();
+    m_containers[own].uid = uid;
+    m_containersByUid.insert(uid, own);
+
+    // Step 1B: link the references together, but never change a link which already exists and never introduce a loop.
+    // A message which has already told us where it belongs is left alone, too.
+    QList<QByteArray> parentIds = references;
+    if (parentIds.isEmpty() && !inReplyTo.isEmpty())
+        parentIds << inReplyTo.front();
+    int previous = -1;
+    Q_FOREACH(const QByteArray &reference, parentIds) {
+        id = normalizedMessageId(reference);
+        if (id.isEmpty())
+            continue;
+        int current = containerForMessageId(id);
+        if (previous != -1 && current != previous && m_containers[current].parent == -1 && !m_containers[current].ownParent &&
+                !wouldCreateLoop(current, previous))
+            setParent(current, previous);
+        previous = current;
+    }
+
+    // Step 1C: the last reference is the parent of this message, overriding whatever might have been guessed before.
+    // A message without any references is a root, no matter what the other messages say about it.
+    if (previous == own)
+        previous = -1;
+    if (previous != -1 && wouldCreateLoop(own, previous)) {
+        // The real parent is currently placed below this message. Unless that comes from the messages themselves, it was
+        // just a guess which gets undone now.
+        int below = previous;
+        while (m_containers[below].parent != own)
+            below = m_containers[below].parent;
+        if (m_containers[below].ownParent)
+            return;
+        setParent(below, -1);
+    }
+    setParent(own, previous);
+    m_containers[own].ownParent = true;
+}
+
+void LocalThreading::removeMessage(const uint uid)
+{
+    auto it = m_containersByUid.find(uid);
+    if (it == m_containersByUid.end())
+        return;
+    int container = *it;
+    m_containersByUid.erase(it);
+    m_containers[container].uid = 0;
+
+    // An empty container without children is useless, and its parent might become one once it is gone
+    while (container != -1 && !m_containers[container].uid && m_containers[container].firstChild == -1) {
+        const int parent = m_containers[container].parent;
+        if (parent != -1)
+            setParent(container, -1);
+        auto idIt = m_containersById.find(m_containers[container].messageId);
+        if (idIt != m_containersById.end() && *idIt == container)
+            m_containersById.erase(idIt);
+        m_containers[container] = Container();
+        m_freeContainers.append(container);
+        container = parent;
+    }
+}
+
+bool LocalThreading::contains(const uint uid) const
+{
+    return m_containersByUid.contains(uid);
+}
+
+int LocalThreading::size() const
+{
+    return m_containersByUid.size();
+}
+
+void LocalThreading::clear()
+{
+    m_containers.clear();
+    m_containersById.clear();
+    m_containersByUid.clear();
+    m_freeContainers.clear();
+}
+
+/** @short Convert a container and everything below it into ThreadingNode instances
+
+This also implements the step 4 of the algorithm -- empty containers without children are dropped, and the children of
+empty containers are promoted one level up unless that would put more than one of them to the root level.
+
+The tree is walked in post-order through an explicit stack because the threads can be arbitrarily deep.
+*/
+void LocalThreading::collectNodes(const int root, QVector<KeyedNode> &output) const
+{
+    struct Frame {
+        int container;
+        int nextChild;
+        QVector<KeyedNode> children;
+    };
+    QVector<Frame> stack;
+    stack.append(Frame{root, m_containers[root].firstChild, QVector<KeyedNode>()});
+
+    while (!stack.isEmpty()) {
+        if (stack.last().nextChild != -1) {
+            const int child = stack.last().nextChild;
+            stack.last().nextChild = m_containers[child].nextSibling;
+            stack.append(Frame{child, m_containers[child].firstChild, QVector<KeyedNode>()});
+            continue;
+        }
+
+        // All children of this container are done already
+        Frame frame = stack.takeLast();
+        const bool atRootLevel = stack.isEmpty();
+        QVector<KeyedNode> &target = atRootLevel ? output : stack.last().children;
+        std::sort(frame.children.begin(), frame.children.end(), [](const KeyedNode &a, const KeyedNode &b) {
+            return a.first < b.first;
+        });
+
+        const uint uid = m_containers[frame.container].uid;
+        if (!uid && frame.children.isEmpty())
+            continue;
+
+        if (!uid && (frame.children.size() == 1 || !atRootLevel)) {
+            target += frame.children;
+            continue;
+        }
+
+        KeyedNode node;
+        node.first = frame.children.isEmpty() ? uid : frame.children.front().first;
+        if (uid && uid < node.first)
+            node.first = uid;
+        node.second.num = uid;
+        node.second.children.reserve(frame.children.size());
+        for (auto it = frame.children.constBegin(); it != frame.children.constEnd(); ++it)
+            node.second.children.append(it->second);
+        target.append(node);
+    }
+}
+
+QVector<Responses::ThreadingNode> LocalThreading::threads() const
+{
+    QVector<KeyedNode> roots;
+    for (int i = 0; i < m_containers.size(); ++i) {
+        if (m_containers[i].parent == -1)
+            collectNodes(i, roots);
+    }
+    std::sort(roots.begin(), roots.end(), [](const KeyedNode &a, const KeyedNode &b) {
+        return a.first < b.first;
+    });
+
+    QVector<Responses::ThreadingNode> res;
+    res.reserve(roots.size());
+    for (auto it = roots.constBegin(); it != roots.constEnd(); ++it)
+        res.append(it->second);
+    return res;
+}
+
+}
+
+}
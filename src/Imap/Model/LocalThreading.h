@@ -0,0 +1,122 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAP_MODEL_LOCALTHREADING_H
+#define IMAP_MODEL_LOCALTHREADING_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QVector>
+#include "Imap/Parser/ThreadingNode.h"
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+/** @short Client-side threading of messages for servers which cannot do that on their own
+
+This is an implementation of the REFERENCES algorithm from RFC 5256 (section 2.2), with the exception of the subject-based
+grouping in its step five -- the result is therefore similar to what the REFS algorithm produces. The input are the
+Message-Id, References and In-Reply-To of each message; the output uses the same format as the server's UID THREAD
+response so that it can be fed directly to ThreadingMsgListModel::applyThreading().
+
+Messages can be added in batches as they become known. Building the links between messages is incremental, only the
+final conversion into a tree of ThreadingNode has to walk all messages again. That walk sorts the siblings, which makes
+the whole process O(n log n), and it does not recurse so that even very deep threads are safe.
+
+A parent which was only guessed from the References of some other message gets replaced once the message itself arrives
+and says what its real parent is.
+*/
+class LocalThreading
+{
+public:
+    LocalThreading();
+
+    /** @short Register another message with the threader
+
+    The @arg references is the content of the References header, the @arg inReplyTo is used only if there are no references.
+    Adding a message whose UID is already known has no effect.
+    */
+    void addMessage(const uint uid, const QByteArray &messageId, const QList<QByteArray> &references, const QList<QByteArray> &inReplyTo);
+
+    /** @short Forget about a message which is gone from the mailbox
+
+    Its container stays in place as an empty one so that the replies to it remain grouped together.
+    */
+    void removeMessage(const uint uid);
+
+    /** @short Was this UID already registered? */
+    bool contains(const uint uid) const;
+
+    /** @short Number of messages which were registered so far */
+    int size() const;
+
+    /** @short Forget about all messages */
+    void clear();
+
+    /** @short Return the resulting thread structure
+
+    Thread roots as well as siblings are ordered by the lowest UID in their subtree.
+    */
+    QVector<Responses::ThreadingNode> threads() const;
+
+    /** @short Strip the angle brackets and whitespace so that the Message-Id can be compared with the References */
+    static QByteArray normalizedMessageId(const QByteArray &messageId);
+
+private:
+    /** @short A container from the JWZ algorithm; it either holds a message, or represents a message which we have not seen */
+    struct Container {
+        /** @short The Message-Id which maps to this container, if any */
+        QByteArray messageId;
+        uint uid;
+        int parent;
+        int firstChild;
+        int nextSibling;
+        /** @short Was the parent set by this message itself rather than guessed from some other message? */
+        bool ownParent;
+        Container(): uid(0), parent(-1), firstChild(-1), nextSibling(-1), ownParent(false) {}
+    };
+
+    int containerForMessageId(const QByteArray &messageId);
+    int createContainer();
+    bool wouldCreateLoop(const int child, const int parent) const;
+    void setParent(const int container, const int parent);
+    /** @short A ThreadingNode along with the lowest UID in its subtree, which is used for ordering the siblings */
+    typedef QPair<uint, Responses::ThreadingNode> KeyedNode;
+    void collectNodes(const int root, QVector<KeyedNode> &output) const;
+
+    QVector<Container> m_containers;
+    QHash<QByteArray, int> m_containersById;
+    QHash<uint, int> m_containersByUid;
+    /** @short Containers which are not used anymore and can be handed out again */
+    QVector<int> m_freeContainers;
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_LOCALTHREADING_H */
@@ -21,10 +21,12 @@
 */
 
 #include <algorithm>
+#include <QDataStream>
 #include <QTextStream>
 #include "Common/FindWithUnknown.h"
 #include "Common/InvokeMethod.h"
 #include "Common/MetaTypes.h"
+#include "Common/Profiling.h"
 #include "Imap/Encoders.h"
 #include "Imap/Parser/Rfc5322HeaderParser.h"
 #include "Imap/Tasks/KeepMailboxOpenTask.h"
@@ -41,6 +43,54 @@ namespace Imap
 namespace Mailbox
 {
 
+namespace {
+
+/** @short Rough estimates of the heap usage of the data stored in the tree items */
+
+quint64 heapUsage(const QByteArray &data)
+{
+    return data.capacity();
+}
+
+quint64 heapUsage(const QString &data)
+{
+    return data.capacity() * sizeof(QChar);
+}
+
+quint64 heapUsage(const QList<QByteArray> &data)
+{
+    quint64 res = data.size() * sizeof(void *);
+    Q_FOREACH(const QByteArray &item, data) {
+        res += heapUsage(item);
+    }
+    return res;
+}
+
+quint64 heapUsage(const QStringList &data)
+{
+    quint64 res = data.size() * sizeof(void *);
+    Q_FOREACH(const QString &item, data) {
+        res += heapUsage(item);
+    }
+    return res;
+}
+
+quint64 heapUsage(const Message::Envelope &envelope)
+{
+    quint64 res = heapUsage(envelope.subject) + heapUsage(envelope.inReplyTo) + heapUsage(envelope.messageId);
+    Q_FOREACH(const QList<Message::MailAddress> *addresses, QList<const QList<Message::MailAddress> *>()
+              << &envelope.from << &envelope.sender << &envelope.replyTo
+              << &envelope.to << &envelope.cc << &envelope.bcc) {
+        res += addresses->size() * (sizeof(void *) + sizeof(Message::MailAddress));
+        Q_FOREACH(const Message::MailAddress &address, *addresses) {
+            res += heapUsage(address.name) + heapUsage(address.adl) + heapUsage(address.mailbox) + heapUsage(address.host);
+        }
+    }
+    return res;
+}
+
+}
+
 TreeItem::TreeItem(TreeItem *parent): m_parent(parent)
 {
     // These just have to be present in the context of TreeItem, otherwise they couldn't access the protected members
@@ -108,6 +158,20 @@ QModelIndex TreeItem::toIndex(Model *const model) const
     return model->createIndex(row(), 0, const_cast<TreeItem *>(this));
 }
 
+quint64 TreeItem::memoryUsage() const
+{
+    return sizeof(TreeItem) + childrenMemoryUsage();
+}
+
+quint64 TreeItem::childrenMemoryUsage() const
+{
+    quint64 res = m_children.capacity() * sizeof(TreeItem *);
+    Q_FOREACH(const TreeItem *item, m_children) {
+        res += item->memoryUsage();
+    }
+    return res;
+}
+
 
 TreeItemMailbox::TreeItemMailbox(TreeItem *parent): TreeItem(parent), maintainingTask(0)
 {
@@ -245,11 +309,24 @@ QVariant TreeItemMailbox::data(Model *const model, int role)
     }
     case RoleMailboxIsSubscribed:
         return QVariant::fromValue<bool>(m_metadata.flags.contains(QStringLiteral("\\SUBSCRIBED")));
+    case RoleMailboxMemoryUsage:
+        return QVariant::fromValue<quint64>(memoryUsage());
     default:
         return QVariant();
     }
 }
 
+quint64 TreeItemMailbox::memoryUsage() const
+{
+    quint64 res = sizeof(TreeItemMailbox) + m_children.capacity() * sizeof(TreeItem *)
+            + heapUsage(m_metadata.mailbox) + heapUsage(m_metadata.separator) + heapUsage(m_metadata.flags)
+            + heapUsage(syncState.flags()) + heapUsage(syncState.permanentFlags());
+    // The child mailboxes are accounted for separately, only the list of messages belongs to this mailbox
+    if (!m_children.isEmpty())
+        res += m_children[0]->memoryUsage();
+    return res;
+}
+
 bool TreeItemMailbox::hasChildren(Model *const model)
 {
     Q_UNUSED(model);
@@ -312,6 +389,7 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
         QList<TreeItemPart *> &changedParts,
         TreeItemMessage *&changedMessage, bool usingQresync)
 {
+    TROJITA_PROFILE_SCOPE("TreeItemMailbox::handleFetchResponse");
     TreeItemMsgList *list = static_cast<TreeItemMsgList *>(m_children[0]);
 
     Responses::Fetch::dataType::const_iterator uidRecord = response.data.find("UID");
@@ -442,6 +520,7 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
                 model->beginInsertRows(messageIdx, 0, newChildren.size() - 1);
                 message->setChildren(newChildren);
                 model->endInsertRows();
+                message->data()->setHasAttachments(message->checkAttachments(model));
             }
         } else if (it.key() == "x-trojita-bodystructure") {
             // do nothing here, it's been already taken care of from the BODYSTRUCTURE handler
@@ -472,6 +551,8 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
                         model->cache()->forgetMessagePart(mailbox(), message->uid(), part->partId());
                         model->cache()->setMsgPart(mailbox(), message->uid(), part->partId() + ".X-RAW", data);
                     }
+                    part->m_partRaw->m_dataInCache = message->uid() != 0;
+                    model->partDataLoaded(part->m_partRaw);
                 }
 
                 // Do not overwrite the part data if we were not asked to fetch it.
@@ -487,6 +568,9 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
                         // Do not store the data into cache if the raw data are already there
                         model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
                     }
+                    // Either the data themselves or their raw form are in the cache now
+                    part->m_dataInCache = message->uid() != 0;
+                    model->partDataLoaded(part);
                 }
 
             } else {
@@ -497,6 +581,8 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
                 if (message->uid()) {
                     model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
                 }
+                part->m_dataInCache = message->uid() != 0;
+                model->partDataLoaded(part);
             }
         } else if (it.key() == "INTERNALDATE") {
             message->data()->setInternalDate(static_cast<const Responses::RespData<QDateTime>&>(*(it.value())).data);
@@ -506,18 +592,22 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
     }
     if (message->uid()) {
         if (message->data()->isComplete() && model->cache()->messageMetadata(mailbox(), message->uid()).uid == 0) {
-             model->cache()->setMessageMetadata(
-                         mailbox(), message->uid(),
-                         Imap::Mailbox::AbstractCache::MessageDataBundle(
-                             message->uid(),
-                             message->data()->envelope(),
-                             message->data()->internalDate(),
-                             message->data()->size(),
-                             message->data()->rememberedBodyStructure(),
-                             message->data()->hdrReferences(),
-                             message->data()->hdrListPost(),
-                             message->data()->hdrListPostNo()
-                         ));
+             Imap::Mailbox::AbstractCache::MessageDataBundle bundle(
+                         message->uid(),
+                         message->data()->envelope(),
+                         message->data()->internalDate(),
+                         message->data()->size(),
+                         message->data()->rememberedBodyStructure(),
+                         message->data()->hdrReferences(),
+                         message->data()->hdrListPost(),
+                         message->data()->hdrListPostNo()
+                         );
+             if (message->data()->gotHasAttachments()) {
+                 bundle.attachments = message->data()->hasAttachments() ?
+                             AbstractCache::MessageDataBundle::ATTACHMENTS_PRESENT :
+                             AbstractCache::MessageDataBundle::ATTACHMENTS_NONE;
+             }
+             model->cache()->setMessageMetadata(mailbox(), message->uid(), bundle);
              message->setFetchStatus(DONE);
         }
         if (updatedFlags) {
@@ -551,31 +641,128 @@ void TreeItemMailbox::saveSyncStateAndUids(Model * model)
     list->setFetchStatus(DONE);
 }
 
+namespace {
+
+/** @short Translate sequence numbers of consecutive EXPUNGE responses into rows of the original list
+
+Each EXPUNGE refers to the message numbering which is in effect after all of the previous ones have been applied.
+A Fenwick tree over the "still present" flags makes it possible to map all of them back to the original positions
+in O(n + k log n) without touching the actual list. Returns sorted rows, or throws if any number is out of bounds.
+*/
+QVector<int> expungedRows(const int messageCount, const QVector<uint> &sequenceNumbers)
+{
+    QVector<int> tree(messageCount + 1, 0);
+    for (int i = 1; i <= messageCount; ++i) {
+        ++tree[i];
+        int parent = i + (i & -i);
+        if (parent <= messageCount)
+            tree[parent] += tree[i];
+    }
+    int topStep = 1;
+    while (topStep * 2 <= messageCount)
+        topStep *= 2;
+
+    QVector<int> rows;
+    rows.reserve(sequenceNumbers.size());
+    int remaining = messageCount;
+    for (const uint number : sequenceNumbers) {
+        if (number == 0 || number > static_cast<uint>(remaining)) {
+            throw UnknownMessageIndex("EXPUNGE references message number which is out-of-bounds");
+        }
+        // find the position of the number-th message which is still present
+        int pos = 0;
+        int wanted = number;
+        for (int step = topStep; step; step >>= 1) {
+            if (pos + step <= messageCount && tree[pos + step] < wanted) {
+                pos += step;
+                wanted -= tree[pos];
+            }
+        }
+        rows << pos;
+        for (int i = pos + 1; i <= messageCount; i += i & -i)
+            --tree[i];
+        --remaining;
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+}
+
+/** @short Remove messages at the specified rows from the list of messages
+
+The rows have to be sorted and unique. Adjacent rows are coalesced into contiguous ranges, each of them is announced
+through a single beginRemoveRows()/endRemoveRows() pair. The ranges are removed from the highest one down so that
+the row numbers remain valid throughout the process, and the m_offset of the surviving messages is renumbered just once
+at the very end.
+
+The removed messages are returned to the caller who is responsible for deleting them.
+*/
+QVector<TreeItemMessage *> TreeItemMailbox::removeMessageRows(Model *const model, const QVector<int> &rows)
+{
+    QVector<TreeItemMessage *> removed;
+    if (rows.isEmpty())
+        return removed;
+
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(m_children[0]);
+    Q_ASSERT(list);
+    Q_ASSERT(rows.front() >= 0 && rows.back() < list->m_children.size());
+    QModelIndex listIndex = list->toIndex(model);
+    removed.reserve(rows.size());
+
+    int rangeEnd = rows.size();
+    while (rangeEnd > 0) {
+        int rangeBegin = rangeEnd - 1;
+        while (rangeBegin > 0 && rows[rangeBegin - 1] == rows[rangeBegin] - 1)
+            --rangeBegin;
+        const int first = rows[rangeBegin];
+        const int last = rows[rangeEnd - 1];
+
+        model->beginRemoveRows(listIndex, first, last);
+        auto firstIt = list->m_children.begin() + first;
+        auto lastIt = list->m_children.begin() + last + 1;
+        for (auto it = firstIt; it != lastIt; ++it)
+            removed << static_cast<TreeItemMessage *>(*it);
+        list->m_children.erase(firstIt, lastIt);
+        model->endRemoveRows();
+
+        rangeEnd = rangeBegin;
+    }
+
+    for (int i = rows.front(); i < list->m_children.size(); ++i) {
+        static_cast<TreeItemMessage *>(list->m_children[i])->m_offset = i;
+    }
+    return removed;
+}
+
 /** @short Process the EXPUNGE response when the UIDs are already synced */
 void TreeItemMailbox::handleExpunge(Model *const model, const Responses::NumberResponse &resp)
 {
     Q_ASSERT(resp.kind == Responses::EXPUNGE);
+    handleExpunge(model, QVector<uint>() << resp.number);
+}
+
+/** @short Process a batch of EXPUNGE responses which arrived back to back
+
+The sequence numbers are in the order in which they were received from the server, i.e. each of them already takes
+the previous expunges into account. All of them are validated before the list is modified.
+*/
+void TreeItemMailbox::handleExpunge(Model *const model, const QVector<uint> &sequenceNumbers)
+{
     TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(m_children[ 0 ]);
     Q_ASSERT(list);
-    if (resp.number > static_cast<uint>(list->m_children.size()) || resp.number == 0) {
-        throw UnknownMessageIndex("EXPUNGE references message number which is out-of-bounds");
-    }
-    uint offset = resp.number - 1;
+    if (sequenceNumbers.isEmpty())
+        return;
 
-    model->beginRemoveRows(list->toIndex(model), offset, offset);
-    auto it = list->m_children.begin() + offset;
-    TreeItemMessage *message = static_cast<TreeItemMessage *>(*it);
-    list->m_children.erase(it);
-    model->cache()->clearMessage(static_cast<TreeItemMailbox *>(list->parent())->mailbox(), message->uid());
-    for (int i = offset; i < list->m_children.size(); ++i) {
-        --static_cast<TreeItemMessage *>(list->m_children[i])->m_offset;
+    const QVector<TreeItemMessage *> removed = removeMessageRows(model, expungedRows(list->m_children.size(), sequenceNumbers));
+    for (TreeItemMessage *message : removed) {
+        model->cache()->clearMessage(mailbox(), message->uid());
     }
-    model->endRemoveRows();
 
-    --list->m_totalMessageCount;
-    list->recalcVariousMessageCountsOnExpunge(const_cast<Model *>(model), message);
+    list->m_totalMessageCount -= removed.size();
+    list->recalcVariousMessageCountsOnExpunge(const_cast<Model *>(model), removed);
 
-    delete message;
+    qDeleteAll(removed);
 
     // The UID map is not synced at this time, though, and we defer a decision on when to do this to the context
     // of the task which invoked this method. The idea is that this task has a better insight for potentially
@@ -594,6 +781,91 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
     // Remove duplicates -- even that garbage can be present in a perfectly valid VANISHED :(
     uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
 
+    const bool hasUnknownUids = std::any_of(list->m_children.constBegin(), list->m_children.constEnd(), [](const TreeItem *item) {
+        return static_cast<const TreeItemMessage *>(item)->uid() == 0;
+    });
+
+    QVector<TreeItemMessage *> removed;
+    if (hasUnknownUids) {
+        // The UIDs of some messages are not known yet, so we have to guess which of them are the expunged ones
+        removed = handleVanishedWithUnknownUids(model, resp, uids);
+    } else {
+        // All UIDs are known, which means that the list is sorted by UID and each vanished UID either matches exactly
+        // one message, or nothing at all. That allows collecting all rows first and removing them in contiguous ranges.
+        QVector<int> rows;
+        rows.reserve(uids.size());
+        auto it = list->m_children.constBegin();
+        for (const uint uid : uids) {
+            if (uid == 0) {
+                qDebug() << "VANISHED informs about removal of UID zero...";
+                model->logTrace(listIndex.parent(), Common::LOG_MAILBOX_SYNC, QStringLiteral("TreeItemMailbox::handleVanished"),
+                                QStringLiteral("VANISHED contains UID zero for increased fun"));
+                continue;
+            }
+            it = std::lower_bound(it, list->m_children.constEnd(), uid, [](const TreeItem *item, const uint value) {
+                return static_cast<const TreeItemMessage *>(item)->uid() < value;
+            });
+            if (it != list->m_children.constEnd() && static_cast<const TreeItemMessage *>(*it)->uid() == uid) {
+                rows << it - list->m_children.constBegin();
+                if (syncState.uidNext() <= uid) {
+                    // We're informed about a message being deleted; this means that that UID must have been in the mailbox
+                    // for some (possibly tiny) time and we can therefore use it to get an idea about the UIDNEXT
+                    syncState.setUidNext(uid + 1);
+                }
+            } else if (resp.earlier != Responses::Vanished::EARLIER) {
+                // VANISHED is free to refer to a non-existing UID...
+                QString str = QStringLiteral("VANISHED refers to UID %1 which wasn't found in the mailbox").arg(uid);
+                qDebug() << str.toUtf8().constData();
+                model->logTrace(listIndex.parent(), Common::LOG_MAILBOX_SYNC, QStringLiteral("TreeItemMailbox::handleVanished"), str);
+            }
+        }
+
+        removed = removeMessageRows(model, rows);
+        for (TreeItemMessage *message : removed) {
+            model->cache()->clearMessage(mailbox(), message->uid());
+        }
+    }
+
+    if (resp.earlier == Responses::Vanished::EARLIER && static_cast<uint>(list->m_children.size()) < syncState.exists()) {
+        // Okay, there were some new arrivals which we failed to take into account because we had processed EXISTS
+        // before VANISHED (EARLIER). That means that we have to add some of that messages back right now.
+        int newArrivals = syncState.exists() - list->m_children.size();
+        Q_ASSERT(newArrivals > 0);
+        QModelIndex parent = list->toIndex(model);
+        int offset = list->m_children.size();
+        model->beginInsertRows(parent, offset, syncState.exists() - 1);
+        for (int i = 0; i < newArrivals; ++i) {
+            TreeItemMessage *msg = new TreeItemMessage(list);
+            msg->m_offset = i + offset;
+            list->m_children << msg;
+            // yes, we really have to add this message with UID 0 :(
+        }
+        model->endInsertRows();
+    }
+
+    list->m_totalMessageCount = list->m_children.size();
+    syncState.setExists(list->m_totalMessageCount);
+    // The new arrivals are accounted for once their FLAGS arrive, so only the removed messages affect the counters
+    list->recalcVariousMessageCountsOnExpunge(const_cast<Model *>(model), removed);
+    qDeleteAll(removed);
+
+    if (list->accessFetchStatus() == DONE) {
+        // Previously, we were synced, so we got to save this update
+        saveSyncStateAndUids(model);
+    }
+}
+
+/** @short Remove messages referenced by VANISHED one by one, guessing the positions of messages whose UID is not known yet
+
+The removed messages are returned to the caller which is responsible for deleting them.
+*/
+QVector<TreeItemMessage *> TreeItemMailbox::handleVanishedWithUnknownUids(Model *const model, const Responses::Vanished &resp, QVector<uint> uids)
+{
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(m_children[ 0 ]);
+    Q_ASSERT(list);
+    QModelIndex listIndex = list->toIndex(model);
+    QVector<TreeItemMessage *> removed;
+
     auto it = list->m_children.end();
     while (!uids.isEmpty()) {
         // We have to process each UID separately because the UIDs in the mailbox are not necessarily present
@@ -683,34 +955,9 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
             syncState.setUidNext(uid + 1);
         }
         model->cache()->clearMessage(mailbox(), uid);
-        delete msgCandidate;
-    }
-
-    if (resp.earlier == Responses::Vanished::EARLIER && static_cast<uint>(list->m_children.size()) < syncState.exists()) {
-        // Okay, there were some new arrivals which we failed to take into account because we had processed EXISTS
-        // before VANISHED (EARLIER). That means that we have to add some of that messages back right now.
-        int newArrivals = syncState.exists() - list->m_children.size();
-        Q_ASSERT(newArrivals > 0);
-        QModelIndex parent = list->toIndex(model);
-        int offset = list->m_children.size();
-        model->beginInsertRows(parent, offset, syncState.exists() - 1);
-        for (int i = 0; i < newArrivals; ++i) {
-            TreeItemMessage *msg = new TreeItemMessage(list);
-            msg->m_offset = i + offset;
-            list->m_children << msg;
-            // yes, we really have to add this message with UID 0 :(
-        }
-        model->endInsertRows();
-    }
-
-    list->m_totalMessageCount = list->m_children.size();
-    syncState.setExists(list->m_totalMessageCount);
-    list->recalcVariousMessageCounts(const_cast<Model *>(model));
-
-    if (list->accessFetchStatus() == DONE) {
-        // Previously, we were synced, so we got to save this update
-        saveSyncStateAndUids(model);
+        removed << msgCandidate;
     }
+    return removed;
 }
 
 /** @short Process the EXISTS response
@@ -870,6 +1117,11 @@ QVariant TreeItemMsgList::data(Model *const model, int role)
     return QLatin1String("[messages?]");
 }
 
+quint64 TreeItemMsgList::memoryUsage() const
+{
+    return sizeof(TreeItemMsgList) + childrenMemoryUsage();
+}
+
 bool TreeItemMsgList::hasChildren(Model *const model)
 {
     Q_UNUSED(model);
@@ -901,6 +1153,11 @@ int TreeItemMsgList::recentMessageCount(Model *const model)
     return m_recentMessageCount;
 }
 
+/** @short Recount the unread and recent messages from scratch
+
+This walks all messages in the list, so it should only be used when the mailbox gets (re)synchronized. All further changes
+are tracked incrementally by TreeItemMessage::setFlags() and recalcVariousMessageCountsOnExpunge().
+*/
 void TreeItemMsgList::recalcVariousMessageCounts(Model *model)
 {
     m_unreadMessageCount = 0;
@@ -922,7 +1179,7 @@ void TreeItemMsgList::recalcVariousMessageCounts(Model *model)
     model->emitMessageCountChanged(static_cast<TreeItemMailbox *>(parent()));
 }
 
-void TreeItemMsgList::recalcVariousMessageCountsOnExpunge(Model *model, TreeItemMessage *expungedMessage)
+void TreeItemMsgList::recalcVariousMessageCountsOnExpunge(Model *model, const QVector<TreeItemMessage *> &expungedMessages)
 {
     if (m_numberFetchingStatus != DONE) {
         // In case the counts weren't synced before, we cannot really rely on them now -> go to the slow path
@@ -930,17 +1187,44 @@ void TreeItemMsgList::recalcVariousMessageCountsOnExpunge(Model *model, TreeItem
         return;
     }
 
-    bool isRead, isRecent;
-    expungedMessage->checkFlagsReadRecent(isRead, isRecent);
-    if (expungedMessage->m_flagsHandled) {
-        if (!isRead)
-            --m_unreadMessageCount;
-        if (isRecent)
-            --m_recentMessageCount;
+    for (TreeItemMessage *expungedMessage : expungedMessages) {
+        bool isRead, isRecent;
+        expungedMessage->checkFlagsReadRecent(isRead, isRecent);
+        if (expungedMessage->m_flagsHandled) {
+            if (!isRead)
+                --m_unreadMessageCount;
+            if (isRecent)
+                --m_recentMessageCount;
+        }
     }
+    checkMessageCountsConsistency(model);
     model->emitMessageCountChanged(static_cast<TreeItemMailbox *>(parent()));
 }
 
+/** @short Warn when the incrementally maintained number of unread messages does not match the actual flags
+
+Messages whose flags have not been processed yet are not included in the count. The number of recent messages is not
+checked because it comes from the RECENT responses of the server. Walking all messages is too expensive to be done after
+each update, so this only runs when the "trojita-imap-check-message-counts" property of the Model is set, which is what
+the unit tests do.
+*/
+void TreeItemMsgList::checkMessageCountsConsistency(Model *const model) const
+{
+    if (m_numberFetchingStatus != DONE || !model->property("trojita-imap-check-message-counts").toBool())
+        return;
+    int unread = 0;
+    for (const TreeItem *item : m_children) {
+        const TreeItemMessage *message = static_cast<const TreeItemMessage *>(item);
+        if (message->m_flagsHandled && !message->isMarkedAsRead())
+            ++unread;
+    }
+    if (unread != m_unreadMessageCount) {
+        model->logTrace(parent()->toIndex(model), Common::LOG_MAILBOX_SYNC, QStringLiteral("TreeItemMsgList::checkMessageCountsConsistency"),
+                        QStringLiteral("Inconsistent number of unread messages: %1 counted, %2 remembered")
+                        .arg(QString::number(unread), QString::number(m_unreadMessageCount)));
+    }
+}
+
 void TreeItemMsgList::resetWasUnreadState()
 {
     for (int i = 0; i < m_children.size(); ++i) {
@@ -967,9 +1251,25 @@ MessageDataPayload::MessageDataPayload()
     , m_gotBodystructure(false)
     , m_gotHdrReferences(false)
     , m_gotHdrListPost(false)
+    , m_gotHasAttachments(false)
+    , m_hasAttachments(false)
 {
 }
 
+quint64 MessageDataPayload::memoryUsage() const
+{
+    quint64 res = sizeof(MessageDataPayload) + heapUsage(m_envelope) + heapUsage(m_hdrReferences)
+            + heapUsage(m_rememberedBodyStructure);
+    Q_FOREACH(const QUrl &url, m_hdrListPost) {
+        res += sizeof(void *) + heapUsage(url.toString());
+    }
+    if (m_partHeader)
+        res += m_partHeader->memoryUsage();
+    if (m_partText)
+        res += m_partText->memoryUsage();
+    return res;
+}
+
 bool MessageDataPayload::isComplete() const
 {
     return m_gotEnvelope && m_gotInternalDate && m_gotSize && m_gotBodystructure;
@@ -1082,6 +1382,22 @@ bool MessageDataPayload::gotRemeberedBodyStructure() const
     return m_gotBodystructure;
 }
 
+bool MessageDataPayload::hasAttachments() const
+{
+    return m_hasAttachments;
+}
+
+void MessageDataPayload::setHasAttachments(const bool hasAttachments)
+{
+    m_hasAttachments = hasAttachments;
+    m_gotHasAttachments = true;
+}
+
+bool MessageDataPayload::gotHasAttachments() const
+{
+    return m_gotHasAttachments;
+}
+
 TreeItemPart *MessageDataPayload::partHeader() const
 {
     return m_partHeader.get();
@@ -1144,9 +1460,74 @@ unsigned int TreeItemMessage::rowCount(Model *const model)
     if (!data()->gotRemeberedBodyStructure()) {
         fetch(model);
     }
+    materializeChildren(model);
+    return m_children.size();
+}
+
+unsigned int TreeItemMessage::childrenCount(Model *const model)
+{
+    fetch(model);
+    materializeChildren(model);
     return m_children.size();
 }
 
+TreeItem *TreeItemMessage::child(const int offset, Model *const model)
+{
+    fetch(model);
+    materializeChildren(model);
+    if (offset >= 0 && offset < m_children.size())
+        return m_children[ offset ];
+    else
+        return 0;
+}
+
+void TreeItemMessage::materializeChildren(Model *const model)
+{
+    if (!m_children.isEmpty() || !fetched() || !m_data || !m_data->gotRemeberedBodyStructure())
+        return;
+
+    QDataStream stream(m_data->rememberedBodyStructure());
+    stream.setVersion(QDataStream::Qt_4_6);
+    QVariantList unserialized;
+    stream >> unserialized;
+    QSharedPointer<Message::AbstractMessage> abstractMessage;
+    try {
+        abstractMessage = Message::AbstractMessage::fromList(unserialized, QByteArray(), 0);
+    } catch (Imap::ParserException &e) {
+        qDebug() << "Error when parsing cached BODYSTRUCTURE" << e.what();
+    }
+    if (!abstractMessage) {
+        setFetchStatus(UNAVAILABLE);
+        // This gets called from within the data() and rowCount() of the views, so the signal cannot be emitted right away
+        QModelIndex index = toIndex(model);
+        EMIT_LATER(model, dataChanged, Q_ARG(QModelIndex, index), Q_ARG(QModelIndex, index));
+        return;
+    }
+
+    // Nobody has seen any children of this message yet, so there's no need to announce them through the model
+    setChildren(abstractMessage->createTreeItems(this));
+}
+
+quint64 TreeItemMessage::memoryUsage() const
+{
+    // The flag names are shared through Model::normalizeFlags(), only the list itself belongs to this message
+    quint64 res = sizeof(TreeItemMessage) + m_flags.size() * sizeof(void *) + childrenMemoryUsage();
+    if (m_data)
+        res += m_data->memoryUsage();
+    return res;
+}
+
+void TreeItemMessage::collectLoadedParts(QVector<TreeItemPart *> &parts) const
+{
+    Q_FOREACH(TreeItem *item, m_children) {
+        static_cast<TreeItemPart *>(item)->collectLoadedParts(parts);
+    }
+    if (m_data && m_data->partHeader())
+        m_data->partHeader()->collectLoadedParts(parts);
+    if (m_data && m_data->partText())
+        m_data->partText()->collectLoadedParts(parts);
+}
+
 TreeItemChildrenList TreeItemMessage::setChildren(const TreeItemChildrenList &items)
 {
     auto origStatus = accessFetchStatus();
@@ -1209,6 +1590,8 @@ QVariant TreeItemMessage::data(Model *const model, int role)
     case RoleMessageFlags:
         // The flags are already sorted by Model::normalizeFlags()
         return m_flags;
+    case RoleMessageMemoryUsage:
+        return QVariant::fromValue<quint64>(memoryUsage());
     case RoleMessageIsMarkedDeleted:
         return isMarkedAsDeleted();
     case RoleMessageIsMarkedRead:
@@ -1445,6 +1828,11 @@ quint64 TreeItemMessage::size(Model *const model)
     return data()->size();
 }
 
+/** @short Update the flags of this message and the number of unread messages in the list accordingly
+
+The number of recent messages is not touched here because the \\Recent flag cannot be changed by the clients; the
+server reports newly arrived recent messages through the RECENT response instead.
+*/
 void TreeItemMessage::setFlags(TreeItemMsgList *list, const QStringList &flags)
 {
     // wasSeen is used to determine if the message was marked as read before this operation
@@ -1508,6 +1896,16 @@ bool TreeItemMessage::hasAttachments(Model *const model)
     if (!fetched())
         return false;
 
+    if (!data()->gotHasAttachments()) {
+        data()->setHasAttachments(checkAttachments(model));
+    }
+    return data()->hasAttachments();
+}
+
+bool TreeItemMessage::checkAttachments(Model *const model)
+{
+    materializeChildren(model);
+
     if (m_children.isEmpty()) {
         // strange, but why not, I guess
         return false;
@@ -1557,7 +1955,8 @@ bool TreeItemMessage::hasNestedAttachments(Model *const model, TreeItemPart *par
 
 
 TreeItemPart::TreeItemPart(TreeItem *parent, const QByteArray &mimeType):
-    TreeItem(parent), m_mimeType(mimeType.toLower()), m_octets(0), m_partMime(0), m_partRaw(0)
+    TreeItem(parent), m_mimeType(mimeType.toLower()), m_octets(0), m_partMime(0), m_partRaw(0), m_lastAccess(0),
+    m_dataInCache(false)
 {
     if (isTopLevelMultiPart()) {
         // Note that top-level multipart messages are special, their immediate contents
@@ -1567,7 +1966,8 @@ TreeItemPart::TreeItemPart(TreeItem *parent, const QByteArray &mimeType):
 }
 
 TreeItemPart::TreeItemPart(TreeItem *parent):
-    TreeItem(parent), m_mimeType("text/plain"), m_octets(0), m_partMime(0), m_partRaw(0)
+    TreeItem(parent), m_mimeType("text/plain"), m_octets(0), m_partMime(0), m_partRaw(0), m_lastAccess(0),
+    m_dataInCache(false)
 {
 }
 
@@ -1675,6 +2075,7 @@ QVariant TreeItemPart::data(Model *const model, int role)
         fetchFromCache(model);
         return QVariant();
     case RolePartBufferPtr:
+        model->notePartDataAccess(this);
         return QVariant::fromValue(dataPtr());
     case RolePartBodyFldParam:
         return QVariant::fromValue(m_bodyFldParam);
@@ -1701,8 +2102,10 @@ QVariant TreeItemPart::data(Model *const model, int role)
     case Qt::ToolTipRole:
         return QStringLiteral("%1 bytes of data").arg(m_data.size());
     case RolePartData:
+        model->notePartDataAccess(this);
         return m_data;
     case RolePartUnicodeText:
+        model->notePartDataAccess(this);
         if (m_mimeType.startsWith("text/")) {
             return decodeByteArray(m_data, m_charset);
         } else {
@@ -1728,6 +2131,35 @@ bool TreeItemPart::isTopLevelMultiPart() const
     return m_mimeType.startsWith("multipart/") && (msg || (part && part->m_mimeType.startsWith("message/")));
 }
 
+quint64 TreeItemPart::memoryUsage() const
+{
+    quint64 res = sizeof(TreeItemPart) + heapUsage(m_mimeType) + heapUsage(m_charset) + heapUsage(m_contentFormat)
+            + heapUsage(m_delSp) + heapUsage(m_encoding) + heapUsage(m_data) + heapUsage(m_bodyFldId)
+            + heapUsage(m_bodyDisposition) + heapUsage(m_fileName) + heapUsage(m_multipartRelatedStartPart)
+            + childrenMemoryUsage();
+    for (auto it = m_bodyFldParam.constBegin(); it != m_bodyFldParam.constEnd(); ++it) {
+        res += 4 * sizeof(void *) + heapUsage(it.key()) + heapUsage(*it);
+    }
+    if (m_partMime)
+        res += m_partMime->memoryUsage();
+    if (m_partRaw)
+        res += m_partRaw->memoryUsage();
+    return res;
+}
+
+void TreeItemPart::collectLoadedParts(QVector<TreeItemPart *> &parts)
+{
+    if (fetched() && !m_data.isEmpty())
+        parts << this;
+    Q_FOREACH(TreeItem *item, m_children) {
+        static_cast<TreeItemPart *>(item)->collectLoadedParts(parts);
+    }
+    if (m_partMime)
+        m_partMime->collectLoadedParts(parts);
+    if (m_partRaw)
+        m_partRaw->collectLoadedParts(parts);
+}
+
 QByteArray TreeItemPart::partId() const
 {
     if (isTopLevelMultiPart()) {
@@ -1840,6 +2272,7 @@ void TreeItemPart::silentlyReleaseMemoryRecursive()
         m_partRaw = 0;
     }
     m_data.clear();
+    m_dataInCache = false;
     setFetchStatus(NONE);
     qDeleteAll(m_children);
     m_children.clear();
@@ -1988,6 +2421,26 @@ TreeItem *TreeItemPartMultipartMessage::specialColumnPtr(int row, int column) co
     }
 }
 
+quint64 TreeItemPartMultipartMessage::memoryUsage() const
+{
+    quint64 res = TreeItemPart::memoryUsage() + sizeof(TreeItemPartMultipartMessage) - sizeof(TreeItemPart)
+            + heapUsage(m_envelope);
+    if (m_partHeader)
+        res += m_partHeader->memoryUsage();
+    if (m_partText)
+        res += m_partText->memoryUsage();
+    return res;
+}
+
+void TreeItemPartMultipartMessage::collectLoadedParts(QVector<TreeItemPart *> &parts)
+{
+    TreeItemPart::collectLoadedParts(parts);
+    if (m_partHeader)
+        m_partHeader->collectLoadedParts(parts);
+    if (m_partText)
+        m_partText->collectLoadedParts(parts);
+}
+
 void TreeItemPartMultipartMessage::silentlyReleaseMemoryRecursive()
 {
     TreeItemPart::silentlyReleaseMemoryRecursive();
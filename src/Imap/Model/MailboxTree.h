@@ -126,6 +126,14 @@ public:
     virtual bool isUnavailable() const;
     virtual TreeItem *specialColumnPtr(int row, int column) const;
     virtual QModelIndex toIndex(Model *const model) const;
+    /** @short Approximate heap usage of this item and of everything below it, in bytes
+
+    Implicitly shared data are counted in full by each of their owners, so this is an upper estimate.
+    */
+    virtual quint64 memoryUsage() const;
+
+protected:
+    quint64 childrenMemoryUsage() const;
 };
 
 class TreeItemPart;
@@ -139,6 +147,7 @@ class TreeItemMailbox: public TreeItem
     friend class MailboxModel;
     friend class DeleteMailboxTask; // for direct access to maintainingTask
     friend class KeepMailboxOpenTask; // needs access to maintainingTask
+    friend class NotificationConnectionTask; // needs access to maintainingTask
     friend class SubscribeUnsubscribeTask; // needs access to m_metadata.flags
     static QLatin1String flagNoInferiors;
     static QLatin1String flagHasNoChildren;
@@ -157,6 +166,8 @@ public:
     virtual QVariant data(Model *const model, int role);
     virtual bool hasChildren(Model *const model);
     virtual TreeItem *child(const int offset, Model *const model);
+    /** @short Approximate heap usage of this mailbox and of its messages; child mailboxes are not included */
+    virtual quint64 memoryUsage() const;
 
     SyncState syncState;
 
@@ -186,6 +197,7 @@ public:
                              bool usingQresync);
     void rescanForChildMailboxes(Model *const model);
     void handleExpunge(Model *const model, const Responses::NumberResponse &resp);
+    void handleExpunge(Model *const model, const QVector<uint> &sequenceNumbers);
     void handleExists(Model *const model, const Responses::NumberResponse &resp);
     void handleVanished(Model *const model, const Responses::Vanished &resp);
     bool isSelectable() const;
@@ -194,6 +206,8 @@ public:
 
 private:
     TreeItemPart *partIdToPtr(Model *model, TreeItemMessage *message, const QByteArray &msgId);
+    QVector<TreeItemMessage *> removeMessageRows(Model *const model, const QVector<int> &rows);
+    QVector<TreeItemMessage *> handleVanishedWithUnknownUids(Model *const model, const Responses::Vanished &resp, QVector<uint> uids);
 
     /** @short ImapTask which is currently responsible for well-being of this mailbox */
     QPointer<KeepMailboxOpenTask> maintainingTask;
@@ -207,6 +221,7 @@ class TreeItemMsgList: public TreeItem
     friend class Model;
     friend class ObtainSynchronizedMailboxTask;
     friend class KeepMailboxOpenTask;
+    friend class RefreshMessageCountsTask;
     FetchingState m_numberFetchingStatus;
     int m_totalMessageCount;
     int m_unreadMessageCount;
@@ -218,14 +233,16 @@ public:
     virtual unsigned int rowCount(Model *const model);
     virtual QVariant data(Model *const model, int role);
     virtual bool hasChildren(Model *const model);
+    virtual quint64 memoryUsage() const;
 
     int totalMessageCount(Model *const model);
     int unreadMessageCount(Model *const model);
     int recentMessageCount(Model *const model);
     void fetchNumbers(Model *const model);
     void recalcVariousMessageCounts(Model *model);
-    void recalcVariousMessageCountsOnExpunge(Model *model, TreeItemMessage *expungedMessage);
+    void recalcVariousMessageCountsOnExpunge(Model *model, const QVector<TreeItemMessage *> &expungedMessages);
     void resetWasUnreadState();
+    void checkMessageCountsConsistency(Model *const model) const;
     bool numbersFetched() const;
 };
 
@@ -248,6 +265,8 @@ public:
     void setHdrListPostNo(const bool hdrListPostNo);
     const QByteArray &rememberedBodyStructure() const;
     void setRememberedBodyStructure(const QByteArray &blob);
+    bool hasAttachments() const;
+    void setHasAttachments(const bool hasAttachments);
 
     TreeItemPart *partHeader() const;
     void setPartHeader(std::unique_ptr<TreeItemPart> part);
@@ -256,12 +275,16 @@ public:
 
     bool isComplete() const;
 
+    /** @short Approximate heap usage of the metadata and of the HEADER and TEXT parts */
+    quint64 memoryUsage() const;
+
     bool gotEnvelope() const;
     bool gotInternalDate() const;
     bool gotSize() const;
     bool gotHdrReferences() const;
     bool gotHdrListPost() const;
     bool gotRemeberedBodyStructure() const;
+    bool gotHasAttachments() const;
 
 private:
     Message::Envelope m_envelope;
@@ -280,6 +303,8 @@ private:
     bool m_gotBodystructure : 1;
     bool m_gotHdrReferences : 1;
     bool m_gotHdrListPost : 1;
+    bool m_gotHasAttachments : 1;
+    bool m_hasAttachments : 1;
 };
 
 class TreeItemMessage: public TreeItem
@@ -292,6 +317,7 @@ class TreeItemMessage: public TreeItem
     friend class KeepMailboxOpenTask; // needs access to m_offset
     friend class UpdateFlagsTask; // needs access to m_flags
     friend class UpdateFlagsOfAllMessagesTask; // needs access to m_flags
+    friend class ThreadingMsgListModel; // needs to peek at m_data without triggering a fetch
     int m_offset;
     uint m_uid;
     mutable MessageDataPayload *m_data;
@@ -302,6 +328,14 @@ class TreeItemMessage: public TreeItem
     void setFlags(TreeItemMsgList *list, const QStringList &flags);
     void processAdditionalHeaders(Model *model, const QByteArray &rawHeaders);
     static bool hasNestedAttachments(Model *const model, TreeItemPart *part);
+    /** @short Build the MIME parts from the remembered BODYSTRUCTURE if that hasn't been done yet
+
+    Messages loaded from the cache only keep the serialized BODYSTRUCTURE around; the tree of TreeItemPart
+    instances is only created when somebody actually asks for the message's children.
+    */
+    void materializeChildren(Model *const model);
+    /** @short Walk the MIME tree and find out whether there are any attachments, without consulting the cached answer */
+    bool checkAttachments(Model *const model);
 
     MessageDataPayload *data() const
     {
@@ -315,10 +349,15 @@ public:
     virtual int row() const;
     virtual void fetch(Model *const model);
     virtual unsigned int rowCount(Model *const model);
+    virtual unsigned int childrenCount(Model *const model);
+    virtual TreeItem *child(const int offset, Model *const model);
     virtual unsigned int columnCount();
     virtual QVariant data(Model *const model, int role);
     virtual bool hasChildren(Model *const model) { Q_UNUSED(model); return true; }
     virtual TreeItemChildrenList setChildren(const TreeItemChildrenList &items);
+    virtual quint64 memoryUsage() const;
+    /** @short Append all message parts of this message whose data are loaded in memory to @arg parts */
+    void collectLoadedParts(QVector<TreeItemPart *> &parts) const;
     Message::Envelope envelope(Model *const model);
     QDateTime internalDate(Model *const model);
     quint64 size(Model *const model);
@@ -357,6 +396,10 @@ class TreeItemPart: public TreeItem
     Imap::Message::AbstractMessage::bodyFldParam_t m_bodyFldParam;
     mutable TreeItemPart *m_partMime;
     mutable TreeItemPart *m_partRaw;
+    /** @short When were the data last used, see Model::notePartDataAccess() */
+    quint64 m_lastAccess;
+    /** @short Can the data be loaded from the cache again after they get evicted from memory? */
+    bool m_dataInCache;
 public:
     TreeItemPart(TreeItem *parent, const QByteArray &mimeType);
     ~TreeItemPart();
@@ -416,6 +459,9 @@ public:
     Imap::Message::AbstractMessage::bodyFldParam_t bodyFldParam() const { return m_bodyFldParam; }
     virtual TreeItem *specialColumnPtr(int row, int column) const;
     virtual bool isTopLevelMultiPart() const;
+    virtual quint64 memoryUsage() const;
+    /** @short Append this part and all parts below it whose data are loaded in memory to @arg parts */
+    virtual void collectLoadedParts(QVector<TreeItemPart *> &parts);
 
     virtual void silentlyReleaseMemoryRecursive();
 protected:
@@ -456,6 +502,8 @@ public:
     virtual ~TreeItemPartMultipartMessage();
     virtual QVariant data(Model * const model, int role);
     virtual TreeItem *specialColumnPtr(int row, int column) const;
+    virtual quint64 memoryUsage() const;
+    virtual void collectLoadedParts(QVector<TreeItemPart *> &parts);
     virtual void silentlyReleaseMemoryRecursive();
 };
 
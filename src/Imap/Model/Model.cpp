@@ -20,6 +20,7 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <QAbstractProxyModel>
 #include <QAuthenticator>
 #include <QCoreApplication>
@@ -27,17 +28,22 @@
 #include <QtAlgorithms>
 #include "Model.h"
 #include "MailboxTree.h"
+#include "SessionTrace.h"
 #include "SpecialFlagNames.h"
 #include "TaskPresentationModel.h"
+#include "TaskTrace.h"
 #include "Utils.h"
 #include "Common/FindWithUnknown.h"
 #include "Common/InvokeMethod.h"
+#include "Common/Profiling.h"
 #include "Imap/Encoders.h"
 #include "Imap/Tasks/AppendTask.h"
 #include "Imap/Tasks/CreateMailboxTask.h"
 #include "Imap/Tasks/GetAnyConnectionTask.h"
 #include "Imap/Tasks/KeepMailboxOpenTask.h"
+#include "Imap/Tasks/NotificationConnectionTask.h"
 #include "Imap/Tasks/OpenConnectionTask.h"
+#include "Imap/Tasks/RefreshMessageCountsTask.h"
 #include "Imap/Tasks/UpdateFlagsTask.h"
 #include "Streams/SocketFactory.h"
 
@@ -105,7 +111,10 @@ Model::Model(QObject *parent, AbstractCache *cache, SocketFactoryPtr socketFacto
     QAbstractItemModel(parent),
     // our tools
     m_cache(cache), m_socketFactory(std::move(socketFactory)), m_taskFactory(std::move(taskFactory)), m_maxParsers(4), m_mailboxes(0),
-    m_netPolicy(NETWORK_OFFLINE),  m_taskModel(0), m_hasImapPassword(false)
+    m_netPolicy(NETWORK_OFFLINE),  m_taskModel(0), m_hasImapPassword(false), m_coalesceDataChanged(true),
+    m_pendingDataChangedTimer(0), m_partDataBudget(256 * 1024 * 1024), m_partDataEstimate(0),
+    m_partDataEvictionThreshold(m_partDataBudget), m_partDataAccessCounter(0),
+    m_partDataEvictionTimer(0), m_notificationConnectionTimer(0)
 {
     m_cache->setParent(this);
     m_startTls = m_socketFactory->startTlsRequired();
@@ -131,6 +140,25 @@ Model::Model(QObject *parent, AbstractCache *cache, SocketFactoryPtr socketFacto
     // polling every five minutes
     m_periodicMailboxNumbersRefresh->setInterval(5 * 60 * 1000);
     connect(m_periodicMailboxNumbersRefresh, &QTimer::timeout, this, &Model::invalidateAllMessageCounts);
+
+    m_pendingDataChangedTimer = new QTimer(this);
+    m_pendingDataChangedTimer->setSingleShot(true);
+    m_pendingDataChangedTimer->setInterval(0);
+    connect(m_pendingDataChangedTimer, &QTimer::timeout, this, &Model::flushPendingDataChanged);
+    // The postponed signals refer to the tree items directly, so they have to go out before anything is removed or moved
+    connect(this, &QAbstractItemModel::rowsAboutToBeRemoved, this, &Model::flushPendingDataChanged);
+    connect(this, &QAbstractItemModel::rowsAboutToBeMoved, this, &Model::flushPendingDataChanged);
+    connect(this, &QAbstractItemModel::layoutAboutToBeChanged, this, &Model::flushPendingDataChanged);
+    connect(this, &QAbstractItemModel::modelAboutToBeReset, this, &Model::flushPendingDataChanged);
+
+    m_partDataEvictionTimer = new QTimer(this);
+    m_partDataEvictionTimer->setSingleShot(true);
+    m_partDataEvictionTimer->setInterval(0);
+    connect(m_partDataEvictionTimer, &QTimer::timeout, this, &Model::evictPartData);
+
+    m_notificationConnectionTimer = new QTimer(this);
+    m_notificationConnectionTimer->setSingleShot(true);
+    connect(m_notificationConnectionTimer, &QTimer::timeout, this, &Model::startNotificationConnection);
 }
 
 Model::~Model()
@@ -160,6 +188,7 @@ void Model::responseReceived(Parser *parser)
 /** @short Process responses from the specified parser */
 void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
 {
+    TROJITA_PROFILE_SCOPE("Model::responseReceived");
     Q_ASSERT(it->parser);
 
     int counter = 0;
@@ -178,6 +207,20 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
             }
         }
         try {
+            if ((!m_pendingChangedMessages.isEmpty() || !m_pendingMessageCountChanges.isEmpty()) &&
+                    !dynamic_cast<Responses::Fetch *>(resp.data())) {
+                // Only runs of FETCH get their signals merged; everything else gets to see the model fully up-to-date
+                flushPendingDataChanged();
+            }
+
+            if (it->maintainingTask) {
+                // Runs of EXPUNGE are applied in a single batch, and that batch has to be complete before anything else
+                // gets a chance to look at the message numbers
+                Responses::NumberResponse *numberResponse = dynamic_cast<Responses::NumberResponse *>(resp.data());
+                if (!numberResponse || numberResponse->kind != Responses::EXPUNGE)
+                    it->maintainingTask->flushPendingExpunges();
+            }
+
             /* At this point, we want to iterate over all active tasks and try them
             for processing the server's responses (the plug() method). However, this
             is rather complex -- this call to plug() could result in signals being
@@ -222,6 +265,8 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
                         throw;
                     }
 #endif
+                    if (handled && m_taskTrace)
+                        m_taskTrace->taskHandledResponse(*taskIt);
                 }
 
                 if ((*taskIt)->isFinished()) {
@@ -258,6 +303,20 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
         }
     }
 
+    if (it->parser && it->maintainingTask) {
+        // Don't return to the event loop with some expunges not applied yet
+        try {
+            it->maintainingTask->flushPendingExpunges();
+        } catch (Imap::ImapException &e) {
+            uint parserId = it->parser->parserId();
+            killParser(it->parser, PARSER_KILL_HARD);
+            broadcastParseError(parserId, QString::fromStdString(e.exceptionClass()), QString::fromUtf8(e.what()), e.line(), e.offset());
+        }
+    }
+
+    // Report the updated messages before returning to the event loop
+    flushPendingDataChanged();
+
     if (!it->parser) {
         // He's dead, Jim
         m_taskModel->beginResetModel();
@@ -562,12 +621,20 @@ void Model::handleStatus(Imap::Parser *ptr, const Imap::Responses::Status *const
 {
     if (accessParser(ptr).connState == CONN_STATE_LOGOUT)
         return;
-    Q_UNUSED(ptr);
+    if (accessParser(ptr).notifyState == ParserState::NotifyState::REQUESTED) {
+        // The server reports the initial numbers of all mailboxes which the NOTIFY will keep up-to-date
+        accessParser(ptr).notifyMailboxes.insert(resp->mailbox);
+    }
     TreeItemMailbox *mailbox = findMailboxByName(resp->mailbox);
     if (! mailbox) {
         qDebug() << "Couldn't find out which mailbox is" << resp->mailbox << "when parsing a STATUS reply";
         return;
     }
+    if (mailbox->maintainingTask) {
+        // The numbers of a mailbox which is kept in sync are computed from its messages. A STATUS, e.g. one which
+        // is a part of a LIST-STATUS sent over another connection, might not match what the sync has seen so far.
+        return;
+    }
     TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(mailbox->m_children[0]);
     Q_ASSERT(list);
     bool updateCache = false;
@@ -894,7 +961,15 @@ void Model::askForNumberOfMessages(TreeItemMsgList *item)
             item->m_numberFetchingStatus = TreeItem::UNAVAILABLE;
         }
     } else {
-        m_taskFactory->createNumberOfMessagesTask(this, mailboxPtr->toIndex(this));
+        const QStringList caps = capabilities();
+        if (caps.contains(QStringLiteral("LIST-STATUS")) || caps.contains(QStringLiteral("NOTIFY"))) {
+            // All requests made before the refresh gets a chance to run share a single round trip
+            if (!m_messageCountsRefresh || !m_messageCountsRefresh->isAcceptingMailboxes())
+                m_messageCountsRefresh = m_taskFactory->createRefreshMessageCountsTask(this);
+            m_messageCountsRefresh->addMailbox(mailboxPtr->toIndex(this));
+        } else {
+            m_taskFactory->createNumberOfMessagesTask(this, mailboxPtr->toIndex(this));
+        }
     }
 }
 
@@ -915,29 +990,17 @@ void Model::askForMsgMetadata(TreeItemMessage *item, const PreloadingMode preloa
             item->data()->setHdrReferences(data.hdrReferences);
             item->data()->setHdrListPost(data.hdrListPost);
             item->data()->setHdrListPostNo(data.hdrListPostNo);
-            QDataStream stream(&data.serializedBodyStructure, QIODevice::ReadOnly);
-            stream.setVersion(QDataStream::Qt_4_6);
-            QVariantList unserialized;
-            stream >> unserialized;
-            QSharedPointer<Message::AbstractMessage> abstractMessage;
-            try {
-                abstractMessage = Message::AbstractMessage::fromList(unserialized, QByteArray(), 0);
-            } catch (Imap::ParserException &e) {
-                qDebug() << "Error when parsing cached BODYSTRUCTURE" << e.what();
-            }
-            if (! abstractMessage) {
+            if (data.serializedBodyStructure.isEmpty()) {
                 item->setFetchStatus(TreeItem::UNAVAILABLE);
             } else {
-                auto newChildren = abstractMessage->createTreeItems(item);
-                if (item->m_children.isEmpty()) {
-                    TreeItemChildrenList oldChildren = item->setChildren(newChildren);
-                    Q_ASSERT(oldChildren.size() == 0);
-                } else {
-                    // The following assert guards against that crazy signal emitting we had when various askFor*()
-                    // functions were not delayed. If it gets hit, it means that someone tried to call this function
-                    // on an item which was already loaded.
-                    Q_ASSERT(item->m_children.isEmpty());
-                    item->setChildren(newChildren);
+                // The MIME tree is only built when somebody asks for it, see TreeItemMessage::materializeChildren().
+                // The following assert guards against that crazy signal emitting we had when various askFor*()
+                // functions were not delayed. If it gets hit, it means that someone tried to call this function
+                // on an item which was already loaded.
+                Q_ASSERT(item->m_children.isEmpty());
+                item->data()->setRememberedBodyStructure(data.serializedBodyStructure);
+                if (data.attachments != AbstractCache::MessageDataBundle::ATTACHMENTS_UNKNOWN) {
+                    item->data()->setHasAttachments(data.attachments == AbstractCache::MessageDataBundle::ATTACHMENTS_PRESENT);
                 }
                 item->setFetchStatus(TreeItem::DONE);
             }
@@ -962,8 +1025,8 @@ void Model::askForMsgMetadata(TreeItemMessage *item, const PreloadingMode preloa
             findTaskResponsibleFor(mailboxPtr)->requestEnvelopeDownload(item->uid());
         }
 
-        // preload
-        if (preloadMode != PRELOAD_PER_POLICY)
+        // preload; when a view reports what it is going to show, it knows better than this blind guess
+        if (preloadMode != PRELOAD_PER_POLICY || hasMessageFetchWindow(mailboxPtr))
             break;
         bool ok;
         int preload = property("trojita-imap-preload-msg-metadata").toInt(&ok);
@@ -986,6 +1049,80 @@ void Model::askForMsgMetadata(TreeItemMessage *item, const PreloadingMode preloa
     EMIT_LATER(this, dataChanged, Q_ARG(QModelIndex, item->toIndex(this)), Q_ARG(QModelIndex, item->toIndex(this)));
 }
 
+/** @short Is there a view which reports what messages of this mailbox to prefetch? */
+bool Model::hasMessageFetchWindow(TreeItemMailbox *mailbox)
+{
+    if (!m_messageFetchWindowOwner) {
+        // The view went away, so nobody is going to take care of the prefetching anymore
+        m_messageFetchWindowMailbox = QPersistentModelIndex();
+        m_messageFetchWindowRequests.clear();
+        return false;
+    }
+    return m_messageFetchWindowMailbox == mailbox->toIndex(this);
+}
+
+void Model::setMessageFetchWindow(QObject *view, const QModelIndexList &messages)
+{
+    TreeItemMsgList *list = 0;
+    QVector<TreeItemMessage *> window;
+    window.reserve(messages.size());
+    Q_FOREACH(const QModelIndex &index, messages) {
+        const Model *whichModel = 0;
+        TreeItemMessage *message = dynamic_cast<TreeItemMessage *>(realTreeItem(index, &whichModel));
+        if (!message || whichModel != this)
+            continue;
+        if (!list)
+            list = dynamic_cast<TreeItemMsgList *>(message->parent());
+        if (message->parent() != list)
+            continue;
+        window << message;
+    }
+
+    if (!list)
+        return;
+
+    TreeItemMailbox *mailboxPtr = dynamic_cast<TreeItemMailbox *>(list->parent());
+    Q_ASSERT(mailboxPtr);
+
+    if (m_messageFetchWindowOwner != view || !hasMessageFetchWindow(mailboxPtr)) {
+        // Whatever the previous window asked for belongs to somebody else now
+        m_messageFetchWindowOwner = view;
+        m_messageFetchWindowMailbox = mailboxPtr->toIndex(this);
+        m_messageFetchWindowRequests.clear();
+    }
+
+    Imap::Uids wanted;
+    wanted.reserve(window.size());
+    Q_FOREACH(TreeItemMessage *message, window) {
+        if (!message->uid())
+            continue;
+        wanted << message->uid();
+        if (!message->fetched() && !message->loading() && !message->isUnavailable()) {
+            askForMsgMetadata(message, PRELOAD_DISABLED);
+            if (message->loading())
+                m_messageFetchWindowRequests.insert(message->uid());
+        }
+    }
+
+    if (!mailboxPtr->maintainingTask) {
+        m_messageFetchWindowRequests.clear();
+        return;
+    }
+
+    Imap::Uids dropped = mailboxPtr->maintainingTask->restrictEnvelopeRequests(wanted, m_messageFetchWindowRequests);
+    if (dropped.isEmpty())
+        return;
+
+    // These messages are no longer being loaded, so the next request for their data has to ask again
+    std::sort(dropped.begin(), dropped.end());
+    Q_FOREACH(TreeItemMessage *message, findMessagesByUids(mailboxPtr, dropped)) {
+        if (message->loading()) {
+            message->setFetchStatus(TreeItem::NONE);
+            notifyMessageChanged(message);
+        }
+    }
+}
+
 void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache)
 {
     Q_ASSERT(item->message());   // TreeItemMessage
@@ -1014,7 +1151,9 @@ void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache)
                                                     : item->partId());
     if (! data.isNull()) {
         item->m_data = data;
+        item->m_dataInCache = true;
         item->setFetchStatus(TreeItem::DONE);
+        partDataLoaded(item);
         return;
     }
 
@@ -1024,7 +1163,9 @@ void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache)
 
         if (!data.isNull()) {
             Imap::decodeContentTransferEncoding(data, item->encoding(), item->dataPtr());
+            item->m_dataInCache = true;
             item->setFetchStatus(TreeItem::DONE);
+            partDataLoaded(item);
             return;
         }
 
@@ -1081,6 +1222,7 @@ void Model::setNetworkPolicy(const NetworkPolicy policy)
         }
         m_netPolicy = NETWORK_OFFLINE;
         m_periodicMailboxNumbersRefresh->stop();
+        m_notificationConnectionTimer->stop();
         emit networkPolicyChanged();
         emit networkPolicyOffline();
 
@@ -1439,6 +1581,42 @@ void Model::changeConnectionState(Parser *parser, ConnectionState state)
     accessParser(parser).connState = state;
     logTrace(parser->parserId(), Common::LOG_TASKS, QStringLiteral("conn"), connectionStateToString(state));
     emit connectionStateChanged(parser->parserId(), state);
+
+    if (state == CONN_STATE_AUTHENTICATED && accessParser(parser).purpose == ParserState::Purpose::GENERIC &&
+            (!m_notificationConnection || m_notificationConnection->isFinished())) {
+        // Only do this after the first connection has logged in, so that the credentials are known already
+        m_notificationConnectionTimer->start(0);
+    }
+}
+
+void Model::startNotificationConnection()
+{
+    if ((m_notificationConnection && !m_notificationConnection->isFinished()) || m_netPolicy == NETWORK_OFFLINE ||
+            !property("trojita-imap-dedicated-idle-connection").toBool())
+        return;
+
+    if (m_parsers.size() >= m_maxParsers) {
+        logTrace(0, Common::LOG_OTHER, QStringLiteral("Model"), QStringLiteral("Not opening a dedicated IDLE connection, too many connections already"));
+        return;
+    }
+
+    m_notificationConnection = m_taskFactory->createNotificationConnectionTask(this);
+    connect(m_notificationConnection.data(), &NotificationConnectionTask::connectionLost, this, &Model::slotNotificationConnectionLost);
+}
+
+/** @short The dedicated connection for receiving updates went away while we're online, so try to open it again later */
+void Model::slotNotificationConnectionLost()
+{
+    if (m_netPolicy == NETWORK_OFFLINE)
+        return;
+
+    bool ok;
+    int delay = property("trojita-imap-dedicated-idle-reconnect").toInt(&ok);
+    if (!ok)
+        delay = 60 * 1000;
+    logTrace(0, Common::LOG_OTHER, QStringLiteral("Model"),
+             QStringLiteral("The dedicated IDLE connection is gone, will reconnect in %1 ms").arg(delay));
+    m_notificationConnectionTimer->start(delay);
 }
 
 void Model::handleSocketStateChanged(Parser *parser, Imap::ConnectionState state)
@@ -1484,14 +1662,36 @@ void Model::killParser(Parser *parser, ParserKillingMethod method)
 
 void Model::slotParserLineReceived(Parser *parser, const QByteArray &line)
 {
+    if (m_sessionTrace)
+        m_sessionTrace->record(parser->parserId(), SessionTraceRecord::SERVER_TO_CLIENT, line);
     logTrace(parser->parserId(), Common::LOG_IO_READ, QString(), QString::fromUtf8(line));
 }
 
 void Model::slotParserLineSent(Parser *parser, const QByteArray &line)
 {
+    if (m_sessionTrace)
+        m_sessionTrace->record(parser->parserId(), SessionTraceRecord::CLIENT_TO_SERVER, line);
     logTrace(parser->parserId(), Common::LOG_IO_WRITTEN, QString(), QString::fromUtf8(line));
 }
 
+void Model::setSessionTrace(SessionTraceWriter *trace)
+{
+    if (m_sessionTrace)
+        m_sessionTrace->deleteLater();
+    m_sessionTrace = trace;
+    if (m_sessionTrace)
+        m_sessionTrace->setParent(this);
+}
+
+void Model::setTaskTrace(TaskTraceWriter *trace)
+{
+    if (m_taskTrace)
+        m_taskTrace->deleteLater();
+    m_taskTrace = trace;
+    if (m_taskTrace)
+        m_taskTrace->setParent(this);
+}
+
 void Model::setCache(AbstractCache *cache)
 {
     if (m_cache)
@@ -1552,35 +1752,86 @@ KeepMailboxOpenTask *Model::findTaskResponsibleFor(const QModelIndex &mailbox)
 KeepMailboxOpenTask *Model::findTaskResponsibleFor(TreeItemMailbox *mailboxPtr)
 {
     Q_ASSERT(mailboxPtr);
-    bool canCreateParallelConn = m_parsers.isEmpty(); // FIXME: multiple connections
+
+    // With a single connection, a request for any other mailbox than the one asked for previously would need a SELECT
+    const bool switchesFromLastMailbox = m_lastRoutedMailbox != mailboxPtr->mailbox();
+    m_lastRoutedMailbox = mailboxPtr->mailbox();
 
     if (mailboxPtr->maintainingTask) {
         // The requested mailbox already has the maintaining task associated
         if (accessParser(mailboxPtr->maintainingTask->parser).connState == CONN_STATE_LOGOUT) {
             // The connection is currently getting closed, so we have to create another one
+            ++m_mailboxSelectionStats.newConnections;
             return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), 0);
         } else {
             // it's usable as-is
+            if (switchesFromLastMailbox)
+                ++m_mailboxSelectionStats.selectsAvoided;
             return mailboxPtr->maintainingTask;
         }
-    } else if (canCreateParallelConn) {
-        // The mailbox is not being maintained, but we can create a new connection
-        return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), 0);
+    }
+
+    Parser *parser = findConnectionForMailboxSwitch();
+    if (parser) {
+        ++m_mailboxSelectionStats.mailboxSwitches;
+        if (accessParser(parser).maintainingTask) {
+            logTrace(parser->parserId(), Common::LOG_TASKS, QStringLiteral("Model"),
+                     QStringLiteral("Switching from %1 to %2").arg(accessParser(parser).maintainingTask->debugIdentification(),
+                                                                   mailboxPtr->mailbox()));
+        }
     } else {
-        // Too bad, we have to re-use an existing parser. That will probably lead to
-        // stealing it from some mailbox, but there's no other way.
-        Q_ASSERT(!m_parsers.isEmpty());
+        ++m_mailboxSelectionStats.newConnections;
+    }
+    return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), parser);
+}
 
-        for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
-            if (it->connState == CONN_STATE_LOGOUT) {
-                // this one is not usable
-                continue;
-            }
-            return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), it.key());
+/** @short Find out which connection should be used for opening another mailbox
+
+The preferred connection is one which does not have any mailbox open yet. If there is none, and the configuration allows
+for more connections to be used for mailbox access (the trojita-imap-max-mailbox-connections property), a new connection
+is requested by returning 0. Otherwise, the connection whose mailbox has the least amount of pending work is reused, so
+that the work which is already queued for the other mailboxes gets batched before they are closed.
+
+The connections which are reserved for some other purpose cannot be reused, but they still count towards the overall
+limit on the number of connections.
+*/
+Parser *Model::findConnectionForMailboxSwitch()
+{
+    bool ok;
+    int maxConnections = property("trojita-imap-max-mailbox-connections").toInt(&ok);
+    if (!ok || maxConnections < 1)
+        maxConnections = 1;
+    maxConnections = qMin(maxConnections, m_maxParsers);
+
+    Parser *bestParser = 0;
+    int bestWorkload = 0;
+    int usableConnections = 0;
+    int liveConnections = 0;
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (!it->parser)
+            continue;
+        ++liveConnections;
+        if (it->connState == CONN_STATE_LOGOUT || it->purpose != ParserState::Purpose::GENERIC) {
+            // this one is not usable
+            continue;
+        }
+        ++usableConnections;
+        if (!it->maintainingTask) {
+            // No mailbox has to be closed when using this one
+            return it.key();
         }
-        // At this point, we have no other choice than to create a new connection
-        return m_taskFactory->createKeepMailboxOpenTask(this, mailboxPtr->toIndex(this), 0);
+        const int workload = it->maintainingTask->pendingWorkload();
+        if (!bestParser || workload < bestWorkload) {
+            bestParser = it.key();
+            bestWorkload = workload;
+        }
+    }
+
+    if (!bestParser || (usableConnections < maxConnections && liveConnections < m_maxParsers)) {
+        // Keep the already opened mailboxes where they are and ask for another connection
+        return 0;
     }
+    return bestParser;
 }
 
 void Model::genericHandleFetch(TreeItemMailbox *mailbox, const Imap::Responses::Fetch *const resp)
@@ -1596,10 +1847,74 @@ void Model::genericHandleFetch(TreeItemMailbox *mailbox, const Imap::Responses::
         }
     }
     if (changedMessage) {
-        QModelIndex index = changedMessage->toIndex(this);
+        notifyMessageChanged(changedMessage);
+        notifyMessageCountChanged(mailbox);
+    }
+}
+
+/** @short Report a change of the message data, possibly merging it with other changed messages into a single signal */
+void Model::notifyMessageChanged(TreeItemMessage *message)
+{
+    if (!m_coalesceDataChanged) {
+        QModelIndex index = message->toIndex(this);
         emit dataChanged(index, index);
+        return;
+    }
+    m_pendingChangedMessages[static_cast<TreeItemMsgList *>(message->parent())] << message;
+    if (!m_pendingDataChangedTimer->isActive())
+        m_pendingDataChangedTimer->start();
+}
+
+/** @short Report a possible change of the message counts along with the changed messages, see notifyMessageChanged() */
+void Model::notifyMessageCountChanged(TreeItemMailbox *mailbox)
+{
+    if (!m_coalesceDataChanged) {
         emitMessageCountChanged(mailbox);
+        return;
     }
+    if (!m_pendingMessageCountChanges.contains(mailbox))
+        m_pendingMessageCountChanges << mailbox;
+    if (!m_pendingDataChangedTimer->isActive())
+        m_pendingDataChangedTimer->start();
+}
+
+void Model::flushPendingDataChanged()
+{
+    m_pendingDataChangedTimer->stop();
+
+    // The signals might trigger further changes, so each list is taken out of the queue before its signals are emitted
+    while (!m_pendingChangedMessages.isEmpty()) {
+        auto it = m_pendingChangedMessages.begin();
+        TreeItemMsgList *list = it.key();
+        QVector<int> rows;
+        rows.reserve(it->size());
+        for (const TreeItemMessage *message : *it) {
+            rows << message->row();
+        }
+        m_pendingChangedMessages.erase(it);
+
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        for (int first = 0; first < rows.size();) {
+            int last = first;
+            while (last + 1 < rows.size() && rows[last + 1] == rows[last] + 1)
+                ++last;
+            emit dataChanged(createIndex(rows[first], 0, list->m_children[rows[first]]),
+                             createIndex(rows[last], 0, list->m_children[rows[last]]));
+            first = last + 1;
+        }
+    }
+
+    while (!m_pendingMessageCountChanges.isEmpty()) {
+        emitMessageCountChanged(m_pendingMessageCountChanges.takeFirst());
+    }
+}
+
+void Model::setDataChangedCoalescing(const bool enabled)
+{
+    if (!enabled)
+        flushPendingDataChanged();
+    m_coalesceDataChanged = enabled;
 }
 
 QModelIndex Model::findMailboxForItems(const QModelIndexList &items)
@@ -1689,7 +2004,10 @@ void Model::releaseMessageData(const QModelIndex &message)
     msg->setFetchStatus(TreeItem::NONE);
 
 #ifndef XTUPLE_CONNECT
-    beginRemoveRows(realMessage, 0, msg->m_children.size() - 1);
+    // Messages whose MIME tree was never materialized have no rows to remove
+    const bool hadChildren = !msg->m_children.isEmpty();
+    if (hadChildren)
+        beginRemoveRows(realMessage, 0, msg->m_children.size() - 1);
 #endif
     if (msg->data()->partHeader()) {
         msg->data()->partHeader()->silentlyReleaseMemoryRecursive();
@@ -1709,7 +2027,8 @@ void Model::releaseMessageData(const QModelIndex &message)
     }
     msg->m_children.clear();
 #ifndef XTUPLE_CONNECT
-    endRemoveRows();
+    if (hadChildren)
+        endRemoveRows();
     emit dataChanged(realMessage, realMessage);
 #endif
 }
@@ -1725,6 +2044,189 @@ QStringList Model::capabilities() const
     return QStringList();
 }
 
+QVariantList Model::connectionMetrics() const
+{
+    QVariantList res;
+    for (auto it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (!it->parser)
+            continue;
+        QVariantMap item = it->parser->metrics().toVariantMap();
+        item[QStringLiteral("parserId")] = it->parser->parserId();
+        item[QStringLiteral("connectionState")] = connectionStateToString(it->connState);
+        item[QStringLiteral("activeTasks")] = it->activeTasks.size();
+        if (it->maintainingTask)
+            item[QStringLiteral("maintainingTask")] = it->maintainingTask->debugIdentification();
+        res << item;
+    }
+    return res;
+}
+
+QVariantList Model::memoryUsage() const
+{
+    QVector<QVariantMap> mailboxes;
+    QList<TreeItemMailbox *> pending;
+    pending << m_mailboxes;
+    while (!pending.isEmpty()) {
+        TreeItemMailbox *mailbox = pending.takeFirst();
+        // The first child is always the list of messages, the rest are child mailboxes
+        for (int i = 1; i < mailbox->m_children.size(); ++i) {
+            pending << static_cast<TreeItemMailbox *>(mailbox->m_children[i]);
+        }
+        if (mailbox == m_mailboxes)
+            continue;
+
+        TreeItemMsgList *list = static_cast<TreeItemMsgList *>(mailbox->m_children[0]);
+        int loaded = 0;
+        Q_FOREACH(const TreeItem *item, list->m_children) {
+            if (item->fetched())
+                ++loaded;
+        }
+        QVariantMap entry;
+        entry[QStringLiteral("mailbox")] = mailbox->mailbox();
+        entry[QStringLiteral("bytes")] = mailbox->memoryUsage();
+        entry[QStringLiteral("messages")] = list->m_children.size();
+        entry[QStringLiteral("loadedMessages")] = loaded;
+        mailboxes << entry;
+    }
+
+    std::sort(mailboxes.begin(), mailboxes.end(), [](const QVariantMap &a, const QVariantMap &b) {
+        return a[QStringLiteral("bytes")].toULongLong() > b[QStringLiteral("bytes")].toULongLong();
+    });
+    QVariantList res;
+    Q_FOREACH(const QVariantMap &entry, mailboxes) {
+        res << entry;
+    }
+    return res;
+}
+
+void Model::setPartDataBudget(const quint64 bytes)
+{
+    m_partDataBudget = bytes;
+    m_partDataEvictionThreshold = bytes;
+    if (m_partDataBudget)
+        m_partDataEvictionTimer->start();
+}
+
+quint64 Model::partDataBudget() const
+{
+    return m_partDataBudget;
+}
+
+void Model::pinMessageData(const QModelIndex &message)
+{
+    if (!message.isValid())
+        return;
+    QModelIndex realMessage;
+    realTreeItem(message, 0, &realMessage);
+    m_pinnedMessages << realMessage;
+}
+
+void Model::unpinMessageData(const QModelIndex &message)
+{
+    if (message.isValid()) {
+        QModelIndex realMessage;
+        realTreeItem(message, 0, &realMessage);
+        m_pinnedMessages.removeOne(realMessage);
+    }
+    // Forget about the messages which are gone by now
+    for (auto it = m_pinnedMessages.begin(); it != m_pinnedMessages.end(); ) {
+        if (it->isValid())
+            ++it;
+        else
+            it = m_pinnedMessages.erase(it);
+    }
+    if (m_partDataBudget && m_partDataEstimate > m_partDataBudget)
+        m_partDataEvictionTimer->start();
+}
+
+void Model::partDataLoaded(TreeItemPart *part)
+{
+    notePartDataAccess(part);
+    m_partDataEstimate += part->m_data.size();
+    if (m_partDataBudget && m_partDataEstimate > m_partDataEvictionThreshold)
+        m_partDataEvictionTimer->start();
+}
+
+void Model::notePartDataAccess(TreeItemPart *part)
+{
+    part->m_lastAccess = ++m_partDataAccessCounter;
+}
+
+void Model::evictPartData()
+{
+    if (!m_partDataBudget)
+        return;
+
+    QSet<TreeItem *> pinned;
+    Q_FOREACH(const QPersistentModelIndex &message, m_pinnedMessages) {
+        if (message.isValid())
+            pinned << static_cast<TreeItem *>(message.internalPointer());
+    }
+
+    // Find out how much memory is really used, and by what
+    quint64 total = 0;
+    QVector<TreeItemPart *> evictable;
+    QList<TreeItemMailbox *> pending;
+    pending << m_mailboxes;
+    while (!pending.isEmpty()) {
+        TreeItemMailbox *mailbox = pending.takeFirst();
+        for (int i = 1; i < mailbox->m_children.size(); ++i) {
+            pending << static_cast<TreeItemMailbox *>(mailbox->m_children[i]);
+        }
+        Q_FOREACH(TreeItem *item, mailbox->m_children[0]->m_children) {
+            TreeItemMessage *message = static_cast<TreeItemMessage *>(item);
+            QVector<TreeItemPart *> parts;
+            message->collectLoadedParts(parts);
+            const bool isPinned = pinned.contains(message);
+            Q_FOREACH(TreeItemPart *part, parts) {
+                total += part->m_data.size();
+                if (!isPinned && part->m_dataInCache)
+                    evictable << part;
+            }
+        }
+    }
+
+    // Go a bit below the limit so that the very next download doesn't trigger another round
+    const quint64 target = m_partDataBudget / 4 * 3;
+    QModelIndexList evicted;
+    if (total > m_partDataBudget) {
+        std::sort(evictable.begin(), evictable.end(), [](const TreeItemPart *a, const TreeItemPart *b) {
+            return a->m_lastAccess < b->m_lastAccess;
+        });
+        Q_FOREACH(TreeItemPart *part, evictable) {
+            if (total <= target)
+                break;
+            total -= part->m_data.size();
+            part->m_data = QByteArray();
+            part->m_dataInCache = false;
+            part->setFetchStatus(TreeItem::NONE);
+            evicted << part->toIndex(this);
+        }
+    }
+    m_partDataEstimate = total;
+    m_partDataEvictionThreshold = qMax(m_partDataBudget, total + (m_partDataBudget - target));
+
+    // Report the evicted parts in runs of adjacent rows rather than one by one
+    std::sort(evicted.begin(), evicted.end(), [](const QModelIndex &a, const QModelIndex &b) {
+        const QModelIndex parentA = a.parent();
+        const QModelIndex parentB = b.parent();
+        if (parentA != parentB)
+            return parentA < parentB;
+        if (a.column() != b.column())
+            return a.column() < b.column();
+        return a.row() < b.row();
+    });
+    for (int first = 0; first < evicted.size();) {
+        const QModelIndex parent = evicted[first].parent();
+        int last = first;
+        while (last + 1 < evicted.size() && evicted[last + 1].parent() == parent &&
+               evicted[last + 1].column() == evicted[first].column() && evicted[last + 1].row() == evicted[last].row() + 1)
+            ++last;
+        emit dataChanged(evicted[first], evicted[last]);
+        first = last + 1;
+    }
+}
+
 void Model::logTrace(uint parserId, const Common::LogKind kind, const QString &source, const QString &message)
 {
     Common::LogMessage m(QDateTime::currentDateTime(), kind, source,  message, 0);
@@ -1922,6 +2424,13 @@ QModelIndex Model::messageIndexByUid(const QString &mailboxName, const uint uid)
 /** @short Forget any cached data about number of messages in all mailboxes */
 void Model::invalidateAllMessageCounts()
 {
+    // The server pushes the updated numbers of some mailboxes through NOTIFY, there's no point in polling these
+    QSet<QString> notified;
+    for (auto it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (it->connState != CONN_STATE_LOGOUT && it->notifyState == ParserState::NotifyState::ACTIVE)
+            notified += it->notifyMailboxes;
+    }
+
     QList<TreeItemMailbox*> queue;
     queue.append(m_mailboxes);
     while (!queue.isEmpty()) {
@@ -1930,14 +2439,23 @@ void Model::invalidateAllMessageCounts()
         for (auto it = head->m_children.constBegin() + 1; it != head->m_children.constEnd(); ++it) {
             queue.append(static_cast<TreeItemMailbox*>(*it));
         }
-        TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(head->m_children[0]);
+        if (head != m_mailboxes && notified.contains(head->mailbox()))
+            continue;
+        invalidateMessageCounts(head);
+    }
+}
 
-        if (list->m_numberFetchingStatus == TreeItem::DONE && !head->maintainingTask) {
-            // Ask only for data which were previously available
-            // Also don't mess with a mailbox which is already being kept up-to-date because it's selected.
-            list->m_numberFetchingStatus = TreeItem::NONE;
-            emitMessageCountChanged(head);
-        }
+/** @short Forget the message counts of a single mailbox so that they get requested again when needed */
+void Model::invalidateMessageCounts(TreeItemMailbox *mailbox)
+{
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(mailbox->m_children[0]);
+    Q_ASSERT(list);
+
+    if (list->m_numberFetchingStatus == TreeItem::DONE && !mailbox->maintainingTask) {
+        // Ask only for data which were previously available
+        // Also don't mess with a mailbox which is already being kept up-to-date because it's selected.
+        list->m_numberFetchingStatus = TreeItem::NONE;
+        emitMessageCountChanged(mailbox);
     }
 }
 
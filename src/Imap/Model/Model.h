@@ -78,6 +78,10 @@ class SystemNetworkWatcher;
 
 class ImapTask;
 class KeepMailboxOpenTask;
+class NotificationConnectionTask;
+class RefreshMessageCountsTask;
+class SessionTraceWriter;
+class TaskTraceWriter;
 class TaskPresentationModel;
 template <typename SourceModel> class SubtreeClassSpecificItem;
 typedef std::unique_ptr<Streams::SocketFactory> SocketFactoryPtr;
@@ -90,6 +94,22 @@ typedef enum { STATE_WAIT_FOR_CONN, /**< Waiting for connection to become active
                STATE_DONE /**< Mailbox is fully synchronized, both UIDs and flags are up to date */
              } MailboxSyncingProgress;
 
+/** @short Counters which describe how well the connections are shared among mailboxes
+
+The Model tries to send all mailbox-specific work through a connection which already has that mailbox open, and only
+re-SELECTs when there is no other choice. These numbers make the result of this effort observable.
+*/
+struct MailboxSelectionStats {
+    /** @short Requests which found their mailbox open while a single connection would have had to switch to it */
+    uint selectsAvoided;
+    /** @short How many times a connection had to switch to another mailbox */
+    uint mailboxSwitches;
+    /** @short How many mailbox sessions got a fresh connection instead of evicting another mailbox */
+    uint newConnections;
+
+    MailboxSelectionStats(): selectsAvoided(0), mailboxSwitches(0), newConnections(0) {}
+};
+
 /** @short A model implementing view of the whole IMAP server */
 class Model: public QAbstractItemModel
 {
@@ -112,6 +132,9 @@ class Model: public QAbstractItemModel
     TaskFactoryPtr m_taskFactory;
     mutable QMap<Parser *,ParserState> m_parsers;
     int m_maxParsers;
+    MailboxSelectionStats m_mailboxSelectionStats;
+    /** @short Name of the mailbox which the last request was routed to, see findTaskResponsibleFor() */
+    QString m_lastRoutedMailbox;
     mutable TreeItemMailbox *m_mailboxes;
     mutable NetworkPolicy m_netPolicy;
     bool m_startTls;
@@ -243,9 +266,52 @@ public:
     */
     void releaseMessageData(const QModelIndex &message);
 
+    /** @short Inform the model about messages which the user can see or is about to see
+
+    The @arg messages shall be listed in the order in which they are interesting to the user -- the visible ones first,
+    followed by those which are going to be scrolled into view.  They can come from any proxy model and they shall all
+    belong to a single mailbox.  The @arg view identifies who reports the window; only one view at a time is followed.
+
+    Envelopes of these messages are requested in that order.  Envelope requests which were issued for a previous window
+    of the same view and which have not been sent to the server yet are cancelled; these messages will be asked for again
+    when somebody needs them.  Requests made by anybody else are left alone.  As long as the view exists, the model does
+    not preload envelopes of messages around each message of that mailbox whose data were requested.
+    */
+    void setMessageFetchWindow(QObject *view, const QModelIndexList &messages);
+
     /** @short Return a list of capabilities which are supported by the server */
     QStringList capabilities() const;
 
+    /** @short Per-connection statistics about command latency, traffic volume and queue depth
+
+    Each item is a QVariantMap describing one live connection; see ConnectionMetrics::toVariantMap() for the
+    traffic-related keys.
+    */
+    QVariantList connectionMetrics() const;
+
+    /** @short Approximate heap usage of each known mailbox, the biggest ones first
+
+    Each item is a QVariantMap with the mailbox name, its memory usage in bytes as reported by the
+    RoleMailboxMemoryUsage, the number of messages and the number of messages whose metadata are loaded.
+    */
+    QVariantList memoryUsage() const;
+
+    /** @short Limit the amount of memory occupied by the downloaded data of message parts
+
+    Once the part data exceed @arg bytes, the least recently used parts whose data can be loaded from the cache
+    again are dropped from memory.  They go back to the state in which the next access reads them from the cache.
+    Parts of the messages passed to pinMessageData() are always kept.  Zero disables the limit.
+    */
+    void setPartDataBudget(const quint64 bytes);
+    quint64 partDataBudget() const;
+
+    /** @short Keep all part data of the @arg message in memory regardless of the budget
+
+    Each call has to be balanced by a call to unpinMessageData(); the pins nest.
+    */
+    void pinMessageData(const QModelIndex &message);
+    void unpinMessageData(const QModelIndex &message);
+
     /** @short Log an IMAP-related message */
     void logTrace(uint parserId, const Common::LogKind kind, const QString &source, const QString &message);
     void logTrace(const QModelIndex &relevantIndex, const Common::LogKind kind, const QString &source, const QString &message);
@@ -287,6 +353,32 @@ public:
 
     void setNumberRefreshInterval(const int interval);
 
+    /** @short Merge the per-message dataChanged() signals caused by FETCH responses into contiguous ranges
+
+    When enabled (which is the default), messages updated by the FETCH responses are collected while a batch of responses
+    is being processed, and a single dataChanged() is emitted for each contiguous range of rows once the batch is over.
+    When disabled, each updated message is reported immediately, which is what some unit tests rely on.
+    */
+    void setDataChangedCoalescing(const bool enabled);
+
+    /** @short Statistics about reusing of the already opened mailboxes */
+    MailboxSelectionStats mailboxSelectionStats() const { return m_mailboxSelectionStats; }
+
+    /** @short Record the traffic of all connections into the specified trace
+
+    The Model takes ownership of the @arg trace. Pass a null pointer to stop recording. Only the data which are
+    received or sent after this call are recorded, so this shall be called before the first connection is made
+    in order to obtain a trace which is suitable for replaying.
+    */
+    void setSessionTrace(SessionTraceWriter *trace);
+
+    /** @short Record the lifecycle of the tasks into the specified trace
+
+    The Model takes ownership of the @arg trace. Pass a null pointer to stop recording. Only the tasks which are
+    created after this call are recorded.
+    */
+    void setTaskTrace(TaskTraceWriter *trace);
+
 public slots:
     /** @short Ask for an updated list of mailboxes on the server */
     void reloadMailboxList();
@@ -316,6 +408,12 @@ private slots:
     /** @short Helper for low-level state change propagation */
     void handleSocketStateChanged(Imap::Parser *parser, Imap::ConnectionState state);
 
+    /** @short Emit the dataChanged() signals which were postponed by notifyMessageChanged() */
+    void flushPendingDataChanged();
+
+    /** @short Drop the least recently used part data from memory until they fit into the budget again */
+    void evictPartData();
+
     /** @short The parser has received a full line */
     void slotParserLineReceived(Imap::Parser *parser, const QByteArray &line);
 
@@ -328,6 +426,10 @@ private slots:
     /** @short A maintaining task is about to die */
     void slotTaskDying(QObject *obj);
 
+    /** @short Open the dedicated connection for receiving mailbox updates, if configured to do so */
+    void startNotificationConnection();
+    void slotNotificationConnectionLost();
+
     void setImapAuthError(const QString &error);
 
 signals:
@@ -454,6 +556,9 @@ private:
     friend class KeepMailboxOpenTask;
     friend class OpenConnectionTask;
     friend class GetAnyConnectionTask;
+    friend class NotificationConnectionTask;
+    friend class ParallelFetchConnectionTask;
+    friend class RefreshMessageCountsTask;
     friend class IdTask;
     friend class Fake_ListChildMailboxesTask;
     friend class Fake_OpenConnectionTask;
@@ -488,6 +593,7 @@ private:
     typedef enum {PRELOAD_PER_POLICY, PRELOAD_DISABLED} PreloadingMode;
 
     void askForMsgMetadata(TreeItemMessage *item, PreloadingMode preloadMode);
+    bool hasMessageFetchWindow(TreeItemMailbox *mailbox);
     void askForMsgPart(TreeItemPart *item, bool onlyFromCache=false);
 
     void finalizeList(Parser *parser, TreeItemMailbox *const mailboxPtr);
@@ -501,6 +607,9 @@ private:
     TreeItem *translatePtr(const QModelIndex &index) const;
 
     void emitMessageCountChanged(TreeItemMailbox *const mailbox);
+    void invalidateMessageCounts(TreeItemMailbox *mailbox);
+    void notifyMessageChanged(TreeItemMessage *message);
+    void notifyMessageCountChanged(TreeItemMailbox *mailbox);
 
     TreeItemMailbox *findMailboxByName(const QString &name) const;
     TreeItemMailbox *findMailboxByName(const QString &name, const TreeItemMailbox *const root) const;
@@ -515,6 +624,8 @@ private:
     /** @short Return a corresponding KeepMailboxOpenTask for a given mailbox */
     KeepMailboxOpenTask *findTaskResponsibleFor(const QModelIndex &mailbox);
     KeepMailboxOpenTask *findTaskResponsibleFor(TreeItemMailbox *mailboxPtr);
+    /** @short Pick a connection which shall be used for opening another mailbox, or return 0 to open a new one */
+    Parser *findConnectionForMailboxSwitch();
 
     /** @short Find a mailbox which is expected to be common for all passed items
 
@@ -548,6 +659,11 @@ private:
 
     void responseReceived(const QMap<Parser *,ParserState>::iterator it);
 
+    /** @short Account for the data of a message part which were just loaded into memory */
+    void partDataLoaded(TreeItemPart *part);
+    /** @short Remember that somebody has just used the data of a message part */
+    void notePartDataAccess(TreeItemPart *part);
+
     /** @short Remove deleted Tasks from the activeTasks list */
     void removeDeletedTasks(const QList<ImapTask *> &deletedTasks, QList<ImapTask *> &activeTasks);
 
@@ -572,9 +688,51 @@ private:
     QString m_imapAuthError;
 
     QTimer *m_periodicMailboxNumbersRefresh;
+    /** @short A pending refresh which will ask for the numbers of all mailboxes at once */
+    QPointer<RefreshMessageCountsTask> m_messageCountsRefresh;
+    /** @short The connection which sits in IDLE or NOTIFY to report changes as they happen */
+    QPointer<NotificationConnectionTask> m_notificationConnection;
 
     QStringList m_capabilitiesBlacklist;
 
+    /** @short Should the dataChanged() about messages be merged into ranges? */
+    bool m_coalesceDataChanged;
+    /** @short The view which tells us what messages to prefetch, see setMessageFetchWindow() */
+    QPointer<QObject> m_messageFetchWindowOwner;
+    /** @short The mailbox whose messages are shown by the m_messageFetchWindowOwner */
+    QPersistentModelIndex m_messageFetchWindowMailbox;
+    /** @short UIDs whose envelopes were requested on behalf of the fetch window and are still waiting in the queue */
+    QSet<uint> m_messageFetchWindowRequests;
+    /** @short Messages whose dataChanged() is still pending, grouped by their TreeItemMsgList */
+    QHash<TreeItemMsgList *, QVector<TreeItemMessage *>> m_pendingChangedMessages;
+    /** @short Mailboxes whose message counts shall be reported along with the pending dataChanged() */
+    QVector<TreeItemMailbox *> m_pendingMessageCountChanges;
+    /** @short Make sure that the postponed dataChanged() get emitted even outside of the response processing */
+    QTimer *m_pendingDataChangedTimer;
+    /** @short Where to record the IMAP traffic to, if anywhere */
+    QPointer<SessionTraceWriter> m_sessionTrace;
+    /** @short Where to record the lifecycle of the tasks to, if anywhere */
+    QPointer<TaskTraceWriter> m_taskTrace;
+    /** @short Maximal size of the part data kept in memory, or zero for no limit */
+    quint64 m_partDataBudget;
+    /** @short Upper estimate of the size of the part data in memory; the parts which got deleted are not subtracted */
+    quint64 m_partDataEstimate;
+    /** @short The m_partDataEstimate above which the next evictPartData() runs
+
+    This is the budget itself unless the last pass could not get down to its target, e.g. due to the pinned messages or the data
+    which are not in the cache yet. In that case, the data have to grow by the usual headroom before another walk through
+    the whole tree is worth it.
+    */
+    quint64 m_partDataEvictionThreshold;
+    /** @short Source of the timestamps of the TreeItemPart::m_lastAccess */
+    quint64 m_partDataAccessCounter;
+    /** @short Messages whose part data shall stay in memory, once per each pinMessageData() */
+    QList<QPersistentModelIndex> m_pinnedMessages;
+    /** @short Run the evictPartData() once the current event is processed */
+    QTimer *m_partDataEvictionTimer;
+    /** @short Delays (re)opening of the m_notificationConnection */
+    QTimer *m_notificationConnectionTimer;
+
 protected slots:
     void responseReceived();
     void responseReceived(Imap::Parser *parser);
@@ -261,6 +261,7 @@ QVariant MsgListModel::data(const QModelIndex &proxyIndex, int role) const
     case RoleMessageHeaderListPost:
     case RoleMessageHeaderListPostNo:
     case RoleMessageHasAttachments:
+    case RoleMessageMemoryUsage:
         return dynamic_cast<TreeItemMessage *>(Model::realTreeItem(
                 proxyIndex))->data(static_cast<Model *>(sourceModel()), role);
     default:
@@ -26,6 +26,7 @@
 #include "ItemRoles.h"
 #include "Model.h"
 #include "SubtreeModel.h"
+#include "Utils.h"
 #include "Imap/Network/MsgPartNetAccessManager.h"
 
 namespace Imap
@@ -229,11 +230,10 @@ void OneMessageModel::setMarkedRead(const bool marked)
 
 void OneMessageModel::handleModelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
-    Q_ASSERT(topLeft.row() == bottomRight.row());
     Q_ASSERT(topLeft.parent() == bottomRight.parent());
     Q_ASSERT(topLeft.model() == bottomRight.model());
 
-    if (m_message.isValid() && topLeft == m_message)
+    if (isIndexInRange(m_message, topLeft, bottomRight))
         emit flagsChanged();
 }
 
@@ -24,6 +24,7 @@
 #define IMAP_MODEL_PARSERSTATE_H
 
 #include <QPointer>
+#include <QSet>
 #include "../ConnectionState.h"
 #include "../Parser/Parser.h"
 
@@ -55,6 +56,25 @@ struct ParserState {
     /** @short Is the connection currently being processed? */
     int processingDepth;
 
+    /** @short What is this connection used for */
+    enum class Purpose {
+        GENERIC, /**< @short A regular connection which can be used by any task */
+        PARALLEL_FETCH, /**< @short A helper for downloading data from a mailbox maintained elsewhere, see ParallelFetchConnectionTask */
+        NOTIFICATION, /**< @short Stays in IDLE or NOTIFY to report changes, see NotificationConnectionTask */
+    };
+    Purpose purpose;
+
+    /** @short State of the RFC 5465 NOTIFY subscription for mailbox status changes */
+    enum class NotifyState {
+        NOT_REQUESTED, /**< @short Nobody has asked for NOTIFY on this connection yet */
+        REQUESTED, /**< @short The NOTIFY SET has been sent, the server is reporting the initial STATUS */
+        ACTIVE, /**< @short The server pushes STATUS updates for the notifyMailboxes, no need to poll for their counts */
+        FAILED, /**< @short The server has refused our NOTIFY SET, do not try again */
+    };
+    NotifyState notifyState;
+    /** @short Mailboxes covered by the NOTIFY filter, as learned from the initial STATUS sent in reply to NOTIFY SET */
+    QSet<QString> notifyMailboxes;
+
     ParserState(Parser *parser);
     ParserState();
 };
@@ -20,6 +20,7 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "PrettyMsgListModel.h"
+#include <algorithm>
 #include <QFont>
 #include "ItemRoles.h"
 #include "MsgListModel.h"
@@ -34,9 +35,154 @@ namespace Imap
 namespace Mailbox
 {
 
-PrettyMsgListModel::PrettyMsgListModel(QObject *parent): QSortFilterProxyModel(parent), m_hideRead(false)
+PrettyMsgListModel::PrettyMsgListModel(QObject *parent): QAbstractProxyModel(parent), m_threadingModel(0), m_hideRead(false),
+    m_pendingChange(PENDING_NOTHING), m_pendingFirst(0), m_pendingLast(-1), m_displayCache(2000)
 {
-    setDynamicSortFilter(true);
+}
+
+void PrettyMsgListModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    beginResetModel();
+
+    if (this->sourceModel()) {
+        // there's already something, so take care to disconnect all signals
+        this->sourceModel()->disconnect(this);
+    }
+
+    m_threadingModel = qobject_cast<ThreadingMsgListModel *>(sourceModel);
+    Q_ASSERT(m_threadingModel || !sourceModel);
+    QAbstractProxyModel::setSourceModel(sourceModel);
+
+    if (sourceModel) {
+        connect(sourceModel, &QAbstractItemModel::dataChanged, this, &PrettyMsgListModel::handleDataChanged);
+        connect(sourceModel, &QAbstractItemModel::headerDataChanged, this, &QAbstractItemModel::headerDataChanged);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeInserted, this, &PrettyMsgListModel::handleRowsAboutToBeInserted);
+        connect(sourceModel, &QAbstractItemModel::rowsInserted, this, &PrettyMsgListModel::handleRowsInserted);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, &PrettyMsgListModel::handleRowsAboutToBeRemoved);
+        connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, &PrettyMsgListModel::handleRowsRemoved);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeMoved, this, &PrettyMsgListModel::handleRowsAboutToBeMoved);
+        connect(sourceModel, &QAbstractItemModel::rowsMoved, this, &PrettyMsgListModel::handleRowsMoved);
+        connect(sourceModel, &QAbstractItemModel::layoutAboutToBeChanged, this, &PrettyMsgListModel::handleLayoutAboutToBeChanged);
+        connect(sourceModel, &QAbstractItemModel::layoutChanged, this, &PrettyMsgListModel::handleLayoutChanged);
+        connect(sourceModel, &QAbstractItemModel::modelAboutToBeReset, this, &PrettyMsgListModel::handleModelAboutToBeReset);
+        connect(sourceModel, &QAbstractItemModel::modelReset, this, &PrettyMsgListModel::handleModelReset);
+    }
+
+    m_pendingChange = PENDING_NOTHING;
+    m_displayCache.clear();
+    refilter();
+    endResetModel();
+}
+
+QModelIndex PrettyMsgListModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!m_threadingModel || row < 0 || column < 0)
+        return QModelIndex();
+
+    QModelIndex sourceIndex;
+    if (parent.isValid()) {
+        Q_ASSERT(parent.model() == this);
+        sourceIndex = m_threadingModel->index(row, column, mapToSource(parent));
+    } else {
+        if (row >= rowCount())
+            return QModelIndex();
+        sourceIndex = m_threadingModel->index(sourceRowForTopLevel(row), column);
+    }
+
+    if (!sourceIndex.isValid())
+        return QModelIndex();
+
+    return createIndex(row, column, sourceIndex.internalId());
+}
+
+QModelIndex PrettyMsgListModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || !m_threadingModel)
+        return QModelIndex();
+
+    return mapFromSource(m_threadingModel->parent(mapToSource(child)));
+}
+
+QModelIndex PrettyMsgListModel::sibling(int row, int column, const QModelIndex &idx) const
+{
+    return index(row, column, parent(idx));
+}
+
+int PrettyMsgListModel::rowCount(const QModelIndex &parent) const
+{
+    if (!m_threadingModel)
+        return 0;
+
+    if (!parent.isValid())
+        return isFiltering() ? m_acceptedRows.size() : m_threadingModel->rowCount();
+
+    return m_threadingModel->rowCount(mapToSource(parent));
+}
+
+int PrettyMsgListModel::columnCount(const QModelIndex &parent) const
+{
+    if (!m_threadingModel)
+        return 0;
+
+    return m_threadingModel->columnCount(mapToSource(parent));
+}
+
+bool PrettyMsgListModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!m_threadingModel)
+        return false;
+
+    if (!parent.isValid())
+        return rowCount() > 0;
+
+    return m_threadingModel->hasChildren(mapToSource(parent));
+}
+
+QModelIndex PrettyMsgListModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !m_threadingModel)
+        return QModelIndex();
+
+    Q_ASSERT(proxyIndex.model() == this);
+
+    // The internal IDs are shared, so only the row of a top-level item might differ
+    const ThreadNodeInfo *node = m_threadingModel->threading.constFind(proxyIndex.internalId());
+    if (!node)
+        return QModelIndex();
+
+    return m_threadingModel->createIndex(node->offset, proxyIndex.column(), node->internalId);
+}
+
+QModelIndex PrettyMsgListModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid() || !m_threadingModel)
+        return QModelIndex();
+
+    Q_ASSERT(sourceIndex.model() == m_threadingModel);
+
+    int row = sourceIndex.row();
+
+    if (isFiltering()) {
+        const ThreadNodeInfo *node = m_threadingModel->threading.constFind(sourceIndex.internalId());
+        if (!node)
+            return QModelIndex();
+
+        // Whole threads are hidden at once, so it's the root which decides
+        const bool isTopLevel = !node->parent;
+        while (node->parent) {
+            node = m_threadingModel->threading.constFind(node->parent);
+            Q_ASSERT(node);
+        }
+
+        QVector<int>::const_iterator it = std::lower_bound(m_acceptedRows.constBegin(), m_acceptedRows.constEnd(), node->offset);
+        if (it == m_acceptedRows.constEnd() || *it != node->offset)
+            return QModelIndex();
+
+        if (isTopLevel)
+            row = it - m_acceptedRows.constBegin();
+    }
+
+    return createIndex(row, sourceIndex.column(), sourceIndex.internalId());
 }
 
 QVariant PrettyMsgListModel::data(const QModelIndex &index, int role) const
@@ -61,46 +207,13 @@ QVariant PrettyMsgListModel::data(const QModelIndex &index, int role) const
         case MsgListModel::FROM:
         case MsgListModel::CC:
         case MsgListModel::BCC:
-        {
-            int backendRole = 0;
-            switch (index.column()) {
-            case MsgListModel::FROM:
-                backendRole = RoleMessageFrom;
-                break;
-            case MsgListModel::TO:
-                backendRole = RoleMessageTo;
-                break;
-            case MsgListModel::CC:
-                backendRole = RoleMessageCc;
-                break;
-            case MsgListModel::BCC:
-                backendRole = RoleMessageBcc;
-                break;
-            }
-            QVariantList items = translated.data(backendRole).toList();
-            if (role == Qt::DisplayRole) {
-                return Imap::Message::MailAddress::prettyList(items, Imap::Message::MailAddress::FORMAT_JUST_NAME);
-            } else {
-                return UiUtils::Formatting::htmlEscaped(Imap::Message::MailAddress::prettyList(items, Imap::Message::MailAddress::FORMAT_READABLE));
-            }
-        }
         case MsgListModel::DATE:
         case MsgListModel::RECEIVED_DATE:
-        {
-            QDateTime res = translated.data(RoleMessageDate).toDateTime();
-            if (role == Qt::ToolTipRole) {
-                // tooltips shall always show the full and complete data
-                return res.toLocalTime().toString(Qt::DefaultLocaleLongDate);
-            }
-            return UiUtils::Formatting::prettyDate(res.toLocalTime());
-        }
         case MsgListModel::SIZE:
         {
-            QVariant size = translated.data(RoleMessageSize);
-            if (!size.isValid()) {
-                return QVariant();
-            }
-            return UiUtils::Formatting::prettySize(size.toULongLong());
+            QString text = role == Qt::DisplayRole ?
+                        cachedDisplayText(translated, index.column()) : formattedText(translated, index.column(), role);
+            return text.isNull() ? QVariant() : QVariant(text);
         }
         case MsgListModel::SUBJECT:
         {
@@ -200,29 +313,411 @@ QVariant PrettyMsgListModel::data(const QModelIndex &index, int role) const
     }
     }
 
-    return QSortFilterProxyModel::data(index, role);
+    return QAbstractProxyModel::data(index, role);
+}
+
+/** @short Format the textual representation of the message's address, date or size column */
+QString PrettyMsgListModel::formattedText(const QModelIndex &translated, const int column, const int role) const
+{
+    switch (column) {
+    case MsgListModel::TO:
+    case MsgListModel::FROM:
+    case MsgListModel::CC:
+    case MsgListModel::BCC:
+    {
+        int backendRole = 0;
+        switch (column) {
+        case MsgListModel::FROM:
+            backendRole = RoleMessageFrom;
+            break;
+        case MsgListModel::TO:
+            backendRole = RoleMessageTo;
+            break;
+        case MsgListModel::CC:
+            backendRole = RoleMessageCc;
+            break;
+        case MsgListModel::BCC:
+            backendRole = RoleMessageBcc;
+            break;
+        }
+        QVariantList items = translated.data(backendRole).toList();
+        if (role == Qt::DisplayRole) {
+            return Imap::Message::MailAddress::prettyList(items, Imap::Message::MailAddress::FORMAT_JUST_NAME);
+        } else {
+            return UiUtils::Formatting::htmlEscaped(Imap::Message::MailAddress::prettyList(items, Imap::Message::MailAddress::FORMAT_READABLE));
+        }
+    }
+    case MsgListModel::DATE:
+    case MsgListModel::RECEIVED_DATE:
+    {
+        QDateTime res = translated.data(RoleMessageDate).toDateTime();
+        if (role == Qt::ToolTipRole) {
+            // tooltips shall always show the full and complete data
+            return res.toLocalTime().toString(Qt::DefaultLocaleLongDate);
+        }
+        return UiUtils::Formatting::prettyDate(res.toLocalTime());
+    }
+    case MsgListModel::SIZE:
+    {
+        QVariant size = translated.data(RoleMessageSize);
+        if (!size.isValid()) {
+            return QString();
+        }
+        return UiUtils::Formatting::prettySize(size.toULongLong());
+    }
+    }
+    return QString();
+}
+
+/** @short Return the formatted text of the DisplayRole, reusing the result of a previous call when possible
+
+The views ask for the same data over and over again while scrolling, so formatting the dates, sizes and addresses each
+time is wasteful. The cached texts are dropped when the message changes and the dates also when their relative formatting
+("today", "this week",...) becomes stale.
+*/
+QString PrettyMsgListModel::cachedDisplayText(const QModelIndex &translated, const int column) const
+{
+    DisplayTexts *texts = m_displayCache.object(translated.internalId());
+    if (!texts) {
+        texts = new DisplayTexts();
+        texts->columns.resize(MsgListModel::COLUMN_COUNT);
+        texts->dateExpiry = 0;
+        m_displayCache.insert(translated.internalId(), texts);
+    }
+
+    const bool isDate = column == MsgListModel::DATE || column == MsgListModel::RECEIVED_DATE;
+    if (isDate && texts->dateExpiry && QDateTime::currentMSecsSinceEpoch() >= texts->dateExpiry) {
+        texts->columns[MsgListModel::DATE].clear();
+        texts->columns[MsgListModel::RECEIVED_DATE].clear();
+        texts->dateExpiry = 0;
+    }
+
+    QString &text = texts->columns[column];
+    if (text.isNull()) {
+        text = formattedText(translated, column, Qt::DisplayRole);
+        if (isDate) {
+            QDateTime expiry = UiUtils::Formatting::prettyDateExpiry(translated.data(RoleMessageDate).toDateTime().toLocalTime());
+            texts->dateExpiry = expiry.isValid() ? expiry.toMSecsSinceEpoch() : 0;
+        }
+    }
+    return text;
+}
+
+QVariant PrettyMsgListModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (sourceModel()) {
+        return sourceModel()->headerData(section, orientation, role);
+    } else {
+        return QVariant();
+    }
+}
+
+QStringList PrettyMsgListModel::mimeTypes() const
+{
+    return sourceModel() ? sourceModel()->mimeTypes() : QStringList();
+}
+
+QMimeData *PrettyMsgListModel::mimeData(const QModelIndexList &indexes) const
+{
+    if (! sourceModel())
+        return 0;
+
+    QModelIndexList translated;
+    Q_FOREACH(const QModelIndex &idx, indexes) {
+        translated << mapToSource(idx);
+    }
+    return sourceModel()->mimeData(translated);
 }
 
 void PrettyMsgListModel::setHideRead(bool value)
 {
+    // The "was unread" state of messages might have changed even if the value stays the same, so refilter anyway
+    beginLayoutChange();
     m_hideRead = value;
-    invalidateFilter();
+    refilter();
+    endLayoutChange();
 }
 
-bool PrettyMsgListModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
+bool PrettyMsgListModel::isFiltering() const
 {
-    if (!m_hideRead)
-        return true;
+    return m_hideRead && m_threadingModel;
+}
 
-    QModelIndex source_index = sourceModel()->index(source_row, 0, source_parent);
+/** @short Decide whether the top-level source row shall be visible */
+bool PrettyMsgListModel::filterAcceptsRow(int sourceRow) const
+{
+    QModelIndex sourceIndex = m_threadingModel->index(sourceRow, 0);
+    return sourceIndex.data(RoleThreadRootWithUnreadMessages).toBool() || sourceIndex.data(RoleMessageWasUnread).toBool();
+}
 
-    for (QModelIndex test = source_index; test.isValid(); test = test.parent())
-        if (test.data(RoleThreadRootWithUnreadMessages).toBool() || test.data(RoleMessageWasUnread).toBool())
-            return true;
+/** @short Rebuild the list of accepted top-level rows from scratch */
+void PrettyMsgListModel::refilter()
+{
+    m_acceptedRows.clear();
+    if (!isFiltering())
+        return;
+
+    const int count = m_threadingModel->rowCount();
+    m_acceptedRows.reserve(count);
+    for (int row = 0; row < count; ++row) {
+        if (filterAcceptsRow(row))
+            m_acceptedRows.append(row);
+    }
+}
 
-    return false;
+bool PrettyMsgListModel::isVisibleSourceParent(const QModelIndex &sourceParent) const
+{
+    return !sourceParent.isValid() || mapFromSource(sourceParent).isValid();
+}
+
+int PrettyMsgListModel::sourceRowForTopLevel(int proxyRow) const
+{
+    return isFiltering() ? m_acceptedRows[proxyRow] : proxyRow;
 }
 
+void PrettyMsgListModel::handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (!topLeft.isValid() || !bottomRight.isValid())
+        return;
+
+    Q_ASSERT(topLeft.parent() == bottomRight.parent());
+    const QModelIndex sourceParent = topLeft.parent();
+
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        m_displayCache.remove(topLeft.sibling(row, 0).internalId());
+    }
+
+    if (sourceParent.isValid() || !isFiltering()) {
+        // Nested rows are never filtered on their own
+        QModelIndex first = mapFromSource(topLeft);
+        QModelIndex last = mapFromSource(bottomRight);
+        if (first.isValid() && last.isValid())
+            emit dataChanged(first, last);
+        return;
+    }
+
+    // The changed top-level rows might start or stop passing the filter. Those which remain visible are reported in
+    // contiguous runs of the proxy rows.
+    int runFirst = -1, runLast = -1;
+    auto flushRun = [this, &runFirst, &runLast, &topLeft, &bottomRight]() {
+        if (runFirst != -1)
+            emit dataChanged(index(runFirst, topLeft.column()), index(runLast, bottomRight.column()));
+        runFirst = runLast = -1;
+    };
+
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        QVector<int>::iterator it = std::lower_bound(m_acceptedRows.begin(), m_acceptedRows.end(), row);
+        const int proxyRow = it - m_acceptedRows.begin();
+        const bool wasVisible = it != m_acceptedRows.end() && *it == row;
+        const bool isVisible = filterAcceptsRow(row);
+
+        if (isVisible && wasVisible) {
+            if (runFirst != -1 && runLast == proxyRow - 1) {
+                runLast = proxyRow;
+            } else {
+                flushRun();
+                runFirst = runLast = proxyRow;
+            }
+        } else if (isVisible) {
+            flushRun();
+            beginInsertRows(QModelIndex(), proxyRow, proxyRow);
+            m_acceptedRows.insert(proxyRow, row);
+            endInsertRows();
+        } else if (wasVisible) {
+            flushRun();
+            beginRemoveRows(QModelIndex(), proxyRow, proxyRow);
+            m_acceptedRows.remove(proxyRow);
+            endRemoveRows();
+        }
+    }
+    flushRun();
+}
+
+void PrettyMsgListModel::handleRowsAboutToBeInserted(const QModelIndex &parent, int start, int end)
+{
+    if (!parent.isValid() && isFiltering()) {
+        // Whether the new rows pass the filter is only known once they are present in the source model
+        m_pendingChange = PENDING_TOPLEVEL_INSERT;
+    } else if (isVisibleSourceParent(parent)) {
+        beginInsertRows(mapFromSource(parent), start, end);
+        m_pendingChange = PENDING_END_INSERT;
+    } else {
+        m_pendingChange = PENDING_NOTHING;
+    }
+}
+
+void PrettyMsgListModel::handleRowsInserted(const QModelIndex &parent, int start, int end)
+{
+    Q_UNUSED(parent);
+
+    switch (m_pendingChange) {
+    case PENDING_END_INSERT:
+        endInsertRows();
+        break;
+    case PENDING_TOPLEVEL_INSERT:
+    {
+        Q_ASSERT(!parent.isValid());
+        const int count = end - start + 1;
+        QVector<int>::iterator it = std::lower_bound(m_acceptedRows.begin(), m_acceptedRows.end(), start);
+        const int proxyRow = it - m_acceptedRows.begin();
+        for (; it != m_acceptedRows.end(); ++it)
+            *it += count;
+
+        QVector<int> accepted;
+        for (int row = start; row <= end; ++row) {
+            if (filterAcceptsRow(row))
+                accepted.append(row);
+        }
+
+        if (!accepted.isEmpty()) {
+            beginInsertRows(QModelIndex(), proxyRow, proxyRow + accepted.size() - 1);
+            m_acceptedRows.insert(proxyRow, accepted.size(), 0);
+            std::copy(accepted.constBegin(), accepted.constEnd(), m_acceptedRows.begin() + proxyRow);
+            endInsertRows();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    m_pendingChange = PENDING_NOTHING;
+}
+
+void PrettyMsgListModel::handleRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+{
+    // The internal IDs might get reused
+    m_displayCache.clear();
+
+    if (!parent.isValid() && isFiltering()) {
+        QVector<int>::const_iterator first = std::lower_bound(m_acceptedRows.constBegin(), m_acceptedRows.constEnd(), start);
+        QVector<int>::const_iterator last = std::upper_bound(first, m_acceptedRows.constEnd(), end);
+        m_pendingFirst = first - m_acceptedRows.constBegin();
+        m_pendingLast = last - m_acceptedRows.constBegin() - 1;
+        if (m_pendingFirst <= m_pendingLast)
+            beginRemoveRows(QModelIndex(), m_pendingFirst, m_pendingLast);
+        m_pendingChange = PENDING_TOPLEVEL_REMOVE;
+    } else if (isVisibleSourceParent(parent)) {
+        beginRemoveRows(mapFromSource(parent), start, end);
+        m_pendingChange = PENDING_END_REMOVE;
+    } else {
+        m_pendingChange = PENDING_NOTHING;
+    }
+}
+
+void PrettyMsgListModel::handleRowsRemoved(const QModelIndex &parent, int start, int end)
+{
+    Q_UNUSED(parent);
+
+    switch (m_pendingChange) {
+    case PENDING_END_REMOVE:
+        endRemoveRows();
+        break;
+    case PENDING_TOPLEVEL_REMOVE:
+    {
+        const int count = end - start + 1;
+        m_acceptedRows.erase(m_acceptedRows.begin() + m_pendingFirst, m_acceptedRows.begin() + m_pendingLast + 1);
+        for (QVector<int>::iterator it = m_acceptedRows.begin() + m_pendingFirst; it != m_acceptedRows.end(); ++it)
+            *it -= count;
+        if (m_pendingFirst <= m_pendingLast)
+            endRemoveRows();
+        break;
+    }
+    default:
+        break;
+    }
+    m_pendingChange = PENDING_NOTHING;
+}
+
+void PrettyMsgListModel::handleRowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                                  const QModelIndex &destinationParent, int destinationRow)
+{
+    const bool sourceVisible = isVisibleSourceParent(sourceParent);
+    const bool destinationVisible = isVisibleSourceParent(destinationParent);
+
+    if (!sourceVisible && !destinationVisible) {
+        m_pendingChange = PENDING_NOTHING;
+        return;
+    }
+
+    // When nothing is filtered or when the move happens between visible threads, the row numbers are the same as in the
+    // source model. Everything else would need a proper translation, so just let the views re-read everything.
+    if (sourceVisible && destinationVisible && (!isFiltering() || (sourceParent.isValid() && destinationParent.isValid()))) {
+        if (beginMoveRows(mapFromSource(sourceParent), sourceStart, sourceEnd, mapFromSource(destinationParent), destinationRow)) {
+            m_pendingChange = PENDING_END_MOVE;
+            return;
+        }
+    }
+
+    beginLayoutChange();
+    m_pendingChange = PENDING_LAYOUT;
+}
+
+void PrettyMsgListModel::handleRowsMoved()
+{
+    switch (m_pendingChange) {
+    case PENDING_END_MOVE:
+        endMoveRows();
+        break;
+    case PENDING_LAYOUT:
+        refilter();
+        endLayoutChange();
+        break;
+    default:
+        break;
+    }
+    m_pendingChange = PENDING_NOTHING;
+}
+
+void PrettyMsgListModel::handleLayoutAboutToBeChanged()
+{
+    beginLayoutChange();
+}
+
+void PrettyMsgListModel::handleLayoutChanged()
+{
+    refilter();
+    endLayoutChange();
+}
+
+void PrettyMsgListModel::handleModelAboutToBeReset()
+{
+    beginResetModel();
+}
+
+void PrettyMsgListModel::handleModelReset()
+{
+    m_pendingChange = PENDING_NOTHING;
+    m_displayCache.clear();
+    refilter();
+    endResetModel();
+}
+
+/** @short Remember where the persistent indexes point to in the source model */
+void PrettyMsgListModel::beginLayoutChange()
+{
+    emit layoutAboutToBeChanged();
+    m_displayCache.clear();
+    m_layoutChangePersistentIndexes = persistentIndexList();
+    m_layoutChangeSourceIndexes.clear();
+    m_layoutChangeSourceIndexes.reserve(m_layoutChangePersistentIndexes.size());
+    Q_FOREACH(const QModelIndex &proxyIndex, m_layoutChangePersistentIndexes) {
+        m_layoutChangeSourceIndexes << QPersistentModelIndex(mapToSource(proxyIndex));
+    }
+}
+
+/** @short Point the persistent indexes to the new locations of the items they used to refer to */
+void PrettyMsgListModel::endLayoutChange()
+{
+    QModelIndexList updatedIndexes;
+    updatedIndexes.reserve(m_layoutChangeSourceIndexes.size());
+    Q_FOREACH(const QPersistentModelIndex &sourceIndex, m_layoutChangeSourceIndexes) {
+        updatedIndexes << mapFromSource(sourceIndex);
+    }
+    changePersistentIndexList(m_layoutChangePersistentIndexes, updatedIndexes);
+    m_layoutChangePersistentIndexes.clear();
+    m_layoutChangeSourceIndexes.clear();
+    emit layoutChanged();
+}
 
 void PrettyMsgListModel::sort(int column, Qt::SortOrder order)
 {
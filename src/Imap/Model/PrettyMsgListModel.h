@@ -22,7 +22,9 @@
 #ifndef PRETTYMSGLISTMODEL_H
 #define PRETTYMSGLISTMODEL_H
 
-#include <QSortFilterProxyModel>
+#include <QAbstractProxyModel>
+#include <QCache>
+#include <QVector>
 #include "Imap/Model/MailboxModel.h"
 
 namespace Imap
@@ -31,22 +33,107 @@ namespace Imap
 namespace Mailbox
 {
 
-/** @short A pretty proxy model which increases sexiness of the (Threaded)MsgListModel */
-class PrettyMsgListModel: public QSortFilterProxyModel
+class ThreadingMsgListModel;
+
+/** @short A pretty proxy model which increases sexiness of the (Threaded)MsgListModel
+
+This proxy works on top of the ThreadingMsgListModel only.  The sorting is delegated to that model, so the only
+reordering done here is hiding of threads when the user does not want to see read messages.
+
+Whole threads are either shown or hidden, which means that only the top-level rows have to be filtered.  The proxy keeps
+a single sorted vector of the accepted top-level source rows and adjusts it in place when the source model inserts,
+removes or changes rows, so there is no need to re-filter everything on each change.  The nested rows are passed
+through as-is.  The proxy indexes share the internal IDs with the indexes of the source model.
+*/
+class PrettyMsgListModel: public QAbstractProxyModel
 {
     Q_OBJECT
 public:
     explicit PrettyMsgListModel(QObject *parent=0);
+    virtual void setSourceModel(QAbstractItemModel *sourceModel);
+
+    virtual QModelIndex index(int row, int column, const QModelIndex &parent=QModelIndex()) const;
+    virtual QModelIndex parent(const QModelIndex &child) const;
+    virtual QModelIndex sibling(int row, int column, const QModelIndex &idx) const;
+    virtual int rowCount(const QModelIndex &parent=QModelIndex()) const;
+    virtual int columnCount(const QModelIndex &parent=QModelIndex()) const;
+    virtual bool hasChildren(const QModelIndex &parent=QModelIndex()) const;
+    virtual QModelIndex mapToSource(const QModelIndex &proxyIndex) const;
+    virtual QModelIndex mapFromSource(const QModelIndex &sourceIndex) const;
     virtual QVariant data(const QModelIndex &index, int role) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role=Qt::DisplayRole) const;
+    virtual QStringList mimeTypes() const;
+    virtual QMimeData *mimeData(const QModelIndexList &indexes) const;
     void setHideRead(bool value);
-    virtual bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const;
     virtual void sort(int column, Qt::SortOrder order);
 
 signals:
     void sortingPreferenceChanged(int column, Qt::SortOrder order);
 
+private slots:
+    void handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void handleRowsAboutToBeInserted(const QModelIndex &parent, int start, int end);
+    void handleRowsInserted(const QModelIndex &parent, int start, int end);
+    void handleRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
+    void handleRowsRemoved(const QModelIndex &parent, int start, int end);
+    void handleRowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                  const QModelIndex &destinationParent, int destinationRow);
+    void handleRowsMoved();
+    void handleLayoutAboutToBeChanged();
+    void handleLayoutChanged();
+    void handleModelAboutToBeReset();
+    void handleModelReset();
+
 private:
+    QString formattedText(const QModelIndex &translated, const int column, const int role) const;
+    QString cachedDisplayText(const QModelIndex &translated, const int column) const;
+    bool filterAcceptsRow(int sourceRow) const;
+    void refilter();
+    bool isFiltering() const;
+    bool isVisibleSourceParent(const QModelIndex &sourceParent) const;
+    int sourceRowForTopLevel(int proxyRow) const;
+    void beginLayoutChange();
+    void endLayoutChange();
+
+    /** @short What shall happen when the source model finishes its current change */
+    typedef enum {
+        PENDING_NOTHING, /**< @short No change is pending, or it doesn't affect any visible rows */
+        PENDING_END_INSERT, /**< @short Pass the insertion through */
+        PENDING_TOPLEVEL_INSERT, /**< @short Top-level rows are being inserted and they have to be filtered */
+        PENDING_END_REMOVE, /**< @short Pass the removal through */
+        PENDING_TOPLEVEL_REMOVE, /**< @short Some top-level rows are being removed */
+        PENDING_END_MOVE, /**< @short Pass the move through */
+        PENDING_LAYOUT /**< @short The change is too complex, the whole mapping gets rebuilt */
+    } PendingChange;
+
+    ThreadingMsgListModel *m_threadingModel;
     bool m_hideRead;
+    /** @short Rows of the accepted top-level items of the source model, in an ascending order
+
+    This is only used when the rows are being filtered. The position within this vector is the row number of the proxy.
+    */
+    QVector<int> m_acceptedRows;
+
+    PendingChange m_pendingChange;
+    /** @short Range of m_acceptedRows which refers to the top-level rows being removed */
+    int m_pendingFirst, m_pendingLast;
+
+    QModelIndexList m_layoutChangePersistentIndexes;
+    QList<QPersistentModelIndex> m_layoutChangeSourceIndexes;
+
+    /** @short Formatted texts of a single message, as shown in the columns of the message list */
+    struct DisplayTexts {
+        /** @short Indexed by the column; a null string has not been formatted yet */
+        QVector<QString> columns;
+        /** @short When do the formatted dates get stale, in msecs since the epoch; zero means never */
+        qint64 dateExpiry;
+    };
+    /** @short The most recently shown formatted texts, indexed by the internal ID of the message
+
+    The source model only shows one mailbox at a time and its internal IDs are only stable until the rows get removed or
+    reshuffled, so this cache is flushed upon these events.
+    */
+    mutable QCache<quintptr, DisplayTexts> m_displayCache;
 };
 
 }
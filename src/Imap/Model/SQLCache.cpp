@@ -24,6 +24,7 @@
 #include <QSqlError>
 #include <QSqlRecord>
 #include <QTimer>
+#include "Common/Profiling.h"
 #include "Common/SqlTransactionAutoAborter.h"
 
 //#define CACHE_DEBUG
@@ -468,6 +469,7 @@ void SQLCache::emitError(const QString &message) const
 
 QList<MailboxMetadata> SQLCache::childMailboxes(const QString &mailbox) const
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::childMailboxes");
     QList<MailboxMetadata> res;
     queryChildMailboxes.bindValue(0, mailboxName(mailbox));
     if (! queryChildMailboxes.exec()) {
@@ -492,6 +494,7 @@ QList<MailboxMetadata> SQLCache::childMailboxes(const QString &mailbox) const
 
 bool SQLCache::childMailboxesFresh(const QString &mailbox) const
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::childMailboxesFresh");
     queryChildMailboxesFresh.bindValue(0, mailboxName(mailbox));
     if (! queryChildMailboxesFresh.exec()) {
         emitError(tr("Query queryChildMailboxesFresh failed"), queryChildMailboxesFresh);
@@ -502,6 +505,7 @@ bool SQLCache::childMailboxesFresh(const QString &mailbox) const
 
 void SQLCache::setChildMailboxes(const QString &mailbox, const QList<MailboxMetadata> &data)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::setChildMailboxes");
 #ifdef CACHE_DEBUG
     qDebug() << "Setting child mailboxes for" << mailbox;
 #endif
@@ -534,6 +538,7 @@ void SQLCache::setChildMailboxes(const QString &mailbox, const QList<MailboxMeta
 
 SyncState SQLCache::mailboxSyncState(const QString &mailbox) const
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::mailboxSyncState");
     SyncState res;
     queryMailboxSyncState.bindValue(0, mailboxName(mailbox));
     if (! queryMailboxSyncState.exec()) {
@@ -551,6 +556,7 @@ SyncState SQLCache::mailboxSyncState(const QString &mailbox) const
 
 void SQLCache::setMailboxSyncState(const QString &mailbox, const SyncState &state)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::setMailboxSyncState");
 #ifdef CACHE_DEBUG
     qDebug() << "Setting sync state for" << mailbox;
 #endif
@@ -569,6 +575,7 @@ void SQLCache::setMailboxSyncState(const QString &mailbox, const SyncState &stat
 
 Imap::Uids SQLCache::uidMapping(const QString &mailbox) const
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::uidMapping");
     Imap::Uids res;
     queryUidMapping.bindValue(0, mailboxName(mailbox));
     if (! queryUidMapping.exec()) {
@@ -586,6 +593,7 @@ Imap::Uids SQLCache::uidMapping(const QString &mailbox) const
 
 void SQLCache::setUidMapping(const QString &mailbox, const Imap::Uids &seqToUid)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::setUidMapping");
 #ifdef CACHE_DEBUG
     qDebug() << "Setting UID mapping for" << mailbox;
 #endif
@@ -603,6 +611,7 @@ void SQLCache::setUidMapping(const QString &mailbox, const Imap::Uids &seqToUid)
 
 void SQLCache::clearUidMapping(const QString &mailbox)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::clearUidMapping");
 #ifdef CACHE_DEBUG
     qDebug() << "Clearing UID mapping for" << mailbox;
 #endif
@@ -615,6 +624,7 @@ void SQLCache::clearUidMapping(const QString &mailbox)
 
 void SQLCache::clearAllMessages(const QString &mailbox)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::clearAllMessages");
 #ifdef CACHE_DEBUG
     qDebug() << "Clearing all messages from" << mailbox;
 #endif
@@ -640,6 +650,7 @@ void SQLCache::clearAllMessages(const QString &mailbox)
 
 void SQLCache::clearMessage(const QString mailbox, uint uid)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::clearMessage");
 #ifdef CACHE_DEBUG
     qDebug() << "Clearing message" << uid << "from" << mailbox;
 #endif
@@ -663,6 +674,7 @@ void SQLCache::clearMessage(const QString mailbox, uint uid)
 
 QStringList SQLCache::msgFlags(const QString &mailbox, const uint uid) const
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::msgFlags");
     QStringList res;
     queryMessageFlags.bindValue(0, mailboxName(mailbox));
     queryMessageFlags.bindValue(1, uid);
@@ -681,6 +693,7 @@ QStringList SQLCache::msgFlags(const QString &mailbox, const uint uid) const
 
 void SQLCache::setMsgFlags(const QString &mailbox, const uint uid, const QStringList &flags)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::setMsgFlags");
 #ifdef CACHE_DEBUG
     qDebug() << "Updating flags for" << mailbox << uid;
 #endif
@@ -699,6 +712,7 @@ void SQLCache::setMsgFlags(const QString &mailbox, const uint uid, const QString
 
 AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbox, uint uid) const
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::messageMetadata");
     AbstractCache::MessageDataBundle res;
     queryMessageMetadata.bindValue(0, mailboxName(mailbox));
     queryMessageMetadata.bindValue(1, uid);
@@ -712,6 +726,12 @@ AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbo
         stream.setVersion(streamVersion);
         stream >> res.envelope >> res.internalDate >> res.size >> res.serializedBodyStructure >> res.hdrReferences
                   >> res.hdrListPost >> res.hdrListPostNo;
+        if (!stream.atEnd()) {
+            // The attachment flag was appended later on, so it might not be present in older records
+            quint8 attachments;
+            stream >> attachments;
+            res.attachments = static_cast<MessageDataBundle::AttachmentState>(attachments);
+        }
 
         if (m_updateAccessIfOlder) {
             int lastAccessTimestamp = queryMessageMetadata.value(1).toInt();
@@ -732,6 +752,7 @@ AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbo
 
 void SQLCache::setMessageMetadata(const QString &mailbox, const uint uid, const MessageDataBundle &metadata)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::setMessageMetadata");
 #ifdef CACHE_DEBUG
     qDebug() << "Setting message metadata for" << uid << mailbox;
 #endif
@@ -743,7 +764,8 @@ void SQLCache::setMessageMetadata(const QString &mailbox, const uint uid, const
     QDataStream stream(&buf, QIODevice::ReadWrite);
     stream.setVersion(streamVersion);
     stream << metadata.envelope << metadata.internalDate << metadata.size << metadata.serializedBodyStructure
-           << metadata.hdrReferences << metadata.hdrListPost << metadata.hdrListPostNo;
+           << metadata.hdrReferences << metadata.hdrListPost << metadata.hdrListPostNo
+           << static_cast<quint8>(metadata.attachments);
     querySetMessageMetadata.bindValue(2, qCompress(buf));
     querySetMessageMetadata.bindValue(3, accessingThresholdDate.daysTo(QDate::currentDate()));
     if (! querySetMessageMetadata.exec()) {
@@ -753,6 +775,7 @@ void SQLCache::setMessageMetadata(const QString &mailbox, const uint uid, const
 
 QByteArray SQLCache::messagePart(const QString &mailbox, const uint uid, const QByteArray &partId) const
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::messagePart");
     QByteArray res;
     queryMessagePart.bindValue(0, mailboxName(mailbox));
     queryMessagePart.bindValue(1, uid);
@@ -770,6 +793,7 @@ QByteArray SQLCache::messagePart(const QString &mailbox, const uint uid, const Q
 
 void SQLCache::setMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::setMsgPart");
 #ifdef CACHE_DEBUG
     qDebug() << "Saving message part" << partId << uid << mailbox;
 #endif
@@ -785,6 +809,7 @@ void SQLCache::setMsgPart(const QString &mailbox, const uint uid, const QByteArr
 
 void SQLCache::forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::forgetMessagePart");
 #ifdef CACHE_DEBUG
     qDebug() << "Forgetting message part" << partId << uid << mailbox;
 #endif
@@ -799,6 +824,7 @@ void SQLCache::forgetMessagePart(const QString &mailbox, const uint uid, const Q
 
 QVector<Imap::Responses::ThreadingNode> SQLCache::messageThreading(const QString &mailbox)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::messageThreading");
     QVector<Imap::Responses::ThreadingNode> res;
     queryMessageThreading.bindValue(0, mailboxName(mailbox));
     if (! queryMessageThreading.exec()) {
@@ -815,6 +841,7 @@ QVector<Imap::Responses::ThreadingNode> SQLCache::messageThreading(const QString
 
 void SQLCache::setMessageThreading(const QString &mailbox, const QVector<Imap::Responses::ThreadingNode> &threading)
 {
+    TROJITA_PROFILE_SCOPE("SQLCache::setMessageThreading");
 #ifdef CACHE_DEBUG
     qDebug() << "Setting threading for" << mailbox;
 #endif
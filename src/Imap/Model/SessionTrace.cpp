@@ -0,0 +1,100 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <limits>
+#include <QIODevice>
+#include "SessionTrace.h"
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+/** @short "TRJT" */
+const quint32 SessionTraceWriter::magic = 0x54524a54;
+const quint32 SessionTraceWriter::version = 1;
+
+SessionTraceWriter::SessionTraceWriter(QObject *parent, QIODevice *device):
+    QObject(parent), m_device(device), m_stream(device), m_lastRecordTime(0)
+{
+    m_device->setParent(this);
+    m_stream.setVersion(QDataStream::Qt_5_0);
+    m_stream << magic << version;
+    m_timer.start();
+}
+
+SessionTraceWriter::~SessionTraceWriter()
+{
+    m_device->close();
+}
+
+void SessionTraceWriter::record(const uint parserId, const SessionTraceRecord::Direction direction, const QByteArray &data)
+{
+    if (data.startsWith("*** "))
+        return;
+
+    qint64 now = m_timer.nsecsElapsed() / 1000;
+    quint32 delay = static_cast<quint32>(qMin<qint64>(now - m_lastRecordTime, std::numeric_limits<quint32>::max()));
+    m_lastRecordTime = now;
+    m_stream << static_cast<quint8>(direction) << static_cast<quint32>(parserId) << delay << data;
+}
+
+SessionTraceReader::SessionTraceReader(QIODevice *device):
+    m_stream(device)
+{
+    m_stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version;
+    m_stream >> magic >> version;
+    if (m_stream.status() != QDataStream::Ok || magic != SessionTraceWriter::magic) {
+        m_error = QStringLiteral("Not an IMAP session trace");
+    } else if (version != SessionTraceWriter::version) {
+        m_error = QStringLiteral("Unsupported version %1 of the IMAP session trace").arg(version);
+    }
+}
+
+bool SessionTraceReader::readNext(SessionTraceRecord &record)
+{
+    if (!m_error.isNull() || m_stream.atEnd())
+        return false;
+
+    quint8 direction;
+    quint32 parserId;
+    m_stream >> direction >> parserId >> record.delay >> record.data;
+    if (m_stream.status() != QDataStream::Ok || direction > SessionTraceRecord::CLIENT_TO_SERVER) {
+        m_error = QStringLiteral("Truncated or corrupted IMAP session trace");
+        return false;
+    }
+    record.direction = static_cast<SessionTraceRecord::Direction>(direction);
+    record.parserId = parserId;
+    return true;
+}
+
+QString SessionTraceReader::errorString() const
+{
+    return m_error;
+}
+
+}
+
+}
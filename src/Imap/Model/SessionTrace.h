@@ -0,0 +1,115 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAP_MODEL_SESSIONTRACE_H
+#define IMAP_MODEL_SESSIONTRACE_H
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QObject>
+
+class QIODevice;
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+/** @short One chunk of the IMAP traffic as stored in a session trace */
+struct SessionTraceRecord {
+    typedef enum {
+        SERVER_TO_CLIENT, /**< @short Data received from the IMAP server */
+        CLIENT_TO_SERVER /**< @short Data sent by us */
+    } Direction;
+
+    /** @short Which way did the data go */
+    Direction direction;
+    /** @short Identification of the Parser which has seen this data */
+    uint parserId;
+    /** @short Number of microseconds since the previous record */
+    quint32 delay;
+    /** @short The raw data, including all literals and the trailing CRLF */
+    QByteArray data;
+
+    SessionTraceRecord(): direction(SERVER_TO_CLIENT), parserId(0), delay(0) {}
+    SessionTraceRecord(const Direction direction, const uint parserId, const quint32 delay, const QByteArray &data):
+        direction(direction), parserId(parserId), delay(delay), data(data)
+    {
+    }
+};
+
+/** @short Record the IMAP traffic of all connections of a Model into a compact binary file
+
+The data come from the Parser's lineReceived() and lineSent() signals, i.e. this is what the Parser saw after
+the TLS and DEFLATE layers. Lines which were produced by the Parser itself to describe some event and which
+do not correspond to any real traffic (they start with "*** ") are not recorded. Please note that the trace
+contains the actual e-mails; only the LOGIN command is censored, and that's already done by the Parser.
+
+The file starts with a magic number and a version, followed by a sequence of records serialized through
+the QDataStream.
+*/
+class SessionTraceWriter: public QObject
+{
+    Q_OBJECT
+public:
+    /** @short Start writing into the @arg device, which is reparented to this object */
+    SessionTraceWriter(QObject *parent, QIODevice *device);
+    ~SessionTraceWriter();
+
+    void record(const uint parserId, const SessionTraceRecord::Direction direction, const QByteArray &data);
+
+    static const quint32 magic;
+    static const quint32 version;
+
+private:
+    QIODevice *m_device;
+    QDataStream m_stream;
+    QElapsedTimer m_timer;
+    qint64 m_lastRecordTime;
+
+    SessionTraceWriter(const SessionTraceWriter &); // don't implement
+    SessionTraceWriter &operator=(const SessionTraceWriter &); // don't implement
+};
+
+/** @short Read back a trace created by the SessionTraceWriter */
+class SessionTraceReader
+{
+public:
+    explicit SessionTraceReader(QIODevice *device);
+
+    /** @short Read the next record, returning false at the end of the trace or on error */
+    bool readNext(SessionTraceRecord &record);
+    /** @short Describe what went wrong, or return a null string when the trace was read fine */
+    QString errorString() const;
+
+private:
+    QDataStream m_stream;
+    QString m_error;
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_SESSIONTRACE_H */
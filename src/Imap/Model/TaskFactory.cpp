@@ -38,9 +38,12 @@
 #include "Imap/Tasks/KeepMailboxOpenTask.h"
 #include "Imap/Tasks/Fake_ListChildMailboxesTask.h"
 #include "Imap/Tasks/Fake_OpenConnectionTask.h"
+#include "Imap/Tasks/NotificationConnectionTask.h"
 #include "Imap/Tasks/NumberOfMessagesTask.h"
 #include "Imap/Tasks/ObtainSynchronizedMailboxTask.h"
 #include "Imap/Tasks/OpenConnectionTask.h"
+#include "Imap/Tasks/ParallelFetchConnectionTask.h"
+#include "Imap/Tasks/RefreshMessageCountsTask.h"
 #include "Imap/Tasks/UidSubmitTask.h"
 #include "Imap/Tasks/UpdateFlagsTask.h"
 #include "Imap/Tasks/UpdateFlagsOfAllMessagesTask.h"
@@ -121,6 +124,11 @@ KeepMailboxOpenTask *TaskFactory::createKeepMailboxOpenTask(Model *model, const
     return new KeepMailboxOpenTask(model, mailbox, oldParser);
 }
 
+NotificationConnectionTask *TaskFactory::createNotificationConnectionTask(Model *model)
+{
+    return new NotificationConnectionTask(model);
+}
+
 NumberOfMessagesTask *TaskFactory::createNumberOfMessagesTask(Model *model, const QModelIndex &mailbox)
 {
     return new NumberOfMessagesTask(model, mailbox);
@@ -132,6 +140,16 @@ ObtainSynchronizedMailboxTask *TaskFactory::createObtainSynchronizedMailboxTask(
     return new ObtainSynchronizedMailboxTask(model, mailboxIndex, parentTask, keepTask);
 }
 
+ParallelFetchConnectionTask *TaskFactory::createParallelFetchConnectionTask(Model *model, const QModelIndex &mailbox)
+{
+    return new ParallelFetchConnectionTask(model, mailbox);
+}
+
+RefreshMessageCountsTask *TaskFactory::createRefreshMessageCountsTask(Model *model)
+{
+    return new RefreshMessageCountsTask(model);
+}
+
 UpdateFlagsOfAllMessagesTask *TaskFactory::createUpdateFlagsOfAllMessagesTask(Model *model, const QModelIndex &mailbox,
         const FlagsOperation flagOperation, const QString &flags)
 {
@@ -52,9 +52,12 @@ class IdTask;
 class ImapTask;
 class KeepMailboxOpenTask;
 class ListChildMailboxesTask;
+class NotificationConnectionTask;
 class NumberOfMessagesTask;
 class ObtainSynchronizedMailboxTask;
 class OpenConnectionTask;
+class ParallelFetchConnectionTask;
+class RefreshMessageCountsTask;
 class UpdateFlagsTask;
 class UpdateFlagsOfAllMessagesTask;
 class ThreadTask;
@@ -86,10 +89,13 @@ public:
     virtual IdTask *createIdTask(Model *model, ImapTask *dependingTask);
     virtual KeepMailboxOpenTask *createKeepMailboxOpenTask(Model *model, const QModelIndex &mailbox, Parser *oldParser);
     virtual ListChildMailboxesTask *createListChildMailboxesTask(Model *model, const QModelIndex &mailbox);
+    virtual NotificationConnectionTask *createNotificationConnectionTask(Model *model);
     virtual NumberOfMessagesTask *createNumberOfMessagesTask(Model *model, const QModelIndex &mailbox);
     virtual ObtainSynchronizedMailboxTask *createObtainSynchronizedMailboxTask(Model *model, const QModelIndex &mailboxIndex,
             ImapTask *parentTask, KeepMailboxOpenTask *keepTask);
     virtual OpenConnectionTask *createOpenConnectionTask(Model *model);
+    virtual ParallelFetchConnectionTask *createParallelFetchConnectionTask(Model *model, const QModelIndex &mailbox);
+    virtual RefreshMessageCountsTask *createRefreshMessageCountsTask(Model *model);
     virtual UpdateFlagsOfAllMessagesTask *createUpdateFlagsOfAllMessagesTask(Model *model, const QModelIndex &mailbox,
             const FlagsOperation flagOperation, const QString &flags);
     virtual UpdateFlagsTask *createUpdateFlagsTask(Model *model, const QModelIndexList &messages, const FlagsOperation flagOperation,
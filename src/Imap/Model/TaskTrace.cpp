@@ -0,0 +1,211 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <QIODevice>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "TaskTrace.h"
+#include "Imap/Parser/Parser.h"
+#include "Imap/Tasks/ImapTask.h"
+
+namespace {
+
+/** @short Class name of the task without the namespaces */
+QByteArray taskName(const QObject *task)
+{
+    QByteArray name = task->metaObject()->className();
+    int pos = name.lastIndexOf(':');
+    return pos == -1 ? name : name.mid(pos + 1);
+}
+
+}
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+TaskTraceWriter::TaskTraceWriter(QObject *parent, QIODevice *device):
+    QObject(parent), m_device(device), m_lastId(0), m_firstEvent(true)
+{
+    m_device->setParent(this);
+    m_device->write("[\n");
+    m_timer.start();
+}
+
+TaskTraceWriter::~TaskTraceWriter()
+{
+    // Whatever is still alive at this point gets recorded as unfinished
+    for (auto it = m_tasks.constBegin(); it != m_tasks.constEnd(); ++it) {
+        disconnect(it.key(), &QObject::destroyed, this, &TaskTraceWriter::slotTaskDestroyed);
+        flush(*it, QStringLiteral("unfinished"));
+    }
+    m_device->write("\n]\n");
+    m_device->close();
+}
+
+qint64 TaskTraceWriter::now() const
+{
+    return m_timer.nsecsElapsed() / 1000;
+}
+
+void TaskTraceWriter::taskCreated(ImapTask *task)
+{
+    TaskRecord record;
+    record.id = ++m_lastId;
+    record.created = now();
+    m_tasks[task] = record;
+    connect(task, &QObject::destroyed, this, &TaskTraceWriter::slotTaskDestroyed);
+}
+
+void TaskTraceWriter::taskReparented(ImapTask *task, ImapTask *parent)
+{
+    auto it = m_tasks.find(task);
+    if (it == m_tasks.end())
+        return;
+    it->waitedFor = taskName(parent);
+    auto parentIt = m_tasks.constFind(parent);
+    if (parentIt != m_tasks.constEnd())
+        it->waitedFor += " #" + QByteArray::number(parentIt->id);
+}
+
+void TaskTraceWriter::taskActivated(ImapTask *task)
+{
+    auto it = m_tasks.find(task);
+    if (it == m_tasks.end() || it->activated != -1)
+        return;
+    it->activated = now();
+    it->name = taskName(task);
+    it->parserId = task->parser ? task->parser->parserId() : 0;
+    it->identification = task->debugIdentification();
+}
+
+void TaskTraceWriter::taskHandledResponse(ImapTask *task)
+{
+    auto it = m_tasks.find(task);
+    if (it != m_tasks.end() && it->firstResponse == -1)
+        it->firstResponse = now();
+}
+
+void TaskTraceWriter::taskFinished(ImapTask *task, const QString &failure)
+{
+    auto it = m_tasks.find(task);
+    if (it == m_tasks.end())
+        return;
+    disconnect(task, &QObject::destroyed, this, &TaskTraceWriter::slotTaskDestroyed);
+    // The name and the parser are only known for sure now; tasks might not have been fully constructed when they were created
+    it->name = taskName(task);
+    if (task->parser)
+        it->parserId = task->parser->parserId();
+    QString identification = task->debugIdentification();
+    if (!identification.isEmpty())
+        it->identification = identification;
+    flush(*it, failure.isNull() ? QStringLiteral("completed") : QStringLiteral("failed: %1").arg(failure));
+    m_tasks.erase(it);
+}
+
+void TaskTraceWriter::slotTaskDestroyed(QObject *task)
+{
+    auto it = m_tasks.find(task);
+    if (it == m_tasks.end())
+        return;
+    if (it->name.isEmpty())
+        it->name = "ImapTask";
+    flush(*it, QStringLiteral("destroyed"));
+    m_tasks.erase(it);
+}
+
+void TaskTraceWriter::flush(const TaskRecord &record, const QString &outcome)
+{
+    const qint64 finished = now();
+    const int pid = static_cast<int>(record.parserId);
+
+    if (!m_knownParsers.contains(record.parserId)) {
+        m_knownParsers.insert(record.parserId);
+        QJsonObject args;
+        args[QStringLiteral("name")] = record.parserId ?
+                    QStringLiteral("IMAP connection %1").arg(record.parserId) : QStringLiteral("Never activated");
+        QJsonObject meta;
+        meta[QStringLiteral("ph")] = QStringLiteral("M");
+        meta[QStringLiteral("name")] = QStringLiteral("process_name");
+        meta[QStringLiteral("pid")] = pid;
+        meta[QStringLiteral("args")] = args;
+        writeEvent(meta);
+    }
+
+    QJsonObject base;
+    base[QStringLiteral("cat")] = QStringLiteral("task");
+    base[QStringLiteral("id")] = QString::number(record.id);
+    base[QStringLiteral("pid")] = pid;
+    base[QStringLiteral("tid")] = pid;
+
+    auto event = [&base](const char *phase, const QString &name, const qint64 ts) -> QJsonObject {
+        QJsonObject e = base;
+        e[QStringLiteral("ph")] = QLatin1String(phase);
+        e[QStringLiteral("name")] = name;
+        e[QStringLiteral("ts")] = ts;
+        return e;
+    };
+
+    const QString name = QString::fromUtf8(record.name);
+    QJsonObject begin = event("b", name, record.created);
+    QJsonObject args;
+    args[QStringLiteral("task")] = record.identification;
+    args[QStringLiteral("parser")] = pid;
+    if (!record.waitedFor.isEmpty())
+        args[QStringLiteral("waitedFor")] = QString::fromUtf8(record.waitedFor);
+    begin[QStringLiteral("args")] = args;
+    writeEvent(begin);
+
+    const QString waiting = record.waitedFor.isEmpty() ? QStringLiteral("queued") : QStringLiteral("waiting for parent");
+    const qint64 waitingEnd = record.activated == -1 ? finished : record.activated;
+    writeEvent(event("b", waiting, record.created));
+    writeEvent(event("e", waiting, waitingEnd));
+
+    if (record.activated != -1) {
+        writeEvent(event("b", QStringLiteral("active"), record.activated));
+        if (record.firstResponse != -1)
+            writeEvent(event("n", QStringLiteral("first response"), record.firstResponse));
+        writeEvent(event("e", QStringLiteral("active"), finished));
+    }
+
+    QJsonObject end = event("e", name, finished);
+    QJsonObject endArgs;
+    endArgs[QStringLiteral("outcome")] = outcome;
+    end[QStringLiteral("args")] = endArgs;
+    writeEvent(end);
+}
+
+void TaskTraceWriter::writeEvent(const QJsonObject &event)
+{
+    if (!m_firstEvent)
+        m_device->write(",\n");
+    m_firstEvent = false;
+    m_device->write(QJsonDocument(event).toJson(QJsonDocument::Compact));
+}
+
+}
+
+}
@@ -0,0 +1,112 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef IMAP_MODEL_TASKTRACE_H
+#define IMAP_MODEL_TASKTRACE_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+class QIODevice;
+class QJsonObject;
+
+namespace Imap
+{
+
+namespace Mailbox
+{
+
+class ImapTask;
+
+/** @short Record the lifecycle of all ImapTasks of a Model in the Chrome trace event format
+
+The result can be loaded into chrome://tracing or into Perfetto. Each task is shown as an asynchronous slice
+which spans from the task's creation to its completion, failure or destruction. The slice is split into
+the time spent waiting -- either in the queue or for the parent task on which it depends -- and the time it
+was active on a connection, i.e. from its markAsActiveTask() till the end. The first response which the task
+has handled is marked by an instant event.
+
+Each IMAP connection is presented as a separate process labeled with the parser ID, which makes the
+pipelining gaps and the head-of-line blocking on a connection easy to spot. Tasks which have never been
+activated end up in a process of their own.
+
+The events of a task are only written once the task is over. The device is written as a JSON array
+which gets terminated when the writer is destroyed; the trace viewers accept unterminated arrays, too.
+*/
+class TaskTraceWriter: public QObject
+{
+    Q_OBJECT
+public:
+    /** @short Start writing into the @arg device, which is reparented to this object */
+    TaskTraceWriter(QObject *parent, QIODevice *device);
+    ~TaskTraceWriter();
+
+    void taskCreated(ImapTask *task);
+    /** @short The @arg task will wait for the @arg parent to complete */
+    void taskReparented(ImapTask *task, ImapTask *parent);
+    /** @short The @arg task has become an active task of its parser */
+    void taskActivated(ImapTask *task);
+    void taskHandledResponse(ImapTask *task);
+    /** @short The @arg task has finished; a non-null @arg failure indicates the reason why it failed */
+    void taskFinished(ImapTask *task, const QString &failure);
+
+private slots:
+    void slotTaskDestroyed(QObject *task);
+
+private:
+    struct TaskRecord {
+        quint64 id;
+        QByteArray name;
+        QString identification;
+        uint parserId;
+        qint64 created;
+        qint64 activated;
+        qint64 firstResponse;
+        QByteArray waitedFor;
+
+        TaskRecord(): id(0), parserId(0), created(0), activated(-1), firstResponse(-1) {}
+    };
+
+    qint64 now() const;
+    void flush(const TaskRecord &record, const QString &outcome);
+    void writeEvent(const QJsonObject &event);
+
+    QIODevice *m_device;
+    QElapsedTimer m_timer;
+    quint64 m_lastId;
+    bool m_firstEvent;
+    QHash<QObject *, TaskRecord> m_tasks;
+    QSet<uint> m_knownParsers;
+
+    TaskTraceWriter(const TaskTraceWriter &); // don't implement
+    TaskTraceWriter &operator=(const TaskTraceWriter &); // don't implement
+};
+
+}
+
+}
+
+#endif /* IMAP_MODEL_TASKTRACE_H */
@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <QBuffer>
 #include <QDebug>
+#include "Common/Profiling.h"
 #include "Imap/Tasks/SortTask.h"
 #include "Imap/Tasks/ThreadTask.h"
 #include "ItemRoles.h"
@@ -39,7 +40,7 @@ namespace {
 namespace
 {
 using Imap::Mailbox::ThreadNodeInfo;
-QByteArray dumpThreadNodeInfo(const QHash<uint,ThreadNodeInfo> &mapping, const uint nodeId, const uint offset)
+QByteArray dumpThreadNodeInfo(const Imap::Mailbox::ThreadNodeArena &mapping, const uint nodeId, const uint offset)
 {
     QByteArray res;
     QByteArray prefix(offset, ' ');
@@ -64,21 +65,28 @@ namespace Mailbox
 ThreadingMsgListModel::ThreadingMsgListModel(QObject *parent):
     QAbstractProxyModel(parent), threadingHelperLastId(0), modelResetInProgress(false), threadingInFlight(false),
     m_shallBeThreading(false), m_sortTask(0), m_sortReverse(false), m_currentSortingCriteria(SORT_NONE),
-    m_searchValidity(RESULT_INVALIDATED)
+    m_searchValidity(RESULT_INVALIDATED), m_threadingLocally(false), m_sortingLocally(false)
 {
     m_delayedPrune = new QTimer(this);
     m_delayedPrune->setSingleShot(true);
     m_delayedPrune->setInterval(0);
     connect(m_delayedPrune, &QTimer::timeout, this, &ThreadingMsgListModel::delayedPrune);
+
+    // Envelopes tend to arrive in batches, so let's not rebuild the threads for each of them
+    m_delayedLocalRefresh = new QTimer(this);
+    m_delayedLocalRefresh->setSingleShot(true);
+    m_delayedLocalRefresh->setInterval(250);
+    connect(m_delayedLocalRefresh, &QTimer::timeout, this, &ThreadingMsgListModel::delayedLocalRefresh);
 }
 
 void ThreadingMsgListModel::setSourceModel(QAbstractItemModel *sourceModel)
 {
     beginResetModel();
     threading.clear();
-    ptrToInternal.clear();
+    m_idsBySourceRow.clear();
     unknownUids.clear();
     threadedRootIds.clear();
+    m_pendingArrivals.clear();
     m_currentSortResult.clear();
     m_searchValidity = RESULT_INVALIDATED;
 
@@ -119,40 +127,82 @@ QVariant ThreadingMsgListModel::headerData(int section, Qt::Orientation orientat
 
 void ThreadingMsgListModel::handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
-    // We don't support updates which concern multiple rows at this time.
-    // Doing that would very likely require a completely different codepath due to threading...
+    // The source model merges changes of adjacent messages into a single range. These messages can be scattered all over
+    // the threads, so the range has to be split into individual messages again.
     Q_ASSERT(topLeft.parent() == bottomRight.parent());
-    Q_ASSERT(topLeft.row() == bottomRight.row());
-    QModelIndex translated = mapFromSource(topLeft);
+    QVector<QModelIndex> sourceIndexes;
+    sourceIndexes.reserve(bottomRight.row() - topLeft.row() + 1);
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        sourceIndexes << (row == topLeft.row() ? topLeft : topLeft.sibling(row, topLeft.column()));
+    }
 
-    emit dataChanged(translated, translated.sibling(translated.row(), bottomRight.column()));
+    // The translated messages are reported as a single range of rows per each parent in the thread tree, so that the views
+    // don't get one signal per message again. The range might include some unchanged messages, which is harmless.
+    QMap<QModelIndex, QPair<int, int> > changedRows;
 
     // We provide funny data like "does this thread contain unread messages?". Now the original signal might mean that flags of a
     // nested message have changed. In order to always be consistent, we have to find the thread root and emit dataChanged() on that
-    // as well.
-    QModelIndex rootCandidate = translated;
-    while (rootCandidate.parent().isValid()) {
-        rootCandidate = rootCandidate.parent();
+    // as well. Each affected root is reported just once.
+    QVector<QModelIndex> changedRoots;
+    for (const QModelIndex &sourceIndex : sourceIndexes) {
+        QModelIndex translated = mapFromSource(sourceIndex);
+        if (!translated.isValid())
+            continue;
+
+        const QModelIndex parent = translated.parent();
+        auto range = changedRows.find(parent);
+        if (range == changedRows.end()) {
+            changedRows.insert(parent, qMakePair(translated.row(), translated.row()));
+        } else {
+            range->first = qMin(range->first, translated.row());
+            range->second = qMax(range->second, translated.row());
+        }
+
+        QModelIndex rootCandidate = translated;
+        while (rootCandidate.parent().isValid()) {
+            rootCandidate = rootCandidate.parent();
+        }
+        if (rootCandidate != translated && !changedRoots.contains(rootCandidate)) {
+            // We're really an embedded message
+            changedRoots << rootCandidate;
+        }
     }
-    if (rootCandidate != translated) {
-        // We're really an embedded message
-        emit dataChanged(rootCandidate, rootCandidate.sibling(rootCandidate.row(), bottomRight.column()));
+    for (auto it = changedRows.constBegin(); it != changedRows.constEnd(); ++it) {
+        emit dataChanged(index(it->first, topLeft.column(), it.key()), index(it->second, bottomRight.column(), it.key()));
     }
-
-    auto message = dynamic_cast<TreeItemMessage*>(static_cast<TreeItemMessage*>(topLeft.internalPointer()));
-    Q_ASSERT(message);
-    if (message->uid() == 0) {
-        // UID is not yet known.
-        // This is a legal situation, for example when an unsolicited FETCH FLAGS arrives and there's no UID in there.
-        return;
+    for (const QModelIndex &root : changedRoots) {
+        emit dataChanged(root, root.sibling(root.row(), bottomRight.column()));
     }
 
-    QSet<TreeItem*>::iterator persistent = unknownUids.find(message);
-    if (persistent != unknownUids.end()) {
-        // The message wasn't fully synced before, and now it is
-        persistent = unknownUids.erase(persistent);
-        if (unknownUids.isEmpty()) {
-            wantThreading();
+    // Updating the threads might rearrange the whole model, so it has to wait until all signals above went out
+    for (const QModelIndex &sourceIndex : sourceIndexes) {
+        auto message = dynamic_cast<TreeItemMessage*>(static_cast<TreeItem*>(sourceIndex.internalPointer()));
+        Q_ASSERT(message);
+        if (message->uid() == 0) {
+            // UID is not yet known.
+            // This is a legal situation, for example when an unsolicited FETCH FLAGS arrives and there's no UID in there.
+            continue;
+        }
+
+        if (!m_uidsByMessageIdMailbox.isEmpty() && message->m_data && message->m_data->gotEnvelope()) {
+            // Keep the index used for placing the new arrivals up-to-date
+            QByteArray messageId = LocalThreading::normalizedMessageId(message->m_data->envelope().messageId);
+            if (!messageId.isEmpty())
+                m_uidsByMessageId.insert(messageId, message->uid());
+        }
+
+        QSet<TreeItem*>::iterator persistent = unknownUids.find(message);
+        if (persistent != unknownUids.end()) {
+            // The message wasn't fully synced before, and now it is
+            persistent = unknownUids.erase(persistent);
+            if (unknownUids.isEmpty()) {
+                wantThreading();
+            }
+        } else if (message->m_data && message->m_data->gotEnvelope() &&
+                   ((m_threadingLocally && !m_localThreading.contains(message->uid())) ||
+                    (m_sortingLocally && !m_localSorting.contains(message->uid())))) {
+            // We know where this message belongs now
+            m_delayedLocalRefresh->start();
         }
     }
 }
@@ -176,8 +226,8 @@ QModelIndex ThreadingMsgListModel::index(int row, int column, const QModelIndex
 
     uint parentId = parent.isValid() ? parent.internalId() : 0;
 
-    QHash<uint,ThreadNodeInfo>::const_iterator it = threading.constFind(parentId);
-    Q_ASSERT(it != threading.constEnd());
+    const ThreadNodeInfo *it = threading.constFind(parentId);
+    Q_ASSERT(it);
 
     if (it->children.size() <= row)
         return QModelIndex();
@@ -196,12 +246,12 @@ QModelIndex ThreadingMsgListModel::parent(const QModelIndex &index) const
     if (index.row() < 0 || index.column() < 0 || index.column() >= MsgListModel::COLUMN_COUNT)
         return QModelIndex();
 
-    QHash<uint,ThreadNodeInfo>::const_iterator node = threading.constFind(index.internalId());
-    if (node == threading.constEnd())
+    const ThreadNodeInfo *node = threading.constFind(index.internalId());
+    if (!node)
         return QModelIndex();
 
-    QHash<uint,ThreadNodeInfo>::const_iterator parentNode = threading.constFind(node->parent);
-    Q_ASSERT(parentNode != threading.constEnd());
+    const ThreadNodeInfo *parentNode = threading.constFind(node->parent);
+    Q_ASSERT(parentNode);
     Q_ASSERT(parentNode->internalId == node->parent);
 
     if (parentNode->internalId == 0)
@@ -215,7 +265,8 @@ bool ThreadingMsgListModel::hasChildren(const QModelIndex &parent) const
     if (parent.isValid() && parent.column() != 0)
         return false;
 
-    return ! threading.isEmpty() && ! threading.value(parent.internalId()).children.isEmpty();
+    const ThreadNodeInfo *node = threading.constFind(parent.internalId());
+    return node && !node->children.isEmpty();
 }
 
 int ThreadingMsgListModel::rowCount(const QModelIndex &parent) const
@@ -226,7 +277,8 @@ int ThreadingMsgListModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid() && parent.column() != 0)
         return 0;
 
-    return threading.value(parent.internalId()).children.size();
+    const ThreadNodeInfo *node = threading.constFind(parent.internalId());
+    return node ? node->children.size() : 0;
 }
 
 int ThreadingMsgListModel::columnCount(const QModelIndex &parent) const
@@ -248,8 +300,8 @@ QModelIndex ThreadingMsgListModel::mapToSource(const QModelIndex &proxyIndex) co
     Imap::Mailbox::MsgListModel *msgList = qobject_cast<Imap::Mailbox::MsgListModel *>(sourceModel());
     Q_ASSERT(msgList);
 
-    QHash<uint,ThreadNodeInfo>::const_iterator node = threading.constFind(proxyIndex.internalId());
-    if (node == threading.constEnd())
+    const ThreadNodeInfo *node = threading.constFind(proxyIndex.internalId());
+    if (!node)
         return QModelIndex();
 
     if (node->ptr) {
@@ -267,18 +319,16 @@ QModelIndex ThreadingMsgListModel::mapFromSource(const QModelIndex &sourceIndex)
 
     Q_ASSERT(sourceIndex.model() == sourceModel());
 
-    QHash<void *,uint>::const_iterator it = ptrToInternal.constFind(sourceIndex.internalPointer());
-    if (it == ptrToInternal.constEnd())
+    const uint internalId = internalIdForSourceRow(sourceIndex.row());
+    if (!internalId)
         return QModelIndex();
 
-    const uint internalId = *it;
-
-    QHash<uint,ThreadNodeInfo>::const_iterator node = threading.constFind(internalId);
-    if (node == threading.constEnd()) {
+    const ThreadNodeInfo *node = threading.constFind(internalId);
+    if (!node) {
         // The filtering criteria say that this index shall not be visible
         return QModelIndex();
     }
-    Q_ASSERT(node != threading.constEnd());
+    Q_ASSERT(!node->ptr || node->ptr == sourceIndex.internalPointer());
 
     return createIndex(node->offset, sourceIndex.column(), internalId);
 }
@@ -288,8 +338,8 @@ QVariant ThreadingMsgListModel::data(const QModelIndex &proxyIndex, int role) co
     if (! proxyIndex.isValid() || proxyIndex.model() != this)
         return QVariant();
 
-    QHash<uint,ThreadNodeInfo>::const_iterator it = threading.constFind(proxyIndex.internalId());
-    Q_ASSERT(it != threading.constEnd());
+    const ThreadNodeInfo *it = threading.constFind(proxyIndex.internalId());
+    Q_ASSERT(it);
 
     if (it->ptr) {
         // It's a real item which exists in the underlying model
@@ -324,8 +374,8 @@ Qt::ItemFlags ThreadingMsgListModel::flags(const QModelIndex &index) const
     if (! index.isValid() || index.model() != this)
         return Qt::NoItemFlags;
 
-    QHash<uint,ThreadNodeInfo>::const_iterator it = threading.constFind(index.internalId());
-    Q_ASSERT(it != threading.constEnd());
+    const ThreadNodeInfo *it = threading.constFind(index.internalId());
+    Q_ASSERT(it);
     if (it->ptr && it->uid)
         return Qt::ItemIsSelectable | Qt::ItemIsDragEnabled | Qt::ItemIsEnabled;
 
@@ -343,6 +393,9 @@ void ThreadingMsgListModel::handleRowsAboutToBeRemoved(const QModelIndex &parent
         QModelIndex translated = mapFromSource(index);
 
         unknownUids.remove(static_cast<TreeItem*>(index.internalPointer()));
+        const uint uid = index.data(RoleMessageUid).toUInt();
+        m_localThreading.removeMessage(uid);
+        m_localSorting.removeMessage(uid);
 
         if (!translated.isValid()) {
             // The index being removed wasn't visible in our mapping anyway
@@ -350,8 +403,8 @@ void ThreadingMsgListModel::handleRowsAboutToBeRemoved(const QModelIndex &parent
         }
 
         Q_ASSERT(translated.isValid());
-        QHash<uint,ThreadNodeInfo>::iterator it = threading.find(translated.internalId());
-        Q_ASSERT(it != threading.end());
+        ThreadNodeInfo *it = threading.find(translated.internalId());
+        Q_ASSERT(it);
         it->uid = 0;
         it->ptr = 0;
     }
@@ -360,8 +413,8 @@ void ThreadingMsgListModel::handleRowsAboutToBeRemoved(const QModelIndex &parent
 void ThreadingMsgListModel::handleRowsRemoved(const QModelIndex &parent, int start, int end)
 {
     Q_ASSERT(!parent.isValid());
-    Q_UNUSED(start);
-    Q_UNUSED(end);
+    if (start < m_idsBySourceRow.size())
+        m_idsBySourceRow.remove(start, qMin(end, m_idsBySourceRow.size() - 1) - start + 1);
     if (!m_delayedPrune->isActive())
         m_delayedPrune->start();
 }
@@ -391,19 +444,21 @@ void ThreadingMsgListModel::handleRowsInserted(const QModelIndex &parent, int st
     for (int i = start; i <= end; ++i) {
         QModelIndex index = sourceModel()->index(i, 0);
         uint uid = index.data(RoleMessageUid).toUInt();
-        ThreadNodeInfo node;
-        node.internalId = ++threadingHelperLastId;
+        ThreadNodeInfo &node = threading[++threadingHelperLastId];
         node.uid = uid;
         node.ptr = static_cast<TreeItem *>(index.internalPointer());
         node.offset = threading[0].children.size();
-        threading[node.internalId] = node;
         threading[0].children << node.internalId;
-        ptrToInternal[node.ptr] = node.internalId;
+        if (i > m_idsBySourceRow.size())
+            m_idsBySourceRow.resize(i);
+        m_idsBySourceRow.insert(i, node.internalId);
         if (!node.uid) {
             unknownUids << static_cast<TreeItem*>(index.internalPointer());
         } else {
             threadedRootIds.append(node.internalId);
         }
+        if (m_shallBeThreading)
+            m_pendingArrivals.append(node.internalId);
     }
     endInsertRows();
 
@@ -426,11 +481,19 @@ void ThreadingMsgListModel::resetMe()
     beginResetModel();
     modelResetInProgress = true;
     threading.clear();
-    ptrToInternal.clear();
+    m_idsBySourceRow.clear();
     unknownUids.clear();
     threadedRootIds.clear();
     m_currentSortResult.clear();
     m_searchValidity = RESULT_INVALIDATED;
+    m_localThreading.clear();
+    m_localThreadingMailbox.clear();
+    m_threadingLocally = false;
+    m_localSorting.clear();
+    m_localSortingMailbox.clear();
+    m_pendingArrivals.clear();
+    m_uidsByMessageId.clear();
+    m_uidsByMessageIdMailbox.clear();
     endResetModel();
     updateNoThreading();
     modelResetInProgress = false;
@@ -442,13 +505,14 @@ void ThreadingMsgListModel::resetMe()
 void ThreadingMsgListModel::updateNoThreading()
 {
     threadingHelperLastId = 0;
+    m_pendingArrivals.clear();
 
     if (!sourceModel()) {
         // Maybe we got reset because the parent model is no longer here...
         if (! threading.isEmpty()) {
             beginRemoveRows(QModelIndex(), 0, rowCount() - 1);
             threading.clear();
-            ptrToInternal.clear();
+            m_idsBySourceRow.clear();
             endRemoveRows();
         }
         unknownUids.clear();
@@ -458,14 +522,11 @@ void ThreadingMsgListModel::updateNoThreading()
     emit layoutAboutToBeChanged();
     updatePersistentIndexesPhase1();
     threading.clear();
-    ptrToInternal.clear();
+    m_idsBySourceRow.clear();
     unknownUids.clear();
     threadedRootIds.clear();
 
     int upstreamMessages = sourceModel()->rowCount();
-    QList<uint> allIds;
-    QHash<uint,ThreadNodeInfo> newThreading;
-    QHash<void *,uint> newPtrToInternal;
 
     if (upstreamMessages) {
         // Prefer the direct pointer access instead of going through the MVC API -- similar to how applyThreading() works.
@@ -480,33 +541,29 @@ void ThreadingMsgListModel::updateNoThreading()
         TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(firstMessagePtr->parent());
         Q_ASSERT(list);
 
-        newThreading.reserve(upstreamMessages + headroomForNewmessages);
-        newPtrToInternal.reserve(upstreamMessages + headroomForNewmessages);
+        threading.reserve(upstreamMessages + 1 + headroomForNewmessages);
+        m_idsBySourceRow.reserve(upstreamMessages + headroomForNewmessages);
+
+        // Create the root first, and size the arena in one go by creating the last node
+        threading[0].children.reserve(upstreamMessages + headroomForNewmessages);
+        threading[upstreamMessages];
 
+        ThreadChildList &allIds = threading[0].children;
         for (int i = 0; i < upstreamMessages; ++i) {
             TreeItemMessage *ptr = static_cast<TreeItemMessage*>(list->m_children[i]);
             Q_ASSERT(ptr);
-            ThreadNodeInfo node;
-            node.internalId = i + 1;
+            ThreadNodeInfo &node = threading[i + 1];
             node.uid = ptr->uid();
             node.ptr = ptr;
             node.offset = i;
-            newThreading[node.internalId] = node;
             allIds.append(node.internalId);
-            newPtrToInternal[node.ptr] = node.internalId;
+            m_idsBySourceRow.append(node.internalId);
             if (!node.uid) {
                 unknownUids << ptr;
             }
         }
-    }
-
-    if (newThreading.size()) {
-        threading = newThreading;
-        ptrToInternal = newPtrToInternal;
-        threading[ 0 ].children = allIds;
-        threading[ 0 ].ptr = 0;
-        threadingHelperLastId = newThreading.size();
-        threadedRootIds = threading[0].children;
+        threadingHelperLastId = upstreamMessages;
+        threadedRootIds = allIds.toVector();
     }
     updatePersistentIndexesPhase2();
     emit layoutChanged();
@@ -566,10 +623,25 @@ void ThreadingMsgListModel::wantThreading(const SkipSortSearch skipSortSearch)
 
     if (highestUidInThreadingLowerBound >= highestUidInMailbox) {
         // There's no point asking for data at this point, we shall just apply threading
+        if (!m_threadingLocally && placeArrivalsLikeServer(mapping, true, realModel, list)) {
+            // Only the new arrivals had to move, the rest of the tree is already in shape
+            logTrace(QStringLiteral("New arrivals placed without re-threading"));
+            if (rootsAreSorted()) {
+                searchSortPreferenceImplementation(m_currentSearchConditions, m_currentSortingCriteria,
+                                                   m_sortReverse ? Qt::DescendingOrder : Qt::AscendingOrder);
+            }
+            return;
+        }
+        m_threadingLocally = false;
         applyThreading(mapping);
+    } else if (!canThreadOnServer(realModel)) {
+        // The server won't help us, either because it cannot thread at all or because we're offline
+        m_threadingLocally = true;
+        applyThreading(threadLocally(realModel, mailbox, list));
     } else {
         // There's apparently at least one known UID whose threading info we do not know; that means that we have to ask the
-        // server here.
+        // server here.  The new arrivals can however be shown at their likely position while we wait.
+        placeArrivalsByReferences(realModel, mailbox, list);
         auto roughlyLastKnown = const_cast<Model*>(realModel)->findMessageOrNextOneByUid(list, highestUidInThreadingLowerBound);
         if (list->m_children.end() - roughlyLastKnown >= 50 || roughlyLastKnown == list->m_children.begin()) {
             askForThreading();
@@ -619,6 +691,422 @@ uint ThreadingMsgListModel::findHighEnoughNumber(const QVector<Responses::Thread
     return highestUidInThreadingLowerBound;
 }
 
+bool ThreadingMsgListModel::canThreadOnServer(const Model *realModel)
+{
+    if (!realModel->isNetworkAvailable())
+        return false;
+    Q_FOREACH(const QString &capability, supportedCapabilities()) {
+        if (realModel->capabilities().contains(capability))
+            return true;
+    }
+    return false;
+}
+
+QVector<Responses::ThreadingNode> ThreadingMsgListModel::threadLocally(const Model *realModel, const QModelIndex &mailbox,
+                                                                        TreeItemMsgList *list)
+{
+    const QString mailboxName = mailbox.data(RoleMailboxName).toString();
+    if (mailboxName != m_localThreadingMailbox) {
+        m_localThreading.clear();
+        m_localThreadingMailbox = mailboxName;
+    }
+
+    // Only the messages which were not seen before are processed here; the rest is already linked within m_localThreading
+    QVector<Responses::ThreadingNode> withoutData;
+    for (int i = 0; i < list->m_children.size(); ++i) {
+        TreeItemMessage *message = static_cast<TreeItemMessage *>(list->m_children[i]);
+        const uint uid = message->uid();
+        if (!uid || m_localThreading.contains(uid))
+            continue;
+
+        // Prefer the data which are already loaded, but do not trigger any fetching from here
+        if (message->m_data && message->m_data->gotEnvelope()) {
+            const Message::Envelope &envelope = message->m_data->envelope();
+            m_localThreading.addMessage(uid, envelope.messageId, message->m_data->hdrReferences(), envelope.inReplyTo);
+            continue;
+        }
+
+        AbstractCache::MessageDataBundle cached = realModel->cache()->messageMetadata(mailboxName, uid);
+        if (cached.uid == uid) {
+            m_localThreading.addMessage(uid, cached.envelope.messageId, cached.hdrReferences, cached.envelope.inReplyTo);
+        } else {
+            withoutData << Responses::ThreadingNode(uid);
+        }
+    }
+
+    logTrace(QStringLiteral("Threading locally: %1 messages threaded, %2 without envelope")
+             .arg(QString::number(m_localThreading.size()), QString::number(withoutData.size())));
+
+    QVector<Responses::ThreadingNode> mapping = m_localThreading.threads();
+    mapping += withoutData;
+    return mapping;
+}
+
+Imap::Uids ThreadingMsgListModel::sortLocally(const Model *realModel, const QModelIndex &mailbox, const SortCriterium criterium)
+{
+    LocalSorting::Key key;
+    switch (criterium) {
+    case SORT_ARRIVAL:
+        key = LocalSorting::KEY_ARRIVAL;
+        break;
+    case SORT_CC:
+        key = LocalSorting::KEY_CC;
+        break;
+    case SORT_DATE:
+        key = LocalSorting::KEY_DATE;
+        break;
+    case SORT_FROM:
+        key = LocalSorting::KEY_FROM;
+        break;
+    case SORT_SIZE:
+        key = LocalSorting::KEY_SIZE;
+        break;
+    case SORT_SUBJECT:
+        key = LocalSorting::KEY_SUBJECT;
+        break;
+    case SORT_TO:
+        key = LocalSorting::KEY_TO;
+        break;
+    case SORT_NONE:
+    default:
+        Q_ASSERT(false);
+        return Imap::Uids();
+    }
+
+    const QString mailboxName = mailbox.data(RoleMailboxName).toString();
+    if (mailboxName != m_localSortingMailbox || key != m_localSorting.key()) {
+        m_localSorting.setKey(key);
+        m_localSortingMailbox = mailboxName;
+    }
+
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(static_cast<TreeItem *>(mailbox.internalPointer())->m_children[0]);
+    Q_ASSERT(list);
+
+    // The sort keys of the messages which we have seen before are already known
+    Imap::Uids withoutData;
+    for (int i = 0; i < list->m_children.size(); ++i) {
+        TreeItemMessage *message = static_cast<TreeItemMessage *>(list->m_children[i]);
+        const uint uid = message->uid();
+        if (!uid || m_localSorting.contains(uid))
+            continue;
+
+        if (message->m_data && message->m_data->gotEnvelope()) {
+            m_localSorting.addMessage(uid, message->m_data->envelope(), message->m_data->internalDate(), message->m_data->size());
+            continue;
+        }
+
+        AbstractCache::MessageDataBundle cached = realModel->cache()->messageMetadata(mailboxName, uid);
+        if (cached.uid == uid) {
+            m_localSorting.addMessage(uid, cached.envelope, cached.internalDate, cached.size);
+        } else {
+            withoutData << uid;
+        }
+    }
+
+    Imap::Uids res = m_localSorting.sortedUids();
+    res += withoutData;
+    return res;
+}
+
+void ThreadingMsgListModel::delayedLocalRefresh()
+{
+    if (m_threadingLocally && m_shallBeThreading) {
+        wantThreading();
+    } else if (m_sortingLocally) {
+        searchSortPreferenceImplementation(m_currentSearchConditions, m_currentSortingCriteria,
+                                           m_sortReverse ? Qt::DescendingOrder : Qt::AscendingOrder);
+    }
+}
+
+bool ThreadingMsgListModel::rootsAreSorted() const
+{
+    return m_currentSortingCriteria != SORT_NONE || m_sortReverse;
+}
+
+const ThreadNodeInfo *ThreadingMsgListModel::nodeForUid(const Model *realModel, TreeItemMsgList *list, const uint uid) const
+{
+    auto it = const_cast<Model *>(realModel)->findMessageOrNextOneByUid(list, uid);
+    if (it == list->m_children.end() || static_cast<TreeItemMessage *>(*it)->uid() != uid)
+        return 0;
+    const uint internalId = internalIdForSourceRow(it - list->m_children.begin());
+    if (!internalId)
+        return 0;
+    const ThreadNodeInfo *node = threading.constFind(internalId);
+    return node && node->ptr ? node : 0;
+}
+
+uint ThreadingMsgListModel::internalIdForSourceRow(const int row) const
+{
+    return row >= 0 && row < m_idsBySourceRow.size() ? m_idsBySourceRow[row] : 0;
+}
+
+void ThreadingMsgListModel::placeArrivalsByReferences(const Model *realModel, const QModelIndex &mailbox, TreeItemMsgList *list)
+{
+    if (m_pendingArrivals.isEmpty() || !m_currentSearchConditions.isEmpty() || threading.isEmpty())
+        return;
+
+    const QString mailboxName = mailbox.data(RoleMailboxName).toString();
+    if (mailboxName != m_uidsByMessageIdMailbox) {
+        // Asking the cache about each message would take longer than the re-threading which we are trying to avoid here,
+        // so only the envelopes which are loaded already are indexed. The handleDataChanged() takes care of the rest.
+        m_uidsByMessageId.clear();
+        m_uidsByMessageIdMailbox = mailboxName;
+        for (int i = 0; i < list->m_children.size(); ++i) {
+            TreeItemMessage *message = static_cast<TreeItemMessage *>(list->m_children[i]);
+            if (message->uid() && message->m_data && message->m_data->gotEnvelope()) {
+                m_uidsByMessageId.insert(LocalThreading::normalizedMessageId(message->m_data->envelope().messageId),
+                                         message->uid());
+            }
+        }
+        m_uidsByMessageId.remove(QByteArray());
+    }
+
+    Q_FOREACH(const uint internalId, m_pendingArrivals) {
+        const ThreadNodeInfo *node = threading.constFind(internalId);
+        if (!node || !node->ptr || !node->uid || node->parent != 0 || !node->children.isEmpty())
+            continue;
+
+        const uint uid = node->uid;
+        TreeItemMessage *message = static_cast<TreeItemMessage *>(node->ptr);
+        QByteArray messageId;
+        QList<QByteArray> parentIds;
+        if (message->m_data && message->m_data->gotEnvelope()) {
+            messageId = message->m_data->envelope().messageId;
+            parentIds = message->m_data->hdrReferences();
+            if (parentIds.isEmpty())
+                parentIds = message->m_data->envelope().inReplyTo;
+        } else {
+            AbstractCache::MessageDataBundle cached = realModel->cache()->messageMetadata(mailboxName, uid);
+            if (cached.uid != uid)
+                continue;
+            messageId = cached.envelope.messageId;
+            parentIds = cached.hdrReferences.isEmpty() ? cached.envelope.inReplyTo : cached.hdrReferences;
+        }
+
+        messageId = LocalThreading::normalizedMessageId(messageId);
+        if (!messageId.isEmpty())
+            m_uidsByMessageId.insert(messageId, uid);
+
+        // The closest ancestor which we know about wins
+        const ThreadNodeInfo *parent = 0;
+        for (int i = parentIds.size() - 1; i >= 0 && !parent; --i) {
+            const uint parentUid = m_uidsByMessageId.value(LocalThreading::normalizedMessageId(parentIds[i]));
+            if (parentUid && parentUid != uid)
+                parent = nodeForUid(realModel, list, parentUid);
+        }
+        if (parent)
+            moveArrival(internalId, parent->internalId);
+    }
+}
+
+bool ThreadingMsgListModel::placeArrivalsLikeServer(const QVector<Responses::ThreadingNode> &mapping, const bool isComplete,
+                                                    const Model *realModel, TreeItemMsgList *list)
+{
+    // When filtering, some of the messages are not in the tree at all, and we would not be able to tell them from the missing ones
+    if (m_pendingArrivals.isEmpty() || !unknownUids.isEmpty() || !m_currentSearchConditions.isEmpty() || threading.isEmpty())
+        return false;
+
+    QSet<uint> arrivals;
+    arrivals.reserve(m_pendingArrivals.size());
+    Q_FOREACH(const uint internalId, m_pendingArrivals) {
+        arrivals.insert(internalId);
+    }
+
+    QVector<QPair<uint, uint> > moves;
+    QHash<uint, int> movesInto;
+    QVector<uint> roots;
+    int position = 0;
+    int found = 0;
+    if (!collectArrivalMoves(mapping, 0, position, realModel, list, arrivals, moves, movesInto, roots, found))
+        return false;
+
+    if (isComplete) {
+        // Every single message has to be accounted for, otherwise the response describes a different tree
+        if (found != list->m_children.size())
+            return false;
+
+        if (!rootsAreSorted()) {
+            // The order of threads is up to the server, so predict the top level after all moves and compare that
+            QSet<uint> leavingTopLevel;
+            QVector<uint> enteringTopLevel;
+            for (QVector<QPair<uint, uint> >::const_iterator it = moves.constBegin(); it != moves.constEnd(); ++it) {
+                if (it->second == 0)
+                    enteringTopLevel << it->first;
+                else if (threading[it->first].parent == 0)
+                    leavingTopLevel << it->first;
+            }
+            QVector<uint> predicted;
+            predicted.reserve(threading[0].children.size() + enteringTopLevel.size());
+            Q_FOREACH(const uint internalId, threading[0].children) {
+                if (!leavingTopLevel.contains(internalId))
+                    predicted << internalId;
+            }
+            predicted += enteringTopLevel;
+            if (predicted != roots)
+                return false;
+        }
+    }
+
+    for (QVector<QPair<uint, uint> >::const_iterator it = moves.constBegin(); it != moves.constEnd(); ++it) {
+        if (!moveArrival(it->first, it->second))
+            return false;
+    }
+    m_pendingArrivals.clear();
+    return true;
+}
+
+bool ThreadingMsgListModel::collectArrivalMoves(const QVector<Responses::ThreadingNode> &mapping, const uint parentId, int &position,
+                                                const Model *realModel, TreeItemMsgList *list, const QSet<uint> &arrivals,
+                                                QVector<QPair<uint, uint> > &moves, QHash<uint, int> &movesInto,
+                                                QVector<uint> &roots, int &found) const
+{
+    Q_FOREACH(const Responses::ThreadingNode &node, mapping) {
+        const ThreadNodeInfo *info = node.num ? nodeForUid(realModel, list, node.num) : 0;
+        const Responses::ThreadingNode *real = &node;
+        if (!info) {
+            // This is how pruneTree() gets rid of a missing message: its first child takes its place, and the other children
+            // are appended to the list of children of that first child
+            if (node.children.isEmpty())
+                continue;
+            real = &node.children.first();
+            info = real->num ? nodeForUid(realModel, list, real->num) : 0;
+            if (!info) {
+                // Several levels of missing messages, let's not try to be too smart
+                return false;
+            }
+        }
+
+        ++found;
+        if (parentId == 0)
+            roots << info->internalId;
+
+        if (arrivals.contains(info->internalId)) {
+            const bool hasChildrenInResponse = !real->children.isEmpty() || (real != &node && node.children.size() > 1);
+            if (hasChildrenInResponse || !info->children.isEmpty()) {
+                // Some older messages would have to move as well
+                return false;
+            }
+            if (info->parent != parentId) {
+                if (info->parent != 0) {
+                    // We have placed it below a wrong message, and taking it away from there would shift its siblings
+                    return false;
+                }
+                if (parentId != 0) {
+                    // The arrivals are appended to the end of the list of children, so that has to be what the server wants
+                    int &alreadyMoving = movesInto[parentId];
+                    if (position != threading[parentId].children.size() + alreadyMoving)
+                        return false;
+                    ++alreadyMoving;
+                }
+                moves << qMakePair(info->internalId, parentId);
+            } else if (parentId != 0 && info->offset != position) {
+                return false;
+            }
+        } else if (info->parent != parentId || (parentId != 0 && info->offset != position)) {
+            return false;
+        }
+        ++position;
+
+        int childPosition = 0;
+        if (!collectArrivalMoves(real->children, info->internalId, childPosition, realModel, list, arrivals,
+                                 moves, movesInto, roots, found))
+            return false;
+        if (real != &node && !collectArrivalMoves(node.children.mid(1), info->internalId, childPosition, realModel, list, arrivals,
+                                                  moves, movesInto, roots, found))
+            return false;
+    }
+    return true;
+}
+
+bool ThreadingMsgListModel::moveArrival(const uint internalId, const uint newParentId)
+{
+    ThreadNodeInfo *node = threading.find(internalId);
+    Q_ASSERT(node);
+    Q_ASSERT(node->children.isEmpty());
+    ThreadNodeInfo *oldParent = threading.find(node->parent);
+    ThreadNodeInfo *newParent = threading.find(newParentId);
+    Q_ASSERT(oldParent);
+    Q_ASSERT(newParent);
+    if (oldParent == newParent)
+        return true;
+
+    const int row = node->offset;
+    QModelIndex source = oldParent->internalId ? createIndex(oldParent->offset, 0, oldParent->internalId) : QModelIndex();
+    QModelIndex destination = newParentId ? createIndex(newParent->offset, 0, newParentId) : QModelIndex();
+    if (!beginMoveRows(source, row, row, destination, newParent->children.size()))
+        return false;
+
+    oldParent->children.remove(row);
+    for (int i = row; i < oldParent->children.size(); ++i) {
+        threading.find(oldParent->children[i])->offset = i;
+    }
+    node->parent = newParentId;
+    node->offset = newParent->children.size();
+    newParent->children.append(internalId);
+
+    if (oldParent->internalId == 0) {
+        int rootPosition = threadedRootIds.lastIndexOf(internalId);
+        if (rootPosition != -1)
+            threadedRootIds.remove(rootPosition);
+    }
+    if (newParentId == 0)
+        threadedRootIds.append(internalId);
+    const uint oldParentId = oldParent->internalId;
+    endMoveRows();
+
+    // Whether the thread contains any unread messages might have changed for both of the affected thread roots
+    Q_FOREACH(uint current, QVector<uint>() << oldParentId << newParentId) {
+        while (current && threading[current].parent)
+            current = threading[current].parent;
+        if (current) {
+            QModelIndex root = createIndex(threading[current].offset, 0, current);
+            emit dataChanged(root, root.sibling(root.row(), MsgListModel::COLUMN_COUNT - 1));
+        }
+    }
+    return true;
+}
+
+bool ThreadingMsgListModel::moveThreadAfter(const uint internalId, const uint previousThreadRootUid,
+                                            const Model *realModel, TreeItemMsgList *list)
+{
+    const ThreadNodeInfo *node = threading.constFind(internalId);
+    Q_ASSERT(node);
+    if (node->parent != 0)
+        return false;
+
+    int destination = 0;
+    if (previousThreadRootUid) {
+        const ThreadNodeInfo *previous = nodeForUid(realModel, list, previousThreadRootUid);
+        if (!previous || previous->parent != 0)
+            return false;
+        destination = previous->offset + 1;
+    }
+
+    const int row = node->offset;
+    if (destination == row || destination == row + 1)
+        return true;
+    if (!beginMoveRows(QModelIndex(), row, row, QModelIndex(), destination))
+        return false;
+
+    ThreadChildList &topLevel = threading[0].children;
+    const int newRow = destination > row ? destination - 1 : destination;
+    topLevel.remove(row);
+    topLevel.insert(newRow, internalId);
+    for (int i = qMin(row, newRow); i <= qMax(row, newRow); ++i) {
+        threading.find(topLevel[i])->offset = i;
+    }
+
+    // Without sorting, this is the same ordering
+    int rootPosition = threadedRootIds.lastIndexOf(internalId);
+    if (rootPosition != -1) {
+        threadedRootIds.remove(rootPosition);
+        int previousPosition = newRow ? threadedRootIds.indexOf(topLevel[newRow - 1]) : -1;
+        threadedRootIds.insert(previousPosition + 1, internalId);
+    }
+    endMoveRows();
+    return true;
+}
+
 void ThreadingMsgListModel::askForThreading(const uint firstUnknownUid)
 {
     Q_ASSERT(m_shallBeThreading);
@@ -677,6 +1165,34 @@ void ThreadingMsgListModel::slotIncrementalThreadingAvailable(const Responses::E
     Imap::Mailbox::Model::realTreeItem(someMessage, &realModel, &realIndex);
     QModelIndex mailboxIndex = realIndex.parent().parent();
     Q_ASSERT(mailboxIndex.isValid());
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(static_cast<TreeItem*>(realIndex.parent().internalPointer()));
+    Q_ASSERT(list);
+
+    // Ideally, the server merely confirms where the new arrivals belong
+    QVector<Responses::ThreadingNode> subthreads;
+    for (Responses::ESearch::IncrementalThreadingData_t::const_iterator it = data.constBegin(); it != data.constEnd(); ++it) {
+        subthreads += it->thread;
+    }
+    if (placeArrivalsLikeServer(subthreads, false, realModel, list)) {
+        bool placed = true;
+        if (!rootsAreSorted()) {
+            for (Responses::ESearch::IncrementalThreadingData_t::const_iterator it = data.constBegin();
+                 placed && it != data.constEnd(); ++it) {
+                if (it->thread.isEmpty())
+                    continue;
+                // A missing message is replaced by its first child, see pruneTree()
+                const Responses::ThreadingNode &top = it->thread.first();
+                const ThreadNodeInfo *root = top.num ? nodeForUid(realModel, list, top.num) : 0;
+                if (!root && !top.children.isEmpty() && top.children.first().num)
+                    root = nodeForUid(realModel, list, top.children.first().num);
+                placed = root && moveThreadAfter(root->internalId, it->previousThreadRoot, realModel, list);
+            }
+        }
+        if (placed) {
+            logTrace(QStringLiteral("New arrivals placed according to the incremental threading"));
+            return;
+        }
+    }
 
     // First phase: remove all messages mentioned in the incremental responses from their original placement
     Imap::Uids affectedUids;
@@ -686,29 +1202,31 @@ void ThreadingMsgListModel::slotIncrementalThreadingAvailable(const Responses::E
     qSort(affectedUids);
     QList<TreeItemMessage*> affectedMessages = const_cast<Model*>(realModel)->
             findMessagesByUids(static_cast<TreeItemMailbox*>(mailboxIndex.internalPointer()), affectedUids);
-    QHash<uint,void *> uidToPtrCache;
+    QVector<ThreadNodeByUid> uidToNode;
+    uidToNode.reserve(affectedMessages.size());
 
 
     emit layoutAboutToBeChanged();
     updatePersistentIndexesPhase1();
     for (QList<TreeItemMessage*>::const_iterator it = affectedMessages.constBegin(); it != affectedMessages.constEnd(); ++it) {
-        QHash<void *,uint>::const_iterator ptrMappingIt = ptrToInternal.constFind(*it);
-        Q_ASSERT(ptrMappingIt != ptrToInternal.constEnd());
-        QHash<uint,ThreadNodeInfo>::iterator threadIt = threading.find(*ptrMappingIt);
-        Q_ASSERT(threadIt != threading.end());
-        uidToPtrCache[(*it)->uid()] = threadIt->ptr;
+        const uint internalId = internalIdForSourceRow((*it)->row());
+        Q_ASSERT(internalId);
+        ThreadNodeInfo *threadIt = threading.find(internalId);
+        Q_ASSERT(threadIt);
+        uidToNode.append(ThreadNodeByUid((*it)->uid(), internalId, threadIt->ptr));
         threadIt->ptr = 0;
     }
+    std::sort(uidToNode.begin(), uidToNode.end());
     pruneTree();
     updatePersistentIndexesPhase2();
     emit layoutChanged();
 
     // Second phase: for each message whose UID is returned by the server, update the threading data
-    QSet<uint> usedNodes;
+    QBitArray usedNodes;
     emit layoutAboutToBeChanged();
     updatePersistentIndexesPhase1();
     for (Responses::ESearch::IncrementalThreadingData_t::const_iterator it = data.constBegin(); it != data.constEnd(); ++it) {
-        registerThreading(it->thread, 0, uidToPtrCache, usedNodes);
+        registerThreading(it->thread, 0, uidToNode, usedNodes);
         int actualOffset = threading[0].children.size() - 1;
         int expectedOffsetOfPrevious = threading[0].children.indexOf(it->previousThreadRoot);
         if (actualOffset == expectedOffsetOfPrevious + 1) {
@@ -887,8 +1405,8 @@ void ThreadingMsgListModel::calculateNullSort()
     m_currentSortResult.clear();
     m_currentSortResult.reserve(threadedRootIds.size() + headroomForNewmessages);
     Q_FOREACH(const uint internalId, threadedRootIds) {
-        QHash<uint,ThreadNodeInfo>::const_iterator it = threading.constFind(internalId);
-        if (it == threading.constEnd())
+        const ThreadNodeInfo *it = threading.constFind(internalId);
+        if (!it)
             continue;
         if (it->uid)
             m_currentSortResult.append(it->uid);
@@ -898,30 +1416,35 @@ void ThreadingMsgListModel::calculateNullSort()
 
 void ThreadingMsgListModel::applyThreading(const QVector<Imap::Responses::ThreadingNode> &mapping)
 {
+    TROJITA_PROFILE_SCOPE("ThreadingMsgListModel::applyThreading");
     if (! unknownUids.isEmpty()) {
         // Some messages have UID zero, which means that they weren't loaded yet. Too bad.
         logTrace(QStringLiteral("%1 messages have 0 UID").arg(unknownUids.size()));
         return;
     }
 
+    m_pendingArrivals.clear();
+
     emit layoutAboutToBeChanged();
 
     updatePersistentIndexesPhase1();
 
     threading.clear();
-    ptrToInternal.clear();
+    m_idsBySourceRow.clear();
     // Default-construct the root node
     threading[ 0 ].ptr = 0;
 
     // At first, initialize threading nodes for all messages which are right now available in the mailbox.
     // We risk that we will have to delete some of them later on, but this is likely better than doing a lookup
     // for each UID individually (remember, the THREAD response might contain UIDs in crazy order).
+    // The messages are ordered by their UIDs in the mailbox, so the lookup table is sorted by construction and a binary search
+    // is all that the registerThreading() needs.
     int upstreamMessages = sourceModel()->rowCount();
-    QHash<uint,void *> uidToPtrCache;
-    QSet<uint> usedNodes;
-    uidToPtrCache.reserve(upstreamMessages + headroomForNewmessages);
-    threading.reserve(upstreamMessages + headroomForNewmessages);
-    ptrToInternal.reserve(upstreamMessages + headroomForNewmessages);
+    QVector<ThreadNodeByUid> uidToNode;
+    QBitArray usedNodes;
+    uidToNode.reserve(upstreamMessages);
+    threading.reserve(upstreamMessages + 1 + headroomForNewmessages);
+    m_idsBySourceRow.reserve(upstreamMessages + headroomForNewmessages);
 
     if (upstreamMessages) {
         // Work with pointers instead going through the MVC API for performance.
@@ -936,85 +1459,99 @@ void ThreadingMsgListModel::applyThreading(const QVector<Imap::Responses::Thread
         TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(firstMessagePtr->parent());
         Q_ASSERT(list);
         for (int i = 0; i < upstreamMessages; ++i) {
-            ThreadNodeInfo node;
-            node.uid = dynamic_cast<TreeItemMessage *>(list->m_children[i])->uid();
-            if (! node.uid) {
+            uint uid = dynamic_cast<TreeItemMessage *>(list->m_children[i])->uid();
+            if (! uid) {
                 throw UnknownMessageIndex("Encountered a message with zero UID when threading. This is a bug in Trojita, sorry.");
             }
 
-            node.internalId = i + 1;
+            // We're creating a new node here
+            Q_ASSERT(!threading.contains(i + 1));
+            ThreadNodeInfo &node = threading[i + 1];
+            node.uid = uid;
             node.ptr = list->m_children[i];
-            uidToPtrCache[node.uid] = node.ptr;
+            uidToNode.append(ThreadNodeByUid(node.uid, node.internalId, node.ptr));
             threadingHelperLastId = node.internalId;
-            // We're creating a new node here
-            Q_ASSERT(!threading.contains(node.internalId));
-            threading[ node.internalId ] = node;
-            ptrToInternal[ node.ptr ] = node.internalId;
+            m_idsBySourceRow.append(node.internalId);
+        }
+        if (!std::is_sorted(uidToNode.constBegin(), uidToNode.constEnd())) {
+            // This would be a server bug, but let's not make the lookups silently fail
+            std::sort(uidToNode.begin(), uidToNode.end());
         }
     }
 
     // Mark the root node as always present
-    usedNodes.insert(0);
+    usedNodes.resize(threading.idLimit());
+    usedNodes.setBit(0);
 
     // Set up parents and find the list of all used nodes
-    registerThreading(mapping, 0, uidToPtrCache, usedNodes);
+    registerThreading(mapping, 0, uidToNode, usedNodes);
 
     // Now remove all messages which were not referenced in the THREAD response from our mapping
-    QHash<uint,ThreadNodeInfo>::iterator it = threading.begin();
-    while (it != threading.end()) {
-        if (usedNodes.contains(it.key())) {
+    for (uint id = 1; id < threading.idLimit(); ++id) {
+        if (id < static_cast<uint>(usedNodes.size()) && usedNodes.testBit(id)) {
             // this message should be shown
-            ++it;
-        } else {
+            continue;
+        }
+        const ThreadNodeInfo *node = threading.constFind(id);
+        if (node) {
             // this message is not included in the list of messages actually to be shown
-            ptrToInternal.remove(it->ptr);
-            it = threading.erase(it);
+            if (node->ptr)
+                m_idsBySourceRow[node->ptr->row()] = 0;
+            threading.remove(id);
         }
     }
     pruneTree();
     updatePersistentIndexesPhase2();
     if (rowCount())
-        threadedRootIds = threading[0].children;
+        threadedRootIds = threading[0].children.toVector();
     emit layoutChanged();
 
     // If the sorting was active before, we shall reactivate it now
     searchSortPreferenceImplementation(m_currentSearchConditions, m_currentSortingCriteria, m_sortReverse ? Qt::DescendingOrder : Qt::AscendingOrder);
 }
 
-void ThreadingMsgListModel::registerThreading(const QVector<Imap::Responses::ThreadingNode> &mapping, uint parentId, const QHash<uint,void *> &uidToPtr, QSet<uint> &usedNodes)
+void ThreadingMsgListModel::registerThreading(const QVector<Imap::Responses::ThreadingNode> &mapping, uint parentId,
+                                              const QVector<ThreadNodeByUid> &uidToNode, QBitArray &usedNodes)
 {
+    Q_ASSERT(threading.contains(parentId));
+
     Q_FOREACH(const Imap::Responses::ThreadingNode &node, mapping) {
         uint nodeId;
-        QHash<uint,void *>::const_iterator ptrIt;
-        if (node.num == 0 ||
-                (ptrIt = uidToPtr.find(node.num)) == uidToPtr.constEnd()) {
+        QVector<ThreadNodeByUid>::const_iterator entry = uidToNode.constEnd();
+        if (node.num != 0) {
+            entry = std::lower_bound(uidToNode.constBegin(), uidToNode.constEnd(), ThreadNodeByUid(node.num, 0, 0));
+            if (entry != uidToNode.constEnd() && entry->uid != node.num)
+                entry = uidToNode.constEnd();
+        }
+
+        if (entry == uidToNode.constEnd()) {
             // Either this is an empty node, or the THREAD response references a UID which is no longer in the mailbox.
             // This is a valid scenario; it can happen e.g. when reusing data from cache, or when a message got
             // expunged after the untagged THREAD was received, but before the tagged OK.
             // We cannot just ignore this node, though, because it might have some children which we would otherwise
             // simply hide.
-            // The ptrIt which is initialized by the condition is used in the else branch.
-            ThreadNodeInfo fake;
-            fake.internalId = ++threadingHelperLastId;
-            fake.parent = parentId;
-            Q_ASSERT(threading.contains(parentId));
-            // The child will be registered to the list of parent's children after the if/else branch
-            threading[ fake.internalId ] = fake;
-            nodeId = fake.internalId;
+            // The child will be registered to the list of parent's children below.
+            nodeId = ++threadingHelperLastId;
+            threading[nodeId];
         } else {
-            QHash<void *,uint>::const_iterator nodeIt = ptrToInternal.constFind(*ptrIt);
-            // The following assert would fail if there was a node with a valid UID, but not in our ptrToInternal mapping.
-            // That is however non-issue, as we pre-create nodes for all messages beforehand.
-            Q_ASSERT(nodeIt != ptrToInternal.constEnd());
-            nodeId = *nodeIt;
+            // We pre-create nodes for all messages beforehand, but the incremental threading might have pruned some of them
+            // in the meanwhile; the operator[] brings them back.
+            nodeId = entry->internalId;
+            ThreadNodeInfo &target = threading[nodeId];
+            target.uid = entry->uid;
             // This is needed for the incremental stuff
-            threading[nodeId].ptr = static_cast<TreeItem*>(*ptrIt);
+            target.ptr = entry->ptr;
         }
-        threading[nodeId].offset = threading[parentId].children.size();
-        threading[ parentId ].children.append(nodeId);
-        threading[ nodeId ].parent = parentId;
-        usedNodes.insert(nodeId);
-        registerThreading(node.children, nodeId, uidToPtr, usedNodes);
+        // Careful, creating the node above could have moved all nodes around in memory
+        ThreadNodeInfo &parentNode = threading[parentId];
+        ThreadNodeInfo &childNode = threading[nodeId];
+        childNode.offset = parentNode.children.size();
+        childNode.parent = parentId;
+        parentNode.children.append(nodeId);
+        if (nodeId >= static_cast<uint>(usedNodes.size()))
+            usedNodes.resize(qMax<int>(nodeId + 1, usedNodes.size() * 3 / 2));
+        usedNodes.setBit(nodeId);
+        registerThreading(node.children, nodeId, uidToNode, usedNodes);
     }
 }
 
@@ -1022,38 +1559,31 @@ void ThreadingMsgListModel::registerThreading(const QVector<Imap::Responses::Thr
 void ThreadingMsgListModel::updatePersistentIndexesPhase1()
 {
     oldPersistentIndexes = persistentIndexList();
-    oldPtrs.clear();
+    oldSourceRows.clear();
+    oldSourceRows.reserve(oldPersistentIndexes.size());
     Q_FOREACH(const QModelIndex &idx, oldPersistentIndexes) {
         // the index could get invalidated by the pruneTree() or something else manipulating our threading
-        bool isOk = idx.isValid() && threading.contains(idx.internalId());
-        if (!isOk) {
-            oldPtrs << 0;
-            continue;
-        }
-        QModelIndex translated = mapToSource(idx);
-        if (!translated.isValid()) {
-            // another stale item
-            oldPtrs << 0;
-            continue;
-        }
-        oldPtrs << translated.internalPointer();
+        const ThreadNodeInfo *node = idx.isValid() ? threading.constFind(idx.internalId()) : 0;
+        // Fake messages have no pointer, so they get thrown away as well
+        oldSourceRows << (node && node->ptr ? node->ptr->row() : -1);
     }
 }
 
 /** @short Update the gathered persistent indexes after our change in the layout */
 void ThreadingMsgListModel::updatePersistentIndexesPhase2()
 {
-    Q_ASSERT(oldPersistentIndexes.size() == oldPtrs.size());
+    Q_ASSERT(oldPersistentIndexes.size() == oldSourceRows.size());
     QList<QModelIndex> updatedIndexes;
+    updatedIndexes.reserve(oldPersistentIndexes.size());
     for (int i = 0; i < oldPersistentIndexes.size(); ++i) {
-        QHash<void *,uint>::const_iterator ptrIt = ptrToInternal.constFind(oldPtrs[i]);
-        if (ptrIt == ptrToInternal.constEnd()) {
+        const uint internalId = internalIdForSourceRow(oldSourceRows[i]);
+        if (!internalId) {
             // That message is no longer there
             updatedIndexes.append(QModelIndex());
             continue;
         }
-        QHash<uint,ThreadNodeInfo>::const_iterator it = threading.constFind(*ptrIt);
-        if (it == threading.constEnd()) {
+        const ThreadNodeInfo *it = threading.constFind(internalId);
+        if (!it) {
             // Filtering doesn't accept this index, let's declare it dead
             updatedIndexes.append(QModelIndex());
         } else {
@@ -1063,120 +1593,138 @@ void ThreadingMsgListModel::updatePersistentIndexesPhase2()
     Q_ASSERT(oldPersistentIndexes.size() == updatedIndexes.size());
     changePersistentIndexList(oldPersistentIndexes, updatedIndexes);
     oldPersistentIndexes.clear();
-    oldPtrs.clear();
+    oldSourceRows.clear();
 }
 
 void ThreadingMsgListModel::pruneTree()
 {
-    // Our mapping (threading) is completely unsorted, which means that we simply don't have any way of walking the tree from
-    // the top. Instead, we got to work with a random walk, processing nodes in an unspecified order.  If we iterated on the QHash
-    // directly, we'd hit an issue with iterator ordering (basically, we want to be able to say "hey, I don't care at which point
-    // of the iteration I'm right now, the next node to process should be that one, and then we should resume with the rest").
-    QList<uint> pending = threading.keys();
+    // The nodes are processed in the order of their internal IDs, which says nothing about their placement in the tree.
+    // Removed children are not erased from their parents' lists right away. They are replaced by a zero instead (which can never
+    // be a child) so that the offsets of their siblings remain usable for finding them; the lists are compacted at the very end.
+    // That keeps the whole pruning linear even when a lot of fake nodes at the top level go away.
 
-    // These are the parents whose children will have to be renumbered later on
+    // These are the parents whose children will have to be compacted and renumbered later on
     QSet<uint> parentsForRenumbering;
 
-    for (QList<uint>::iterator id = pending.begin(); id != pending.end(); /* nothing */) {
-        // Convert to the hashmap
-        // The "it" iterator point to the current node in the threading mapping
-        QHash<uint, ThreadNodeInfo>::iterator it = threading.find(*id);
-        if (it == threading.end()) {
-            // We've already seen this node, that's due to promoting
-            ++id;
-            continue;
-        }
+    // Thread roots which were either removed (mapped to 0) or replaced by some other node
+    QHash<uint, uint> replacedRoots;
 
-        if (it->internalId == 0) {
-            // A special root item; we should not delete that one :)
-            ++id;
-            continue;
+    auto compactChildren = [this](ThreadNodeInfo *node) {
+        node->children.erase(std::remove(node->children.begin(), node->children.end(), 0u), node->children.end());
+        for (int offset = 0; offset < node->children.size(); ++offset) {
+            ThreadNodeInfo *child = threading.find(node->children[offset]);
+            Q_ASSERT(child);
+            child->offset = offset;
         }
-        if (it->ptr) {
-            // regular and valid message -> skip
-            ++id;
-        } else {
+    };
+
+    const uint idLimit = threading.idLimit();
+    for (uint id = 1; id < idLimit; ++id) {
+        // The current node might get replaced by its first child which is fake as well; that one has to be visited right away
+        uint current = id;
+        while (current) {
+            ThreadNodeInfo *it = threading.find(current);
+            if (!it || it->ptr) {
+                // Either a node which we've already removed, or a regular and valid message -> skip
+                break;
+            }
+            current = 0;
+
             // a fake one
 
+            if (parentsForRenumbering.contains(it->internalId)) {
+                // Some of our children are gone already, get rid of their placeholders
+                compactChildren(it);
+                parentsForRenumbering.remove(it->internalId);
+            }
+
             // each node has a parent
-            QHash<uint, ThreadNodeInfo>::iterator parent = threading.find(it->parent);
-            Q_ASSERT(parent != threading.end());
+            ThreadNodeInfo *parent = threading.find(it->parent);
+            Q_ASSERT(parent);
 
-            // and the node itself has to be found in its parent's children
-            QList<uint>::iterator childIt = qFind(parent->children.begin(), parent->children.end(), it->internalId);
+            // and the node itself has to be found in its parent's children; the iterator is only good until some list grows
+            ThreadChildList::iterator childIt;
+            if (it->offset >= 0 && it->offset < parent->children.size() && parent->children[it->offset] == it->internalId) {
+                childIt = parent->children.begin() + it->offset;
+            } else {
+                // The offset is stale because this node was moved around by a previous promotion
+                childIt = std::find(parent->children.begin(), parent->children.end(), it->internalId);
+            }
             Q_ASSERT(childIt != parent->children.end());
-            // The offset of this child might no longer be correct, though -- we're postponing the actual deletion until later
 
             if (it->children.isEmpty()) {
                 // This is a leaf node, so we can just remove it
-                childIt = parent->children.erase(childIt);
-                // We do not perform the renumbering immediately, that would lead to an O(n^2) performance when deleting nodes.
+                *childIt = 0;
                 parentsForRenumbering.insert(it->parent);
-                parentsForRenumbering.remove(it->internalId);
 
                 if (it->parent == 0) {
-                    threadedRootIds.removeOne(it->internalId);
+                    replacedRoots[it->internalId] = 0;
                 }
-                threading.erase(it);
-                ++id;
+                threading.remove(it->internalId);
 
             } else {
                 // This node has some children, so we can't just delete it. Instead of that, we promote its first child
                 // to replace this node.
-                QHash<uint, ThreadNodeInfo>::iterator replaceWith = threading.find(it->children.first());
-                Q_ASSERT(replaceWith != threading.end());
+                const uint replaceWithId = it->children.first();
+                ThreadNodeInfo *replaceWith = threading.find(replaceWithId);
+                Q_ASSERT(replaceWith);
 
                 // The offsets will, again, be updated later on
                 parentsForRenumbering.insert(it->parent);
-                parentsForRenumbering.insert(replaceWith.key());
-                parentsForRenumbering.remove(it->internalId);
+                parentsForRenumbering.insert(replaceWithId);
 
-                // Replace the node
-                *childIt = it->children.first();
+                // Replace the node; this keeps the offsets of all siblings intact
+                *childIt = replaceWithId;
                 replaceWith->parent = parent->internalId;
+                replaceWith->offset = childIt - parent->children.begin();
 
                 // Now merge the lists of children
-                it->children.removeFirst();
-                replaceWith->children = replaceWith->children + it->children;
-
-                // Fix parent information of all children of the replacement node
-                for (int i = 0; i < replaceWith->children.size(); ++i) {
-                    QHash<uint, ThreadNodeInfo>::iterator sibling = threading.find(replaceWith->children[i]);
-                    Q_ASSERT(sibling != threading.end());
-                    sibling->parent = replaceWith.key();
+                for (int i = 1; i < it->children.size(); ++i) {
+                    replaceWith->children.append(it->children[i]);
+                    ThreadNodeInfo *sibling = threading.find(it->children[i]);
+                    Q_ASSERT(sibling);
+                    sibling->parent = replaceWithId;
                 }
 
                 if (parent->internalId == 0) {
-                    // Update the list of all thread roots
-                    QList<uint>::iterator rootIt = qFind(threadedRootIds.begin(), threadedRootIds.end(), it->internalId);
-                    if (rootIt != threadedRootIds.end())
-                        *rootIt = replaceWith->internalId;
+                    // The list of all thread roots gets updated at the end
+                    replacedRoots[it->internalId] = replaceWithId;
                 }
 
                 // Now that all references are gone, remove the original node
-                threading.erase(it);
+                threading.remove(it->internalId);
 
                 if (!replaceWith->ptr) {
-                    // If the just-promoted item is also a fake one, we'll have to visit it as well. This assignment is safe,
+                    // If the just-promoted item is also a fake one, we'll have to visit it as well. This is safe,
                     // because we've already processed the current item and are completely done with it. The worst which can
                     // happen is that we'll visit the same node twice, which is reasonably acceptable.
-                    *id = replaceWith.key();
+                    current = replaceWithId;
                 }
             }
         }
     }
 
     // Now fix the sequential numbering of all siblings of deleted children
-    Q_FOREACH(const auto parentId, parentsForRenumbering) {
-        auto parentIt = threading.constFind(parentId);
-        Q_ASSERT(parentIt != threading.constEnd());
-        int offset = 0;
-        for (auto childNumber = parentIt->children.constBegin(); childNumber != parentIt->children.constEnd(); ++childNumber, ++offset) {
-            auto childIt = threading.find(*childNumber);
-            Q_ASSERT(childIt != threading.end());
-            childIt->offset = offset;
+    Q_FOREACH(const uint parentId, parentsForRenumbering) {
+        ThreadNodeInfo *parent = threading.find(parentId);
+        if (parent)
+            compactChildren(parent);
+    }
+
+    if (!replacedRoots.isEmpty()) {
+        QVector<uint> roots;
+        roots.reserve(threadedRootIds.size());
+        Q_FOREACH(uint rootId, threadedRootIds) {
+            QHash<uint, uint>::const_iterator replacement;
+            while ((replacement = replacedRoots.constFind(rootId)) != replacedRoots.constEnd())
+                rootId = *replacement;
+            if (rootId)
+                roots.append(rootId);
         }
+        threadedRootIds = roots;
     }
+
+    threading.compactChildLists();
 }
 
 QStringList ThreadingMsgListModel::supportedCapabilities()
@@ -1204,12 +1752,11 @@ QMimeData *ThreadingMsgListModel::mimeData(const QModelIndexList &indexes) const
 bool ThreadingMsgListModel::threadContainsUnreadMessages(const uint root) const
 {
     // FIXME: cache the value somewhere...
-    QList<uint> queue;
+    QVector<uint> queue;
     queue.append(root);
-    while (! queue.isEmpty()) {
-        uint current = queue.takeFirst();
-        QHash<uint,ThreadNodeInfo>::const_iterator it = threading.constFind(current);
-        Q_ASSERT(it != threading.constEnd());
+    for (int i = 0; i < queue.size(); ++i) {
+        const ThreadNodeInfo *it = threading.constFind(queue[i]);
+        Q_ASSERT(it);
         if (it->ptr) {
             // Because of the delayed delete via pruneTree, we can hit a null pointer here
             TreeItemMessage *message = dynamic_cast<TreeItemMessage *>(it->ptr);
@@ -1217,7 +1764,8 @@ bool ThreadingMsgListModel::threadContainsUnreadMessages(const uint root) const
             if (! message->isMarkedAsRead())
                 return true;
         }
-        queue.append(it->children);
+        for (int j = 0; j < it->children.size(); ++j)
+            queue.append(it->children[j]);
     }
     return false;
 }
@@ -1270,6 +1818,7 @@ bool ThreadingMsgListModel::searchSortPreferenceImplementation(const QStringList
 {
     Q_ASSERT(sourceModel());
     m_sortReverse = order == Qt::DescendingOrder;
+    m_sortingLocally = false;
     if (!sourceModel()->rowCount()) {
         return false;
     }
@@ -1346,6 +1895,19 @@ bool ThreadingMsgListModel::searchSortPreferenceImplementation(const QStringList
         return true;
     }
 
+    if (searchConditions.isEmpty() && (!hasSort || !realModel->isNetworkAvailable())) {
+        // The server cannot sort for us, but we can
+        if (m_sortTask && m_sortTask->isPersistent())
+            m_sortTask->cancelSortingUpdates();
+        m_currentSearchConditions = searchConditions;
+        m_currentSortingCriteria = criterium;
+        m_currentSortResult = sortLocally(realModel, mailboxIndex, criterium);
+        m_sortingLocally = true;
+        m_searchValidity = RESULT_FRESH;
+        applySort();
+        return true;
+    }
+
     if (!hasSort) {
         // sorting is completely unsupported
         return false;
@@ -1391,11 +1953,19 @@ void ThreadingMsgListModel::applySort()
 
     emit layoutAboutToBeChanged();
     updatePersistentIndexesPhase1();
-    QSet<uint> newlyUnreachable(threading[0].children.toSet());
+    QSet<uint> newlyUnreachable;
+    newlyUnreachable.reserve(threading[0].children.size());
+    Q_FOREACH(const uint id, threading[0].children) {
+        newlyUnreachable.insert(id);
+    }
     threading[0].children.clear();
     threading[0].children.reserve(m_currentSortResult.size() + headroomForNewmessages);
 
-    QSet<uint> allRootIds(threadedRootIds.toSet());
+    QSet<uint> allRootIds;
+    allRootIds.reserve(threadedRootIds.size());
+    Q_FOREACH(const uint id, threadedRootIds) {
+        allRootIds.insert(id);
+    }
 
     for (int i = 0; i < m_currentSortResult.size(); ++i) {
         int offset = m_sortReverse ? m_currentSortResult.size() - 1 - i : i;
@@ -1406,14 +1976,14 @@ void ThreadingMsgListModel::applySort()
             continue;
         }
         Q_ASSERT(messages.size() == 1);
-        QHash<void *,uint>::const_iterator it = ptrToInternal.constFind(messages.front());
-        Q_ASSERT(it != ptrToInternal.constEnd());
-        if (!allRootIds.contains(*it)) {
+        const uint internalId = internalIdForSourceRow(messages.front()->row());
+        Q_ASSERT(internalId);
+        if (!allRootIds.contains(internalId)) {
             // not a thread root, so don't show it
             continue;
         }
-        threading[*it].offset = threading[0].children.size();
-        threading[0].children.append(*it);
+        threading[internalId].offset = threading[0].children.size();
+        threading[0].children.append(internalId);
     }
 
     // Now remove everything which is no longer reachable from the root of the thread mapping
@@ -1423,11 +1993,12 @@ void ThreadingMsgListModel::applySort()
     }
     std::vector<uint> queue(newlyUnreachable.constBegin(), newlyUnreachable.constEnd());
     for (std::vector<uint>::size_type i = 0; i < queue.size(); ++i) {
-        QHash<uint,ThreadNodeInfo>::iterator threadingIt = threading.find(queue[i]);
-        Q_ASSERT(threadingIt != threading.end());
+        const ThreadNodeInfo *threadingIt = threading.constFind(queue[i]);
+        Q_ASSERT(threadingIt);
         queue.insert(queue.end(), threadingIt->children.constBegin(), threadingIt->children.constEnd());
-        threading.erase(threadingIt);
+        threading.remove(queue[i]);
     }
+    threading.compactChildLists();
 
     updatePersistentIndexesPhase2();
     emit layoutChanged();
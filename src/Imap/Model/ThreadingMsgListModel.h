@@ -23,10 +23,15 @@
 #ifndef IMAP_THREADINGMSGLISTMODEL_H
 #define IMAP_THREADINGMSGLISTMODEL_H
 
+#include <algorithm>
 #include <QAbstractProxyModel>
+#include <QBitArray>
 #include <QPointer>
 #include <QSet>
+#include <QVector>
 #include "Imap/Parser/Response.h"
+#include "LocalSorting.h"
+#include "LocalThreading.h"
 
 class QTimer;
 class ImapModelThreadingTest;
@@ -43,6 +48,145 @@ class SortTask;
 class TreeItem;
 class TreeItemMsgList;
 
+/** @short Backing storage shared by the lists of children of all nodes in one ThreadNodeArena */
+struct ThreadChildPool {
+    QVector<uint> ids;
+    /** @short Number of slots in the ids which no list refers to anymore */
+    int garbage;
+    ThreadChildPool(): garbage(0) {}
+};
+
+/** @short List of children of a thread node, stored as a span of the arena's shared pool
+
+The children of all nodes live in a single contiguous vector, so walking the tree does not chase a separate heap allocation for
+each node.  A list which outgrows its span is moved to the end of the pool with twice the capacity; the slots which it left behind
+are reclaimed by ThreadNodeArena::compactChildLists().  Growing any list of the same pool invalidates all iterators, and copies of
+a list refer to the very same span, so use toVector() when a snapshot is needed.
+*/
+class ThreadChildList
+{
+public:
+    typedef uint *iterator;
+    typedef const uint *const_iterator;
+
+    ThreadChildList(): m_pool(0), m_begin(0), m_size(0), m_capacity(0) {}
+    explicit ThreadChildList(ThreadChildPool *pool): m_pool(pool), m_begin(0), m_size(0), m_capacity(0) {}
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    int capacity() const { return m_capacity; }
+
+    uint operator[](const int i) const
+    {
+        Q_ASSERT(i >= 0 && i < m_size);
+        return m_pool->ids.at(m_begin + i);
+    }
+
+    uint first() const { return (*this)[0]; }
+
+    iterator begin() { return m_pool->ids.data() + m_begin; }
+    iterator end() { return begin() + m_size; }
+    const_iterator begin() const { return constBegin(); }
+    const_iterator end() const { return constEnd(); }
+    const_iterator constBegin() const { return m_pool->ids.constData() + m_begin; }
+    const_iterator constEnd() const { return constBegin() + m_size; }
+
+    int indexOf(const uint id) const
+    {
+        const_iterator it = std::find(constBegin(), constEnd(), id);
+        return it == constEnd() ? -1 : it - constBegin();
+    }
+
+    void reserve(const int size)
+    {
+        if (size > m_capacity)
+            grow(size);
+    }
+
+    void append(const uint id)
+    {
+        if (m_size == m_capacity)
+            grow(qMax(2, m_capacity * 2));
+        m_pool->ids[m_begin + m_size++] = id;
+    }
+
+    ThreadChildList &operator<<(const uint id)
+    {
+        append(id);
+        return *this;
+    }
+
+    void insert(const int i, const uint id)
+    {
+        Q_ASSERT(i >= 0 && i <= m_size);
+        append(id);
+        std::rotate(begin() + i, end() - 1, end());
+    }
+
+    void remove(const int i)
+    {
+        Q_ASSERT(i >= 0 && i < m_size);
+        std::copy(begin() + i + 1, end(), begin() + i);
+        --m_size;
+    }
+
+    uint takeLast()
+    {
+        const uint id = (*this)[m_size - 1];
+        --m_size;
+        return id;
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        m_size = std::copy(last, end(), first) - begin();
+        return first;
+    }
+
+    /** @short Forget all children, but keep the span for the upcoming ones */
+    void clear() { m_size = 0; }
+
+    QVector<uint> toVector() const
+    {
+        QVector<uint> res(m_size);
+        std::copy(constBegin(), constEnd(), res.begin());
+        return res;
+    }
+
+private:
+    void grow(const int newCapacity)
+    {
+        QVector<uint> &ids = m_pool->ids;
+        if (m_begin + m_capacity == ids.size()) {
+            // The last span of the pool can simply be extended
+            ids.resize(m_begin + newCapacity);
+        } else {
+            const int newBegin = ids.size();
+            ids.resize(newBegin + newCapacity);
+            std::copy(ids.constData() + m_begin, ids.constData() + m_begin + m_size, ids.data() + newBegin);
+            m_pool->garbage += m_capacity;
+            m_begin = newBegin;
+        }
+        m_capacity = newCapacity;
+    }
+
+    /** @short Copy the span to the end of the target pool, keeping the capacity */
+    void moveTo(QVector<uint> &ids)
+    {
+        const int newBegin = ids.size();
+        ids.resize(newBegin + m_capacity);
+        std::copy(constBegin(), constEnd(), ids.data() + newBegin);
+        m_begin = newBegin;
+    }
+
+    ThreadChildPool *m_pool;
+    int m_begin;
+    int m_size;
+    int m_capacity;
+
+    friend class ThreadNodeArena;
+};
+
 /** @short A node in tree structure used for threading representation */
 struct ThreadNodeInfo {
     /** @short Internal unique identifier used for model indexes */
@@ -52,7 +196,7 @@ struct ThreadNodeInfo {
     /** @short internalId of a parent of this message */
     uint parent;
     /** @short List of children of current node */
-    QList<uint> children;
+    ThreadChildList children;
     /** @short Pointer to the TreeItemMessage* of the corresponding message */
     TreeItem *ptr;
     /** @short Position among our parent's children */
@@ -62,6 +206,137 @@ struct ThreadNodeInfo {
 
 QDebug operator<<(QDebug debug, const ThreadNodeInfo &node);
 
+/** @short Storage of the thread tree nodes, addressed directly by their internal ID
+
+The internal IDs are handed out sequentially, so the nodes can live in a flat vector instead of being scattered across a hash
+table.  The API mimics the subset of QHash which the ThreadingMsgListModel needs, except that the lookups return plain pointers
+which are null for missing nodes.  Creating a node through operator[] fills in its internalId and hooks its list of children
+up to the pool which the arena shares among all of its nodes.
+*/
+class ThreadNodeArena
+{
+public:
+    ThreadNodeArena(): m_count(0) {}
+
+    bool isEmpty() const { return m_count == 0; }
+    int size() const { return m_count; }
+
+    /** @short One past the highest internal ID which could be in use */
+    uint idLimit() const { return m_nodes.size(); }
+
+    bool contains(const uint id) const
+    {
+        return id < static_cast<uint>(m_nodes.size()) && m_alive.testBit(id);
+    }
+
+    const ThreadNodeInfo *constFind(const uint id) const
+    {
+        return contains(id) ? m_nodes.constData() + id : 0;
+    }
+
+    ThreadNodeInfo *find(const uint id)
+    {
+        return contains(id) ? m_nodes.data() + id : 0;
+    }
+
+    /** @short Return the node with the given ID, creating it if it does not exist yet */
+    ThreadNodeInfo &operator[](const uint id)
+    {
+        if (id >= static_cast<uint>(m_nodes.size())) {
+            // Grow geometrically; the IDs of new arrivals are allocated one by one
+            int newSize = qMax<int>(id + 1, m_nodes.size() * 3 / 2);
+            m_nodes.resize(newSize);
+            m_alive.resize(newSize);
+        }
+        if (!m_alive.testBit(id)) {
+            m_alive.setBit(id);
+            m_nodes[id].internalId = id;
+            m_nodes[id].children = ThreadChildList(&m_childPool);
+            ++m_count;
+        }
+        return m_nodes[id];
+    }
+
+    const ThreadNodeInfo &operator[](const uint id) const
+    {
+        Q_ASSERT(contains(id));
+        return m_nodes[id];
+    }
+
+    void remove(const uint id)
+    {
+        if (!contains(id))
+            return;
+        m_childPool.garbage += m_nodes[id].children.capacity();
+        m_nodes[id] = ThreadNodeInfo();
+        m_alive.clearBit(id);
+        --m_count;
+    }
+
+    void clear()
+    {
+        m_nodes.clear();
+        m_alive.clear();
+        m_count = 0;
+        m_childPool.ids.clear();
+        m_childPool.garbage = 0;
+    }
+
+    void reserve(const int size) { m_nodes.reserve(size); }
+
+    /** @short IDs of all nodes in an ascending order */
+    QList<uint> keys() const
+    {
+        QList<uint> res;
+        res.reserve(m_count);
+        for (int i = 0; i < m_nodes.size(); ++i) {
+            if (m_alive.testBit(i))
+                res << i;
+        }
+        return res;
+    }
+
+    /** @short Reclaim the slots of the child pool which were abandoned by grown lists and by removed nodes
+
+    This does nothing unless at least half of the pool is garbage, so it is cheap enough to call after each batch of changes
+    to the tree.  The lists get laid out in the order of their node IDs and keep their capacity.
+    */
+    void compactChildLists()
+    {
+        if (m_childPool.garbage * 2 <= m_childPool.ids.size())
+            return;
+        QVector<uint> ids;
+        ids.reserve(m_childPool.ids.size() - m_childPool.garbage);
+        for (int i = 0; i < m_nodes.size(); ++i) {
+            if (m_alive.testBit(i))
+                m_nodes[i].children.moveTo(ids);
+        }
+        m_childPool.ids = ids;
+        m_childPool.garbage = 0;
+    }
+
+private:
+    Q_DISABLE_COPY(ThreadNodeArena)
+
+    QVector<ThreadNodeInfo> m_nodes;
+    QBitArray m_alive;
+    int m_count;
+    ThreadChildPool m_childPool;
+};
+
+/** @short Where to find a message with a given UID in the thread tree
+
+Vectors of these are kept sorted by the UID, which is what the mailbox order guarantees anyway.
+*/
+struct ThreadNodeByUid {
+    uint uid;
+    uint internalId;
+    TreeItem *ptr;
+    ThreadNodeByUid(): uid(0), internalId(0), ptr(0) {}
+    ThreadNodeByUid(const uint uid, const uint internalId, TreeItem *ptr): uid(uid), internalId(internalId), ptr(ptr) {}
+    bool operator<(const ThreadNodeByUid &other) const { return uid < other.uid; }
+};
+
 /** @short A model implementing view of the whole IMAP server
 
 The problem with threading is that due to the extremely asynchronous nature of the IMAP Model, we often get informed about indexes
@@ -187,6 +462,9 @@ public slots:
 
     void delayedPrune();
 
+    /** @short Some messages got their envelopes meanwhile, include them in the locally computed threading and sorting */
+    void delayedLocalRefresh();
+
 signals:
     void sortingFailed();
 
@@ -200,6 +478,53 @@ private:
     */
     void askForThreading(const uint firstUnknownUid = 0);
 
+    /** @short Can we expect the server to send us a THREAD response? */
+    static bool canThreadOnServer(const Model *realModel);
+
+    /** @short Build threading from the Message-Id and References of messages whose envelopes are already known
+
+    Messages without any data available yet are returned as standalone threads.
+    */
+    QVector<Imap::Responses::ThreadingNode> threadLocally(const Model *realModel, const QModelIndex &mailbox, TreeItemMsgList *list);
+
+    /** @short Sort the messages whose envelopes are already known, and put the rest at the end in the mailbox order */
+    Imap::Uids sortLocally(const Model *realModel, const QModelIndex &mailbox, const SortCriterium criterium);
+
+    /** @short Move the new arrivals below the messages which they refer to via the References or In-Reply-To
+
+    Only the messages whose envelopes are already loaded are considered. The result is just a preview; the server has the final
+    word on where the arrivals belong.
+    */
+    void placeArrivalsByReferences(const Model *realModel, const QModelIndex &mailbox, TreeItemMsgList *list);
+
+    /** @short Move the new arrivals where the THREAD response wants them, provided that nothing else has changed
+
+    If the @arg mapping @arg isComplete, it has to describe the whole mailbox, otherwise it is a list of subthreads from the
+    incremental threading. Returns false without touching anything if the response requires more than moving the arrivals around.
+    */
+    bool placeArrivalsLikeServer(const QVector<Imap::Responses::ThreadingNode> &mapping, const bool isComplete,
+                                 const Model *realModel, TreeItemMsgList *list);
+
+    /** @short Compare a part of the THREAD response with the current tree and find out which arrivals have to move where */
+    bool collectArrivalMoves(const QVector<Imap::Responses::ThreadingNode> &mapping, const uint parentId, int &position,
+                             const Model *realModel, TreeItemMsgList *list, const QSet<uint> &arrivals,
+                             QVector<QPair<uint, uint> > &moves, QHash<uint, int> &movesInto, QVector<uint> &roots,
+                             int &found) const;
+
+    /** @short Move a childless node below another parent, or to the top level */
+    bool moveArrival(const uint internalId, const uint newParentId);
+
+    /** @short Move a thread root right after the thread root of the message with the given UID */
+    bool moveThreadAfter(const uint internalId, const uint previousThreadRootUid, const Model *realModel, TreeItemMsgList *list);
+
+    /** @short Return the visible node of a message with given UID, or null */
+    const ThreadNodeInfo *nodeForUid(const Model *realModel, TreeItemMsgList *list, const uint uid) const;
+    /** @short Our internal ID of the message at the given upstream row, or zero if it isn't in the tree */
+    uint internalIdForSourceRow(const int row) const;
+
+    /** @short Is the ordering of thread roots dictated by something else than the threading? */
+    bool rootsAreSorted() const;
+
     void updatePersistentIndexesPhase1();
     void updatePersistentIndexesPhase2();
 
@@ -214,7 +539,7 @@ private:
 
     /** @short Convert the threading from a THREAD response and apply that threading to this model */
     void registerThreading(const QVector<Imap::Responses::ThreadingNode> &mapping, uint parentId,
-                           const QHash<uint,void *> &uidToPtr, QSet<uint> &usedNodes);
+                           const QVector<ThreadNodeByUid> &uidToNode, QBitArray &usedNodes);
 
     bool searchSortPreferenceImplementation(const QStringList &searchConditions, const SortCriterium criterium,
                                             const Qt::SortOrder order = Qt::AscendingOrder);
@@ -242,14 +567,18 @@ private:
     ThreadingMsgListModel &operator=(const ThreadingMsgListModel &);  // don't implement
     ThreadingMsgListModel(const ThreadingMsgListModel &);  // don't implement
 
-    /** @short Mapping from the upstream model's internalId to ThreadingMsgListModel's internal IDs */
-    QHash<void *,uint> ptrToInternal;
+    /** @short ThreadingMsgListModel's internal ID of each upstream message, indexed by the upstream row
+
+    A zero means that the message is not present in the thread tree. Each message has a row in the upstream model anyway,
+    so this table is dense and it keeps up with the upstream through the rowsInserted() and rowsRemoved() signals.
+    */
+    QVector<uint> m_idsBySourceRow;
 
     /** @short Tree for the threading
 
     This tree is indexed by our internal ID.
     */
-    QHash<uint,ThreadNodeInfo> threading;
+    ThreadNodeArena threading;
 
     /** @short Last assigned internal ID */
     uint threadingHelperLastId;
@@ -269,7 +598,8 @@ private:
     bool modelResetInProgress;
 
     QModelIndexList oldPersistentIndexes;
-    QList<void *> oldPtrs;
+    /** @short Upstream rows of the messages behind the oldPersistentIndexes, or -1 for fake nodes */
+    QVector<int> oldSourceRows;
 
     /** @short There's a pending THREAD command for which we haven't received data yet */
     bool threadingInFlight;
@@ -284,7 +614,7 @@ private:
     bool m_sortReverse;
 
     /** @short IDs of all thread roots when no sorting or filtering is applied */
-    QList<uint> threadedRootIds;
+    QVector<uint> threadedRootIds;
 
     /** @short Sorting criteria of the current copy of the sort result */
     SortCriterium m_currentSortingCriteria;
@@ -309,7 +639,29 @@ private:
 
     QTimer *m_delayedPrune;
 
+    /** @short Client-side threading for when the server cannot do it for us */
+    LocalThreading m_localThreading;
+    /** @short Name of the mailbox whose messages are known to the m_localThreading */
+    QString m_localThreadingMailbox;
+    /** @short Is the current threading computed locally? */
+    bool m_threadingLocally;
+    /** @short Client-side sorting for when the server cannot do it for us */
+    LocalSorting m_localSorting;
+    /** @short Name of the mailbox whose messages are known to the m_localSorting */
+    QString m_localSortingMailbox;
+    /** @short Is the current sort order computed locally? */
+    bool m_sortingLocally;
+    QTimer *m_delayedLocalRefresh;
+
+    /** @short Internal IDs of messages which arrived after the threading was applied and which the server has not placed yet */
+    QVector<uint> m_pendingArrivals;
+    /** @short UIDs of messages by their normalized Message-Id, for placing the new arrivals */
+    QHash<QByteArray, uint> m_uidsByMessageId;
+    /** @short Name of the mailbox which the m_uidsByMessageId belongs to */
+    QString m_uidsByMessageIdMailbox;
+
     friend class ::ImapModelThreadingTest; // needs access to wantThreading();
+    friend class PrettyMsgListModel; // maps its indexes through the thread nodes
 };
 
 }
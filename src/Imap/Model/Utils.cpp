@@ -433,6 +433,14 @@ QModelIndex deproxifiedIndex(const QModelIndex& index)
     return res;
 }
 
+/** @short Check whether the @arg index is among the items covered by a dataChanged(topLeft, bottomRight) signal */
+bool isIndexInRange(const QModelIndex &index, const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    return index.isValid() && index.model() == topLeft.model() && index.parent() == topLeft.parent() &&
+            index.row() >= topLeft.row() && index.row() <= bottomRight.row() &&
+            index.column() >= topLeft.column() && index.column() <= bottomRight.column();
+}
+
 /** @short Recursively removes a directory and all its contents
 
 This by some crazy voodoo unintentional 'magic', is almost identical
@@ -49,6 +49,8 @@ void migrateSettings(QSettings *settings);
 
 QModelIndex deproxifiedIndex(const QModelIndex& index);
 
+bool isIndexInRange(const QModelIndex &index, const QModelIndex &topLeft, const QModelIndex &bottomRight);
+
 bool removeRecursively(const QString &dirName);
 
 }
@@ -88,6 +88,15 @@ void MsgPartNetworkReply::slotMyDataChanged()
     if (!part.data(Mailbox::RoleIsFetched).toBool())
         return;
 
+    if (!isFinished() && buffer.isOpen()) {
+        // Keep our own reference to the data; the model is free to drop its copy from memory from now on
+        QByteArray data = buffer.data();
+        buffer.close();
+        buffer.setBuffer(0);
+        buffer.setData(data);
+        buffer.open(QIODevice::ReadOnly);
+    }
+
     MsgPartNetAccessManager *netAccess = qobject_cast<MsgPartNetAccessManager*>(manager());
     Q_ASSERT(netAccess);
     QString mimeType = netAccess->translateToSupportedMimeType(part.data(Mailbox::RolePartMimeType).toString());
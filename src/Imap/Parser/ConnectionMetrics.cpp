@@ -0,0 +1,118 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "ConnectionMetrics.h"
+
+namespace Imap
+{
+
+LatencyHistogram::LatencyHistogram():
+    m_buckets(bucketBoundsMsec().size() + 1, 0), m_count(0), m_totalUsec(0), m_maxUsec(0)
+{
+}
+
+QVector<int> LatencyHistogram::bucketBoundsMsec()
+{
+    static const QVector<int> bounds = QVector<int>() << 1 << 2 << 5 << 10 << 20 << 50 << 100
+                                                      << 200 << 500 << 1000 << 2000 << 5000 << 10000;
+    return bounds;
+}
+
+void LatencyHistogram::record(const qint64 usec)
+{
+    const QVector<int> bounds = bucketBoundsMsec();
+    int i = 0;
+    while (i < bounds.size() && usec > bounds[i] * 1000LL)
+        ++i;
+    ++m_buckets[i];
+    ++m_count;
+    m_totalUsec += usec;
+    m_maxUsec = qMax(m_maxUsec, usec);
+}
+
+int LatencyHistogram::percentileMsec(const double percentile) const
+{
+    if (!m_count)
+        return 0;
+    const QVector<int> bounds = bucketBoundsMsec();
+    const double wanted = m_count * percentile / 100.0;
+    int seen = 0;
+    for (int i = 0; i < bounds.size(); ++i) {
+        seen += m_buckets[i];
+        if (seen >= wanted)
+            return bounds[i];
+    }
+    return -1;
+}
+
+QVariantMap LatencyHistogram::toVariantMap() const
+{
+    QVariantList buckets;
+    Q_FOREACH(const int num, m_buckets) {
+        buckets << num;
+    }
+    QVariantList bounds;
+    Q_FOREACH(const int bound, bucketBoundsMsec()) {
+        bounds << bound;
+    }
+    QVariantMap res;
+    res[QStringLiteral("count")] = m_count;
+    res[QStringLiteral("totalUsec")] = m_totalUsec;
+    res[QStringLiteral("maxUsec")] = m_maxUsec;
+    res[QStringLiteral("bucketBoundsMsec")] = bounds;
+    res[QStringLiteral("buckets")] = buckets;
+    res[QStringLiteral("p50Msec")] = percentileMsec(50);
+    res[QStringLiteral("p95Msec")] = percentileMsec(95);
+    res[QStringLiteral("p99Msec")] = percentileMsec(99);
+    return res;
+}
+
+ConnectionMetrics::ConnectionMetrics():
+    bytesReceived(0), bytesSent(0), wireBytesReceived(0), wireBytesSent(0), commandsQueued(0), commandsInFlight(0)
+{
+}
+
+QVariantMap ConnectionMetrics::toVariantMap() const
+{
+    QVariantMap latency;
+    for (auto it = commandLatency.constBegin(); it != commandLatency.constEnd(); ++it) {
+        latency[QString::fromUtf8(it.key())] = it->toVariantMap();
+    }
+    QVariantMap responses;
+    for (auto it = responseCounts.constBegin(); it != responseCounts.constEnd(); ++it) {
+        responses[QString::fromUtf8(it.key())] = *it;
+    }
+    QVariantMap res;
+    res[QStringLiteral("commandLatency")] = latency;
+    res[QStringLiteral("responseCounts")] = responses;
+    res[QStringLiteral("bytesReceived")] = bytesReceived;
+    res[QStringLiteral("bytesSent")] = bytesSent;
+    res[QStringLiteral("wireBytesReceived")] = wireBytesReceived;
+    res[QStringLiteral("wireBytesSent")] = wireBytesSent;
+    res[QStringLiteral("commandsQueued")] = commandsQueued;
+    res[QStringLiteral("commandsInFlight")] = commandsInFlight;
+    return res;
+}
+
+}
@@ -0,0 +1,95 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef IMAP_PARSER_CONNECTIONMETRICS_H
+#define IMAP_PARSER_CONNECTIONMETRICS_H
+
+#include <QMap>
+#include <QVariant>
+#include <QVector>
+
+namespace Imap
+{
+
+/** @short Distribution of command latencies in a fixed set of logarithmic buckets
+
+  The bucket boundaries are fixed so that histograms coming from different
+  connections can be compared and summed without any rebinning.
+*/
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    /** @short Upper bounds of the buckets in milliseconds; the last bucket is open-ended */
+    static QVector<int> bucketBoundsMsec();
+
+    /** @short Account for a single command which took @arg usec microseconds to complete */
+    void record(const qint64 usec);
+
+    int count() const { return m_count; }
+    qint64 totalUsec() const { return m_totalUsec; }
+    qint64 maxUsec() const { return m_maxUsec; }
+    const QVector<int> &buckets() const { return m_buckets; }
+
+    /** @short Upper bound of the bucket containing the given percentile, in milliseconds
+
+    Returns -1 when the percentile falls into the open-ended bucket, and 0 for an empty histogram.
+    */
+    int percentileMsec(const double percentile) const;
+
+    QVariantMap toVariantMap() const;
+
+private:
+    QVector<int> m_buckets;
+    int m_count;
+    qint64 m_totalUsec;
+    qint64 m_maxUsec;
+};
+
+/** @short Traffic and latency statistics of a single IMAP connection */
+struct ConnectionMetrics {
+    /** @short Latency of the tagged commands, keyed by the command name (e.g. "UID FETCH") */
+    QMap<QByteArray, LatencyHistogram> commandLatency;
+    /** @short Number of responses keyed by their kind (e.g. "FETCH", "TAGGED OK", "+") */
+    QMap<QByteArray, int> responseCounts;
+    /** @short Payload bytes as seen by the parser, i.e. after decompression */
+    qint64 bytesReceived;
+    qint64 bytesSent;
+    /** @short Bytes which went over the wire, i.e. before decompression and after compression */
+    qint64 wireBytesReceived;
+    qint64 wireBytesSent;
+    /** @short Commands which were not sent yet */
+    int commandsQueued;
+    /** @short Commands which were sent and await their tagged response */
+    int commandsInFlight;
+
+    ConnectionMetrics();
+
+    QVariantMap toVariantMap() const;
+};
+
+}
+
+#endif /* IMAP_PARSER_CONNECTIONMETRICS_H */
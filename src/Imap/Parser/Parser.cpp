@@ -28,6 +28,7 @@
 #include <QTime>
 #include <QTimer>
 #include "Parser.h"
+#include "Common/Profiling.h"
 #include "Imap/Encoders.h"
 #include "LowLevelParser.h"
 #include "../../Streams/IODeviceSocket.h"
@@ -96,6 +97,7 @@ Parser::Parser(QObject *parent, Streams::Socket *socket, const uint myId):
     connect(socket, &Streams::Socket::readyRead, this, &Parser::handleReadyRead);
     connect(socket, &Streams::Socket::stateChanged, this, &Parser::slotSocketStateChanged);
     connect(socket, &Streams::Socket::encrypted, this, &Parser::handleSocketEncrypted);
+    m_metricsClock.start();
 }
 
 CommandHandle Parser::noop()
@@ -567,6 +569,17 @@ CommandHandle Parser::enable(const QList<QByteArray> &extensions)
     return queueCommand(cmd);
 }
 
+CommandHandle Parser::notifySet(const QList<QByteArray> &eventGroups, const bool sendStatus)
+{
+    Commands::Command cmd("NOTIFY SET");
+    if (sendStatus)
+        cmd << Commands::PartOfCommand(Commands::ATOM, "STATUS");
+    Q_FOREACH(const QByteArray &group, eventGroups) {
+        cmd << Commands::PartOfCommand(Commands::ATOM, group);
+    }
+    return queueCommand(cmd);
+}
+
 CommandHandle Parser::genUrlAuth(const QByteArray &url, const QByteArray mechanism)
 {
     Commands::Command cmd("GENURLAUTH");
@@ -662,6 +675,7 @@ QByteArray Parser::generateTag()
 
 void Parser::handleReadyRead()
 {
+    TROJITA_PROFILE_SCOPE("Parser::handleReadyRead");
     while (!waitingForEncryption && !waitingForSslPolicy) {
         switch (readingMode) {
         case ReadingLine:
@@ -808,7 +822,7 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
         qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-        socket->write(buf);
+        writeToSocket(buf);
         idling = false;
         cmdQueue.pop_front();
         emit lineSent(this, buf);
@@ -818,6 +832,9 @@ void Parser::executeACommand()
 
     Q_ASSERT(! idling);
 
+    if (cmd.currentPart == 0)
+        noteCommandStarted(cmd);
+
     while (1) {
         Commands::PartOfCommand &part = cmd.cmds[ cmd.currentPart ];
         switch (part.kind) {
@@ -852,7 +869,7 @@ void Parser::executeACommand()
                 else
                     qDebug() << m_parserId << ">>> [sensitive command] -- added literal";
 #endif
-                socket->write(buf);
+                writeToSocket(buf);
                 part.numberSent = true;
                 waitingForContinuation = true;
                 Q_ASSERT(literalCommandTag.isEmpty());
@@ -870,7 +887,7 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
             qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-            socket->write(buf);
+            writeToSocket(buf);
             idling = true;
             waitForInitialIdle = true;
             cmdQueue.pop_front();
@@ -883,7 +900,7 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
             qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-            socket->write(buf);
+            writeToSocket(buf);
             startTlsInProgress = true;
             emit lineSent(this, buf);
             return;
@@ -894,7 +911,7 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
             qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-            socket->write(buf);
+            writeToSocket(buf);
             compressDeflateInProgress = true;
             cmdQueue.pop_front();
             emit lineSent(this, buf);
@@ -910,7 +927,7 @@ void Parser::executeACommand()
             else
                 qDebug() << m_parserId << ">>> [sensitive command]";
 #endif
-            socket->write(buf);
+            writeToSocket(buf);
             cmdQueue.pop_front();
             emit lineSent(this, sensitiveCommand ? privateMessage : buf);
             break;
@@ -936,6 +953,7 @@ void Parser::processLine(QByteArray line)
         qDebug() << m_parserId << "<<<" << debugLine;
 #endif
     emit lineReceived(this, line);
+    noteLineReceived(line);
     if (m_expectsInitialGreeting && !line.startsWith("* ")) {
         throw NotAnImapServerError(std::string(), line, -1);
     } else if (line.startsWith("* ")) {
@@ -957,6 +975,65 @@ void Parser::processLine(QByteArray line)
     }
 }
 
+void Parser::writeToSocket(const QByteArray &buf)
+{
+    m_metrics.bytesSent += buf.size();
+    socket->write(buf);
+}
+
+void Parser::noteCommandStarted(const Commands::Command &cmd)
+{
+    if (cmd.cmds.size() < 2 || cmd.cmds[1].kind == Commands::IDLE)
+        return;
+    QByteArray name = cmd.cmds[1].text.toUpper();
+    if (name == "UID" && cmd.cmds.size() > 2)
+        name += ' ' + cmd.cmds[2].text.toUpper();
+    m_commandsInFlight[cmd.cmds[0].text] = qMakePair(name, m_metricsClock.nsecsElapsed() / 1000);
+}
+
+void Parser::noteLineReceived(const QByteArray &line)
+{
+    m_metrics.bytesReceived += line.size();
+
+    if (line.startsWith("+ ")) {
+        ++m_metrics.responseCounts["+"];
+        return;
+    }
+
+    QList<QByteArray> words = line.left(64).simplified().split(' ');
+    if (words.size() < 2) {
+        ++m_metrics.responseCounts["?"];
+        return;
+    }
+
+    if (words[0] == "*") {
+        // Numbered responses like "* 3 FETCH" are counted by their kind, not by the number
+        bool isNumber;
+        words[1].toUInt(&isNumber);
+        QByteArray kind = (isNumber && words.size() > 2) ? words[2] : words[1];
+        ++m_metrics.responseCounts[kind.toUpper()];
+        return;
+    }
+
+    QByteArray kind = "TAGGED " + words[1].toUpper();
+    ++m_metrics.responseCounts[kind];
+    auto it = m_commandsInFlight.find(words[0]);
+    if (it != m_commandsInFlight.end()) {
+        m_metrics.commandLatency[it->first].record(m_metricsClock.nsecsElapsed() / 1000 - it->second);
+        m_commandsInFlight.erase(it);
+    }
+}
+
+ConnectionMetrics Parser::metrics() const
+{
+    ConnectionMetrics res = m_metrics;
+    res.wireBytesReceived = socket->wireBytesReceived();
+    res.wireBytesSent = socket->wireBytesSent();
+    res.commandsQueued = cmdQueue.size();
+    res.commandsInFlight = m_commandsInFlight.size();
+    return res;
+}
+
 QSharedPointer<Responses::AbstractResponse> Parser::parseUntagged(const QByteArray &line)
 {
     int pos = 2;
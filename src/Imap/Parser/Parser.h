@@ -21,9 +21,12 @@
 */
 #ifndef IMAP_PARSER_H
 #define IMAP_PARSER_H
+#include <QElapsedTimer>
+#include <QHash>
 #include <QLinkedList>
 #include <QSharedPointer>
 #include "Command.h"
+#include "ConnectionMetrics.h"
 #include "Response.h"
 #include "Sequence.h"
 #include "../ConnectionState.h"
@@ -80,6 +83,9 @@ public:
 
     uint parserId() const;
 
+    /** @short Latency, throughput and queue statistics of this connection */
+    ConnectionMetrics metrics() const;
+
 public slots:
 
     /** @short CAPABILITY, RFC 3501 section 6.1.1 */
@@ -269,6 +275,12 @@ public slots:
     /** @short GENURLAUTH, RFC 4467 */
     CommandHandle genUrlAuth(const QByteArray &url, const QByteArray mechanism);
 
+    /** @short NOTIFY SET, RFC 5465
+
+    Each item of the @arg eventGroups is sent verbatim, i.e. as "(personal (MessageNew MessageExpunge))".
+    */
+    CommandHandle notifySet(const QList<QByteArray> &eventGroups, const bool sendStatus);
+
     /** @short UID SENDMAIL, jkt's draft-imap-sendmail */
     CommandHandle uidSendmail(const uint uid, const Mailbox::UidSubmitOptionsList &submissionOptions);
 
@@ -278,7 +290,6 @@ public slots:
 
     void closeConnection();
 
-
 signals:
     /** @short New response received */
     void responseReceived(Imap::Parser *parser);
@@ -361,6 +372,15 @@ private:
     /** @short Add parsed response to the internal queue, emit notification signal */
     void queueResponse(const QSharedPointer<Responses::AbstractResponse> &resp);
 
+    /** @short Send data over the socket while keeping track of the outgoing volume */
+    void writeToSocket(const QByteArray &buf);
+
+    /** @short Remember when a command got sent so that its latency can be determined */
+    void noteCommandStarted(const Commands::Command &cmd);
+
+    /** @short Update the response counters and command latencies from a received line */
+    void noteLineReceived(const QByteArray &line);
+
     /** @short Connection to the IMAP server */
     Streams::Socket *socket;
 
@@ -396,6 +416,13 @@ private:
 
     /** @short Unique-id for debugging purposes */
     uint m_parserId;
+
+    /** @short Running statistics; the queue depths and wire volume are filled in by metrics() */
+    ConnectionMetrics m_metrics;
+    /** @short Clock used for measuring the command latency */
+    QElapsedTimer m_metricsClock;
+    /** @short Commands which were sent already, keyed by tag, with their name and starting time in usec */
+    QHash<QByteArray, QPair<QByteArray, qint64> > m_commandsInFlight;
 };
 
 QTextStream &operator<<(QTextStream &stream, const Sequence &s);
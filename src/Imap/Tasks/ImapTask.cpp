@@ -24,6 +24,7 @@
 #include "Common/InvokeMethod.h"
 #include "Imap/Model/Model.h"
 #include "Imap/Model/TaskPresentationModel.h"
+#include "Imap/Model/TaskTrace.h"
 #include "KeepMailboxOpenTask.h"
 
 namespace Imap
@@ -35,6 +36,8 @@ ImapTask::ImapTask(Model *model) :
     QObject(model), parser(0), parentTask(0), model(model), _finished(false), _dead(false), _aborted(false)
 {
     connect(this, &QObject::destroyed, model, &Model::slotTaskDying);
+    if (model->m_taskTrace)
+        model->m_taskTrace->taskCreated(this);
     CHECK_TASK_TREE;
 }
 
@@ -65,6 +68,8 @@ void ImapTask::updateParentTask(ImapTask *newParent)
     parentTask = newParent;
     CHECK_TASK_TREE
     model->m_taskModel->slotTaskGotReparented(this);
+    if (model->m_taskTrace)
+        model->m_taskTrace->taskReparented(this, newParent);
     if (parser) {
         Q_ASSERT(!model->accessParser(parser).activeTasks.contains(this));
         //log(tr("Reparented to %1").arg(newParent->debugIdentification()));
@@ -97,6 +102,9 @@ void ImapTask::markAsActiveTask(const TaskActivatingPosition place)
         connect(this, &QObject::destroyed, model->accessParser(parser).maintainingTask.data(), &KeepMailboxOpenTask::slotTaskDeleted);
     }
 
+    if (model->m_taskTrace)
+        model->m_taskTrace->taskActivated(this);
+
     log(QStringLiteral("Activated"));
     CHECK_TASK_TREE
 }
@@ -224,6 +232,8 @@ bool ImapTask::handleParseErrorResponse(const Imap::Responses::ParseErrorRespons
 void ImapTask::_completed()
 {
     _finished = true;
+    if (model->m_taskTrace)
+        model->m_taskTrace->taskFinished(this, QString());
     log(QStringLiteral("Completed"));
     Q_FOREACH(ImapTask* task, dependentTasks) {
         if (!task->isFinished())
@@ -235,6 +245,8 @@ void ImapTask::_completed()
 void ImapTask::_failed(const QString &errorMessage)
 {
     _finished = true;
+    if (model->m_taskTrace)
+        model->m_taskTrace->taskFinished(this, errorMessage);
     killAllPendingTasks(errorMessage);
     log(QStringLiteral("Failed: %1").arg(errorMessage));
     emit failed(errorMessage);
@@ -34,6 +34,7 @@
 #include "IdleLauncher.h"
 #include "OpenConnectionTask.h"
 #include "ObtainSynchronizedMailboxTask.h"
+#include "ParallelFetchConnectionTask.h"
 #include "OfflineConnectionTask.h"
 #include "SortTask.h"
 #include "NoopTask.h"
@@ -46,7 +47,7 @@ namespace Mailbox
 
 KeepMailboxOpenTask::KeepMailboxOpenTask(Model *model, const QModelIndex &mailboxIndex, Parser *oldParser) :
     ImapTask(model), mailboxIndex(mailboxIndex), synchronizeConn(0), shouldExit(false), isRunning(Running::NOT_YET),
-    shouldRunNoop(false), shouldRunIdle(false), idleLauncher(0), unSelectTask(0),
+    shouldRunNoop(false), shouldRunIdle(false), idleLauncher(0), parallelFetchConnsFailed(false), unSelectTask(0),
     m_skippedStateSynces(0), m_performedStateSynces(0), m_syncingTimer(nullptr)
 {
     Q_ASSERT(mailboxIndex.isValid());
@@ -151,6 +152,11 @@ KeepMailboxOpenTask::KeepMailboxOpenTask(Model *model, const QModelIndex &mailbo
     if (! ok)
         limitActiveTasks = 100;
 
+    // Extra read-only connections for bulk downloads are opt-in
+    limitParallelFetchConnections = model->property("trojita-imap-parallel-fetch-connections").toInt(&ok);
+    if (! ok)
+        limitParallelFetchConnections = 0;
+
     CHECK_TASK_TREE
     emit model->mailboxSyncingProgress(mailboxIndex, STATE_WAIT_FOR_CONN);
 
@@ -439,9 +445,8 @@ bool KeepMailboxOpenTask::handleNumberResponse(const Imap::Responses::NumberResp
     Q_ASSERT(list);
     // FIXME: tests!
     if (resp->kind == Imap::Responses::EXPUNGE) {
-        mailbox->handleExpunge(model, *resp);
-        mailbox->syncState.setExists(mailbox->syncState.exists() - 1);
-        saveSyncStateNowOrLater(mailbox);
+        // A mass expunge arrives as a long run of these; they are applied together by flushPendingExpunges()
+        m_pendingExpunges << resp->number;
         return true;
     } else if (resp->kind == Imap::Responses::EXISTS) {
 
@@ -634,6 +639,7 @@ void KeepMailboxOpenTask::abort()
         idleLauncher->die();
 
     detachFromMailbox();
+    releaseParallelFetchConnections();
 
     _aborted = true;
     // We do not want to propagate the signal to the child tasks, though -- the KeepMailboxOpenTask::abort() is used in the course
@@ -672,6 +678,7 @@ void KeepMailboxOpenTask::die(const QString &message)
     }
     ImapTask::die(message);
     detachFromMailbox();
+    releaseParallelFetchConnections();
 }
 
 /** @short Kill all pending tasks -- both the regular one and the replacement ObtainSynchronizedMailboxTask instances
@@ -787,6 +794,47 @@ void KeepMailboxOpenTask::requestEnvelopeDownload(const uint uid)
     }
 }
 
+/** @short Drop the envelope requests which were not sent yet and which are not interesting anymore
+
+Only the requests listed in @arg cancellable are ever dropped; the rest was asked for by somebody else. Upon return,
+@arg cancellable contains just those of its requests which are still waiting to be sent.
+
+The @arg wanted requests go first, ordered in the same way as the @arg wanted UIDs, so that they get fetched in the order
+in which the user is going to see them. The other requests follow in their original order.
+*/
+Imap::Uids KeepMailboxOpenTask::restrictEnvelopeRequests(const Imap::Uids &wanted, QSet<uint> &cancellable)
+{
+    QSet<uint> queued;
+    queued.reserve(requestedEnvelopes.size());
+    Q_FOREACH(const uint uid, requestedEnvelopes) {
+        queued.insert(uid);
+    }
+
+    Imap::Uids kept;
+    QSet<uint> stillCancellable;
+    Q_FOREACH(const uint uid, wanted) {
+        if (queued.remove(uid)) {
+            kept << uid;
+            if (cancellable.contains(uid))
+                stillCancellable.insert(uid);
+        }
+    }
+
+    Imap::Uids dropped;
+    Q_FOREACH(const uint uid, requestedEnvelopes) {
+        if (!queued.remove(uid))
+            continue;
+        if (cancellable.contains(uid))
+            dropped << uid;
+        else
+            kept << uid;
+    }
+
+    requestedEnvelopes = kept;
+    cancellable = stillCancellable;
+    return dropped;
+}
+
 void KeepMailboxOpenTask::slotFetchRequestedParts()
 {
     // FIXME: abort/die
@@ -794,13 +842,20 @@ void KeepMailboxOpenTask::slotFetchRequestedParts()
     if (requestedParts.isEmpty())
         return;
 
-    breakOrCancelPossibleIdle();
+    // No need to break IDLE here; the FetchMsgPartTask will do that when it registers with us
+    spawnParallelFetchConnections();
 
     auto it = requestedParts.begin();
     auto parts = *it;
 
-    // When asked to exit, do as much as possible and die
-    while (shouldExit || fetchPartTasks.size() < limitParallelFetchTasks) {
+    while (true) {
+        // Use whichever connection has less work on its hands. When asked to exit, do as much as possible and die.
+        ParallelFetchConnectionTask *helper = leastBusyParallelFetchConnection();
+        const bool canUseOwnConnection = shouldExit || fetchPartTasks.size() < limitParallelFetchTasks;
+        const bool useHelper = helper && (!canUseOwnConnection || helper->pendingBatchCount() < fetchPartTasks.size());
+        if (!useHelper && !canUseOwnConnection)
+            return;
+
         Imap::Uids uids;
         uint totalSize = 0;
         while (uids.size() < limitMessagesAtOnce && it != requestedParts.end() && totalSize < limitBytesAtOnce) {
@@ -814,10 +869,70 @@ void KeepMailboxOpenTask::slotFetchRequestedParts()
         if (uids.isEmpty())
             return;
 
-        fetchPartTasks << model->m_taskFactory->createFetchMsgPartTask(model, mailboxIndex, uids, parts.toList());
+        if (useHelper) {
+            helper->requestParts(uids, parts.toList());
+        } else {
+            fetchPartTasks << model->m_taskFactory->createFetchMsgPartTask(model, mailboxIndex, uids, parts.toList());
+        }
+    }
+}
+
+void KeepMailboxOpenTask::spawnParallelFetchConnections()
+{
+    parallelFetchConns.removeAll(QPointer<ParallelFetchConnectionTask>());
+
+    if (limitParallelFetchConnections <= 0 || parallelFetchConnsFailed || shouldExit || isRunning != Running::RUNNING)
+        return;
+
+    // Extra connections are not cheap, so don't bother unless we're on a proper network
+    if (model->networkPolicy() != NETWORK_ONLINE)
+        return;
+
+    // Only a bulk download is worth the overhead of another login and EXAMINE
+    if (requestedParts.size() <= limitMessagesAtOnce) {
+        uint totalSize = 0;
+        for (auto it = requestedPartSizes.constBegin(); it != requestedPartSizes.constEnd() && totalSize <= limitBytesAtOnce; ++it) {
+            totalSize += *it;
+        }
+        if (totalSize <= limitBytesAtOnce)
+            return;
+    }
+
+    while (parallelFetchConns.size() < limitParallelFetchConnections && model->m_parsers.size() < model->m_maxParsers) {
+        ParallelFetchConnectionTask *helper = model->m_taskFactory->createParallelFetchConnectionTask(model, mailboxIndex);
+        connect(helper, &ParallelFetchConnectionTask::readyForMoreWork, this, &KeepMailboxOpenTask::slotFetchRequestedParts);
+        connect(helper, &ImapTask::failed, this, &KeepMailboxOpenTask::slotParallelFetchConnectionFailed);
+        parallelFetchConns << helper;
     }
 }
 
+ParallelFetchConnectionTask *KeepMailboxOpenTask::leastBusyParallelFetchConnection() const
+{
+    ParallelFetchConnectionTask *res = 0;
+    Q_FOREACH(const QPointer<ParallelFetchConnectionTask> &helper, parallelFetchConns) {
+        if (!helper || !helper->isAcceptingRequests() || helper->pendingBatchCount() >= limitParallelFetchTasks)
+            continue;
+        if (!res || helper->pendingBatchCount() < res->pendingBatchCount())
+            res = helper;
+    }
+    return res;
+}
+
+void KeepMailboxOpenTask::releaseParallelFetchConnections()
+{
+    Q_FOREACH(const QPointer<ParallelFetchConnectionTask> &helper, parallelFetchConns) {
+        if (helper)
+            helper->finishAndLogout();
+    }
+    parallelFetchConns.clear();
+}
+
+void KeepMailboxOpenTask::slotParallelFetchConnectionFailed()
+{
+    // The server probably limits the number of concurrent connections; let's not keep asking
+    parallelFetchConnsFailed = true;
+}
+
 void KeepMailboxOpenTask::slotFetchRequestedEnvelopes()
 {
     // FIXME: abort/die
@@ -1119,6 +1234,54 @@ bool KeepMailboxOpenTask::hasItsOwnActivity() const
     return !newArrivalsFetch.isEmpty();
 }
 
+int KeepMailboxOpenTask::pendingWorkload() const
+{
+    // Closing a mailbox which is still being synchronized wastes the SELECT which started the sync, and the next request for
+    // this mailbox will need another one. A mailbox switch which is queued already would get postponed by yet another switch.
+    // Either of these outweighs quite a few queued requests, each of which only counts as one unit.
+    const int unfinishedSyncPenalty = 100;
+    const int queuedSwitchPenalty = 100;
+
+    int workload = dependingTasksForThisMailbox.size() + runningTasksForThisMailbox.size() + dependingTasksNoMailbox.size() +
+            requestedParts.size() + requestedEnvelopes.size() + newArrivalsFetch.size();
+    if (synchronizeConn && !synchronizeConn->isFinished())
+        workload += unfinishedSyncPenalty;
+    workload += queuedSwitchPenalty * waitingObtainTasks.size();
+    return workload;
+}
+
+void KeepMailboxOpenTask::requestUpdateCheck()
+{
+    if (isRunning != Running::RUNNING || shouldExit || _finished || _dead || _aborted)
+        return;
+
+    if (idleLauncher && idleLauncher->idling()) {
+        // The server will report the changes over our own IDLE
+        return;
+    }
+
+    // The NOOP gets queued after whatever is running now, and the server will include the updates in its responses
+    model->m_taskFactory->createNoopTask(model, this);
+}
+
+void KeepMailboxOpenTask::flushPendingExpunges()
+{
+    if (m_pendingExpunges.isEmpty())
+        return;
+
+    QVector<uint> expunges;
+    expunges.swap(m_pendingExpunges);
+
+    if (!mailboxIndex.isValid())
+        return;
+
+    TreeItemMailbox *mailbox = Model::mailboxForSomeItem(mailboxIndex);
+    Q_ASSERT(mailbox);
+    mailbox->handleExpunge(model, expunges);
+    mailbox->syncState.setExists(mailbox->syncState.exists() - expunges.size());
+    saveSyncStateNowOrLater(mailbox);
+}
+
 /** @short Signal the final termination of this task */
 void KeepMailboxOpenTask::finalizeTermination()
 {
@@ -25,6 +25,7 @@
 
 #include <QModelIndex>
 #include <QSet>
+#include <QVector>
 #include "ImapTask.h"
 
 class QTimer;
@@ -44,6 +45,7 @@ class ObtainSynchronizedMailboxTask;
 class IdleLauncher;
 class FetchMsgMetadataTask;
 class FetchMsgPartTask;
+class ParallelFetchConnectionTask;
 class TreeItemMailbox;
 class UnSelectTask;
 
@@ -148,6 +150,8 @@ public:
     void requestPartDownload(const uint uid, const QByteArray &partId, const uint estimatedSize);
     /** @short Request a delayed loading of a message envelope */
     void requestEnvelopeDownload(const uint uid);
+    /** @short Forget the @arg cancellable queued envelope requests which are not @arg wanted, return UIDs of the dropped ones */
+    Imap::Uids restrictEnvelopeRequests(const Imap::Uids &wanted, QSet<uint> &cancellable);
 
     virtual QVariant taskData(const int role) const;
 
@@ -159,6 +163,24 @@ public:
 
     bool hasItsOwnActivity() const;
 
+    /** @short Estimate how much work is still queued for this mailbox
+
+    Used for deciding which mailbox to close when a connection is needed elsewhere. Every queued task, message part and
+    envelope counts as one unit. A sync which has not finished yet and each mailbox which is already waiting to be opened
+    over this connection add a fixed penalty, so that such a connection only gets picked when all others are busy, too.
+    */
+    int pendingWorkload() const;
+
+    /** @short Another connection has seen a change in this mailbox, make sure that we find out about it soon */
+    void requestUpdateCheck();
+
+    /** @short Apply the EXPUNGE responses which were received since the last call in one batch
+
+    The Model calls this before any other response from the same connection is processed and before returning
+    to the event loop, so that nobody gets to observe the message list with some of the expunges still pending.
+    */
+    void flushPendingExpunges();
+
 private slots:
     void slotTaskDeleted(QObject *object);
 
@@ -187,6 +209,8 @@ private slots:
     void slotFetchRequestedParts();
     /** @short Fetch the ENVELOPEs which were queued for later retrieval */
     void slotFetchRequestedEnvelopes();
+    /** @short One of the extra download connections could not be established */
+    void slotParallelFetchConnectionFailed();
 
     /** @short Something bad has happened to the connection, and we're no longer in that mailbox */
     void slotUnselected();
@@ -226,6 +250,13 @@ private:
     /** @short Return true if this has a list of stuff to do */
     bool hasPendingInternalActions() const;
 
+    /** @short Open extra connections for bulk downloads, if configured and if there is enough work for them */
+    void spawnParallelFetchConnections();
+    /** @short Find the least busy helper connection which is able to take another batch of work */
+    ParallelFetchConnectionTask *leastBusyParallelFetchConnection() const;
+    /** @short Tell all helper connections that they should finish their work and log out */
+    void releaseParallelFetchConnections();
+
     void detachFromMailbox();
 
     bool canRunIdleRightNow() const;
@@ -274,10 +305,16 @@ protected:
     IdleLauncher *idleLauncher;
     QList<FetchMsgPartTask *> fetchPartTasks;
     QList<FetchMsgMetadataTask *> fetchMetadataTasks;
+    /** @short Read-only connections which download message parts in parallel with our own connection */
+    QList<QPointer<ParallelFetchConnectionTask> > parallelFetchConns;
+    /** @short Set when a helper connection could not be used, so that we do not keep trying again */
+    bool parallelFetchConnsFailed;
     QPointer<DeleteMailboxTask> m_deleteCurrentMailboxTask;
     CommandHandle tagIdle;
     QList<CommandHandle> newArrivalsFetch;
     CommandHandle tagClose;
+    /** @short Sequence numbers from a run of consecutive EXPUNGE responses, in the order of their arrival */
+    QVector<uint> m_pendingExpunges;
     friend class IdleLauncher;
     friend class ImapTask; // needs access to slotTaskDeleted()
     friend class ObtainSynchronizedMailboxTask; // needs access to slotUnSelectCompleted()
@@ -301,6 +338,7 @@ protected:
     int limitMessagesAtOnce;
     int limitParallelFetchTasks;
     int limitActiveTasks;
+    int limitParallelFetchConnections;
 
     /** @short An UNSELECT task, if active */
     UnSelectTask *unSelectTask;
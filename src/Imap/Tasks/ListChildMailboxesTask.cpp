@@ -136,6 +136,20 @@ void ListChildMailboxesTask::applyCachedStatus()
     m_pendingStatusResponses.clear();
 }
 
+/** @short Is the @arg mailbox one of the direct children which this task has asked for? */
+bool ListChildMailboxesTask::isListingParentOf(const QString &mailbox, const QString &separator) const
+{
+    if (!mailboxIndex.isValid() && !mailboxIsRootMailbox)
+        return false;
+
+    QString prefix = mailboxIndex.data(RoleMailboxName).toString();
+    if (!prefix.isEmpty())
+        prefix += separator;
+    if (!mailbox.startsWith(prefix))
+        return false;
+    return separator.isEmpty() || !mailbox.mid(prefix.size()).contains(separator);
+}
+
 QString ListChildMailboxesTask::debugIdentification() const
 {
     if (!mailboxIndex.isValid() && !mailboxIsRootMailbox)
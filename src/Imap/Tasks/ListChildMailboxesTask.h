@@ -46,6 +46,8 @@ public:
     virtual QString debugIdentification() const;
     virtual QVariant taskData(const int role) const;
     virtual bool needsMailbox() const {return false;}
+
+    bool isListingParentOf(const QString &mailbox, const QString &separator) const;
 protected:
     void applyCachedStatus();
     virtual void _failed(const QString &errorMessage);
@@ -0,0 +1,323 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "NotificationConnectionTask.h"
+#include <QTimer>
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Model/TaskFactory.h"
+#include "KeepMailboxOpenTask.h"
+#include "OpenConnectionTask.h"
+#include "RefreshMessageCountsTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+NotificationConnectionTask::NotificationConnectionTask(Model *model) :
+    ImapTask(model), conn(0), m_watchedMailbox(QStringLiteral("INBOX")), m_exists(0), m_examined(false),
+    m_notifyActive(false), m_idling(false), m_renewal(0), m_delayedProcessing(0)
+{
+    conn = model->m_taskFactory->createOpenConnectionTask(model);
+    parser = conn->parser;
+    Q_ASSERT(parser);
+    // Nobody else shall run anything over this connection, otherwise the IDLE would get interrupted
+    model->accessParser(parser).purpose = ParserState::Purpose::NOTIFICATION;
+    conn->addDependentTask(this);
+
+    m_renewal = new QTimer(this);
+    m_renewal->setSingleShot(true);
+    bool ok;
+    int timeout = model->property("trojita-imap-idle-renewal").toUInt(&ok);
+    if (!ok || !timeout)
+        timeout = 1000 * 29 * 60; // 29 minutes -- that's the longest allowed time to IDLE
+    m_renewal->setInterval(timeout);
+    connect(m_renewal, &QTimer::timeout, this, &NotificationConnectionTask::slotRenewIdle);
+
+    // A burst of changes shall result in a single update of each mailbox
+    m_delayedProcessing = new QTimer(this);
+    m_delayedProcessing->setSingleShot(true);
+    m_delayedProcessing->setInterval(0);
+    connect(m_delayedProcessing, &QTimer::timeout, this, &NotificationConnectionTask::processChangedMailboxes);
+}
+
+void NotificationConnectionTask::perform()
+{
+    parser = conn->parser;
+    markAsActiveTask();
+
+    IMAP_TASK_CHECK_ABORT_DIE;
+
+    ParserState &state = model->accessParser(parser);
+    const bool hasNotify = state.capabilitiesFresh && state.capabilities.contains(QStringLiteral("NOTIFY"));
+    const bool hasIdle = state.capabilitiesFresh && state.capabilities.contains(QStringLiteral("IDLE"));
+
+    if (hasNotify) {
+        // The initial STATUS corrects any numbers which went stale before the NOTIFY got set up, and tells us which
+        // mailboxes the server will keep updating
+        tagNotify = parser->notifySet(RefreshMessageCountsTask::notifyEventGroups(), true);
+        state.notifyState = ParserState::NotifyState::REQUESTED;
+    } else if (hasIdle) {
+        model->changeConnectionState(parser, CONN_STATE_SELECTING);
+        tagExamine = parser->examine(m_watchedMailbox);
+    } else {
+        log(QStringLiteral("The server supports neither IDLE nor NOTIFY, the dedicated connection is useless"));
+        logout();
+    }
+}
+
+void NotificationConnectionTask::die(const QString &message)
+{
+    m_renewal->stop();
+    m_delayedProcessing->stop();
+    if (m_idling && model && model->m_parsers.contains(parser) && model->accessParser(parser).connState != CONN_STATE_LOGOUT) {
+        // The LOGOUT which is sent when going offline has to break the IDLE first
+        parser->idleDone();
+    }
+    m_idling = false;
+    ImapTask::die(message);
+}
+
+void NotificationConnectionTask::enterIdle()
+{
+    if (_finished || _dead || _aborted || m_idling || !tagIdle.isEmpty())
+        return;
+
+    if (!model->accessParser(parser).capabilities.contains(QStringLiteral("IDLE"))) {
+        // With NOTIFY, the server will send the updates anyway
+        return;
+    }
+
+    tagIdle = parser->idle();
+    m_idling = true;
+    m_renewal->start();
+}
+
+void NotificationConnectionTask::slotRenewIdle()
+{
+    if (m_idling) {
+        parser->idleDone();
+        m_idling = false;
+        // ...and the IDLE gets restarted once the server confirms its termination
+    }
+}
+
+void NotificationConnectionTask::logout()
+{
+    m_renewal->stop();
+    m_delayedProcessing->stop();
+    if (model->accessParser(parser).connState != CONN_STATE_LOGOUT) {
+        model->accessParser(parser).logoutCmd = parser->logout();
+        model->changeConnectionState(parser, CONN_STATE_LOGOUT);
+    }
+    if (!_finished)
+        _completed();
+}
+
+bool NotificationConnectionTask::handleStateHelper(const Imap::Responses::State *const resp)
+{
+    if (resp->tag.isEmpty()) {
+        if (resp->kind == Responses::BYE && model->accessParser(parser).logoutCmd.isEmpty()) {
+            // Losing this connection is no reason for taking the whole Model offline
+            log(QLatin1String("Notification connection closed by the server: ") + resp->message);
+            const bool wasEstablished = m_notifyActive || m_examined;
+            model->changeConnectionState(parser, CONN_STATE_LOGOUT);
+            model->killParser(parser, Model::PARSER_KILL_EXPECTED);
+            if (wasEstablished)
+                emit connectionLost();
+            return true;
+        }
+        // UIDVALIDITY, UIDNEXT, PERMANENTFLAGS etc. are tracked over the connections which actually sync the mailbox
+        return resp->kind == Responses::OK;
+    }
+
+    if (resp->tag == tagNotify) {
+        tagNotify.clear();
+        if (resp->kind == Responses::OK) {
+            m_notifyActive = true;
+            model->accessParser(parser).notifyState = ParserState::NotifyState::ACTIVE;
+            log(QStringLiteral("Receiving mailbox updates through NOTIFY"));
+            enterIdle();
+        } else {
+            model->accessParser(parser).notifyState = ParserState::NotifyState::FAILED;
+            model->accessParser(parser).notifyMailboxes.clear();
+            log(QStringLiteral("NOTIFY has failed, will IDLE in %1").arg(m_watchedMailbox));
+            if (model->accessParser(parser).capabilities.contains(QStringLiteral("IDLE"))) {
+                model->changeConnectionState(parser, CONN_STATE_SELECTING);
+                tagExamine = parser->examine(m_watchedMailbox);
+            } else {
+                _failed(tr("Cannot subscribe to mailbox updates"));
+                logout();
+            }
+        }
+        return true;
+    }
+
+    if (resp->tag == tagExamine) {
+        tagExamine.clear();
+        if (resp->kind == Responses::OK) {
+            model->changeConnectionState(parser, CONN_STATE_SELECTED);
+            m_examined = true;
+            enterIdle();
+        } else {
+            _failed(tr("Cannot open %1 for receiving updates").arg(m_watchedMailbox));
+            logout();
+        }
+        return true;
+    }
+
+    if (resp->tag == tagIdle) {
+        tagIdle.clear();
+        m_renewal->stop();
+        if (resp->kind == Responses::OK) {
+            if (m_idling) {
+                log(QStringLiteral("Warning: IDLE completed before we could ask for its termination..."));
+                m_idling = false;
+                parser->idleMagicallyTerminatedByServer();
+            }
+            enterIdle();
+        } else {
+            m_idling = false;
+            parser->idleContinuationWontCome();
+            _failed(tr("The IDLE command has failed"));
+            logout();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool NotificationConnectionTask::handleNumberResponse(const Imap::Responses::NumberResponse *const resp)
+{
+    if (resp->kind == Responses::EXISTS) {
+        if (m_examined && resp->number != m_exists)
+            mailboxChanged(m_watchedMailbox, false);
+        m_exists = resp->number;
+    } else if (resp->kind == Responses::EXPUNGE) {
+        if (m_exists)
+            --m_exists;
+        mailboxChanged(m_watchedMailbox, false);
+    }
+    // The RECENT does not carry any new information, it always comes with an EXISTS
+    return true;
+}
+
+bool NotificationConnectionTask::handleFlags(const Imap::Responses::Flags *const resp)
+{
+    Q_UNUSED(resp);
+    return true;
+}
+
+bool NotificationConnectionTask::handleFetch(const Imap::Responses::Fetch *const resp)
+{
+    // Somebody has changed the flags, which could affect the number of unread messages
+    Q_UNUSED(resp);
+    if (m_examined)
+        mailboxChanged(m_watchedMailbox, false);
+    return true;
+}
+
+bool NotificationConnectionTask::handleVanished(const Imap::Responses::Vanished *const resp)
+{
+    Q_UNUSED(resp);
+    if (m_examined)
+        mailboxChanged(m_watchedMailbox, false);
+    return true;
+}
+
+bool NotificationConnectionTask::handleStatus(const Imap::Responses::Status *const resp)
+{
+    ParserState &state = model->accessParser(parser);
+    if (state.notifyState == ParserState::NotifyState::REQUESTED) {
+        // Part of the reply to our NOTIFY SET, see Model::handleStatus()
+        state.notifyMailboxes.insert(resp->mailbox);
+    }
+
+    TreeItemMailbox *mailbox = model->findMailboxByName(resp->mailbox);
+    if (!mailbox) {
+        // Not in the tree (yet?), so nobody can be interested in its numbers
+        return true;
+    }
+
+    if (mailbox->maintainingTask) {
+        // Don't overwrite the numbers of a synced mailbox by data which might not match the rest of what we know
+        mailboxChanged(resp->mailbox, true);
+        return true;
+    }
+
+    // The numbers get updated by the Model just as for any other STATUS
+    return false;
+}
+
+/** @short Remember that the @arg mailbox has changed and process that a bit later */
+void NotificationConnectionTask::mailboxChanged(const QString &mailbox, const bool countsUpdated)
+{
+    auto it = m_changedMailboxes.find(mailbox);
+    if (it == m_changedMailboxes.end()) {
+        m_changedMailboxes.insert(mailbox, countsUpdated);
+    } else {
+        *it = *it && countsUpdated;
+    }
+    m_delayedProcessing->start();
+}
+
+/** @short Propagate the changes to the rest of the Model */
+void NotificationConnectionTask::processChangedMailboxes()
+{
+    if (!model)
+        return;
+
+    for (auto it = m_changedMailboxes.constBegin(); it != m_changedMailboxes.constEnd(); ++it) {
+        TreeItemMailbox *mailbox = model->findMailboxByName(it.key());
+        if (!mailbox)
+            continue;
+
+        if (mailbox->maintainingTask) {
+            // Let the regular code path pick the changes up over the connection which keeps the mailbox in sync
+            mailbox->maintainingTask->requestUpdateCheck();
+        } else if (!it.value()) {
+            model->invalidateMessageCounts(mailbox);
+        }
+    }
+    m_changedMailboxes.clear();
+}
+
+QString NotificationConnectionTask::debugIdentification() const
+{
+    if (m_notifyActive)
+        return QStringLiteral("NOTIFY");
+    return QStringLiteral("IDLE in %1%2").arg(m_watchedMailbox, m_examined ? QString() : QStringLiteral(" [not examined yet]"));
+}
+
+QVariant NotificationConnectionTask::taskData(const int role) const
+{
+    // This one is not interesting for the user
+    Q_UNUSED(role);
+    return QVariant();
+}
+
+}
+}
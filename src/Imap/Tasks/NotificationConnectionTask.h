@@ -0,0 +1,106 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAP_NOTIFICATIONCONNECTIONTASK_H
+#define IMAP_NOTIFICATIONCONNECTIONTASK_H
+
+#include <QMap>
+#include "ImapTask.h"
+
+class QTimer;
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+/** @short Keep a dedicated connection in IDLE so that the mailbox updates arrive without any delay
+
+The KeepMailboxOpenTask can only IDLE when nothing else is using its connection, so each fetch which the user triggers
+postpones the delivery of updates. This task opens its own connection which never runs anything else. When the server
+supports the RFC 5465 NOTIFY, it subscribes to events in all personal mailboxes; otherwise it EXAMINEs the INBOX and
+stays in IDLE there.
+
+The events are not applied to the tree directly because the sequence numbers of this connection are unrelated to
+what the rest of the Model knows. A mailbox which is kept open by some KeepMailboxOpenTask is asked to check for updates
+over its own connection, which makes the regular handlers in the TreeItemMailbox process them. For all other mailboxes,
+the message counts are either updated from the STATUS sent through NOTIFY, or invalidated so that they are requested
+again.
+
+The connection is reserved for this task (see ParserState::Purpose) and no other task can use it. When the server drops
+it, the rest of the Model stays online and the connectionLost() signal lets the Model open a new one later.
+*/
+class NotificationConnectionTask : public ImapTask
+{
+    Q_OBJECT
+public:
+    explicit NotificationConnectionTask(Model *model);
+    virtual void perform();
+    virtual void die(const QString &message);
+
+    virtual bool handleStateHelper(const Imap::Responses::State *const resp);
+    virtual bool handleNumberResponse(const Imap::Responses::NumberResponse *const resp);
+    virtual bool handleFlags(const Imap::Responses::Flags *const resp);
+    virtual bool handleFetch(const Imap::Responses::Fetch *const resp);
+    virtual bool handleVanished(const Imap::Responses::Vanished *const resp);
+    virtual bool handleStatus(const Imap::Responses::Status *const resp);
+
+    virtual QString debugIdentification() const;
+    virtual QVariant taskData(const int role) const;
+    virtual bool needsMailbox() const {return false;}
+
+signals:
+    /** @short The server has closed this connection after it has been set up */
+    void connectionLost();
+
+private slots:
+    void enterIdle();
+    void slotRenewIdle();
+    void processChangedMailboxes();
+
+private:
+    void mailboxChanged(const QString &mailbox, const bool countsUpdated);
+    void logout();
+
+    ImapTask *conn;
+    CommandHandle tagNotify;
+    CommandHandle tagExamine;
+    CommandHandle tagIdle;
+    /** @short The mailbox which is EXAMINEd when NOTIFY is not available */
+    QString m_watchedMailbox;
+    /** @short Number of messages in the watched mailbox as reported over this connection */
+    uint m_exists;
+    bool m_examined;
+    bool m_notifyActive;
+    /** @short Are we between queueing the IDLE and the DONE? */
+    bool m_idling;
+    QTimer *m_renewal;
+    QTimer *m_delayedProcessing;
+    /** @short Mailboxes with a pending change; the value says whether the message counts are already fresh */
+    QMap<QString, bool> m_changedMailboxes;
+};
+
+}
+}
+
+#endif // IMAP_NOTIFICATIONCONNECTIONTASK_H
@@ -87,6 +87,11 @@ void ObtainSynchronizedMailboxTask::perform()
     Q_ASSERT(msgList);
 
     msgList->setFetchStatus(TreeItem::LOADING);
+    if (msgList->numbersFetched() && !msgList->m_children.isEmpty()) {
+        // The numbers might come from a STATUS which arrived while nobody kept this mailbox in sync. From now on, the messages
+        // which we already have are going to be updated incrementally, so the counters have to match them.
+        msgList->recalcVariousMessageCounts(model);
+    }
 
     Q_ASSERT(model->m_parsers.contains(parser));
 
@@ -1005,8 +1010,7 @@ bool ObtainSynchronizedMailboxTask::handleFetch(const Imap::Responses::Fetch *co
     TreeItemMessage *changedMessage = 0;
     mailbox->handleFetchResponse(model, *resp, changedParts, changedMessage, m_usingQresync);
     if (changedMessage) {
-        QModelIndex index = changedMessage->toIndex(model);
-        emit model->dataChanged(index, index);
+        model->notifyMessageChanged(changedMessage);
         if (mailbox->syncState.uidNext() <= changedMessage->uid()) {
             mailbox->syncState.setUidNext(changedMessage->uid() + 1);
         }
@@ -0,0 +1,318 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ParallelFetchConnectionTask.h"
+#include <QTimer>
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Model/TaskFactory.h"
+#include "Imap/Model/TaskPresentationModel.h"
+#include "KeepMailboxOpenTask.h"
+#include "OpenConnectionTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+ParallelFetchConnectionTask::ParallelFetchConnectionTask(Model *model, const QModelIndex &mailboxIndex) :
+    ImapTask(model), conn(0), mailboxIndex(mailboxIndex), m_examined(false), m_uidValidityMismatch(false), m_shouldExit(false),
+    m_idleTimer(0)
+{
+    Q_ASSERT(mailboxIndex.isValid());
+    conn = model->m_taskFactory->createOpenConnectionTask(model);
+    parser = conn->parser;
+    Q_ASSERT(parser);
+    // Make sure that nobody else gets a chance to SELECT some other mailbox over this connection
+    model->accessParser(parser).purpose = ParserState::Purpose::PARALLEL_FETCH;
+    conn->addDependentTask(this);
+
+    m_idleTimer = new QTimer(this);
+    m_idleTimer->setSingleShot(true);
+    bool ok;
+    int timeout = model->property("trojita-imap-parallel-fetch-idle-logout").toUInt(&ok);
+    if (!ok)
+        timeout = 30 * 1000;
+    m_idleTimer->setInterval(timeout);
+    connect(m_idleTimer, &QTimer::timeout, this, &ParallelFetchConnectionTask::logout);
+}
+
+void ParallelFetchConnectionTask::perform()
+{
+    parser = conn->parser;
+    markAsActiveTask();
+
+    IMAP_TASK_CHECK_ABORT_DIE;
+
+    TreeItemMailbox *mailboxPtr = mailbox();
+    if (!mailboxPtr) {
+        // Nothing to do here; don't keep the connection around
+        logout();
+        return;
+    }
+
+    model->changeConnectionState(parser, CONN_STATE_SELECTING);
+    tagExamine = parser->examine(mailboxPtr->mailbox());
+}
+
+void ParallelFetchConnectionTask::die(const QString &message)
+{
+    ImapTask::die(message);
+    m_idleTimer->stop();
+    if (!model)
+        return;
+    // Whatever has not arrived so far won't arrive over this connection anymore. If the mailbox is still being
+    // maintained, its own connection can take over; otherwise the parts cannot be fetched at all.
+    TreeItemMailbox *mailboxPtr = mailbox();
+    KeepMailboxOpenTask *keepTask = mailboxPtr && model->networkPolicy() != NETWORK_OFFLINE ?
+                mailboxPtr->maintainingTask.data() : 0;
+    Q_FOREACH(const Batch &batch, m_runningBatches) {
+        if (keepTask) {
+            requeueBatch(keepTask, batch);
+        } else {
+            finalizeBatch(batch);
+        }
+    }
+    m_runningBatches.clear();
+}
+
+void ParallelFetchConnectionTask::requestParts(const Imap::Uids &uids, const QList<QByteArray> &parts)
+{
+    Q_ASSERT(isAcceptingRequests());
+    m_idleTimer->stop();
+    m_runningBatches[parser->uidFetch(Sequence::fromVector(uids), parts)] = qMakePair(uids, parts);
+    model->m_taskModel->slotTaskMighHaveChanged(this);
+}
+
+int ParallelFetchConnectionTask::pendingBatchCount() const
+{
+    return m_runningBatches.size();
+}
+
+bool ParallelFetchConnectionTask::isAcceptingRequests() const
+{
+    return m_examined && !_finished && !_dead && !_aborted && !m_shouldExit && mailboxIndex.isValid();
+}
+
+void ParallelFetchConnectionTask::finishAndLogout()
+{
+    m_shouldExit = true;
+    if (m_examined) {
+        logoutIfIdle();
+    }
+    // ...otherwise the EXAMINE will notice that we are no longer needed
+}
+
+TreeItemMailbox *ParallelFetchConnectionTask::mailbox() const
+{
+    if (!mailboxIndex.isValid())
+        return 0;
+    TreeItemMailbox *mailboxPtr = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailboxIndex.internalPointer()));
+    Q_ASSERT(mailboxPtr);
+    return mailboxPtr;
+}
+
+/** @short Let the tree know that all data which were supposed to come in this batch have been received */
+void ParallelFetchConnectionTask::finalizeBatch(const Batch &batch)
+{
+    TreeItemMailbox *mailboxPtr = mailbox();
+    if (!mailboxPtr)
+        return;
+
+    QList<TreeItemMessage *> messages = model->findMessagesByUids(mailboxPtr, batch.first);
+    Q_FOREACH(TreeItemMessage *message, messages) {
+        Q_FOREACH(const QByteArray &partId, batch.second) {
+            if (!model->finalizeFetchPart(mailboxPtr, message->row() + 1, partId)) {
+                log(QLatin1String("Received no data for part ") + QString::fromUtf8(partId), Common::LOG_MESSAGES);
+            }
+        }
+    }
+}
+
+/** @short Hand the parts which have not arrived yet back to the maintaining task */
+void ParallelFetchConnectionTask::requeueBatch(KeepMailboxOpenTask *keepTask, const Batch &batch)
+{
+    TreeItemMailbox *mailboxPtr = mailbox();
+    Q_ASSERT(mailboxPtr);
+
+    QList<TreeItemMessage *> messages = model->findMessagesByUids(mailboxPtr, batch.first);
+    Q_FOREACH(TreeItemMessage *message, messages) {
+        Q_FOREACH(const QByteArray &partId, batch.second) {
+            TreeItemPart *part = mailboxPtr->partIdToPtr(model, message, partId);
+            if (part && part->loading()) {
+                keepTask->requestPartDownload(message->uid(), partId, part->octets());
+            }
+        }
+    }
+}
+
+void ParallelFetchConnectionTask::logoutIfIdle()
+{
+    if (_finished || !m_runningBatches.isEmpty())
+        return;
+
+    if (m_shouldExit || !mailboxIndex.isValid()) {
+        logout();
+    } else {
+        m_idleTimer->start();
+    }
+}
+
+void ParallelFetchConnectionTask::logout()
+{
+    if (_finished)
+        return;
+
+    m_idleTimer->stop();
+    if (model->accessParser(parser).connState != CONN_STATE_LOGOUT) {
+        model->accessParser(parser).logoutCmd = parser->logout();
+        model->changeConnectionState(parser, CONN_STATE_LOGOUT);
+    }
+    log(QStringLiteral("Parallel fetch connection no longer needed"));
+    _completed();
+}
+
+bool ParallelFetchConnectionTask::handleStateHelper(const Imap::Responses::State *const resp)
+{
+    if (resp->tag.isEmpty()) {
+        if (resp->kind == Responses::BYE && model->accessParser(parser).logoutCmd.isEmpty()) {
+            // The server is free to drop an extra connection at any time, and that is no reason for going offline.
+            // Killing the parser makes us die(), which passes the unfinished work back to the maintaining task.
+            log(QLatin1String("Parallel fetch connection closed by the server: ") + resp->message);
+            model->changeConnectionState(parser, CONN_STATE_LOGOUT);
+            model->killParser(parser, Model::PARSER_KILL_EXPECTED);
+            return true;
+        }
+        if (resp->respCode == Responses::UIDVALIDITY) {
+            const Responses::RespData<uint> *const num = dynamic_cast<const Responses::RespData<uint>* const>(resp->respCodeData.data());
+            Q_ASSERT(num);
+            TreeItemMailbox *mailboxPtr = mailbox();
+            if (mailboxPtr && mailboxPtr->syncState.uidValidity() != num->data) {
+                m_uidValidityMismatch = true;
+            }
+        }
+        // The untagged OK responses with UIDNEXT, PERMANENTFLAGS etc. are all tracked by the maintaining task
+        return resp->kind == Responses::OK;
+    }
+
+    if (resp->tag == tagExamine) {
+        tagExamine.clear();
+        if (resp->kind == Responses::OK && !m_uidValidityMismatch && mailboxIndex.isValid()) {
+            model->changeConnectionState(parser, CONN_STATE_SELECTED);
+            m_examined = true;
+            logoutIfIdle();
+            if (!_finished)
+                emit readyForMoreWork();
+        } else {
+            _failed(m_uidValidityMismatch ?
+                        tr("UIDVALIDITY of the parallel connection does not match") :
+                        tr("Cannot open mailbox for parallel download"));
+            if (model->accessParser(parser).connState != CONN_STATE_LOGOUT) {
+                model->accessParser(parser).logoutCmd = parser->logout();
+                model->changeConnectionState(parser, CONN_STATE_LOGOUT);
+            }
+        }
+        return true;
+    }
+
+    auto it = m_runningBatches.find(resp->tag);
+    if (it == m_runningBatches.end())
+        return false;
+
+    Batch batch = *it;
+    m_runningBatches.erase(it);
+    finalizeBatch(batch);
+    if (resp->kind == Responses::OK) {
+        log(QStringLiteral("Fetched parts"), Common::LOG_MESSAGES);
+    } else {
+        log(QLatin1String("Part fetch failed: ") + resp->message, Common::LOG_MESSAGES);
+    }
+    logoutIfIdle();
+    if (!_finished)
+        emit readyForMoreWork();
+    return true;
+}
+
+bool ParallelFetchConnectionTask::handleNumberResponse(const Imap::Responses::NumberResponse *const resp)
+{
+    // EXISTS, RECENT and EXPUNGE are handled by the maintaining task, which sees them over its own connection
+    Q_UNUSED(resp);
+    return true;
+}
+
+bool ParallelFetchConnectionTask::handleFlags(const Imap::Responses::Flags *const resp)
+{
+    Q_UNUSED(resp);
+    return true;
+}
+
+bool ParallelFetchConnectionTask::handleVanished(const Imap::Responses::Vanished *const resp)
+{
+    Q_UNUSED(resp);
+    return true;
+}
+
+bool ParallelFetchConnectionTask::handleFetch(const Imap::Responses::Fetch *const resp)
+{
+    TreeItemMailbox *mailboxPtr = mailbox();
+    if (!mailboxPtr)
+        return true;
+
+    Responses::Fetch::dataType::const_iterator uidRecord = resp->data.constFind("UID");
+    if (uidRecord == resp->data.constEnd()) {
+        // An unsolicited update of the message flags; the primary connection will get it, too
+        return true;
+    }
+
+    // The sequence numbers of this connection might not match what the primary connection knows about,
+    // so the message has to be looked up through its UID
+    const uint uid = static_cast<const Responses::RespData<uint>&>(*(uidRecord.value())).data;
+    QList<TreeItemMessage *> messages = model->findMessagesByUids(mailboxPtr, Imap::Uids() << uid);
+    if (messages.isEmpty()) {
+        log(QStringLiteral("Ignoring FETCH for UID %1 which is not known (yet?)").arg(uid), Common::LOG_MESSAGES);
+        return true;
+    }
+
+    Responses::Fetch translated(messages.front()->row() + 1, resp->data);
+    model->genericHandleFetch(mailboxPtr, &translated);
+    return true;
+}
+
+QString ParallelFetchConnectionTask::debugIdentification() const
+{
+    if (!mailboxIndex.isValid())
+        return QStringLiteral("[invalid mailbox]");
+
+    return QStringLiteral("%1: %2 batches running%3").arg(mailboxIndex.data(RoleMailboxName).toString(),
+                                                          QString::number(pendingBatchCount()),
+                                                          m_examined ? QString() : QStringLiteral(" [not examined yet]"));
+}
+
+QVariant ParallelFetchConnectionTask::taskData(const int role) const
+{
+    return role == RoleTaskCompactName && pendingBatchCount() ? QVariant(tr("Downloading messages")) : QVariant();
+}
+
+}
+}
@@ -0,0 +1,113 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_PARALLELFETCHCONNECTIONTASK_H
+#define IMAP_PARALLELFETCHCONNECTIONTASK_H
+
+#include <QPersistentModelIndex>
+#include "ImapTask.h"
+
+class QTimer;
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+class KeepMailboxOpenTask;
+class TreeItemMailbox;
+
+/** @short Download message parts over an extra, read-only connection to an already opened mailbox
+
+The KeepMailboxOpenTask which maintains a mailbox owns the only connection through which the mailbox' state is kept
+synchronized. When a lot of data is requested at once (think bulk export or an offline pre-download), a single TCP stream
+is a bottleneck on links with a high bandwidth-delay product. This task opens its own connection, EXAMINEs the same
+mailbox and serves batches of UID FETCH requests for body parts which are handed over by the maintaining task.
+
+The helper does not participate in the mailbox synchronization at all -- EXISTS, EXPUNGE and flag updates are ignored
+here because the maintaining task's connection sees them, too. The FETCH responses are matched to messages by their
+UID, so that a sequence number which is not yet known to the primary connection cannot put the data into a wrong message.
+
+The connection is reserved for this task (see ParserState::Purpose) and no other task can use it. Work is only accepted
+once the mailbox has been opened, so a failure to connect does not lose any requests. When the connection goes away in
+the middle of a transfer, the unfinished parts are handed back to the maintaining task. The connection is logged out after
+a period of inactivity, or when asked to finish via finishAndLogout().
+*/
+class ParallelFetchConnectionTask : public ImapTask
+{
+    Q_OBJECT
+public:
+    ParallelFetchConnectionTask(Model *model, const QModelIndex &mailboxIndex);
+    virtual void perform();
+    virtual void die(const QString &message);
+
+    /** @short Start downloading a batch of parts */
+    void requestParts(const Imap::Uids &uids, const QList<QByteArray> &parts);
+
+    /** @short How many batches are being transferred at this time */
+    int pendingBatchCount() const;
+
+    /** @short Is this connection ready to accept new requests? */
+    bool isAcceptingRequests() const;
+
+    /** @short Let the running downloads finish, and log out afterwards */
+    void finishAndLogout();
+
+    virtual bool handleStateHelper(const Imap::Responses::State *const resp);
+    virtual bool handleNumberResponse(const Imap::Responses::NumberResponse *const resp);
+    virtual bool handleFlags(const Imap::Responses::Flags *const resp);
+    virtual bool handleFetch(const Imap::Responses::Fetch *const resp);
+    virtual bool handleVanished(const Imap::Responses::Vanished *const resp);
+
+    virtual QString debugIdentification() const;
+    virtual QVariant taskData(const int role) const;
+    virtual bool needsMailbox() const {return false;}
+
+signals:
+    /** @short The mailbox is open or a batch of parts has been transferred, so the connection can accept more work */
+    void readyForMoreWork();
+
+private slots:
+    void logout();
+
+private:
+    typedef QPair<Imap::Uids, QList<QByteArray> > Batch;
+
+    TreeItemMailbox *mailbox() const;
+    void finalizeBatch(const Batch &batch);
+    void requeueBatch(KeepMailboxOpenTask *keepTask, const Batch &batch);
+    void logoutIfIdle();
+
+    ImapTask *conn;
+    QPersistentModelIndex mailboxIndex;
+    CommandHandle tagExamine;
+    bool m_examined;
+    bool m_uidValidityMismatch;
+    bool m_shouldExit;
+    QMap<CommandHandle, Batch> m_runningBatches;
+    QTimer *m_idleTimer;
+};
+
+}
+}
+
+#endif // IMAP_PARALLELFETCHCONNECTIONTASK_H
@@ -0,0 +1,177 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "RefreshMessageCountsTask.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/Model.h"
+#include "GetAnyConnectionTask.h"
+#include "ListChildMailboxesTask.h"
+#include "NumberOfMessagesTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+
+RefreshMessageCountsTask::RefreshMessageCountsTask(Model *model):
+    ImapTask(model), m_started(false)
+{
+    conn = model->m_taskFactory->createGetAnyConnectionTask(model);
+    conn->addDependentTask(this);
+}
+
+/** @short Include one more mailbox in this refresh */
+void RefreshMessageCountsTask::addMailbox(const QModelIndex &mailbox)
+{
+    Q_ASSERT(isAcceptingMailboxes());
+    Q_ASSERT(dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(mailbox.internalPointer())));
+    m_mailboxes << mailbox;
+}
+
+/** @short Is it still possible to add more mailboxes, i.e. has nothing been sent yet? */
+bool RefreshMessageCountsTask::isAcceptingMailboxes() const
+{
+    return !m_started && !isFinished();
+}
+
+void RefreshMessageCountsTask::perform()
+{
+    parser = conn->parser;
+    markAsActiveTask();
+    m_started = true;
+
+    IMAP_TASK_CHECK_ABORT_DIE;
+
+    ParserState &state = model->accessParser(parser);
+    if (state.capabilitiesFresh && state.capabilities.contains(QStringLiteral("NOTIFY")) &&
+            state.notifyState == ParserState::NotifyState::NOT_REQUESTED) {
+        // The initial STATUS for all mailboxes is a part of the reply, and the server will keep them fresh from now on
+        tagNotify = parser->notifySet(notifyEventGroups(), true);
+        state.notifyState = ParserState::NotifyState::REQUESTED;
+        return;
+    }
+
+    sendListStatus();
+}
+
+/** @short Ask for the numbers of all mailboxes at once, or fall back to the STATUS when not supported */
+void RefreshMessageCountsTask::sendListStatus()
+{
+    if (model->accessParser(parser).capabilitiesFresh &&
+            model->accessParser(parser).capabilities.contains(QStringLiteral("LIST-STATUS"))) {
+        // empty string, not a null string
+        tagList = parser->list(QLatin1String(""), QStringLiteral("*"), QStringList() <<
+                               QStringLiteral("STATUS (%1)").arg(NumberOfMessagesTask::requestedStatusOptions().join(QStringLiteral(" "))));
+    } else {
+        completeWithFallback();
+    }
+}
+
+/** @short Event groups which we are interested in when using NOTIFY
+
+The selected mailbox is specified explicitly with the events which the KeepMailboxOpenTask is used to, so that its
+behavior does not change. Mailboxes outside of the personal namespace, e.g. the shared ones, are not covered and their
+numbers have to be polled as usual.
+*/
+QList<QByteArray> RefreshMessageCountsTask::notifyEventGroups()
+{
+    return QList<QByteArray>() << "(selected (MessageNew MessageExpunge FlagChange))"
+                               << "(personal (MessageNew MessageExpunge FlagChange))";
+}
+
+/** @short Ask for each mailbox which we did not get any data for via the slow path and declare ourselves completed */
+void RefreshMessageCountsTask::completeWithFallback()
+{
+    Q_FOREACH(const QPersistentModelIndex &index, m_mailboxes) {
+        if (!index.isValid())
+            continue;
+        TreeItemMailbox *mailbox = dynamic_cast<TreeItemMailbox *>(static_cast<TreeItem *>(index.internalPointer()));
+        Q_ASSERT(mailbox);
+        TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(mailbox->m_children[0]);
+        Q_ASSERT(list);
+        if (list->m_numberFetchingStatus == TreeItem::LOADING) {
+            // This could be a mailbox which the server did not report, or the STATUS went to a concurrent LIST
+            model->m_taskFactory->createNumberOfMessagesTask(model, index);
+        }
+    }
+    m_mailboxes.clear();
+    _completed();
+}
+
+bool RefreshMessageCountsTask::handleStateHelper(const Imap::Responses::State *const resp)
+{
+    if (resp->tag.isEmpty())
+        return false;
+
+    if (resp->tag == tagNotify) {
+        if (resp->kind == Responses::OK) {
+            model->accessParser(parser).notifyState = ParserState::NotifyState::ACTIVE;
+            log(QStringLiteral("NOTIFY is active, message counts will be updated by the server"));
+            completeWithFallback();
+        } else {
+            model->accessParser(parser).notifyState = ParserState::NotifyState::FAILED;
+            model->accessParser(parser).notifyMailboxes.clear();
+            log(QStringLiteral("NOTIFY has failed"));
+            sendListStatus();
+        }
+        return true;
+    } else if (resp->tag == tagList) {
+        if (resp->kind != Responses::OK)
+            log(QStringLiteral("LIST-STATUS has failed"));
+        completeWithFallback();
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/** @short Eat the LIST responses which are just a side effect of asking for the STATUS */
+bool RefreshMessageCountsTask::handleList(const Imap::Responses::List *const resp)
+{
+    if (tagList.isEmpty())
+        return false;
+
+    // A concurrent ListChildMailboxesTask has to see the responses for its own children
+    Q_FOREACH(ImapTask *task, model->accessParser(parser).activeTasks) {
+        ListChildMailboxesTask *listTask = dynamic_cast<ListChildMailboxesTask *>(task);
+        if (listTask && !listTask->isFinished() && listTask->isListingParentOf(resp->mailbox, resp->separator))
+            return false;
+    }
+    return true;
+}
+
+QString RefreshMessageCountsTask::debugIdentification() const
+{
+    return QStringLiteral("%1 mailboxes").arg(m_mailboxes.size());
+}
+
+QVariant RefreshMessageCountsTask::taskData(const int role) const
+{
+    return role == RoleTaskCompactName ? QVariant(tr("Looking for messages")) : QVariant();
+}
+
+}
+}
@@ -0,0 +1,75 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAP_REFRESHMESSAGECOUNTS_TASK_H
+#define IMAP_REFRESHMESSAGECOUNTS_TASK_H
+
+#include <QPersistentModelIndex>
+#include "ImapTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+/** @short Refresh the message counts of several mailboxes in a single round trip
+
+This task collects all mailboxes whose numbers were requested before the task got a chance to run. When the server
+supports the RFC 5465 NOTIFY, the task subscribes to the mailbox events first; the server replies with STATUS for
+all of them and keeps them up-to-date from now on, so no polling is needed at all. Otherwise, a single
+LIST "" "*" RETURN (STATUS ...) from RFC 5819 replaces the per-mailbox STATUS commands. Any mailbox which has not
+been reported by the server falls back to a regular NumberOfMessagesTask.
+*/
+class RefreshMessageCountsTask : public ImapTask
+{
+    Q_OBJECT
+public:
+    explicit RefreshMessageCountsTask(Model *model);
+    virtual void perform();
+
+    void addMailbox(const QModelIndex &mailbox);
+    bool isAcceptingMailboxes() const;
+
+    virtual bool handleStateHelper(const Imap::Responses::State *const resp);
+    virtual bool handleList(const Imap::Responses::List *const resp);
+
+    virtual QString debugIdentification() const;
+    virtual QVariant taskData(const int role) const;
+    virtual bool needsMailbox() const {return false;}
+
+    static QList<QByteArray> notifyEventGroups();
+private:
+    void sendListStatus();
+    void completeWithFallback();
+
+    ImapTask *conn;
+    CommandHandle tagNotify;
+    CommandHandle tagList;
+    QList<QPersistentModelIndex> m_mailboxes;
+    bool m_started;
+};
+
+}
+}
+
+#endif // IMAP_REFRESHMESSAGECOUNTS_TASK_H
@@ -94,6 +94,7 @@ bool UpdateFlagsOfAllMessagesTask::handleStateHelper(const Imap::Responses::Stat
                     model->dataChanged(messageIndex, messageIndex);
                 }
             }
+            list->checkMessageCountsConsistency(model);
             model->emitMessageCountChanged(mailbox);
             list->fetchNumbers(model);
             _completed();
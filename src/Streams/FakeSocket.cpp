@@ -89,17 +89,24 @@ bool FakeSocket::canReadLine()
 
 QByteArray FakeSocket::read(qint64 maxSize)
 {
-    return readChannel->read(maxSize);
+    QByteArray buf = readChannel->read(maxSize);
+    m_wireBytesReceived += buf.size();
+    return buf;
 }
 
 QByteArray FakeSocket::readLine(qint64 maxSize)
 {
-    return readChannel->readLine(maxSize);
+    QByteArray buf = readChannel->readLine(maxSize);
+    m_wireBytesReceived += buf.size();
+    return buf;
 }
 
 qint64 FakeSocket::write(const QByteArray &byteArray)
 {
-    return writeChannel->write(byteArray);
+    qint64 written = writeChannel->write(byteArray);
+    m_wireBytesSent += written;
+    emit dataWritten();
+    return written;
 }
 
 void FakeSocket::startTls()
@@ -53,6 +53,10 @@ public:
     /** @short Return data written since the last call to this function */
     QByteArray writtenStuff();
 
+signals:
+    /** @short Some data were written into the socket and can be retrieved via writtenStuff() */
+    void dataWritten();
+
 private slots:
     /** @short Delayed informing about being connected */
     void slotEmitConnected();
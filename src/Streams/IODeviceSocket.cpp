@@ -33,6 +33,7 @@
 #include "3rdparty/rfc1951.h"
 #endif
 #include "Common/InvokeMethod.h"
+#include "Common/Profiling.h"
 
 namespace Streams {
 
@@ -69,10 +70,15 @@ QByteArray IODeviceSocket::read(qint64 maxSize)
 {
 #if TROJITA_COMPRESS_DEFLATE
     if (m_decompressor) {
-        return m_decompressor->read(maxSize);
+        QByteArray buf = m_decompressor->read(maxSize);
+        TROJITA_PROFILE_COUNT("IODeviceSocket::read: bytes", buf.size());
+        return buf;
     }
 #endif
-    return d->read(maxSize);
+    QByteArray buf = d->read(maxSize);
+    m_wireBytesReceived += buf.size();
+    TROJITA_PROFILE_COUNT("IODeviceSocket::read: bytes", buf.size());
+    return buf;
 }
 
 QByteArray IODeviceSocket::readLine(qint64 maxSize)
@@ -80,21 +86,32 @@ QByteArray IODeviceSocket::readLine(qint64 maxSize)
 #if TROJITA_COMPRESS_DEFLATE
     if (m_decompressor) {
         // FIXME: well, we apparently don't respect the maxSize argument...
-        return m_decompressor->readLine();
+        QByteArray buf = m_decompressor->readLine();
+        TROJITA_PROFILE_COUNT("IODeviceSocket::read: bytes", buf.size());
+        return buf;
     }
 #endif
-    return d->readLine(maxSize);
+    QByteArray buf = d->readLine(maxSize);
+    m_wireBytesReceived += buf.size();
+    TROJITA_PROFILE_COUNT("IODeviceSocket::read: bytes", buf.size());
+    return buf;
 }
 
 qint64 IODeviceSocket::write(const QByteArray &byteArray)
 {
 #if TROJITA_COMPRESS_DEFLATE
     if (m_compressor) {
+        // The compressor writes straight into the device, so the compressed size is only visible through its buffer
+        qint64 pending = d->bytesToWrite();
         m_compressor->write(d, &const_cast<QByteArray&>(byteArray));
+        m_wireBytesSent += qMax<qint64>(0, d->bytesToWrite() - pending);
         return byteArray.size();
     }
 #endif
-    return d->write(byteArray);
+    qint64 written = d->write(byteArray);
+    if (written > 0)
+        m_wireBytesSent += written;
+    return written;
 }
 
 void IODeviceSocket::startTls()
@@ -126,7 +143,10 @@ void IODeviceSocket::handleReadyRead()
 {
 #if TROJITA_COMPRESS_DEFLATE
     if (m_decompressor) {
+        TROJITA_PROFILE_SCOPE("IODeviceSocket::handleReadyRead: inflate");
+        qint64 available = d->bytesAvailable();
         m_decompressor->consume(d);
+        m_wireBytesReceived += available - d->bytesAvailable();
     }
 #endif
     emit readyRead();
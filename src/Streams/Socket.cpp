@@ -24,6 +24,10 @@
 
 namespace Streams {
 
+Socket::Socket(): m_wireBytesReceived(0), m_wireBytesSent(0)
+{
+}
+
 Socket::~Socket()
 {
 }
@@ -44,4 +48,14 @@ QList<QSslError> Socket::sslErrors() const
     return QList<QSslError>();
 }
 
+qint64 Socket::wireBytesReceived() const
+{
+    return m_wireBytesReceived;
+}
+
+qint64 Socket::wireBytesSent() const
+{
+    return m_wireBytesSent;
+}
+
 }
@@ -38,6 +38,7 @@ class Socket: public QObject
 {
     Q_OBJECT
 public:
+    Socket();
     virtual ~Socket();
 
     /** @short Returns true if there's enough data to read, including the CR-LF pair */
@@ -77,6 +78,12 @@ public:
 
     /** @short Start the DEFLATE algorithm on both directions of this stream */
     virtual void startDeflate() = 0;
+
+    /** @short Number of bytes received from the network, i.e. before any decompression */
+    qint64 wireBytesReceived() const;
+
+    /** @short Number of bytes sent to the network, i.e. after any compression */
+    qint64 wireBytesSent() const;
 signals:
     /** @short The socket got disconnected */
     void disconnected(const QString);
@@ -89,6 +96,10 @@ signals:
 
     /** @short The socket is now encrypted */
     void encrypted();
+
+protected:
+    qint64 m_wireBytesReceived;
+    qint64 m_wireBytesSent;
 };
 
 }
@@ -68,9 +68,15 @@ QString Formatting::prettySize(quint64 bytes)
 
 /** @short Format a QDateTime for compact display in one column of the view */
 QString Formatting::prettyDate(const QDateTime &dateTime)
+{
+    return prettyDateAt(dateTime, QDateTime::currentDateTime());
+}
+
+/** @short Format the @arg dateTime like prettyDate() does when the clock shows @arg currentTime */
+QString Formatting::prettyDateAt(const QDateTime &dateTime, const QDateTime &currentTime)
 {
     // The time is not always synced properly, so better accept even slightly too new messages as "from today"
-    QDateTime now = QDateTime::currentDateTime().addSecs(15*60);
+    QDateTime now = currentTime.addSecs(15*60);
     if (dateTime >= now) {
         // Messages from future shall always be shown using full format to prevent nasty surprises.
         return dateTime.toString(Qt::DefaultLocaleShortDate);
@@ -101,6 +107,47 @@ QString Formatting::prettyDate(const QDateTime &dateTime)
     }
 }
 
+/** @short Return the moment when prettyDate() starts to return a different string for the same @arg dateTime
+
+An invalid QDateTime is returned when the formatting won't ever change.
+
+Not every switch to another rule of prettyDate() changes the result, as the translated formats might happen to be the
+same, so the candidate moments are checked by actually formatting the date.
+*/
+QDateTime Formatting::prettyDateExpiry(const QDateTime &dateTime)
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    const QString text = prettyDateAt(dateTime, now);
+    for (QDateTime cutOff = prettyDateCutOff(dateTime, now); cutOff.isValid(); cutOff = prettyDateCutOff(dateTime, cutOff)) {
+        if (prettyDateAt(dateTime, cutOff) != text)
+            return cutOff;
+    }
+    return QDateTime();
+}
+
+/** @short Return the first moment after @arg currentTime when prettyDateAt() uses another rule for the @arg dateTime
+
+The cut-off points have to match what prettyDateAt() does, including the tolerance for clocks which are slightly off.
+*/
+QDateTime Formatting::prettyDateCutOff(const QDateTime &dateTime, const QDateTime &currentTime)
+{
+    QDateTime now = currentTime.addSecs(15*60);
+    QDateTime cutOff;
+    if (dateTime >= now) {
+        // the only rule which holds even when the time is exactly the same
+        cutOff = dateTime.addMSecs(1);
+    } else if (dateTime.date() == now.date() || dateTime > now.addSecs(-6 * 3600)) {
+        cutOff = qMax(QDateTime(dateTime.date().addDays(1)), dateTime.addSecs(6 * 3600));
+    } else if (dateTime > now.addDays(-7)) {
+        cutOff = dateTime.addDays(7);
+    } else if (dateTime > now.addYears(-1)) {
+        cutOff = dateTime.addYears(1);
+    } else {
+        return QDateTime();
+    }
+    return cutOff.addSecs(-15*60);
+}
+
 QString Formatting::htmlizedTextPart(const QModelIndex &partIndex, const QFont &font,
                                      const QColor &backgroundColor, const QColor &textColor,
                                      const QColor &linkColor, const QColor &visitedLinkColor)
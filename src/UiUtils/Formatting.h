@@ -49,6 +49,7 @@ public:
 
     Q_INVOKABLE static QString prettySize(quint64 bytes);
     Q_INVOKABLE static QString prettyDate(const QDateTime &dateTime);
+    static QDateTime prettyDateExpiry(const QDateTime &dateTime);
     Q_INVOKABLE static QString htmlizedTextPart(const QModelIndex &partIndex, const QFont &font,
                                                 const QColor &backgroundColor, const QColor &textColor,
                                                 const QColor &linkColor, const QColor &visitedLinkColor);
@@ -67,6 +68,9 @@ public:
 
 private:
     Formatting(QObject *parent);
+
+    static QString prettyDateAt(const QDateTime &dateTime, const QDateTime &currentTime);
+    static QDateTime prettyDateCutOff(const QDateTime &dateTime, const QDateTime &currentTime);
 };
 
 bool elideAddress(QString &address);
@@ -31,6 +31,7 @@
 #include <QStack>
 #include "PlainTextFormatter.h"
 #include "Common/Paths.h"
+#include "Common/Profiling.h"
 #include "Imap/Model/ItemRoles.h"
 #include "UiUtils/Color.h"
 
@@ -201,6 +202,7 @@ static QString lineWithoutTrailingCr(const QString &line)
 
 QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed)
 {
+    TROJITA_PROFILE_SCOPE("UiUtils::plainTextToHtml");
     QRegExp quotemarks;
     switch (flowed) {
     case FlowedFormat::FLOWED:
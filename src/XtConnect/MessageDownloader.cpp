@@ -159,9 +159,11 @@ void MessageDownloader::slotDataChanged( const QModelIndex &a, const QModelIndex
     }
 
     if ( a != b ) {
-#ifdef DEBUG_PENDING_MESSAGES
-        qDebug() << "MessageDownloader::slotDataChanged: a != b" << a;
-#endif
+        // A range of updated messages; body parts are always reported one by one
+        for ( int row = a.row(); row <= b.row(); ++row ) {
+            const QModelIndex single = a.sibling( row, a.column() );
+            slotDataChanged( single, single );
+        }
         return;
     }
 
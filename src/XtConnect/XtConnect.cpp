@@ -63,6 +63,9 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
     bool readstdin = true;
     bool logConsole = false;
     QString logFile;
+    qint64 logMaxSize = 0;
+    int logKeptFiles = 0;
+    bool logCompress = false;
 
     QStringList args = QCoreApplication::arguments();
     for ( int i = 1; i < args.length(); i++ ) {
@@ -89,6 +92,18 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
         } else if (args.at(i) == "--log" && args.length() > i) {
             if (args.length() <= i + 1) qFatal("The \"--log\" option requires a value.");
             logFile = args.at(++i);
+        } else if (args.at(i) == "--log-max-size") {
+            if (args.length() <= i + 1) qFatal("The \"--log-max-size\" option requires a value.");
+            bool ok;
+            logMaxSize = args.at(++i).toLongLong(&ok);
+            if (!ok || logMaxSize < 0) qFatal("The \"--log-max-size\" option requires a size in bytes.");
+        } else if (args.at(i) == "--log-keep") {
+            if (args.length() <= i + 1) qFatal("The \"--log-keep\" option requires a value.");
+            bool ok;
+            logKeptFiles = args.at(++i).toInt(&ok);
+            if (!ok || logKeptFiles < 0) qFatal("The \"--log-keep\" option requires a number of files.");
+        } else if (args.at(i) == "--log-compress") {
+            logCompress = true;
         } else {
             QByteArray err = args.at(i).toLocal8Bit();
             qFatal("Error: unrecognized command line option '%s'.", err.constData());
@@ -106,6 +121,8 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
     if (logConsole)
         logger->setConsoleLogging(true);
     if (!logFile.isEmpty()) {
+        logger->setRotation(logMaxSize, logKeptFiles);
+        logger->setCompression(logCompress);
         logger->setFileLogging(true, logFile);
         logger->setAutoFlush(true);
     }
@@ -189,6 +206,8 @@ void XtConnect::setupModels()
     // Disable preload of message envelopes. We are aggresively cleaning the cache as soon as possible, and
     // we don't want to re-request message envelopes for messages which have been already processed before.
     m_model->setProperty("trojita-imap-preload-msg-metadata", 0);
+    // Keep each synchronized mailbox open on a connection of its own (within the Model's limits) instead of re-SELECTing
+    m_model->setProperty("trojita-imap-max-mailbox-connections", m_settings->value(SettingsNames::xtSyncMailboxList).toStringList().size());
 
     connect( m_model, SIGNAL( alertReceived( const QString& ) ), this, SLOT( alertReceived( const QString& ) ) );
     connect( m_model, SIGNAL( imapError( const QString& ) ), this, SLOT( connectionError( const QString& ) ) );
@@ -314,6 +333,9 @@ void XtConnect::slotMessageIsDuplicate( const QString &mailbox, const QModelInde
 void XtConnect::slotDumpStats()
 {
     qDebug() << QDateTime::currentDateTime();
+    const Imap::Mailbox::MailboxSelectionStats selectionStats = m_model->mailboxSelectionStats();
+    qDebug() << "Mailbox selection: reused" << selectionStats.selectsAvoided << "switched" << selectionStats.mailboxSwitches
+             << "new connections" << selectionStats.newConnections;
     Q_FOREACH( const QPointer<MailSynchronizer> item, m_syncers ) {
         item->debugStats();
     }
@@ -0,0 +1,369 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <functional>
+#include <QtTest>
+#include "bench_MailboxSync.h"
+#include "Utils/FakeImapServer.h"
+#include "Utils/LibMailboxSync.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MemoryCache.h"
+#include "Imap/Model/TaskFactory.h"
+
+using namespace Imap::Mailbox;
+
+namespace {
+
+/** @short How long to wait for any single step before giving up */
+const int SYNC_TIMEOUT = 600000;
+
+/** @short Percentage of messages whose flags change while the client is offline */
+const int CHANGED_PERCENT = 1;
+
+/** @short Number of messages delivered during the EXISTS storm */
+const int ARRIVALS = 1000;
+
+/** @short Number of messages whose envelopes a view asks for at once */
+const int SCREENFUL = 200;
+
+/** @short Number of screenfuls of envelopes to fetch in one run */
+const int SCREENFULS = 50;
+
+QStringList plainCapabilities()
+{
+    return QStringList() << QStringLiteral("IMAP4rev1") << QStringLiteral("LITERAL+") << QStringLiteral("IDLE");
+}
+
+QStringList condstoreCapabilities()
+{
+    return plainCapabilities() << QStringLiteral("ESEARCH") << QStringLiteral("CONDSTORE");
+}
+
+QStringList qresyncCapabilities()
+{
+    return condstoreCapabilities() << QStringLiteral("ENABLE") << QStringLiteral("QRESYNC");
+}
+
+/** @short Spin the event loop until the condition holds, checking it whenever the model announces a change
+
+Unlike the QTRY_* macros, this does not sleep between the checks, so no polling interval gets added to the measured time.
+Returns false if the condition does not hold after SYNC_TIMEOUT.
+*/
+bool waitForModel(Model *model, const std::function<bool()> &condition)
+{
+    if (condition())
+        return true;
+
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+    auto check = [&loop, &condition]() {
+        if (condition())
+            loop.quit();
+    };
+    QObject::connect(model, &QAbstractItemModel::rowsInserted, &loop, check);
+    QObject::connect(model, &QAbstractItemModel::rowsRemoved, &loop, check);
+    QObject::connect(model, &QAbstractItemModel::dataChanged, &loop, check);
+    QObject::connect(model, &QAbstractItemModel::layoutChanged, &loop, check);
+    QObject::connect(model, &Model::mailboxSyncingProgress, &loop, check);
+    timeout.start(SYNC_TIMEOUT);
+    loop.exec();
+    return condition();
+}
+
+}
+
+QList<int> MailboxSyncBenchmark::mailboxSizes()
+{
+    QList<int> res;
+    QByteArray env = qgetenv("TROJITA_BENCHMARK_SIZES");
+    if (env.isEmpty())
+        env = "1000,10000,100000";
+    Q_FOREACH(const QByteArray &item, env.split(',')) {
+        bool ok;
+        int size = item.trimmed().toInt(&ok);
+        if (ok && size > 0)
+            res << size;
+    }
+    return res;
+}
+
+void MailboxSyncBenchmark::addSizeColumn()
+{
+    QTest::addColumn<int>("messageCount");
+}
+
+void MailboxSyncBenchmark::init()
+{
+    model = 0;
+    server = 0;
+}
+
+void MailboxSyncBenchmark::cleanup()
+{
+    delete model;
+    model = 0;
+    // owned by the model
+    server = 0;
+}
+
+void MailboxSyncBenchmark::createModel(const int messageCount, const QStringList &capabilities)
+{
+    server = new FakeImapServer();
+    server->setCapabilities(capabilities);
+    FakeImapServer::MailboxOptions options;
+    options.messageCount = messageCount;
+    options.uidGapPercent = 10;
+    options.averageThreadSize = 4;
+    options.seed = 42;
+    server->addMailbox(QStringLiteral("a"), options);
+
+    model = new Model(0, new MemoryCache(0), SocketFactoryPtr(server), TaskFactoryPtr(new TaskFactory()));
+    model->setImapUser(QStringLiteral("user"));
+    model->setImapPassword(QStringLiteral("password"));
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_ONLINE);
+}
+
+/** @short Open the mailbox and wait until both its UIDs and flags are synced, providing the index of its message list */
+void MailboxSyncBenchmark::syncMailbox(QModelIndex *msgList)
+{
+    bool done = false;
+    auto connection = connect(model, &Model::mailboxSyncingProgress,
+                              [&done](const QModelIndex &mailbox, const MailboxSyncingProgress state) {
+        Q_UNUSED(mailbox);
+        if (state == STATE_DONE)
+            done = true;
+    });
+    model->rowCount(QModelIndex());
+    const bool listed = waitForModel(model, [this]() { return model->rowCount(QModelIndex()) == 2; });
+    if (listed) {
+        *msgList = model->index(0, 0, model->index(1, 0, QModelIndex()));
+        model->rowCount(*msgList);
+    }
+    const bool synced = listed && waitForModel(model, [&done]() { return done; });
+    disconnect(connection);
+    QVERIFY2(listed, "The mailbox list has not arrived");
+    QVERIFY2(synced, "The mailbox has not been synced");
+}
+
+/** @short Sync the mailbox, disconnect and let some flags change on the server meanwhile */
+void MailboxSyncBenchmark::prepareResync(const int messageCount, const QStringList &capabilities, QModelIndex *msgList)
+{
+    createModel(messageCount, capabilities);
+    syncMailbox(msgList);
+    if (QTest::currentTestFailed())
+        return;
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_OFFLINE);
+    QTest::qWait(50);
+    const int step = 100 / CHANGED_PERCENT;
+    for (int i = 0; i < messageCount; i += step) {
+        server->toggleSeen(QStringLiteral("a"), i);
+    }
+    server->resetCommandCount();
+}
+
+/** @short Reconnect and measure the time it takes to get the mailbox synced again */
+void MailboxSyncBenchmark::resync(const QModelIndex &msgList)
+{
+    bool done = false;
+    auto connection = connect(model, &Model::mailboxSyncingProgress,
+                              [&done](const QModelIndex &mailbox, const MailboxSyncingProgress state) {
+        Q_UNUSED(mailbox);
+        if (state == STATE_DONE)
+            done = true;
+    });
+    QBENCHMARK_ONCE {
+        LibMailboxSync::setModelNetworkPolicy(model, NETWORK_ONLINE);
+        model->resyncMailbox(msgList.parent());
+        QVERIFY(waitForModel(model, [&done]() { return done; }));
+    }
+    disconnect(connection);
+    QTRY_COMPARE(msgList.parent().data(RoleUnreadMessageCount).toInt(), server->unreadCount(QStringLiteral("a")));
+}
+
+/** @short Connect, log in and sync a mailbox which is not in the cache yet */
+void MailboxSyncBenchmark::benchmarkFullSync()
+{
+    QFETCH(int, messageCount);
+    QFETCH(QStringList, capabilities);
+
+    createModel(messageCount, capabilities);
+    QModelIndex msgList;
+    QBENCHMARK_ONCE {
+        syncMailbox(&msgList);
+    }
+    if (QTest::currentTestFailed())
+        return;
+    QCOMPARE(model->rowCount(msgList), messageCount);
+}
+
+void MailboxSyncBenchmark::benchmarkFullSync_data()
+{
+    addSizeColumn();
+    QTest::addColumn<QStringList>("capabilities");
+
+    Q_FOREACH(const int size, mailboxSizes()) {
+        QTest::newRow(QByteArray("plain-" + QByteArray::number(size)).constData()) << size << plainCapabilities();
+        QTest::newRow(QByteArray("condstore-" + QByteArray::number(size)).constData()) << size << condstoreCapabilities();
+        QTest::newRow(QByteArray("qresync-" + QByteArray::number(size)).constData()) << size << qresyncCapabilities();
+    }
+}
+
+/** @short Reopen a cached mailbox through SELECT ... (QRESYNC ...) after some flags have changed */
+void MailboxSyncBenchmark::benchmarkQresyncResync()
+{
+    QFETCH(int, messageCount);
+
+    QModelIndex msgList;
+    prepareResync(messageCount, qresyncCapabilities(), &msgList);
+    if (QTest::currentTestFailed())
+        return;
+    resync(msgList);
+    QCOMPARE(server->commandCount("UID SEARCH"), 0);
+}
+
+void MailboxSyncBenchmark::benchmarkQresyncResync_data()
+{
+    addSizeColumn();
+    Q_FOREACH(const int size, mailboxSizes()) {
+        QTest::newRow(QByteArray::number(size).constData()) << size;
+    }
+}
+
+/** @short Reopen a cached mailbox with CONDSTORE only, i.e. through FETCH ... (CHANGEDSINCE ...) */
+void MailboxSyncBenchmark::benchmarkChangedSinceResync()
+{
+    QFETCH(int, messageCount);
+
+    QModelIndex msgList;
+    prepareResync(messageCount, condstoreCapabilities(), &msgList);
+    if (QTest::currentTestFailed())
+        return;
+    resync(msgList);
+    QVERIFY(server->commandCount("FETCH") > 0);
+}
+
+void MailboxSyncBenchmark::benchmarkChangedSinceResync_data()
+{
+    benchmarkQresyncResync_data();
+}
+
+/** @short Deliver lots of new messages, each one announced by its own EXISTS, into a synced mailbox */
+void MailboxSyncBenchmark::benchmarkExistsStorm()
+{
+    QFETCH(int, messageCount);
+
+    createModel(messageCount, qresyncCapabilities());
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+
+    const int expected = messageCount + ARRIVALS;
+    QBENCHMARK_ONCE {
+        server->appendMessages(QStringLiteral("a"), ARRIVALS);
+        QVERIFY(waitForModel(model, [&]() {
+            return model->rowCount(msgList) == expected &&
+                    model->index(expected - 1, 0, msgList).data(RoleMessageUid).toUInt() ==
+                    server->uidAt(QStringLiteral("a"), expected - 1);
+        }));
+    }
+}
+
+void MailboxSyncBenchmark::benchmarkExistsStorm_data()
+{
+    benchmarkQresyncResync_data();
+}
+
+/** @short Expunge every other message from a synced mailbox */
+void MailboxSyncBenchmark::benchmarkMassVanished()
+{
+    QFETCH(int, messageCount);
+    QFETCH(bool, qresync);
+
+    createModel(messageCount, qresync ? qresyncCapabilities() : plainCapabilities());
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+
+    QVector<int> offsets;
+    for (int i = 0; i < messageCount; i += 2) {
+        offsets << i;
+    }
+    const int expected = messageCount - offsets.size();
+    QBENCHMARK_ONCE {
+        server->expungeMessages(QStringLiteral("a"), offsets);
+        QVERIFY(waitForModel(model, [&]() { return model->rowCount(msgList) == expected; }));
+    }
+    QCOMPARE(model->index(0, 0, msgList).data(RoleMessageUid).toUInt(), server->uidAt(QStringLiteral("a"), 0));
+}
+
+void MailboxSyncBenchmark::benchmarkMassVanished_data()
+{
+    addSizeColumn();
+    QTest::addColumn<bool>("qresync");
+
+    Q_FOREACH(const int size, mailboxSizes()) {
+        QTest::newRow(QByteArray("expunge-" + QByteArray::number(size)).constData()) << size << false;
+        QTest::newRow(QByteArray("vanished-" + QByteArray::number(size)).constData()) << size << true;
+    }
+}
+
+/** @short Time the KeepMailboxOpenTask while it fetches envelopes for a screenful of messages after another
+
+The mailbox holds exactly SCREENFULS screenfuls, so that every screenful hits messages whose envelopes are not known
+yet. The whole run is measured once, which is why the data never run out no matter how the QTest is invoked.
+*/
+void MailboxSyncBenchmark::benchmarkFetchEnvelopes()
+{
+    QFETCH(int, latency);
+
+    createModel(SCREENFUL * SCREENFULS, qresyncCapabilities());
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+    server->setLatency(latency);
+    QBENCHMARK_ONCE {
+        for (int fetched = 0; fetched < SCREENFUL * SCREENFULS; fetched += SCREENFUL) {
+            for (int i = fetched; i < fetched + SCREENFUL; ++i) {
+                model->index(i, 0, msgList).data(RoleMessageSubject);
+            }
+            const QModelIndex last = model->index(fetched + SCREENFUL - 1, 0, msgList);
+            QVERIFY(waitForModel(model, [&last]() { return last.data(RoleIsFetched).toBool(); }));
+        }
+    }
+}
+
+void MailboxSyncBenchmark::benchmarkFetchEnvelopes_data()
+{
+    QTest::addColumn<int>("latency");
+
+    QTest::newRow("no-latency") << 0;
+    QTest::newRow("5ms") << 5;
+}
+
+QTEST_GUILESS_MAIN(MailboxSyncBenchmark)
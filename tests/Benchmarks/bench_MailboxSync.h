@@ -0,0 +1,81 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef BENCH_MAILBOXSYNC_H
+#define BENCH_MAILBOXSYNC_H
+
+#include <QObject>
+#include <QModelIndex>
+#include <QStringList>
+
+namespace Imap {
+namespace Mailbox {
+class Model;
+}
+}
+
+class FakeImapServer;
+
+/** @short Performance of the mailbox synchronization against the FakeImapServer
+
+The mailbox sizes are taken from the TROJITA_BENCHMARK_SIZES environment variable, a comma-separated list of message
+counts. Each benchmark is measured once per size through QBENCHMARK_ONCE, with all the setup happening outside of the
+measured block. The measured code waits for the Model by running the event loop until the Model signals the expected
+change, never through the sleeping QTRY_* macros.
+*/
+class MailboxSyncBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void benchmarkFullSync();
+    void benchmarkFullSync_data();
+    void benchmarkQresyncResync();
+    void benchmarkQresyncResync_data();
+    void benchmarkChangedSinceResync();
+    void benchmarkChangedSinceResync_data();
+    void benchmarkExistsStorm();
+    void benchmarkExistsStorm_data();
+    void benchmarkMassVanished();
+    void benchmarkMassVanished_data();
+    void benchmarkFetchEnvelopes();
+    void benchmarkFetchEnvelopes_data();
+
+private:
+    static QList<int> mailboxSizes();
+    static void addSizeColumn();
+
+    void createModel(const int messageCount, const QStringList &capabilities);
+    void syncMailbox(QModelIndex *msgList);
+    void prepareResync(const int messageCount, const QStringList &capabilities, QModelIndex *msgList);
+    void resync(const QModelIndex &msgList);
+
+    Imap::Mailbox::Model *model;
+    FakeImapServer *server;
+};
+
+#endif
@@ -0,0 +1,281 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <functional>
+#include <QElapsedTimer>
+#include <QtTest>
+#include "bench_Parsers.h"
+#include "Imap/Encoders.h"
+#include "Imap/Parser/LowLevelParser.h"
+#include "Imap/Parser/Rfc5322HeaderParser.h"
+
+using namespace Imap::LowLevelParser;
+
+namespace {
+
+/** @short Minimal time to spend in each benchmark, in nanoseconds */
+const qint64 MIN_DURATION = 500 * 1000 * 1000;
+
+/** @short Defeat the optimizer which would otherwise throw away the unused results */
+volatile int sink;
+
+/** @short Call @arg runOnce, which processes @arg items items of @arg bytes octets in total, until enough time passes
+
+The result is the time spent on a single item. The throughput of the very same run is logged along with it.
+*/
+void measure(const int items, const qint64 bytes, const std::function<void()> &runOnce)
+{
+    int runs = 0;
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        runOnce();
+        ++runs;
+    } while (timer.nsecsElapsed() < MIN_DURATION);
+    const qint64 elapsed = timer.nsecsElapsed();
+    QTest::setBenchmarkResult(static_cast<double>(elapsed) / (static_cast<qint64>(runs) * items), QTest::WalltimeNanoseconds);
+    qDebug("%.1f MB/s", static_cast<double>(bytes) * runs / (elapsed / 1e9) / 1e6);
+}
+
+qint64 totalSize(const QList<QByteArray> &corpus)
+{
+    qint64 res = 0;
+    Q_FOREACH(const QByteArray &item, corpus) {
+        res += item.size();
+    }
+    return res;
+}
+
+/** @short Turn a handful of samples into a corpus of a reasonable size */
+QList<QByteArray> replicate(const QList<QByteArray> &samples)
+{
+    QList<QByteArray> res;
+    while (res.size() < 1000)
+        res += samples;
+    return res;
+}
+
+QList<QByteArray> quotedStrings()
+{
+    return replicate(QList<QByteArray>()
+                     << "\"Re: [project-devel] Weekly status meeting, agenda for Tuesday\" NIL\r\n"
+                     << "\"=?UTF-8?Q?P=C5=99=C3=ADli=C5=A1_=C5=BElu=C5=A5ou=C4=8Dk=C3=BD_k=C5=AF=C5=88?=\" NIL\r\n"
+                     << "\"Path with \\\"quotes\\\" and a backslash \\\\ in it\" NIL\r\n"
+                     << "\"x\" NIL\r\n");
+}
+
+QList<QByteArray> literals()
+{
+    QList<QByteArray> samples;
+    Q_FOREACH(const int size, QList<int>() << 12 << 200 << 4096) {
+        QByteArray data = QByteArray("Lorem ipsum dolor sit amet, consectetur adipiscing elit.\r\n").repeated(size / 58 + 1).left(size);
+        samples << '{' + QByteArray::number(data.size()) + "}\r\n" + data + " NIL\r\n";
+    }
+    return replicate(samples);
+}
+
+QList<QByteArray> envelopes()
+{
+    return replicate(QList<QByteArray>()
+                     << "(\"Tue, 14 Jan 2014 09:12:45 +0100\" \"Re: [project-devel] Build failure on the ARM builders\" "
+                        "((\"Jane Doe\" NIL \"jane.doe\" \"example.org\")) ((\"Jane Doe\" NIL \"jane.doe\" \"example.org\")) "
+                        "((NIL NIL \"project-devel\" \"lists.example.org\")) ((NIL NIL \"project-devel\" \"lists.example.org\")) "
+                        "((\"John Smith\" NIL \"jsmith\" \"example.com\")) NIL \"<20140114081012.GA1234@build.example.com>\" "
+                        "\"<52D4F0ED.8060503@example.org>\")\r\n"
+                     << "(\"Mon, 13 Jan 2014 17:01:02 -0500\" \"=?utf-8?B?UMWZw61sacWhIMW+bHXFpW91xI1rw70ga8WvxYg=?=\" "
+                        "((\"=?iso-8859-2?Q?Pavel_Nov=E1k?=\" NIL \"pavel\" \"example.cz\")) NIL NIL "
+                        "((NIL NIL \"team\" \"example.cz\")(\"Eva\" NIL \"eva\" \"example.cz\")) NIL NIL NIL "
+                        "\"<1389650462.1234.5.camel@laptop>\")\r\n");
+}
+
+QList<QByteArray> bodyStructures()
+{
+    return replicate(QList<QByteArray>()
+                     << "(\"text\" \"plain\" (\"charset\" \"utf-8\" \"format\" \"flowed\") NIL NIL \"quoted-printable\" 1834 47 NIL NIL NIL NIL)\r\n"
+                     << "((\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL \"7bit\" 412 12 NIL NIL NIL NIL)"
+                        "(\"text\" \"html\" (\"charset\" \"us-ascii\") NIL NIL \"7bit\" 1290 30 NIL NIL NIL NIL) "
+                        "\"alternative\" (\"boundary\" \"----=_Part_1234_5678.1389650462\") NIL NIL NIL)\r\n"
+                     << "(((\"text\" \"plain\" (\"charset\" \"utf-8\") NIL NIL \"8bit\" 220 8 NIL NIL NIL NIL)"
+                        "(\"text\" \"html\" (\"charset\" \"utf-8\") NIL NIL \"8bit\" 780 20 NIL NIL NIL NIL) \"alternative\" "
+                        "(\"boundary\" \"b2\") NIL NIL NIL)(\"application\" \"pdf\" (\"name\" \"report.pdf\") NIL NIL \"base64\" "
+                        "183422 NIL (\"attachment\" (\"filename\" \"report.pdf\")) NIL NIL) \"mixed\" (\"boundary\" \"b1\") NIL NIL NIL)\r\n");
+}
+
+QList<QByteArray> flagLists()
+{
+    return replicate(QList<QByteArray>()
+                     << "(\\Seen)\r\n"
+                     << "(\\Seen \\Answered $Forwarded $label1)\r\n"
+                     << "()\r\n");
+}
+
+}
+
+void ParsersBenchmark::benchmarkGetString()
+{
+    QFETCH(QList<QByteArray>, corpus);
+    measure(corpus.size(), totalSize(corpus), [&corpus]() {
+        Q_FOREACH(const QByteArray &line, corpus) {
+            int start = 0;
+            sink = getString(line, start).first.size();
+        }
+    });
+}
+
+void ParsersBenchmark::benchmarkGetString_data()
+{
+    QTest::addColumn<QList<QByteArray> >("corpus");
+    QTest::newRow("quoted") << quotedStrings();
+    QTest::newRow("literal") << literals();
+}
+
+void ParsersBenchmark::benchmarkParseList()
+{
+    QFETCH(QList<QByteArray>, corpus);
+    measure(corpus.size(), totalSize(corpus), [&corpus]() {
+        Q_FOREACH(const QByteArray &line, corpus) {
+            int start = 0;
+            sink = parseList('(', ')', line, start).size();
+        }
+    });
+}
+
+void ParsersBenchmark::benchmarkParseList_data()
+{
+    QTest::addColumn<QList<QByteArray> >("corpus");
+    QTest::newRow("envelope") << envelopes();
+    QTest::newRow("bodystructure") << bodyStructures();
+    QTest::newRow("flags") << flagLists();
+}
+
+void ParsersBenchmark::benchmarkGetSequence()
+{
+    QList<QByteArray> corpus = replicate(QList<QByteArray>()
+                                         << "42\r\n"
+                                         << "1:4,7,10:15,20,22,30:35\r\n"
+                                         << "3,5,8,13,21,34,55,89,144,233,377,610,987,1597,2584,4181\r\n"
+                                         << "1001:1500\r\n");
+    measure(corpus.size(), totalSize(corpus), [&corpus]() {
+        Q_FOREACH(const QByteArray &line, corpus) {
+            int start = 0;
+            sink = getSequence(line, start).size();
+        }
+    });
+}
+
+void ParsersBenchmark::benchmarkParseRFC2822DateTime()
+{
+    QList<QByteArray> corpus = replicate(QList<QByteArray>()
+                                         << "Tue, 14 Jan 2014 09:12:45 +0100"
+                                         << "Mon, 13 Jan 2014 17:01:02 -0500 (EST)"
+                                         << "14 Jan 2014 08:12:45 GMT"
+                                         << "Sun, 5 Jan 2014 3:04 +0000"
+                                         << "Wed, 01 Jan 2014 00:00:00 UT");
+    measure(corpus.size(), totalSize(corpus), [&corpus]() {
+        Q_FOREACH(const QByteArray &line, corpus) {
+            sink = parseRFC2822DateTime(line).isValid();
+        }
+    });
+}
+
+void ParsersBenchmark::benchmarkRfc5322HeaderParser()
+{
+    QList<QByteArray> corpus = replicate(QList<QByteArray>()
+                                         << "References: <52D4F0ED.8060503@example.org>\r\n"
+                                            " <20140114081012.GA1234@build.example.com>\r\n"
+                                            " <CAB+3d9xk=Yk5UJ8J3Vj0U1oG0yTz@mail.example.com>\r\n"
+                                            "List-Post: <mailto:project-devel@lists.example.org>\r\n\r\n"
+                                         << "References: <1389650462.1234.5.camel@laptop>\r\n\r\n"
+                                         << "List-Post: NO (posting not allowed on this list)\r\n\r\n"
+                                         << "\r\n"
+                                         << "Message-ID: <20140114101010.A1B2C3@mx.example.net>\r\n"
+                                            "In-Reply-To: <52D4F0ED.8060503@example.org> (Jane Doe's message of\r\n"
+                                            "\t\"Tue, 14 Jan 2014 09:12:45 +0100\")\r\n"
+                                            "References: <52D4F0ED.8060503@example.org>\r\n\r\n");
+    measure(corpus.size(), totalSize(corpus), [&corpus]() {
+        Q_FOREACH(const QByteArray &headers, corpus) {
+            Rfc5322HeaderParser parser;
+            sink = parser.parse(headers);
+        }
+    });
+}
+
+void ParsersBenchmark::benchmarkDecodeRFC2047String()
+{
+    QList<QByteArray> corpus = replicate(QList<QByteArray>()
+                                         << "=?UTF-8?Q?P=C5=99=C3=ADli=C5=A1_=C5=BElu=C5=A5ou=C4=8Dk=C3=BD_k=C5=AF=C5=88?="
+                                         << "=?utf-8?B?UMWZw61sacWhIMW+bHXFpW91xI1rw70ga8WvxYg=?="
+                                         << "Re: =?iso-8859-2?Q?Pavel_Nov=E1k?= and =?iso-8859-1?Q?J=F6rg?= on the list"
+                                         << "A plain ASCII subject which needs no decoding at all");
+    measure(corpus.size(), totalSize(corpus), [&corpus]() {
+        Q_FOREACH(const QByteArray &raw, corpus) {
+            sink = Imap::decodeRFC2047String(raw).size();
+        }
+    });
+}
+
+void ParsersBenchmark::benchmarkQuotedPrintableDecode()
+{
+    QList<QByteArray> corpus = replicate(QList<QByteArray>()
+                                         << QByteArray("Dobr=C3=BD den,\r\nzas=C3=ADl=C3=A1m p=C5=99=C3=ADlohu, "
+                                                       "kter=C3=A1 je velmi dlouh=C3=A1 a mus=C3=AD b=C3=BDt zalomen=\r\n"
+                                                       "=C3=A1 na v=C3=ADce =C5=99=C3=A1dk=C5=AF.\r\n").repeated(20)
+                                         << QByteArray("This is mostly plain text with an occasional =3D sign and soft=\r\n"
+                                                       " line breaks.\r\n").repeated(50));
+    measure(corpus.size(), totalSize(corpus), [&corpus]() {
+        Q_FOREACH(const QByteArray &raw, corpus) {
+            sink = Imap::quotedPrintableDecode(raw).size();
+        }
+    });
+}
+
+void ParsersBenchmark::benchmarkExtractRfc2231Param()
+{
+    typedef QMap<QByteArray, QByteArray> Parameters;
+    QList<Parameters> corpus;
+    Parameters simple;
+    simple["NAME"] = "report.pdf";
+    simple["CHARSET"] = "utf-8";
+    Parameters encoded;
+    encoded["NAME*"] = "utf-8''P%C5%99%C3%ADloha%20%C4%8D.%201.pdf";
+    Parameters continued;
+    continued["NAME*0*"] = "utf-8''Velmi%20dlouh%C3%BD%20n%C3%A1zev%20";
+    continued["NAME*1*"] = "p%C5%99%C3%ADlohy%2C%20kter%C3%BD%20se%20";
+    continued["NAME*2*"] = "nevejde%20na%20jeden%20%C5%99%C3%A1dek.odt";
+    while (corpus.size() < 1000)
+        corpus << simple << encoded << continued;
+
+    qint64 bytes = 0;
+    Q_FOREACH(const Parameters &params, corpus) {
+        for (auto it = params.constBegin(); it != params.constEnd(); ++it)
+            bytes += it.key().size() + it.value().size();
+    }
+    measure(corpus.size(), bytes, [&corpus]() {
+        Q_FOREACH(const Parameters &params, corpus) {
+            sink = Imap::extractRfc2231Param(params, "NAME").size();
+        }
+    });
+}
+
+QTEST_GUILESS_MAIN(ParsersBenchmark)
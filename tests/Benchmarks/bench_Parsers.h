@@ -0,0 +1,52 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef BENCH_PARSERS_H
+#define BENCH_PARSERS_H
+
+#include <QObject>
+
+/** @short Throughput of the parsing hot spots
+
+Each benchmark runs a function over a corpus of anonymized, but otherwise realistic, input data for a while. The result
+is the wall time spent on a single item of the corpus in nanoseconds; the throughput of the same run is logged as well.
+*/
+class ParsersBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void benchmarkGetString();
+    void benchmarkGetString_data();
+    void benchmarkParseList();
+    void benchmarkParseList_data();
+    void benchmarkGetSequence();
+    void benchmarkParseRFC2822DateTime();
+    void benchmarkRfc5322HeaderParser();
+    void benchmarkDecodeRFC2047String();
+    void benchmarkQuotedPrintableDecode();
+    void benchmarkExtractRfc2231Param();
+};
+
+#endif
@@ -445,4 +445,107 @@ void BodyPartsTest::testFilenameExtraction_data()
     QTest::newRow("name-overwrites-empty-filename") << bsPlaintextEmptyFilename << QStringLiteral("0") << QStringLiteral("actual");
 }
 
+/** @short Check that the downloaded part data show up in the memory accounting, and disappear once released */
+void BodyPartsTest::testMemoryUsage()
+{
+    model->setProperty("trojita-imap-delayed-fetch-part", 0);
+    helperSyncBNoMessages();
+    cServer("* 1 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 1:* (FLAGS)\r\n"));
+    cServer("* 1 FETCH (UID 333 FLAGS ())\r\n" + t.last("OK fetched\r\n"));
+    QModelIndex msg = msgListB.child(0, 0);
+    QVERIFY(msg.isValid());
+    QCOMPARE(model->rowCount(msg), 0);
+    cClient(t.mk("UID FETCH 333 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer("* 1 FETCH (UID 333 BODYSTRUCTURE (" + bsManyPlaintexts + "))\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(model->rowCount(msg), 1);
+    QModelIndex part = msg.child(0, 0).child(0, 0);
+    QVERIFY(part.isValid());
+
+    const quint64 mailboxBefore = idxB.data(RoleMailboxMemoryUsage).value<quint64>();
+    const quint64 messageBefore = msg.data(RoleMessageMemoryUsage).value<quint64>();
+    QVERIFY(messageBefore > 0);
+    QVERIFY(mailboxBefore >= messageBefore);
+
+    const QByteArray payload(64 * 1024, 'x');
+    QCOMPARE(part.data(RolePartData).toByteArray(), QByteArray());
+    cClient(t.mk("UID FETCH 333 (BODY.PEEK[1])\r\n"));
+    cServer("* 1 FETCH (UID 333 BODY[1] \"" + payload.toBase64() + "\")\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(part.data(RolePartData).toByteArray(), payload);
+    cEmpty();
+
+    const quint64 mailboxLoaded = idxB.data(RoleMailboxMemoryUsage).value<quint64>();
+    QVERIFY(msg.data(RoleMessageMemoryUsage).value<quint64>() >= messageBefore + payload.size());
+    QVERIFY(mailboxLoaded >= mailboxBefore + payload.size());
+
+    // The biggest mailbox comes first in the summary
+    QVariantList summary = model->memoryUsage();
+    QVERIFY(!summary.isEmpty());
+    QVariantMap first = summary.first().toMap();
+    QCOMPARE(first[QStringLiteral("mailbox")].toString(), QStringLiteral("b"));
+    QCOMPARE(first[QStringLiteral("bytes")].value<quint64>(), mailboxLoaded);
+    QCOMPARE(first[QStringLiteral("messages")].toInt(), 1);
+
+    model->releaseMessageData(msg);
+    QVERIFY(idxB.data(RoleMailboxMemoryUsage).value<quint64>() < mailboxLoaded - payload.size());
+    cEmpty();
+}
+
+/** @short Check that the least recently used part data are dropped from memory and reloaded from the cache */
+void BodyPartsTest::testPartDataEviction()
+{
+    model->setProperty("trojita-imap-delayed-fetch-part", 0);
+    helperSyncBNoMessages();
+    cServer("* 1 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 1:* (FLAGS)\r\n"));
+    cServer("* 1 FETCH (UID 333 FLAGS ())\r\n" + t.last("OK fetched\r\n"));
+    QModelIndex msg = msgListB.child(0, 0);
+    QVERIFY(msg.isValid());
+    QCOMPARE(model->rowCount(msg), 0);
+    cClient(t.mk("UID FETCH 333 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer("* 1 FETCH (UID 333 BODYSTRUCTURE (" + bsManyPlaintexts + "))\r\n" + t.last("OK fetched\r\n"));
+    QModelIndex rootMultipart = msg.child(0, 0);
+    QCOMPARE(model->rowCount(rootMultipart), 5);
+    QModelIndex part1 = rootMultipart.child(0, 0);
+    QModelIndex part2 = rootMultipart.child(1, 0);
+
+    model->setPartDataBudget(100 * 1024);
+    const QByteArray payload1(64 * 1024, '1');
+    const QByteArray payload2(64 * 1024, '2');
+
+    QCOMPARE(part1.data(RolePartData).toByteArray(), QByteArray());
+    cClient(t.mk("UID FETCH 333 (BODY.PEEK[1])\r\n"));
+    cServer("* 1 FETCH (UID 333 BODY[1] \"" + payload1.toBase64() + "\")\r\n" + t.last("OK fetched\r\n"));
+    QCoreApplication::processEvents();
+    QVERIFY(part1.data(RoleIsFetched).toBool());
+
+    // The second part doesn't fit into the budget, so the older one has to go
+    QCOMPARE(part2.data(RolePartData).toByteArray(), QByteArray());
+    cClient(t.mk("UID FETCH 333 (BODY.PEEK[2])\r\n"));
+    cServer("* 1 FETCH (UID 333 BODY[2] \"" + payload2.toBase64() + "\")\r\n" + t.last("OK fetched\r\n"));
+    QCoreApplication::processEvents();
+    QVERIFY(!part1.data(RoleIsFetched).toBool());
+    QVERIFY(part2.data(RoleIsFetched).toBool());
+
+    // The evicted data come back from the cache, without any network activity
+    QCOMPARE(part1.data(RolePartData).toByteArray(), payload1);
+    QVERIFY(part1.data(RoleIsFetched).toBool());
+    QCoreApplication::processEvents();
+    QVERIFY(!part2.data(RoleIsFetched).toBool());
+    cEmpty();
+
+    // Pinned messages keep all of their data
+    model->pinMessageData(msg);
+    QCOMPARE(part2.data(RolePartData).toByteArray(), payload2);
+    QCoreApplication::processEvents();
+    QVERIFY(part1.data(RoleIsFetched).toBool());
+    QVERIFY(part2.data(RoleIsFetched).toBool());
+
+    model->unpinMessageData(msg);
+    QCoreApplication::processEvents();
+    QVERIFY(!part1.data(RoleIsFetched).toBool());
+    QVERIFY(part2.data(RoleIsFetched).toBool());
+    cEmpty();
+}
+
 QTEST_GUILESS_MAIN(BodyPartsTest)
@@ -41,6 +41,9 @@ private slots:
 
     void testFilenameExtraction();
     void testFilenameExtraction_data();
+
+    void testMemoryUsage();
+    void testPartDataEviction();
 };
 
 #endif
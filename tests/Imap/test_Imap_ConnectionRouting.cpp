@@ -0,0 +1,194 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include "test_Imap_ConnectionRouting.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Streams/FakeSocket.h"
+
+using namespace Imap::Mailbox;
+
+/** @short Helper: open an empty mailbox from the specified @arg row of the top-level list
+
+The SELECT is expected to go over the most recently created connection, whose commands are tagged by the @arg tags.
+*/
+void ImapModelConnectionRoutingTest::helperSelectEmptyMailbox(const int row, TagGenerator &tags)
+{
+    QModelIndex mailbox = model->index(row, 0, QModelIndex());
+    QVERIFY(mailbox.isValid());
+    const QByteArray name = mailbox.data(RoleMailboxName).toString().toUtf8();
+    QCOMPARE(model->rowCount(mailbox.child(0, 0)), 0);
+    model->switchToMailbox(mailbox);
+    cClient(tags.mk("SELECT ") + name + "\r\n");
+    cServer("* 0 EXISTS\r\n" + tags.last("OK selected\r\n"));
+}
+
+/** @short By default, all mailboxes share a single connection */
+void ImapModelConnectionRoutingTest::testSwitchOverSingleConnection()
+{
+    helperSyncBNoMessages();
+    Streams::FakeSocket *primary = SOCK;
+    const MailboxSelectionStats before = model->mailboxSelectionStats();
+
+    helperSelectEmptyMailbox(idxA.row(), t);
+    QVERIFY(SOCK == primary);
+
+    const MailboxSelectionStats after = model->mailboxSelectionStats();
+    QCOMPARE(after.mailboxSwitches, before.mailboxSwitches + 1);
+    QCOMPARE(after.newConnections, before.newConnections);
+    QCOMPARE(after.selectsAvoided, before.selectsAvoided);
+    cEmpty();
+}
+
+/** @short When allowed to, another mailbox gets its own connection instead of evicting the current one */
+void ImapModelConnectionRoutingTest::testNewConnectionForAnotherMailbox()
+{
+    model->setProperty("trojita-imap-max-mailbox-connections", 2);
+    helperSyncBNoMessages();
+    Streams::FakeSocket *primary = SOCK;
+    const MailboxSelectionStats before = model->mailboxSelectionStats();
+
+    TagGenerator tagsA;
+    helperSelectEmptyMailbox(idxA.row(), tagsA);
+    QVERIFY(SOCK != primary);
+    QCOMPARE(primary->writtenStuff(), QByteArray());
+
+    const MailboxSelectionStats after = model->mailboxSelectionStats();
+    QCOMPARE(after.mailboxSwitches, before.mailboxSwitches);
+    QCOMPARE(after.newConnections, before.newConnections + 1);
+    cEmpty();
+}
+
+/** @short A request for an already open mailbox goes to its connection, and only an actual switch is counted as avoided */
+void ImapModelConnectionRoutingTest::testReuseOpenMailbox()
+{
+    model->setProperty("trojita-imap-max-mailbox-connections", 2);
+    helperSyncBNoMessages();
+    Streams::FakeSocket *primary = SOCK;
+    TagGenerator tagsA;
+    helperSelectEmptyMailbox(idxA.row(), tagsA);
+    Streams::FakeSocket *second = SOCK;
+    QVERIFY(second != primary);
+    const MailboxSelectionStats before = model->mailboxSelectionStats();
+
+    // Going back to B would have required a SELECT if there was just a single connection
+    model->switchToMailbox(idxB);
+    QCOMPARE(model->mailboxSelectionStats().selectsAvoided, before.selectsAvoided + 1);
+
+    // ...but further requests for the same mailbox would not
+    model->switchToMailbox(idxB);
+    model->switchToMailbox(idxB);
+    QCOMPARE(model->mailboxSelectionStats().selectsAvoided, before.selectsAvoided + 1);
+
+    model->switchToMailbox(idxA);
+    QCOMPARE(model->mailboxSelectionStats().selectsAvoided, before.selectsAvoided + 2);
+
+    TROJITA_CLIENT_LOOP
+    QCOMPARE(primary->writtenStuff(), QByteArray());
+    QCOMPARE(second->writtenStuff(), QByteArray());
+    QVERIFY(SOCK == second);
+
+    const MailboxSelectionStats after = model->mailboxSelectionStats();
+    QCOMPARE(after.mailboxSwitches, before.mailboxSwitches);
+    QCOMPARE(after.newConnections, before.newConnections);
+}
+
+/** @short The number of mailbox connections is capped by the overall limit on connections */
+void ImapModelConnectionRoutingTest::testConnectionLimit()
+{
+    model->setProperty("trojita-imap-max-mailbox-connections", 10);
+    helperSyncBNoMessages();
+    QList<Streams::FakeSocket *> sockets;
+    sockets << SOCK;
+
+    // The Model uses at most four connections; B has one already, and each of A, C and D gets another one
+    const int rows[] = {idxA.row(), idxC.row(), idxC.row() + 1};
+    for (int row : rows) {
+        TagGenerator tags;
+        helperSelectEmptyMailbox(row, tags);
+        QVERIFY(!sockets.contains(SOCK));
+        sockets << SOCK;
+    }
+    const MailboxSelectionStats before = model->mailboxSelectionStats();
+
+    // There's no room for another connection, so one of the mailboxes has to make room for E
+    QModelIndex mailboxE = model->index(idxC.row() + 2, 0, QModelIndex());
+    QCOMPARE(mailboxE.data(RoleMailboxName).toString(), QStringLiteral("e"));
+    model->switchToMailbox(mailboxE);
+    TROJITA_CLIENT_LOOP
+    QVERIFY(SOCK == sockets.last());
+    int switched = -1;
+    for (int i = 0; i < sockets.size(); ++i) {
+        const QByteArray written = sockets[i]->writtenStuff();
+        if (written.isEmpty())
+            continue;
+        QCOMPARE(switched, -1);
+        QVERIFY(written.endsWith(" SELECT e\r\n"));
+        switched = i;
+    }
+    QVERIFY(switched != -1);
+
+    const MailboxSelectionStats after = model->mailboxSelectionStats();
+    QCOMPARE(after.mailboxSwitches, before.mailboxSwitches + 1);
+    QCOMPARE(after.newConnections, before.newConnections);
+}
+
+/** @short Under load spread over several mailboxes, the idle mailbox makes room rather than the one still syncing
+
+Closing A in the middle of its sync would cost one more SELECT when A is needed again, so only C gets selected.
+*/
+void ImapModelConnectionRoutingTest::testSwitchAvoidsBusyMailbox()
+{
+    model->setProperty("trojita-imap-max-mailbox-connections", 2);
+    helperSyncBNoMessages();
+    Streams::FakeSocket *primary = SOCK;
+
+    // A gets its own connection, but the server is slow to answer its SELECT
+    QCOMPARE(model->rowCount(idxA.child(0, 0)), 0);
+    model->switchToMailbox(idxA);
+    TagGenerator tagsA;
+    cClient(tagsA.mk("SELECT a\r\n"));
+    Streams::FakeSocket *second = SOCK;
+    QVERIFY(second != primary);
+    const MailboxSelectionStats before = model->mailboxSelectionStats();
+
+    // Both connections are taken, so the idle B gets closed for C
+    QCOMPARE(model->rowCount(idxC.child(0, 0)), 0);
+    model->switchToMailbox(idxC);
+    TROJITA_CLIENT_LOOP
+    QCOMPARE(primary->writtenStuff(), t.mk("SELECT c\r\n"));
+    primary->fakeReading("* 0 EXISTS\r\n" + t.last("OK selected\r\n"));
+    cServer("* 0 EXISTS\r\n" + tagsA.last("OK selected\r\n"));
+
+    // Going back to A needs no further SELECT
+    model->switchToMailbox(idxA);
+    TROJITA_CLIENT_LOOP
+    QCOMPARE(primary->writtenStuff(), QByteArray());
+    cEmpty();
+
+    const MailboxSelectionStats after = model->mailboxSelectionStats();
+    QCOMPARE(after.mailboxSwitches, before.mailboxSwitches + 1);
+    QCOMPARE(after.newConnections, before.newConnections);
+    QCOMPARE(after.selectsAvoided, before.selectsAvoided + 1);
+}
+
+QTEST_GUILESS_MAIN(ImapModelConnectionRoutingTest)
@@ -0,0 +1,212 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <QtTest>
+#include "test_Imap_FakeServer.h"
+#include "Utils/FakeImapServer.h"
+#include "Utils/LibMailboxSync.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MemoryCache.h"
+#include "Imap/Model/MsgListModel.h"
+#include "Imap/Model/TaskFactory.h"
+#include "Imap/Model/ThreadingMsgListModel.h"
+
+using namespace Imap::Mailbox;
+
+namespace {
+
+/** @short Capabilities of a server without any of the synchronization extensions */
+QStringList plainCapabilities()
+{
+    return QStringList() << QStringLiteral("IMAP4rev1") << QStringLiteral("LITERAL+") << QStringLiteral("IDLE");
+}
+
+/** @short How long to wait for a sync of a large mailbox before giving up */
+const int SYNC_TIMEOUT = 60000;
+
+}
+
+void ImapFakeServerTest::init()
+{
+    model = 0;
+    server = 0;
+}
+
+void ImapFakeServerTest::cleanup()
+{
+    delete model;
+    model = 0;
+    // owned by the model
+    server = 0;
+}
+
+void ImapFakeServerTest::createModel(const int messageCount, const QStringList &capabilities)
+{
+    server = new FakeImapServer();
+    if (!capabilities.isEmpty())
+        server->setCapabilities(capabilities);
+    FakeImapServer::MailboxOptions options;
+    options.messageCount = messageCount;
+    options.uidGapPercent = 10;
+    options.averageThreadSize = 4;
+    options.seed = 42;
+    server->addMailbox(QStringLiteral("a"), options);
+
+    model = new Model(0, new MemoryCache(0), SocketFactoryPtr(server), TaskFactoryPtr(new TaskFactory()));
+    model->setImapUser(QStringLiteral("user"));
+    model->setImapPassword(QStringLiteral("password"));
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_ONLINE);
+}
+
+/** @short Open the mailbox and wait until it gets synced, providing the index of its message list */
+void ImapFakeServerTest::syncMailbox(QModelIndex *msgList)
+{
+    model->rowCount(QModelIndex());
+    QTRY_COMPARE_WITH_TIMEOUT(model->rowCount(QModelIndex()), 2, SYNC_TIMEOUT);
+    QModelIndex mailbox = model->index(1, 0, QModelIndex());
+    Q_ASSERT(mailbox.data(RoleMailboxName).toString() == QLatin1String("a"));
+    *msgList = model->index(0, 0, mailbox);
+    model->rowCount(*msgList);
+    QTRY_VERIFY_WITH_TIMEOUT(msgList->data(RoleIsFetched).toBool(), SYNC_TIMEOUT);
+}
+
+/** @short Ask for the envelopes of the first @arg count messages, the way the message list view does */
+void ImapFakeServerTest::fetchEnvelopes(const QModelIndex &msgList, const int count)
+{
+    for (int i = 0; i < count; ++i) {
+        model->index(i, 0, msgList).data(RoleMessageSubject);
+    }
+    QModelIndex last = model->index(count - 1, 0, msgList);
+    QTRY_VERIFY_WITH_TIMEOUT(last.data(RoleIsFetched).toBool(), SYNC_TIMEOUT);
+}
+
+/** @short Sync through UID SEARCH and FETCH FLAGS, then fetch a few envelopes */
+void ImapFakeServerTest::testSyncPlain()
+{
+    createModel(1000, plainCapabilities());
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+    QCOMPARE(model->rowCount(msgList), server->messageCount(QStringLiteral("a")));
+    QCOMPARE(model->index(0, 0, msgList).data(RoleMessageUid).toUInt(), server->uidAt(QStringLiteral("a"), 0));
+    QCOMPARE(model->index(999, 0, msgList).data(RoleMessageUid).toUInt(), server->uidAt(QStringLiteral("a"), 999));
+    QTRY_COMPARE(msgList.parent().data(RoleUnreadMessageCount).toInt(), server->unreadCount(QStringLiteral("a")));
+    QCOMPARE(server->commandCount("UID SEARCH"), 1);
+    QCOMPARE(server->commandCount("FETCH"), 1);
+
+    fetchEnvelopes(msgList, 50);
+    if (QTest::currentTestFailed())
+        return;
+    for (int i = 0; i < 50; ++i) {
+        QCOMPARE(model->index(i, 0, msgList).data(RoleMessageSubject).toString(), server->subjectAt(QStringLiteral("a"), i));
+    }
+}
+
+/** @short The initial sync with QRESYNC enabled goes through ESEARCH and FETCH FLAGS with MODSEQ */
+void ImapFakeServerTest::testSyncQresync()
+{
+    createModel(1000);
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+    QCOMPARE(model->rowCount(msgList), server->messageCount(QStringLiteral("a")));
+    QCOMPARE(model->index(999, 0, msgList).data(RoleMessageUid).toUInt(), server->uidAt(QStringLiteral("a"), 999));
+    QTRY_COMPARE(msgList.parent().data(RoleUnreadMessageCount).toInt(), server->unreadCount(QStringLiteral("a")));
+    QCOMPARE(server->commandCount("ENABLE"), 1);
+}
+
+/** @short Reconnecting with a warm cache only transfers the changed flags */
+void ImapFakeServerTest::testResyncQresync()
+{
+    createModel(1000);
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+    QTRY_COMPARE(msgList.parent().data(RoleUnreadMessageCount).toInt(), server->unreadCount(QStringLiteral("a")));
+
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_OFFLINE);
+    QTest::qWait(50);
+    server->toggleSeen(QStringLiteral("a"), 10);
+    server->toggleSeen(QStringLiteral("a"), 500);
+    server->resetCommandCount();
+
+    LibMailboxSync::setModelNetworkPolicy(model, NETWORK_ONLINE);
+    model->resyncMailbox(msgList.parent());
+    QTRY_VERIFY_WITH_TIMEOUT(server->commandCount("SELECT") > 0 && msgList.data(RoleIsFetched).toBool(), SYNC_TIMEOUT);
+    QTRY_COMPARE(msgList.parent().data(RoleUnreadMessageCount).toInt(), server->unreadCount(QStringLiteral("a")));
+    QCOMPARE(model->rowCount(msgList), server->messageCount(QStringLiteral("a")));
+    QCOMPARE(server->commandCount("UID SEARCH"), 0);
+    QCOMPARE(server->commandCount("FETCH"), 0);
+}
+
+void ImapFakeServerTest::testFlagChangeOfOpenMailbox_data()
+{
+    QTest::addColumn<QStringList>("capabilities");
+    QTest::newRow("plain") << plainCapabilities();
+    QTest::newRow("qresync") << QStringList();
+}
+
+/** @short Flags changed by another client while the mailbox is open are pushed to the Model without asking */
+void ImapFakeServerTest::testFlagChangeOfOpenMailbox()
+{
+    QFETCH(QStringList, capabilities);
+    createModel(100, capabilities);
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+    QTRY_COMPARE(msgList.parent().data(RoleUnreadMessageCount).toInt(), server->unreadCount(QStringLiteral("a")));
+    server->resetCommandCount();
+
+    const QModelIndex message = model->index(10, 0, msgList);
+    const bool wasRead = message.data(RoleMessageIsMarkedRead).toBool();
+    server->toggleSeen(QStringLiteral("a"), 10);
+    QTRY_COMPARE(message.data(RoleMessageIsMarkedRead).toBool(), !wasRead);
+    QCOMPARE(msgList.parent().data(RoleUnreadMessageCount).toInt(), server->unreadCount(QStringLiteral("a")));
+    QCOMPARE(server->commandCount("FETCH"), 0);
+    QCOMPARE(server->commandCount("UID FETCH"), 0);
+}
+
+/** @short The THREAD response is built from the synthesized replies and gets consumed by the threading model */
+void ImapFakeServerTest::testThreading()
+{
+    createModel(1000);
+    QModelIndex msgList;
+    syncMailbox(&msgList);
+    if (QTest::currentTestFailed())
+        return;
+    MsgListModel msgListModel(0, model);
+    msgListModel.setMailbox(msgList.parent());
+    ThreadingMsgListModel threadingModel(0);
+    threadingModel.setSourceModel(&msgListModel);
+    threadingModel.setUserWantsThreading(true);
+    QTRY_COMPARE_WITH_TIMEOUT(threadingModel.rowCount(QModelIndex()), server->threadRootCount(QStringLiteral("a")), SYNC_TIMEOUT);
+    QVERIFY(threadingModel.rowCount(QModelIndex()) < server->messageCount(QStringLiteral("a")));
+    QCOMPARE(server->commandCount("UID THREAD"), 1);
+}
+
+QTEST_GUILESS_MAIN(ImapFakeServerTest)
@@ -61,6 +61,41 @@ void ImapModelTest::testSyncMailbox()
     // further tests are especially in the Imap_Task_ObtainSynchronizedMailboxTest
 }
 
+void ImapModelTest::testConnectionMetrics()
+{
+    model->rowCount(QModelIndex());
+    QCoreApplication::processEvents();
+    cServer("* PREAUTH [CAPABILITY Imap4Rev1] foo\r\n");
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+
+    QVariantList connections = model->connectionMetrics();
+    QCOMPARE(connections.size(), 1);
+    QVariantMap metrics = connections[0].toMap();
+    QCOMPARE(metrics[QStringLiteral("commandsInFlight")].toInt(), 1);
+    QCOMPARE(metrics[QStringLiteral("commandsQueued")].toInt(), 0);
+    QVERIFY(metrics[QStringLiteral("commandLatency")].toMap().isEmpty());
+
+    cServer("* LIST (\\HasNoChildren) \".\" \"INBOX\"\r\n"
+            "* LIST (\\HasNoChildren) \".\" \"foo\"\r\n"
+            + t.last("ok list completed\r\n"));
+    cEmpty();
+
+    metrics = model->connectionMetrics()[0].toMap();
+    QCOMPARE(metrics[QStringLiteral("commandsInFlight")].toInt(), 0);
+    QVariantMap latency = metrics[QStringLiteral("commandLatency")].toMap();
+    QCOMPARE(latency.keys(), QStringList() << QStringLiteral("LIST"));
+    QCOMPARE(latency[QStringLiteral("LIST")].toMap()[QStringLiteral("count")].toInt(), 1);
+    QVariantMap responses = metrics[QStringLiteral("responseCounts")].toMap();
+    QCOMPARE(responses[QStringLiteral("PREAUTH")].toInt(), 1);
+    QCOMPARE(responses[QStringLiteral("LIST")].toInt(), 2);
+    QCOMPARE(responses[QStringLiteral("TAGGED OK")].toInt(), 1);
+
+    // There's no compression on this connection, so the payload is what went over the wire
+    QCOMPARE(metrics[QStringLiteral("bytesSent")].toLongLong(), qint64(t.last("LIST \"\" \"%\"\r\n").size()));
+    QCOMPARE(metrics[QStringLiteral("bytesSent")], metrics[QStringLiteral("wireBytesSent")]);
+    QCOMPARE(metrics[QStringLiteral("bytesReceived")], metrics[QStringLiteral("wireBytesReceived")]);
+}
+
 void ImapModelTest::testInboxCaseSensitivity()
 {
     mboxModel = new Imap::Mailbox::MailboxModel(this, model);
@@ -46,6 +46,9 @@ private slots:
     /** @short Test that we detect failures to CREATE/DELETE a mailbox */
     void testCreationDeletionHandling();
 
+    /** @short Test the per-connection latency and traffic counters */
+    void testConnectionMetrics();
+
 private:
     Imap::Mailbox::MailboxModel* mboxModel;
 };
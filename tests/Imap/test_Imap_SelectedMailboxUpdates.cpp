@@ -25,11 +25,17 @@
 #include "test_Imap_SelectedMailboxUpdates.h"
 #include "Imap/Model/DummyNetworkWatcher.h"
 #include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxTree.h"
 #include "Imap/Model/MemoryCache.h"
 #include "Imap/Parser/Uids.h"
 #include "Streams/FakeSocket.h"
 #include "Imap/data.h"
 
+void ImapModelSelectedMailboxUpdatesTest::initTestCase_data()
+{
+    helperDataChangedCoalescingData();
+}
+
 /** @short Test that we survive a new message arrival and its subsequent removal in rapid sequence
 
 The code won't notice that the message got expunged immediately (simply because it has no idea of a
@@ -713,6 +719,48 @@ void ImapModelSelectedMailboxUpdatesTest::testVanishedWithNonExisting()
     cEmpty();
 }
 
+/** @short Runs of EXPUNGE and ranges in VANISHED are removed as contiguous blocks of rows */
+void ImapModelSelectedMailboxUpdatesTest::testBatchedExpunges()
+{
+    initialMessages(10);
+    QSignalSpy rowsRemoved(model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    QSignalSpy numbersWatcher(model, SIGNAL(messageCountPossiblyChanged(QModelIndex)));
+
+    // Each EXPUNGE refers to the numbering after the previous ones, so this removes UIDs 2, 3, 4, 8 and 1
+    cServer("* 2 EXPUNGE\r\n* 2 EXPUNGE\r\n* 2 EXPUNGE\r\n* 5 EXPUNGE\r\n* 1 EXPUNGE\r\n");
+    uidMapA = Imap::Uids() << 5 << 6 << 7 << 9 << 10;
+    existsA = uidMapA.size();
+    helperCheckUidMapFromModel();
+    helperCheckCache();
+    QCOMPARE(rowsRemoved.size(), 2);
+    QCOMPARE(rowsRemoved[0][1].toInt(), 7);
+    QCOMPARE(rowsRemoved[0][2].toInt(), 7);
+    QCOMPARE(rowsRemoved[1][1].toInt(), 0);
+    QCOMPARE(rowsRemoved[1][2].toInt(), 3);
+    QCOMPARE(numbersWatcher.size(), 1);
+    for (int i = 0; i < uidMapA.size(); ++i) {
+        QCOMPARE(static_cast<Imap::Mailbox::TreeItem *>(msgListA.child(i, 0).internalPointer())->row(), i);
+    }
+    rowsRemoved.clear();
+
+    cServer("* VANISHED 6:7,10,11\r\n");
+    uidMapA = Imap::Uids() << 5 << 9;
+    existsA = uidMapA.size();
+    helperCheckUidMapFromModel();
+    helperCheckCache();
+    QCOMPARE(rowsRemoved.size(), 2);
+    QCOMPARE(rowsRemoved[0][1].toInt(), 4);
+    QCOMPARE(rowsRemoved[0][2].toInt(), 4);
+    QCOMPARE(rowsRemoved[1][1].toInt(), 1);
+    QCOMPARE(rowsRemoved[1][2].toInt(), 2);
+
+    // An out-of-bounds number anywhere in the run means that nothing gets applied
+    {
+        ExpectSingleErrorHere blocker(this);
+        cServer("* 1 EXPUNGE\r\n* 2 EXPUNGE\r\n");
+    }
+}
+
 /** @short Test what happens when the server informs about new message arrivals twice in a row */
 void ImapModelSelectedMailboxUpdatesTest::testMultipleArrivals()
 {
@@ -967,6 +1015,154 @@ void ImapModelSelectedMailboxUpdatesTest::testFlagsRecalcOnExpunge()
     cEmpty();
 }
 
+/** @short The message counts are adjusted incrementally when VANISHED removes messages, including those without UID */
+void ImapModelSelectedMailboxUpdatesTest::testFlagsRecalcOnVanished()
+{
+    initialMessages(10);
+    // Only the ninth message is unread after the initial sync
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    cServer("* 3 FETCH (FLAGS ())\r\n");
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 2);
+
+    QSignalSpy numbersWatcher(model, SIGNAL(messageCountPossiblyChanged(QModelIndex)));
+    cServer("* VANISHED 9\r\n");
+    QCOMPARE(numbersWatcher.size(), 1);
+    numbersWatcher.clear();
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleTotalMessageCount).toInt(), 9);
+
+    // A new arrival is not counted as unread until its flags are known
+    cServer("* 10 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 11:* (FLAGS)\r\n"));
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleTotalMessageCount).toInt(), 10);
+    numbersWatcher.clear();
+
+    // This time there's a message with an unknown UID in the mailbox
+    cServer("* VANISHED 3\r\n");
+    QCOMPARE(numbersWatcher.size(), 1);
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 0);
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleTotalMessageCount).toInt(), 9);
+
+    cServer("* 9 FETCH (UID 11 FLAGS ())\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleTotalMessageCount).toInt(), 9);
+    cEmpty();
+}
+
+/** @short A STATUS of a mailbox which is not kept in sync does not leak into its incremental message counts */
+void ImapModelSelectedMailboxUpdatesTest::testStatusOfClosedMailbox()
+{
+    initialMessages(10);
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    helperSyncBNoMessages();
+
+    // Nobody keeps A in sync now, so the server knows better
+    cServer("* STATUS a (MESSAGES 10 RECENT 0 UNSEEN 4)\r\n");
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 4);
+
+    // Once A is being synced again, the counters are based on the messages which are going to be updated incrementally
+    model->switchToMailbox(idxA);
+    cClient(t.mk("SELECT a\r\n"));
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    // ...and the STATUS which the server might send meanwhile does not change that
+    cServer("* STATUS a (MESSAGES 10 RECENT 0 UNSEEN 4)\r\n");
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    helperFakeExistsUidValidityUidNext();
+    helperSyncFlags();
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+
+    cServer("* 3 FETCH (FLAGS ())\r\n");
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 2);
+    cServer("* 9 EXPUNGE\r\n");
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 1);
+    cEmpty();
+}
+
+/** @short Updates of adjacent messages are reported through a single dataChanged() */
+void ImapModelSelectedMailboxUpdatesTest::testCoalescedDataChanged()
+{
+    initialMessages(10);
+    // This one is about the merged signals, whatever the mode the rest of the tests runs in
+    model->setDataChangedCoalescing(true);
+    QSignalSpy changedSpy(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+    QSignalSpy numbersWatcher(model, SIGNAL(messageCountPossiblyChanged(QModelIndex)));
+    cServer("* 2 FETCH (FLAGS (x))\r\n"
+            "* 3 FETCH (FLAGS (y))\r\n"
+            "* 4 FETCH (FLAGS (z))\r\n"
+            "* 7 FETCH (FLAGS (\\Seen))\r\n"
+            "* 3 FETCH (FLAGS (\\Seen))\r\n");
+
+    QCOMPARE(changedSpy.size(), 4);
+    QCOMPARE(changedSpy[0][0].toModelIndex(), msgListA.child(1, 0));
+    QCOMPARE(changedSpy[0][1].toModelIndex(), msgListA.child(3, 0));
+    QCOMPARE(changedSpy[1][0].toModelIndex(), msgListA.child(6, 0));
+    QCOMPARE(changedSpy[1][1].toModelIndex(), msgListA.child(6, 0));
+    // The message counts are reported just once
+    QCOMPARE(changedSpy[2][0].toModelIndex(), QModelIndex(msgListA));
+    QCOMPARE(changedSpy[3][0].toModelIndex(), QModelIndex(idxA));
+    QCOMPARE(numbersWatcher.size(), 1);
+    QCOMPARE(idxA.data(Imap::Mailbox::RoleUnreadMessageCount).toInt(), 3);
+    changedSpy.clear();
+
+    // Anything but FETCH gets to see a fully updated model
+    cServer("* 5 FETCH (FLAGS ())\r\n"
+            "* 11 EXISTS\r\n");
+    QCOMPARE(changedSpy.size(), 5);
+    QCOMPARE(changedSpy[0][0].toModelIndex(), msgListA.child(4, 0));
+    QCOMPARE(changedSpy[0][1].toModelIndex(), msgListA.child(4, 0));
+    cClient(t.mk("UID FETCH 11:* (FLAGS)\r\n"));
+    cServer("* 11 FETCH (UID 11 FLAGS ())\r\n" + t.last("OK fetched\r\n"));
+    cEmpty();
+}
+
+/** @short Envelope requests follow the window of messages reported by a view */
+void ImapModelSelectedMailboxUpdatesTest::testMessageFetchWindow()
+{
+    initialMessages(10);
+    QScopedPointer<QObject> view(new QObject());
+
+    model->setMessageFetchWindow(view.data(), QModelIndexList() << msgListA.child(4, 0) << msgListA.child(5, 0));
+    // A request which comes from somewhere else, like a delegate painting a row which is just being scrolled away.
+    // Nothing around it gets preloaded.
+    QCOMPARE(msgListA.child(0, 0).data(Imap::Mailbox::RoleMessageSubject), QVariant());
+    QSignalSpy changedSpy(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+    // The view moves on before any of these requests were sent. Only what the view asked for itself gets cancelled.
+    model->setMessageFetchWindow(view.data(), QModelIndexList() << msgListA.child(6, 0) << msgListA.child(5, 0));
+    cClient(t.mk("UID FETCH 1,6:7 (" FETCH_METADATA_ITEMS ")\r\n"));
+    bool cancelledReported = false;
+    for (const auto &args : changedSpy) {
+        if (args[0].toModelIndex() == msgListA.child(4, 0))
+            cancelledReported = true;
+    }
+    QVERIFY(cancelledReported);
+    cServer(helperCreateTrivialEnvelope(1, 1, QStringLiteral("one")) + helperCreateTrivialEnvelope(6, 6, QStringLiteral("six"))
+            + helperCreateTrivialEnvelope(7, 7, QStringLiteral("seven")) + t.last("OK fetched\r\n"));
+    QCOMPARE(msgListA.child(0, 0).data(Imap::Mailbox::RoleMessageSubject).toString(), QStringLiteral("one"));
+    QCOMPARE(msgListA.child(5, 0).data(Imap::Mailbox::RoleMessageSubject).toString(), QStringLiteral("six"));
+    QCOMPARE(msgListA.child(6, 0).data(Imap::Mailbox::RoleMessageSubject).toString(), QStringLiteral("seven"));
+
+    // The cancelled requests are issued again once somebody needs the data
+    QCOMPARE(msgListA.child(4, 0).data(Imap::Mailbox::RoleMessageSubject), QVariant());
+    cClient(t.mk("UID FETCH 5 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer(helperCreateTrivialEnvelope(5, 5, QStringLiteral("five")) + t.last("OK fetched\r\n"));
+    QCOMPARE(msgListA.child(4, 0).data(Imap::Mailbox::RoleMessageSubject).toString(), QStringLiteral("five"));
+
+    // Without the view, the model goes back to preloading whatever is around the requested message
+    view.reset();
+    QCOMPARE(msgListA.child(9, 0).data(Imap::Mailbox::RoleMessageSubject), QVariant());
+    cClient(t.mk("UID FETCH 2:4,8:10 (" FETCH_METADATA_ITEMS ")\r\n"));
+    QByteArray envelopes;
+    Q_FOREACH(const uint uid, Imap::Uids() << 2 << 3 << 4 << 8 << 9 << 10) {
+        envelopes += helperCreateTrivialEnvelope(uid, uid, QString::number(uid));
+    }
+    cServer(envelopes + t.last("OK fetched\r\n"));
+    QCOMPARE(msgListA.child(9, 0).data(Imap::Mailbox::RoleMessageSubject).toString(), QStringLiteral("10"));
+
+    justKeepTask();
+    cEmpty();
+}
+
 /** @short Servers reporting UID 0 are buggy, full stop */
 void ImapModelSelectedMailboxUpdatesTest::testUid0()
 {
@@ -31,6 +31,7 @@ class ImapModelSelectedMailboxUpdatesTest : public LibMailboxSync
 {
     Q_OBJECT
 private slots:
+    void initTestCase_data();
 
     void testExpungeImmediatelyAfterArrival();
     void testExpungeImmediatelyAfterArrivalWithUidNext();
@@ -39,6 +40,7 @@ private slots:
     void testGenericTrafficWithEnvelopes();
     void testVanishedUpdates();
     void testVanishedWithNonExisting();
+    void testBatchedExpunges();
     void testMultipleArrivals();
     void testMultipleArrivalsBlockingFurtherActivity();
     void testInnocentUidValidityChange();
@@ -47,6 +49,10 @@ private slots:
     void testFetchAndConcurrentArrival();
     void testGMailSpontaneousFlagsAndNoRecent();
     void testFlagsRecalcOnExpunge();
+    void testFlagsRecalcOnVanished();
+    void testStatusOfClosedMailbox();
+    void testCoalescedDataChanged();
+    void testMessageFetchWindow();
     void testUid0();
     void testMarkAllConcurrentArrival();
     void testLogoutClosed();
@@ -0,0 +1,206 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include "test_Imap_SessionTrace.h"
+#include "Utils/SessionReplay.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MemoryCache.h"
+#include "Imap/Model/SessionTrace.h"
+#include "Imap/Model/TaskFactory.h"
+#include "Streams/FakeSocket.h"
+
+using namespace Imap::Mailbox;
+
+namespace {
+
+QVector<SessionTraceRecord> readTrace(QByteArray *data, QString *errorString)
+{
+    QBuffer device(data);
+    device.open(QIODevice::ReadOnly);
+    SessionTraceReader reader(&device);
+    QVector<SessionTraceRecord> records;
+    SessionTraceRecord record;
+    while (reader.readNext(record))
+        records << record;
+    *errorString = reader.errorString();
+    return records;
+}
+
+}
+
+/** @short Check that what gets written can be read back, except for the lines which aren't real traffic */
+void ImapSessionTraceTest::testRoundTrip()
+{
+    QByteArray data;
+    QBuffer *device = new QBuffer(&data);
+    device->open(QIODevice::WriteOnly);
+    {
+        SessionTraceWriter writer(0, device);
+        writer.record(3, SessionTraceRecord::SERVER_TO_CLIENT, "* OK [CAPABILITY IMAP4rev1] hi\r\n");
+        writer.record(3, SessionTraceRecord::SERVER_TO_CLIENT, "*** Connection established");
+        writer.record(4, SessionTraceRecord::CLIENT_TO_SERVER, "y0 LOGOUT\r\n");
+    }
+
+    QString error;
+    QVector<SessionTraceRecord> records = readTrace(&data, &error);
+    QVERIFY(error.isNull());
+    QCOMPARE(records.size(), 2);
+    QCOMPARE(records[0].direction, SessionTraceRecord::SERVER_TO_CLIENT);
+    QCOMPARE(records[0].parserId, 3u);
+    QCOMPARE(records[0].data, QByteArray("* OK [CAPABILITY IMAP4rev1] hi\r\n"));
+    QCOMPARE(records[1].direction, SessionTraceRecord::CLIENT_TO_SERVER);
+    QCOMPARE(records[1].parserId, 4u);
+    QCOMPARE(records[1].data, QByteArray("y0 LOGOUT\r\n"));
+}
+
+/** @short Garbage and truncated traces are reported as such */
+void ImapSessionTraceTest::testCorruptedTrace()
+{
+    QString error;
+    QByteArray garbage("this is not a trace");
+    QVERIFY(readTrace(&garbage, &error).isEmpty());
+    QVERIFY(!error.isNull());
+
+    QByteArray data;
+    QBuffer *device = new QBuffer(&data);
+    device->open(QIODevice::WriteOnly);
+    {
+        SessionTraceWriter writer(0, device);
+        writer.record(1, SessionTraceRecord::SERVER_TO_CLIENT, "* OK hi\r\n");
+        writer.record(1, SessionTraceRecord::CLIENT_TO_SERVER, "y0 CAPABILITY\r\n");
+    }
+    data.chop(3);
+    QCOMPARE(readTrace(&data, &error).size(), 1);
+    QVERIFY(!error.isNull());
+}
+
+/** @short Helper: record a sync of mailbox A followed by a request for one envelope */
+void ImapSessionTraceTest::helperRecordSync(QVector<SessionTraceRecord> &records)
+{
+    QByteArray data;
+    QBuffer *device = new QBuffer(&data);
+    device->open(QIODevice::WriteOnly);
+    model->setSessionTrace(new SessionTraceWriter(model, device));
+
+    existsA = 3;
+    uidValidityA = 6;
+    uidMapA << 1 << 7 << 9;
+    uidNextA = 16;
+    helperSyncAWithMessagesEmptyState();
+    requestAndCheckSubject(1, "subject 7");
+    model->setSessionTrace(0);
+
+    QString error;
+    records = readTrace(&data, &error);
+    QVERIFY(error.isNull());
+    QVERIFY(!records.isEmpty());
+    QCOMPARE(records.first().direction, SessionTraceRecord::CLIENT_TO_SERVER);
+    QCOMPARE(records.first().data, QByteArray("y0 SELECT a\r\n"));
+}
+
+/** @short Helper: create a fresh Model which is set up in the same way as the one which got recorded */
+std::unique_ptr<Model> ImapSessionTraceTest::helperCreateReplayModel(Streams::FakeSocketFactory *&replayFactory)
+{
+    replayFactory = new Streams::FakeSocketFactory(Imap::CONN_STATE_AUTHENTICATED);
+    TaskFactoryPtr replayTaskFactory(new TestingTaskFactory());
+    TestingTaskFactory *replayTaskFactoryUnsafe = static_cast<TestingTaskFactory *>(replayTaskFactory.get());
+    replayTaskFactoryUnsafe->fakeOpenConnectionTask = true;
+    replayTaskFactoryUnsafe->fakeListChildMailboxes = true;
+    replayTaskFactoryUnsafe->fakeListChildMailboxesMap = taskFactoryUnsafe->fakeListChildMailboxesMap;
+    return std::unique_ptr<Model>(new Model(0, new MemoryCache(0), SocketFactoryPtr(replayFactory), std::move(replayTaskFactory)));
+}
+
+/** @short Record a mailbox sync and replay it into a fresh Model */
+void ImapSessionTraceTest::testRecordAndReplay()
+{
+    QVector<SessionTraceRecord> records;
+    helperRecordSync(records);
+    if (QTest::currentTestFailed())
+        return;
+
+    Streams::FakeSocketFactory *replayFactory;
+    std::unique_ptr<Model> replayModel = helperCreateReplayModel(replayFactory);
+    SessionReplay replay(0, replayModel.get(), replayFactory, records);
+    QVERIFY2(replay.run(), replay.errorString().toUtf8().constData());
+    QCOMPARE(replay.replayedRecords(), records.size());
+
+    QModelIndex message = replayModel->messageIndexByUid(QStringLiteral("a"), 7);
+    QVERIFY(message.isValid());
+    QCOMPARE(replayModel->rowCount(message.parent()), 3);
+    QCOMPARE(message.data(RoleMessageSubject).toString(), QStringLiteral("subject 7"));
+}
+
+/** @short A command which differs from the recorded one, even when the tag is right, stops the replay */
+void ImapSessionTraceTest::testReplayMismatch()
+{
+    QVector<SessionTraceRecord> records;
+    helperRecordSync(records);
+    if (QTest::currentTestFailed())
+        return;
+
+    int tampered = -1;
+    for (int i = 0; i < records.size(); ++i) {
+        if (records[i].direction == SessionTraceRecord::CLIENT_TO_SERVER && records[i].data.contains("(FLAGS)")) {
+            records[i].data.replace("(FLAGS)", "(FLAGS MODSEQ)");
+            tampered = i;
+            break;
+        }
+    }
+    QVERIFY(tampered != -1);
+
+    Streams::FakeSocketFactory *replayFactory;
+    std::unique_ptr<Model> replayModel = helperCreateReplayModel(replayFactory);
+    SessionReplay replay(0, replayModel.get(), replayFactory, records);
+    // There's no reason to wait for the recorded command when something else has arrived already
+    replay.setCommandTimeout(60 * 1000);
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(!replay.run());
+    QVERIFY(timer.elapsed() < 60 * 1000);
+    QCOMPARE(replay.replayedRecords(), tampered);
+    QVERIFY2(replay.errorString().contains(QLatin1String("(FLAGS MODSEQ)")), replay.errorString().toUtf8().constData());
+}
+
+/** @short Traces of several connections are refused instead of being replayed only partially */
+void ImapSessionTraceTest::testReplayMultipleConnections()
+{
+    QVector<SessionTraceRecord> records;
+    helperRecordSync(records);
+    if (QTest::currentTestFailed())
+        return;
+
+    SessionTraceRecord other = records.last();
+    other.parserId = records.first().parserId + 1;
+    records << other;
+
+    Streams::FakeSocketFactory *replayFactory;
+    std::unique_ptr<Model> replayModel = helperCreateReplayModel(replayFactory);
+    SessionReplay replay(0, replayModel.get(), replayFactory, records);
+    QVERIFY(!replay.run());
+    QCOMPARE(replay.replayedRecords(), 0);
+    QVERIFY2(replay.errorString().contains(QLatin1String("more than one connection")), replay.errorString().toUtf8().constData());
+}
+
+QTEST_GUILESS_MAIN(ImapSessionTraceTest)
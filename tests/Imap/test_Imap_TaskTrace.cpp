@@ -0,0 +1,94 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <QBuffer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "test_Imap_TaskTrace.h"
+#include "Imap/Model/TaskTrace.h"
+
+using namespace Imap::Mailbox;
+
+/** @short Sync a mailbox and check that the tasks are reported in a well-formed Chrome trace */
+void ImapTaskTraceTest::testMailboxSync()
+{
+    QByteArray data;
+    QBuffer *device = new QBuffer(&data);
+    device->open(QIODevice::WriteOnly);
+    TaskTraceWriter *trace = new TaskTraceWriter(model, device);
+    model->setTaskTrace(trace);
+
+    existsA = 3;
+    uidValidityA = 6;
+    uidMapA << 1 << 7 << 9;
+    uidNextA = 16;
+    helperSyncAWithMessagesEmptyState();
+    delete trace;
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    QCOMPARE(error.error, QJsonParseError::NoError);
+    QVERIFY(doc.isArray());
+
+    QMap<QString, int> openSlices;
+    QString syncTaskId;
+    bool sawFirstResponse = false;
+    bool sawConnectionName = false;
+    Q_FOREACH(const QJsonValue &value, doc.array()) {
+        QJsonObject event = value.toObject();
+        const QString phase = event[QStringLiteral("ph")].toString();
+        const QString id = event[QStringLiteral("id")].toString();
+        const QString name = event[QStringLiteral("name")].toString();
+        if (phase == QLatin1String("M")) {
+            if (event[QStringLiteral("pid")].toInt() != 0) {
+                QVERIFY(event[QStringLiteral("args")].toObject()[QStringLiteral("name")].toString().startsWith(QLatin1String("IMAP connection")));
+                sawConnectionName = true;
+            }
+        } else if (phase == QLatin1String("b")) {
+            ++openSlices[id];
+            if (name == QLatin1String("ObtainSynchronizedMailboxTask"))
+                syncTaskId = id;
+        } else if (phase == QLatin1String("e")) {
+            QVERIFY(openSlices[id] > 0);
+            --openSlices[id];
+            if (id == syncTaskId && name == QLatin1String("ObtainSynchronizedMailboxTask")) {
+                QCOMPARE(event[QStringLiteral("args")].toObject()[QStringLiteral("outcome")].toString(),
+                         QStringLiteral("completed"));
+            }
+        } else if (phase == QLatin1String("n")) {
+            if (id == syncTaskId && name == QLatin1String("first response"))
+                sawFirstResponse = true;
+        }
+    }
+
+    QVERIFY(!syncTaskId.isEmpty());
+    QVERIFY(sawFirstResponse);
+    QVERIFY(sawConnectionName);
+    Q_FOREACH(const int depth, openSlices) {
+        QCOMPARE(depth, 0);
+    }
+}
+
+QTEST_GUILESS_MAIN(ImapTaskTraceTest)
@@ -28,6 +28,7 @@
 #include "Imap/Model/MemoryCache.h"
 #include "Imap/Model/Model.h"
 #include "Imap/Tasks/Fake_ListChildMailboxesTask.h"
+#include "Utils/FakeCapabilitiesInjector.h"
 
 void ImapModelListChildMailboxesTest::init()
 {
@@ -228,5 +229,176 @@ void ImapModelListChildMailboxesTest::testNoStatusForCachedItems()
     cEmpty();
 }
 
+/** @short Check that a refresh of message counts uses a single LIST-STATUS instead of a STATUS per mailbox */
+void ImapModelListChildMailboxesTest::testListStatusRefresh()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QStringLiteral("LIST-STATUS"));
+    cClient(t.mk("LIST \"\" \"%\" RETURN (STATUS (MESSAGES UNSEEN RECENT))\r\n"));
+    cServer("* LIST (\\HasChildren) \".\" a\r\n"
+            "* STATUS a (MESSAGES 1 RECENT 0 UNSEEN 1)\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            "* STATUS b (MESSAGES 2 RECENT 0 UNSEEN 0)\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    idxB = model->index(2, 0, QModelIndex());
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 1);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 2);
+    cEmpty();
+
+    // The periodic refresh asks for everything at once
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), false);
+    QCOMPARE(idxB.data(RoleMailboxNumbersFetched).toBool(), false);
+    // The old numbers remain visible while the refresh is in progress
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 1);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 2);
+    cClient(t.mk("LIST \"\" \"*\" RETURN (STATUS (MESSAGES UNSEEN RECENT))\r\n"));
+    cServer("* LIST (\\HasChildren) \".\" a\r\n"
+            "* STATUS a (MESSAGES 10 RECENT 1 UNSEEN 3)\r\n"
+            "* LIST (\\HasNoChildren) \".\" a.deeper\r\n"
+            "* STATUS a.deeper (MESSAGES 0 RECENT 0 UNSEEN 0)\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            "* STATUS b (MESSAGES 20 RECENT 2 UNSEEN 4)\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 10);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 3);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 20);
+    QCOMPARE(idxB.data(RoleRecentMessageCount).toInt(), 2);
+    // The mailbox tree is left alone
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    cEmpty();
+}
+
+/** @short The numbers of a mailbox which is kept in sync are not overwritten by a LIST-STATUS */
+void ImapModelListChildMailboxesTest::testListStatusLeavesSyncedMailboxAlone()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QStringLiteral("LIST-STATUS"));
+    cClient(t.mk("LIST \"\" \"%\" RETURN (STATUS (MESSAGES UNSEEN RECENT))\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* STATUS a (MESSAGES 1 RECENT 0 UNSEEN 1)\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            "* STATUS b (MESSAGES 2 RECENT 0 UNSEEN 0)\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    idxB = model->index(2, 0, QModelIndex());
+    msgListB = model->index(0, 0, idxB);
+    cEmpty();
+
+    // Once synced, the numbers of "b" are computed from its messages
+    QCOMPARE(model->rowCount(msgListB), 0);
+    model->switchToMailbox(idxB);
+    cClient(t.mk("SELECT b\r\n"));
+    cServer("* 0 EXISTS\r\n" + t.last("OK selected\r\n"));
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 0);
+    cEmpty();
+
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), false);
+    QCOMPARE(idxB.data(RoleMailboxNumbersFetched).toBool(), true);
+    cClient(t.mk("LIST \"\" \"*\" RETURN (STATUS (MESSAGES UNSEEN RECENT))\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* STATUS a (MESSAGES 10 RECENT 1 UNSEEN 3)\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            "* STATUS b (MESSAGES 20 RECENT 2 UNSEEN 4)\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 10);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 0);
+    QCOMPARE(idxB.data(RoleUnreadMessageCount).toInt(), 0);
+    QCOMPARE(idxB.data(RoleRecentMessageCount).toInt(), 0);
+    cEmpty();
+}
+
+/** @short Check that NOTIFY provides the numbers and makes the periodic polling unnecessary */
+void ImapModelListChildMailboxesTest::testNotifyInsteadOfPolling()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QStringLiteral("NOTIFY"));
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    idxB = model->index(2, 0, QModelIndex());
+
+    QCOMPARE(idxA.data(RoleTotalMessageCount), QVariant());
+    QCOMPARE(idxB.data(RoleTotalMessageCount), QVariant());
+    cClient(t.mk("NOTIFY SET STATUS (selected (MessageNew MessageExpunge FlagChange)) "
+                 "(personal (MessageNew MessageExpunge FlagChange))\r\n"));
+    cServer("* STATUS a (MESSAGES 5 UIDNEXT 6 UNSEEN 1)\r\n"
+            "* STATUS b (MESSAGES 7 UIDNEXT 8 UNSEEN 0)\r\n"
+            + t.last("OK notifying\r\n"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 5);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 1);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 7);
+    cEmpty();
+
+    // No more polling
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(idxB.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 5);
+    cEmpty();
+
+    // ...because the updates are pushed by the server
+    cServer("* STATUS a (MESSAGES 6 UIDNEXT 7 UNSEEN 2)\r\n");
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 6);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 2);
+    cEmpty();
+}
+
+/** @short Mailboxes which the NOTIFY does not cover, e.g. those outside of the personal namespace, are still polled */
+void ImapModelListChildMailboxesTest::testNotifyPollsUncoveredMailboxes()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QStringLiteral("NOTIFY"));
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* LIST (\\HasNoChildren) \".\" shared\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    QModelIndex idxShared = model->index(2, 0, QModelIndex());
+    QCOMPARE(idxShared.data(RoleMailboxName).toString(), QStringLiteral("shared"));
+
+    QCOMPARE(idxA.data(RoleTotalMessageCount), QVariant());
+    QCOMPARE(idxShared.data(RoleTotalMessageCount), QVariant());
+    cClient(t.mk("NOTIFY SET STATUS (selected (MessageNew MessageExpunge FlagChange)) "
+                 "(personal (MessageNew MessageExpunge FlagChange))\r\n"));
+    // The "shared" is not in the personal namespace, so the server does not report it
+    cServer("* STATUS a (MESSAGES 5 UIDNEXT 6 UNSEEN 1)\r\n" + t.last("OK notifying\r\n"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 5);
+    cClient(t.mk("STATUS shared (MESSAGES UNSEEN RECENT)\r\n"));
+    cServer("* STATUS shared (MESSAGES 7 RECENT 0 UNSEEN 0)\r\n" + t.last("OK status\r\n"));
+    QCOMPARE(idxShared.data(RoleTotalMessageCount).toInt(), 7);
+    cEmpty();
+
+    // The periodic refresh leaves the notified mailbox alone, but keeps asking for the other one
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(idxShared.data(RoleMailboxNumbersFetched).toBool(), false);
+    cClient(t.mk("STATUS shared (MESSAGES UNSEEN RECENT)\r\n"));
+    cServer("* STATUS shared (MESSAGES 8 RECENT 1 UNSEEN 1)\r\n" + t.last("OK status\r\n"));
+    QCOMPARE(idxShared.data(RoleTotalMessageCount).toInt(), 8);
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 5);
+    cEmpty();
+}
+
 
 QTEST_GUILESS_MAIN( ImapModelListChildMailboxesTest )
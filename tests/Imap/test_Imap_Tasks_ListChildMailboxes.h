@@ -43,6 +43,11 @@ private slots:
 
     void testNoStatusForCachedItems();
 
+    void testListStatusRefresh();
+    void testListStatusLeavesSyncedMailboxAlone();
+    void testNotifyInsteadOfPolling();
+    void testNotifyPollsUncoveredMailboxes();
+
     void testFailingList();
 };
 
@@ -0,0 +1,226 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include "test_Imap_Tasks_NotificationConnection.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Streams/FakeSocket.h"
+
+/** @short Like cServer(), but for a connection which is not the most recent one */
+#define cServerOn(SOCKET, data) \
+{ \
+    SOCKET->fakeReading(data); \
+    for (int i=0; i<4; ++i) \
+        QCoreApplication::processEvents(); \
+}
+
+/** @short Like cClient(), but for a connection which is not the most recent one */
+#define cClientOn(SOCKET, data) \
+{ \
+    TROJITA_CLIENT_LOOP \
+    QCOMPARE(QString::fromUtf8(SOCKET->writtenStuff()), QString::fromUtf8(data));\
+}
+
+void ImapModelNotificationConnectionTest::init()
+{
+    LibMailboxSync::init();
+
+    model->setProperty("trojita-imap-dedicated-idle-connection", true);
+    model->setProperty("trojita-imap-dedicated-idle-reconnect", 0);
+
+    // The dedicated connection is only opened after a real login, so start from scratch
+    LibMailboxSync::setModelNetworkPolicy(model, Imap::Mailbox::NETWORK_OFFLINE);
+    cClient(t.mk("LOGOUT\r\n"));
+    cServer(t.last("OK logged out\r\n"));
+
+    taskFactoryUnsafe->fakeOpenConnectionTask = false;
+    taskFactoryUnsafe->fakeListChildMailboxesMap.clear();
+    taskFactoryUnsafe->fakeListChildMailboxesMap[QLatin1String("")] = QStringList() <<
+        QStringLiteral("INBOX") << QStringLiteral("a") << QStringLiteral("b");
+    factory->setInitialState(Imap::CONN_STATE_CONNECTED_PRETLS_PRECAPS);
+    tp.reset();
+    tn.reset();
+    primary = 0;
+    notification = 0;
+}
+
+/** @short Helper: go online and log in, which makes the Model open the dedicated connection */
+void ImapModelNotificationConnectionTest::helperGoOnline()
+{
+    LibMailboxSync::setModelNetworkPolicy(model, Imap::Mailbox::NETWORK_ONLINE);
+    QCoreApplication::processEvents();
+    primary = SOCK;
+    cServerOn(primary, "* PREAUTH [CAPABILITY IMAP4rev1 IDLE] hi\r\n");
+    QCOMPARE(model->rowCount(QModelIndex()), 4);
+    TROJITA_CLIENT_LOOP;
+    notification = SOCK;
+    QVERIFY(notification);
+    QVERIFY(notification != primary);
+    cClientOn(primary, QByteArray());
+}
+
+/** @short Helper: let the dedicated connection subscribe to the updates through NOTIFY and enter IDLE */
+void ImapModelNotificationConnectionTest::helperNotifySetup()
+{
+    cServerOn(notification, "* PREAUTH [CAPABILITY IMAP4rev1 IDLE NOTIFY] hi\r\n");
+    cClientOn(notification, tn.mk("NOTIFY SET STATUS (selected (MessageNew MessageExpunge FlagChange)) "
+                                  "(personal (MessageNew MessageExpunge FlagChange))\r\n"));
+    cServerOn(notification, tn.last("OK notifying\r\n"));
+    cClientOn(notification, tn.mk("IDLE\r\n"));
+    cServerOn(notification, "+ idling\r\n");
+    cClientOn(notification, QByteArray());
+}
+
+QModelIndex ImapModelNotificationConnectionTest::findMailbox(const QString &name)
+{
+    for (int i = 1; i < model->rowCount(QModelIndex()); ++i) {
+        QModelIndex index = model->index(i, 0, QModelIndex());
+        if (index.data(Imap::Mailbox::RoleMailboxName).toString() == name)
+            return index;
+    }
+    return QModelIndex();
+}
+
+/** @short The STATUS which the server pushes over the dedicated connection updates the message counts */
+void ImapModelNotificationConnectionTest::testNotifySetup()
+{
+    using namespace Imap::Mailbox;
+
+    helperGoOnline();
+    helperNotifySetup();
+
+    QPersistentModelIndex mailboxA = findMailbox(QStringLiteral("a"));
+    QVERIFY(mailboxA.isValid());
+    cServerOn(notification, "* STATUS a (MESSAGES 5 UNSEEN 1)\r\n");
+    QCOMPARE(mailboxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(mailboxA.data(RoleTotalMessageCount).toInt(), 5);
+    QCOMPARE(mailboxA.data(RoleUnreadMessageCount).toInt(), 1);
+
+    // Nothing has to be asked for over the regular connection
+    cClientOn(primary, QByteArray());
+    cClientOn(notification, QByteArray());
+}
+
+/** @short The initial STATUS refreshes the numbers, and only the mailboxes which it does not mention are polled */
+void ImapModelNotificationConnectionTest::testNotifyInitialStatus()
+{
+    using namespace Imap::Mailbox;
+
+    helperGoOnline();
+    QPersistentModelIndex mailboxA = findMailbox(QStringLiteral("a"));
+    QPersistentModelIndex mailboxB = findMailbox(QStringLiteral("b"));
+    QVERIFY(mailboxA.isValid());
+    QVERIFY(mailboxB.isValid());
+
+    cServerOn(notification, "* PREAUTH [CAPABILITY IMAP4rev1 IDLE NOTIFY] hi\r\n");
+    cClientOn(notification, tn.mk("NOTIFY SET STATUS (selected (MessageNew MessageExpunge FlagChange)) "
+                                  "(personal (MessageNew MessageExpunge FlagChange))\r\n"));
+    cServerOn(notification, "* STATUS b (MESSAGES 9 UNSEEN 2)\r\n" + tn.last("OK notifying\r\n"));
+    cClientOn(notification, tn.mk("IDLE\r\n"));
+    cServerOn(notification, "+ idling\r\n");
+    QCOMPARE(mailboxB.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(mailboxB.data(RoleTotalMessageCount).toInt(), 9);
+    QCOMPARE(mailboxB.data(RoleUnreadMessageCount).toInt(), 2);
+
+    // The server did not mention "a", so its numbers come from the regular connection...
+    QCOMPARE(mailboxA.data(RoleTotalMessageCount), QVariant());
+    cClientOn(primary, tp.mk("STATUS a (MESSAGES UNSEEN RECENT)\r\n"));
+    cServerOn(primary, "* STATUS a (MESSAGES 3 RECENT 0 UNSEEN 1)\r\n" + tp.last("OK status\r\n"));
+    QCOMPARE(mailboxA.data(RoleTotalMessageCount).toInt(), 3);
+
+    // ...and they keep being polled, unlike those of "b"
+    model->invalidateAllMessageCounts();
+    QCOMPARE(mailboxB.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(mailboxA.data(RoleMailboxNumbersFetched).toBool(), false);
+    cClientOn(primary, tp.mk("STATUS a (MESSAGES UNSEEN RECENT)\r\n"));
+    cServerOn(primary, "* STATUS a (MESSAGES 4 RECENT 1 UNSEEN 2)\r\n" + tp.last("OK status\r\n"));
+    QCOMPARE(mailboxA.data(RoleTotalMessageCount).toInt(), 4);
+
+    cClientOn(primary, QByteArray());
+    cClientOn(notification, QByteArray());
+}
+
+/** @short Without NOTIFY, the INBOX is watched through IDLE and its changes make the numbers get refreshed */
+void ImapModelNotificationConnectionTest::testIdleFallback()
+{
+    using namespace Imap::Mailbox;
+
+    helperGoOnline();
+    cServerOn(notification, "* PREAUTH [CAPABILITY IMAP4rev1 IDLE] hi\r\n");
+    cClientOn(notification, tn.mk("EXAMINE INBOX\r\n"));
+    cServerOn(notification, "* 3 EXISTS\r\n" + tn.last("OK [READ-ONLY] examined\r\n"));
+    cClientOn(notification, tn.mk("IDLE\r\n"));
+    cServerOn(notification, "+ idling\r\n");
+
+    QPersistentModelIndex inbox = findMailbox(QStringLiteral("INBOX"));
+    QVERIFY(inbox.isValid());
+    QCOMPARE(inbox.data(RoleTotalMessageCount), QVariant());
+    cClientOn(primary, tp.mk("STATUS INBOX (MESSAGES UNSEEN RECENT)\r\n"));
+    cServerOn(primary, "* STATUS INBOX (MESSAGES 3 RECENT 0 UNSEEN 1)\r\n" + tp.last("OK status\r\n"));
+    QCOMPARE(inbox.data(RoleTotalMessageCount).toInt(), 3);
+
+    // A new arrival makes the numbers stale...
+    cServerOn(notification, "* 4 EXISTS\r\n");
+    QCOMPARE(inbox.data(RoleMailboxNumbersFetched).toBool(), false);
+
+    // ...so they get requested again over the regular connection
+    QCOMPARE(inbox.data(RoleTotalMessageCount), QVariant());
+    cClientOn(primary, tp.mk("STATUS INBOX (MESSAGES UNSEEN RECENT)\r\n"));
+    cServerOn(primary, "* STATUS INBOX (MESSAGES 4 RECENT 1 UNSEEN 2)\r\n" + tp.last("OK status\r\n"));
+    QCOMPARE(inbox.data(RoleTotalMessageCount).toInt(), 4);
+    QCOMPARE(inbox.data(RoleUnreadMessageCount).toInt(), 2);
+
+    cClientOn(primary, QByteArray());
+    cClientOn(notification, QByteArray());
+}
+
+/** @short The server closing the dedicated connection keeps us online and a new connection gets opened */
+void ImapModelNotificationConnectionTest::testReconnectAfterBye()
+{
+    using namespace Imap::Mailbox;
+
+    helperGoOnline();
+    helperNotifySetup();
+
+    cServerOn(notification, "* BYE Too many connections\r\n");
+    QVERIFY(model->isNetworkOnline());
+    QVERIFY(errorSpy->isEmpty());
+    QVERIFY(netErrorSpy->isEmpty());
+
+    // The replacement uses a fresh connection, with its own tags
+    TROJITA_CLIENT_LOOP;
+    QVERIFY(SOCK != primary);
+    notification = SOCK;
+    tn.reset();
+    helperNotifySetup();
+
+    // ...and it works
+    QPersistentModelIndex mailboxB = findMailbox(QStringLiteral("b"));
+    QVERIFY(mailboxB.isValid());
+    cServerOn(notification, "* STATUS b (MESSAGES 7 UNSEEN 0)\r\n");
+    QCOMPARE(mailboxB.data(RoleTotalMessageCount).toInt(), 7);
+
+    cClientOn(primary, QByteArray());
+    QVERIFY(model->isNetworkOnline());
+}
+
+QTEST_GUILESS_MAIN(ImapModelNotificationConnectionTest)
@@ -30,6 +30,11 @@
 #include "Imap/Tasks/ObtainSynchronizedMailboxTask.h"
 
 
+void ImapModelObtainSynchronizedMailboxTest::initTestCase_data()
+{
+    helperDataChangedCoalescingData();
+}
+
 void ImapModelObtainSynchronizedMailboxTest::init()
 {
     LibMailboxSync::init();
@@ -2386,6 +2391,8 @@ void ImapModelObtainSynchronizedMailboxTest::testOfflineOpening()
                                          start);
     msg10.serializedBodyStructure = dynamic_cast<const Imap::Responses::RespData<QByteArray>&>(*(fetchResponse.data["x-trojita-bodystructure"])).data;
     msg20.serializedBodyStructure = msg10.serializedBodyStructure;
+    // Not true for the BODYSTRUCTURE above, which makes it possible to check that the cached value gets used
+    msg10.attachments = Imap::Mailbox::AbstractCache::MessageDataBundle::ATTACHMENTS_PRESENT;
 
     model->cache()->setMessageMetadata(QStringLiteral("a"), 10, msg10);
     model->cache()->setMessageMetadata(QStringLiteral("a"), 20, msg20);
@@ -2399,6 +2406,12 @@ void ImapModelObtainSynchronizedMailboxTest::testOfflineOpening()
     checkCachedSubject(2, "");
     QCOMPARE(msgListA.child(2, 0).data(Imap::Mailbox::RoleIsFetched).toBool(), false);
 
+    // The attachment indicator comes from the cache if it's there, otherwise from the lazily built MIME tree
+    QCOMPARE(msgListA.child(0, 0).data(Imap::Mailbox::RoleMessageHasAttachments).toBool(), true);
+    QCOMPARE(msgListA.child(1, 0).data(Imap::Mailbox::RoleMessageHasAttachments).toBool(), false);
+    QCOMPARE(model->rowCount(msgListA.child(0, 0)), 1);
+    QCOMPARE(msgListA.child(0, 0).child(0, 0).data(Imap::Mailbox::RolePartMimeType).toByteArray(), QByteArrayLiteral("text/plain"));
+
     QCOMPARE(model->taskModel()->rowCount(), 0);
 
     QCOMPARE(model->cache()->mailboxSyncState("a"), sync);
@@ -2406,6 +2419,47 @@ void ImapModelObtainSynchronizedMailboxTest::testOfflineOpening()
     QCOMPARE(model->cache()->uidMapping("a"), uidMap);
 }
 
+/** @short A cached BODYSTRUCTURE which cannot be turned into a MIME tree makes the message unavailable */
+void ImapModelObtainSynchronizedMailboxTest::testOfflineOpeningBrokenBodyStructure()
+{
+    LibMailboxSync::setModelNetworkPolicy(model, Imap::Mailbox::NETWORK_OFFLINE);
+    cClient(t.mk("LOGOUT\r\n"));
+    cServer(t.last("OK logged out\r\n"));
+
+    Imap::Mailbox::SyncState sync;
+    sync.setExists(1);
+    sync.setUidValidity(333);
+    sync.setRecent(0);
+    sync.setUidNext(666);
+    model->cache()->setMailboxSyncState(QStringLiteral("a"), sync);
+    model->cache()->setUidMapping(QStringLiteral("a"), Imap::Uids() << 10);
+    Imap::Mailbox::AbstractCache::MessageDataBundle msg10;
+    msg10.uid = 10;
+    msg10.envelope.subject = QLatin1String("msg10");
+    // A well-formed serialized list which is way too short to describe any body part
+    QDataStream stream(&msg10.serializedBodyStructure, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << (QVariantList() << QByteArray("text"));
+    model->cache()->setMessageMetadata(QStringLiteral("a"), 10, msg10);
+
+    QCOMPARE(model->rowCount(msgListA), 0);
+    QCoreApplication::processEvents();
+    QCOMPARE(model->rowCount(msgListA), 1);
+    checkCachedSubject(0, "msg10");
+    QPersistentModelIndex msg = msgListA.child(0, 0);
+    QCoreApplication::processEvents();
+
+    // The MIME tree is only built now, and the views get to know that there isn't going to be any
+    QSignalSpy changedSpy(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+    QCOMPARE(model->rowCount(msg), 0);
+    QVERIFY(msg.data(Imap::Mailbox::RoleIsUnavailable).toBool());
+    QCOMPARE(changedSpy.size(), 0);
+    QCoreApplication::processEvents();
+    QCOMPARE(changedSpy.size(), 1);
+    QCOMPARE(changedSpy[0][0].toModelIndex(), QModelIndex(msg));
+    QCOMPARE(changedSpy[0][1].toModelIndex(), QModelIndex(msg));
+}
+
 /** @short Check that ENABLE QRESYNC always gets sent prior to SELECT QRESYNC
 
 See Redmine #611 for details.
@@ -41,6 +41,7 @@ class ImapModelObtainSynchronizedMailboxTest : public LibMailboxSync
     enum class MessageNumberChange { SAME, MORE, LESS };
     void helperMissingUidNext(const MessageNumberChange mode);
 private slots:
+    void initTestCase_data();
     void init();
     void testSyncEmptyMinimal();
     void testSyncEmptyMinimalNonEmpty();
@@ -110,6 +111,7 @@ private slots:
     void testSpuriousESearch();
 
     void testOfflineOpening();
+    void testOfflineOpeningBrokenBodyStructure();
 
     void testQresyncEnabling();
 
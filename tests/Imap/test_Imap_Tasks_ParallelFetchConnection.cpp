@@ -0,0 +1,224 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest>
+#include "data.h"
+#include "test_Imap_Tasks_ParallelFetchConnection.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Streams/FakeSocket.h"
+
+/** @short Like cServer(), but for a connection which is not the most recent one */
+#define cServerOn(SOCKET, data) \
+{ \
+    SOCKET->fakeReading(data); \
+    for (int i=0; i<4; ++i) \
+        QCoreApplication::processEvents(); \
+}
+
+/** @short Like cClient(), but for a connection which is not the most recent one */
+#define cClientOn(SOCKET, data) \
+{ \
+    TROJITA_CLIENT_LOOP \
+    QCOMPARE(QString::fromUtf8(SOCKET->writtenStuff()), QString::fromUtf8(data));\
+}
+
+void ImapModelParallelFetchConnectionTest::init()
+{
+    LibMailboxSync::init();
+
+    // By default, there's a 50ms delay between the time we request a part download and the time it actually happens.
+    // That's too long for a unit test.
+    model->setProperty("trojita-imap-delayed-fetch-part", 0);
+    // Let each connection work on a single batch at a time, and make each of the parts a batch of its own
+    model->setProperty("trojita-imap-limit-parallel-fetch-tasks", 1);
+    model->setProperty("trojita-imap-limit-fetch-bytes-per-group", 10);
+    model->setProperty("trojita-imap-parallel-fetch-connections", 1);
+}
+
+/** @short Helper: open mailbox B with three messages whose structure is known, but none of the parts are loaded */
+void ImapModelParallelFetchConnectionTest::helperSyncThreeMessages()
+{
+    helperSyncBNoMessages();
+    cServer("* 3 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 1:* (FLAGS)\r\n"));
+    cServer("* 1 FETCH (UID 11 FLAGS ())\r\n"
+            "* 2 FETCH (UID 12 FLAGS ())\r\n"
+            "* 3 FETCH (UID 13 FLAGS ())\r\n"
+            + t.last("OK fetched\r\n"));
+    QCOMPARE(model->rowCount(msgListB), 3);
+
+    QCOMPARE(model->rowCount(msgListB.child(0, 0)), 0);
+    cClient(t.mk("UID FETCH 11:13 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer("* 1 FETCH (UID 11 BODYSTRUCTURE (" + bsPlaintext + "))\r\n"
+            "* 2 FETCH (UID 12 BODYSTRUCTURE (" + bsPlaintext + "))\r\n"
+            "* 3 FETCH (UID 13 BODYSTRUCTURE (" + bsPlaintext + "))\r\n"
+            + t.last("OK fetched\r\n"));
+
+    for (int i = 0; i < 3; ++i) {
+        QCOMPARE(model->rowCount(msgListB.child(i, 0)), 1);
+    }
+    part1 = msgListB.child(0, 0).child(0, 0);
+    part2 = msgListB.child(1, 0).child(0, 0);
+    part3 = msgListB.child(2, 0).child(0, 0);
+    QVERIFY(part1.isValid());
+    QVERIFY(part2.isValid());
+    QVERIFY(part3.isValid());
+    cEmpty();
+}
+
+/** @short Helper: ask for the data of all three parts at once, which is a bulk download as far as the model is concerned */
+void ImapModelParallelFetchConnectionTest::helperRequestParts()
+{
+    QCOMPARE(part1.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray());
+    QCOMPARE(part2.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray());
+    QCOMPARE(part3.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray());
+}
+
+/** @short Helper: remember the IDs of the connections which start opening a mailbox from now on */
+void ImapModelParallelFetchConnectionTest::helperWatchExtraConnections(QSet<uint> &parserIds)
+{
+    connect(model, &Imap::Mailbox::Model::connectionStateChanged, this,
+            [&parserIds](uint parserId, Imap::ConnectionState state) {
+        if (state == Imap::CONN_STATE_SELECTING)
+            parserIds.insert(parserId);
+    });
+}
+
+/** @short Parts of a bulk download are spread over the primary connection and an extra one */
+void ImapModelParallelFetchConnectionTest::testPartsOverSecondConnection()
+{
+    helperSyncThreeMessages();
+    Streams::FakeSocket *primary = SOCK;
+    helperRequestParts();
+
+    // The primary connection gets to work right away, the extra one has to open the mailbox first
+    cClientOn(primary, t.mk("UID FETCH 11 (BODY.PEEK[1])\r\n"));
+    Streams::FakeSocket *helper = SOCK;
+    QVERIFY(helper != primary);
+    TagGenerator h;
+    cClientOn(helper, h.mk("EXAMINE b\r\n"));
+    cServerOn(helper, "* 3 EXISTS\r\n" + h.last("OK [READ-ONLY] examined\r\n"));
+
+    // The FETCH responses are matched by their UIDs
+    cClientOn(helper, h.mk("UID FETCH 12 (BODY.PEEK[1])\r\n"));
+    cServerOn(helper, "* 2 FETCH (UID 12 BODY[1] " + asLiteral("second") + ")\r\n" + h.last("OK fetched\r\n"));
+    QCOMPARE(part2.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("second"));
+
+    // The primary connection is still busy, so the next batch goes over the extra one as well
+    cClientOn(helper, h.mk("UID FETCH 13 (BODY.PEEK[1])\r\n"));
+    cServerOn(primary, "* 1 FETCH (UID 11 BODY[1] " + asLiteral("first") + ")\r\n" + t.last("OK fetched\r\n"));
+    cServerOn(helper, "* 3 FETCH (UID 13 BODY[1] " + asLiteral("third") + ")\r\n" + h.last("OK fetched\r\n"));
+    QCOMPARE(part1.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("first"));
+    QCOMPARE(part3.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("third"));
+
+    cClientOn(primary, QByteArray());
+    cClientOn(helper, QByteArray());
+    QVERIFY(SOCK == helper);
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short When the extra connection cannot open the mailbox, everything is fetched over the primary one */
+void ImapModelParallelFetchConnectionTest::testFallbackWhenExamineFails()
+{
+    helperSyncThreeMessages();
+    Streams::FakeSocket *primary = SOCK;
+    helperRequestParts();
+
+    cClientOn(primary, t.mk("UID FETCH 11 (BODY.PEEK[1])\r\n"));
+    Streams::FakeSocket *helper = SOCK;
+    QVERIFY(helper != primary);
+    TagGenerator h;
+    cClientOn(helper, h.mk("EXAMINE b\r\n"));
+    cServerOn(helper, h.last("NO [UNAVAILABLE] Too many connections\r\n"));
+    cClientOn(helper, h.mk("LOGOUT\r\n"));
+
+    cServerOn(primary, "* 1 FETCH (UID 11 BODY[1] " + asLiteral("first") + ")\r\n" + t.last("OK fetched\r\n"));
+    cClientOn(primary, t.mk("UID FETCH 12 (BODY.PEEK[1])\r\n"));
+    cServerOn(primary, "* 2 FETCH (UID 12 BODY[1] " + asLiteral("second") + ")\r\n" + t.last("OK fetched\r\n"));
+    cClientOn(primary, t.mk("UID FETCH 13 (BODY.PEEK[1])\r\n"));
+    cServerOn(primary, "* 3 FETCH (UID 13 BODY[1] " + asLiteral("third") + ")\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(part1.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("first"));
+    QCOMPARE(part2.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("second"));
+    QCOMPARE(part3.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("third"));
+
+    // No more attempts at opening another connection
+    cClientOn(primary, QByteArray());
+    QVERIFY(SOCK == helper);
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short The server closing the extra connection in the middle of a transfer neither loses data nor takes us offline */
+void ImapModelParallelFetchConnectionTest::testFallbackWhenConnectionCloses()
+{
+    helperSyncThreeMessages();
+    Streams::FakeSocket *primary = SOCK;
+    QSet<uint> helperParsers;
+    helperWatchExtraConnections(helperParsers);
+    helperRequestParts();
+
+    cClientOn(primary, t.mk("UID FETCH 11 (BODY.PEEK[1])\r\n"));
+    QPointer<Streams::FakeSocket> helper = SOCK;
+    QVERIFY(helper != primary);
+    TagGenerator h;
+    cClientOn(helper, h.mk("EXAMINE b\r\n"));
+    cServerOn(helper, h.last("OK [READ-ONLY] examined\r\n"));
+    cClientOn(helper, h.mk("UID FETCH 12 (BODY.PEEK[1])\r\n"));
+    QCOMPARE(helperParsers.size(), 1);
+
+    cServerOn(helper, "* BYE Idle for too long\r\n");
+    QCOMPARE(model->networkPolicy(), Imap::Mailbox::NETWORK_ONLINE);
+    QCOMPARE(part2.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray());
+    QVERIFY(!part2.data(Imap::Mailbox::RoleIsUnavailable).toBool());
+
+    // The unfinished batch is retried over the primary connection, and so is the rest of the work
+    cServerOn(primary, "* 1 FETCH (UID 11 BODY[1] " + asLiteral("first") + ")\r\n" + t.last("OK fetched\r\n"));
+    cClientOn(primary, t.mk("UID FETCH 12 (BODY.PEEK[1])\r\n"));
+    cServerOn(primary, "* 2 FETCH (UID 12 BODY[1] " + asLiteral("second") + ")\r\n" + t.last("OK fetched\r\n"));
+    cClientOn(primary, t.mk("UID FETCH 13 (BODY.PEEK[1])\r\n"));
+    cServerOn(primary, "* 3 FETCH (UID 13 BODY[1] " + asLiteral("third") + ")\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(part1.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("first"));
+    QCOMPARE(part2.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("second"));
+    QCOMPARE(part3.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("third"));
+
+    // No more attempts at opening another connection
+    cClientOn(primary, QByteArray());
+    QCOMPARE(helperParsers.size(), 1);
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short The extra connections are subject to the global limit on the number of connections */
+void ImapModelParallelFetchConnectionTest::testConnectionLimit()
+{
+    model->setProperty("trojita-imap-parallel-fetch-connections", 10);
+    helperSyncThreeMessages();
+    Streams::FakeSocket *primary = SOCK;
+    QSet<uint> helperParsers;
+    helperWatchExtraConnections(helperParsers);
+    helperRequestParts();
+    cClientOn(primary, t.mk("UID FETCH 11 (BODY.PEEK[1])\r\n"));
+
+    // The model allows four connections in total, one of them is the primary one
+    QCOMPARE(helperParsers.size(), 3);
+    QVERIFY(errorSpy->isEmpty());
+}
+
+QTEST_GUILESS_MAIN(ImapModelParallelFetchConnectionTest)
@@ -23,8 +23,12 @@
 #include <algorithm>
 #include <QtTest>
 #include "test_Imap_Threading.h"
+#include "Imap/Model/LocalSorting.h"
+#include "Imap/Model/LocalThreading.h"
 #include "Imap/Model/MsgListModel.h"
+#include "Imap/Model/PrettyMsgListModel.h"
 #include "Imap/Model/ThreadingMsgListModel.h"
+#include "Imap/Parser/Message.h"
 #include "Streams/FakeSocket.h"
 #include "Utils/FakeCapabilitiesInjector.h"
 
@@ -1184,6 +1188,284 @@ void ImapModelThreadingTest::testThreadingPerformance()
     }
 }
 
+/** @short Client-side threading based on the Message-Id, References and In-Reply-To */
+void ImapModelThreadingTest::testLocalThreading()
+{
+    using Imap::Responses::ThreadingNode;
+    typedef QList<QByteArray> Ids;
+    typedef QVector<ThreadingNode> Nodes;
+
+    Imap::Mailbox::LocalThreading threader;
+    threader.addMessage(1, "<a@x>", Ids(), Ids());
+    threader.addMessage(2, "b@x", Ids() << "<a@x>", Ids());
+    threader.addMessage(3, "c@x", Ids() << "a@x" << "b@x", Ids() << "b@x");
+    // Two replies to a message which we do not have
+    threader.addMessage(4, "d@x", Ids(), Ids() << "missing@x");
+    threader.addMessage(5, "e@x", Ids() << "missing@x", Ids());
+    // A single reply to a missing message gets promoted to the root level
+    threader.addMessage(6, "f@x", Ids() << "another-missing@x", Ids());
+    // Duplicate Message-Id
+    threader.addMessage(7, "a@x", Ids(), Ids());
+    // Referencing itself
+    threader.addMessage(8, "g@x", Ids() << "g@x", Ids());
+    // Adding the same UID for the second time has no effect
+    threader.addMessage(8, "h@x", Ids() << "a@x", Ids());
+    QCOMPARE(threader.size(), 8);
+
+    Nodes expected = Nodes()
+            << ThreadingNode(1, Nodes() << ThreadingNode(2, Nodes() << ThreadingNode(3)))
+            << ThreadingNode(0, Nodes() << ThreadingNode(4) << ThreadingNode(5))
+            << ThreadingNode(6)
+            << ThreadingNode(7)
+            << ThreadingNode(8);
+    QCOMPARE(threader.threads(), expected);
+
+    // New arrivals are linked to what we already have, including the older messages which referenced them before
+    threader.addMessage(9, "i@x", Ids() << "a@x" << "b@x", Ids());
+    threader.addMessage(10, "missing@x", Ids() << "a@x", Ids());
+    expected = Nodes()
+            << ThreadingNode(1, Nodes()
+                             << ThreadingNode(2, Nodes() << ThreadingNode(3) << ThreadingNode(9))
+                             << ThreadingNode(10, Nodes() << ThreadingNode(4) << ThreadingNode(5)))
+            << ThreadingNode(6)
+            << ThreadingNode(7)
+            << ThreadingNode(8);
+    QCOMPARE(threader.threads(), expected);
+}
+
+/** @short Guessed parents get replaced by the real ones, and the expunged messages are forgotten */
+void ImapModelThreadingTest::testLocalThreadingRelinking()
+{
+    using Imap::Responses::ThreadingNode;
+    typedef QList<QByteArray> Ids;
+    typedef QVector<ThreadingNode> Nodes;
+
+    Imap::Mailbox::LocalThreading threader;
+    // The References of the first message say that "q" is a reply to "p", but "q" itself has no references at all
+    threader.addMessage(1, "x@x", Ids() << "p@x" << "q@x", Ids());
+    threader.addMessage(2, "q@x", Ids(), Ids());
+    Nodes expected = Nodes()
+            << ThreadingNode(2, Nodes() << ThreadingNode(1));
+    QCOMPARE(threader.threads(), expected);
+
+    // Here, the real parent of "s" was guessed to be its child
+    threader.addMessage(3, "r@x", Ids() << "s@x" << "t@x", Ids());
+    threader.addMessage(4, "s@x", Ids() << "t@x", Ids());
+    expected = Nodes()
+            << ThreadingNode(2, Nodes() << ThreadingNode(1))
+            << ThreadingNode(0, Nodes() << ThreadingNode(3) << ThreadingNode(4));
+    QCOMPARE(threader.threads(), expected);
+
+    // Once gone, a message is only kept as an empty container as long as it has some replies
+    threader.removeMessage(2);
+    QVERIFY(!threader.contains(2));
+    expected = Nodes()
+            << ThreadingNode(1)
+            << ThreadingNode(0, Nodes() << ThreadingNode(3) << ThreadingNode(4));
+    QCOMPARE(threader.threads(), expected);
+    threader.removeMessage(1);
+    threader.removeMessage(42);
+    QCOMPARE(threader.size(), 2);
+    expected = Nodes()
+            << ThreadingNode(0, Nodes() << ThreadingNode(3) << ThreadingNode(4));
+    QCOMPARE(threader.threads(), expected);
+
+    threader.addMessage(5, "u@x", Ids() << "q@x", Ids());
+    expected = Nodes()
+            << ThreadingNode(0, Nodes() << ThreadingNode(3) << ThreadingNode(4))
+            << ThreadingNode(5);
+    QCOMPARE(threader.threads(), expected);
+
+    // Very deep threads do not exhaust the stack
+    threader.clear();
+    const uint depth = 5000;
+    threader.addMessage(1, "1@deep", Ids(), Ids());
+    for (uint uid = 2; uid <= depth; ++uid)
+        threader.addMessage(uid, QByteArray::number(uid) + "@deep", Ids(), Ids() << QByteArray::number(uid - 1) + "@deep");
+    Nodes deep = threader.threads();
+    QCOMPARE(deep.size(), 1);
+    const ThreadingNode *node = &deep.front();
+    for (uint uid = 1; uid < depth; ++uid) {
+        QCOMPARE(node->num, uid);
+        QCOMPARE(node->children.size(), 1);
+        node = &node->children.front();
+    }
+    QCOMPARE(node->num, depth);
+}
+
+/** @short Client-side threading of a mailbox of the same shape as the testThreadingPerformance */
+void ImapModelThreadingTest::testLocalThreadingPerformance()
+{
+    const uint num = 100000;
+    QVector<QByteArray> messageIds(num + 1);
+    QVector<QList<QByteArray> > references(num + 1);
+    for (uint uid = 1; uid <= num; ++uid) {
+        messageIds[uid] = QByteArray::number(uid) + "@example.org";
+        // Threads of ten messages, each of them a reply to the previous one
+        if (uid % 10 != 1) {
+            references[uid] = references[uid - 1];
+            references[uid] << messageIds[uid - 1];
+        }
+    }
+
+    QBENCHMARK {
+        Imap::Mailbox::LocalThreading threader;
+        for (uint uid = 1; uid <= num; ++uid) {
+            threader.addMessage(uid, messageIds[uid], references[uid], QList<QByteArray>());
+        }
+        QCOMPARE(threader.threads().size(), static_cast<int>(num / 10));
+    }
+}
+
+/** @short Client-side sorting with incremental merging of new arrivals */
+void ImapModelThreadingTest::testLocalSorting()
+{
+    using namespace Imap::Message;
+    using Imap::Mailbox::LocalSorting;
+
+    auto envelope = [](const QString &subject, const QString &fromName, const QString &fromMailbox, const QDateTime &date) {
+        Envelope e;
+        e.subject = subject;
+        e.date = date;
+        e.from << MailAddress(fromName, QString(), fromMailbox, QStringLiteral("example.org"));
+        return e;
+    };
+    const QDateTime base(QDate(2014, 1, 1), QTime(12, 0), Qt::UTC);
+
+    LocalSorting bySubject(LocalSorting::KEY_SUBJECT);
+    bySubject.addMessage(1, envelope(QStringLiteral("Re: [list] Beta"), QString(), QStringLiteral("x"), base), QDateTime(), 0);
+    bySubject.addMessage(2, envelope(QStringLiteral("alpha"), QString(), QStringLiteral("x"), base), QDateTime(), 0);
+    bySubject.addMessage(3, envelope(QStringLiteral("Fwd: BETA (fwd)"), QString(), QStringLiteral("x"), base), QDateTime(), 0);
+    QCOMPARE(bySubject.sortedUids(), Imap::Uids() << 2 << 1 << 3);
+    // The new arrivals get merged into the existing order
+    bySubject.addMessage(5, envelope(QStringLiteral("gamma"), QString(), QStringLiteral("x"), base), QDateTime(), 0);
+    bySubject.addMessage(4, envelope(QStringLiteral("[fwd: RE: Alpha]"), QString(), QStringLiteral("x"), base), QDateTime(), 0);
+    bySubject.addMessage(4, envelope(QStringLiteral("zzz"), QString(), QStringLiteral("x"), base), QDateTime(), 0);
+    QCOMPARE(bySubject.sortedUids(), Imap::Uids() << 2 << 4 << 1 << 3 << 5);
+
+    LocalSorting byFrom(LocalSorting::KEY_FROM);
+    byFrom.addMessage(1, envelope(QString(), QStringLiteral("Zed"), QStringLiteral("a"), base), QDateTime(), 0);
+    byFrom.addMessage(2, envelope(QString(), QString(), QStringLiteral("bob"), base), QDateTime(), 0);
+    byFrom.addMessage(3, envelope(QString(), QStringLiteral("alice"), QStringLiteral("z"), base), QDateTime(), 0);
+    QCOMPARE(byFrom.sortedUids(), Imap::Uids() << 3 << 2 << 1);
+
+    // Messages without the Date header are sorted by their INTERNALDATE
+    LocalSorting byDate(LocalSorting::KEY_DATE);
+    byDate.addMessage(1, envelope(QString(), QString(), QStringLiteral("x"), base.addSecs(60)), base, 0);
+    byDate.addMessage(2, envelope(QString(), QString(), QStringLiteral("x"), QDateTime()), base.addSecs(30), 0);
+    byDate.addMessage(3, envelope(QString(), QString(), QStringLiteral("x"), base), base.addSecs(90), 0);
+    QCOMPARE(byDate.sortedUids(), Imap::Uids() << 3 << 2 << 1);
+
+    // Removed messages disappear from the order, no matter whether they were merged already or not
+    bySubject.addMessage(6, envelope(QStringLiteral("beta"), QString(), QStringLiteral("x"), base), QDateTime(), 0);
+    bySubject.removeMessage(1);
+    bySubject.removeMessage(6);
+    QVERIFY(!bySubject.contains(1));
+    QVERIFY(!bySubject.contains(6));
+    QCOMPARE(bySubject.sortedUids(), Imap::Uids() << 2 << 4 << 3 << 5);
+}
+
+/** @short An expunged message is forgotten by the local sorting as well */
+void ImapModelThreadingTest::testLocalSortingExpunge()
+{
+    using namespace Imap::Mailbox;
+
+    threadingModel->setUserWantsThreading(false);
+    initialMessages(4);
+    const QStringList subjects = QStringList() << QStringLiteral("d") << QStringLiteral("b")
+                                               << QStringLiteral("c") << QStringLiteral("a");
+    for (int i = 0; i < subjects.size(); ++i) {
+        AbstractCache::MessageDataBundle bundle;
+        bundle.uid = i + 1;
+        bundle.envelope.subject = subjects[i];
+        model->cache()->setMessageMetadata(QStringLiteral("a"), bundle.uid, bundle);
+    }
+
+    auto sortedUids = [this]() {
+        Imap::Uids res;
+        for (int i = 0; i < threadingModel->rowCount(QModelIndex()); ++i)
+            res << threadingModel->index(i, 0).data(RoleMessageUid).toUInt();
+        return res;
+    };
+
+    // There's no SORT, so the messages are sorted locally
+    QVERIFY(threadingModel->setUserSearchingSortingPreference(QStringList(), ThreadingMsgListModel::SORT_SUBJECT));
+    QCOMPARE(sortedUids(), Imap::Uids() << 4 << 2 << 3 << 1);
+    QVERIFY(threadingModel->m_localSorting.contains(2));
+
+    cServer("* 2 EXPUNGE\r\n");
+    QVERIFY(!threadingModel->m_localSorting.contains(2));
+    QCOMPARE(sortedUids(), Imap::Uids() << 4 << 3 << 1);
+    QVERIFY(threadingModel->setUserSearchingSortingPreference(QStringList(), ThreadingMsgListModel::SORT_SUBJECT));
+    QCOMPARE(sortedUids(), Imap::Uids() << 4 << 3 << 1);
+    QCOMPARE(threadingModel->m_localSorting.sortedUids(), Imap::Uids() << 4 << 3 << 1);
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short The lists of children share one pool which gets compacted once it is mostly garbage */
+void ImapModelThreadingTest::testThreadChildPool()
+{
+    using namespace Imap::Mailbox;
+
+    ThreadNodeArena arena;
+    arena[0];
+    arena[1];
+    arena[2];
+
+    // Interleaved appends make the lists leapfrog each other at the end of the pool
+    for (uint i = 10; i < 20; ++i) {
+        arena[1].children.append(i);
+        arena[2].children.append(i + 100);
+    }
+    arena[1].children.insert(0, 9);
+    arena[1].children.remove(5);
+    QCOMPARE(arena[1].children.takeLast(), 19u);
+    QCOMPARE(arena[1].children.toVector(), QVector<uint>() << 9 << 10 << 11 << 12 << 14 << 15 << 16 << 17 << 18);
+    QCOMPARE(arena[1].children.indexOf(14), 4);
+    QCOMPARE(arena[1].children.indexOf(13), -1);
+
+    arena[0].children << 1 << 2;
+    arena.remove(2);
+    arena.compactChildLists();
+    QVERIFY(arena[0].children.constBegin() < arena[1].children.constBegin());
+    QCOMPARE(arena[0].children.toVector(), QVector<uint>() << 1 << 2);
+    QCOMPARE(arena[1].children.toVector(), QVector<uint>() << 9 << 10 << 11 << 12 << 14 << 15 << 16 << 17 << 18);
+
+    // Nodes created after the removal start with an empty list
+    QVERIFY(arena[2].children.isEmpty());
+    arena[2].children.append(1000);
+    QCOMPARE(arena[2].children.first(), 1000u);
+    QCOMPARE(arena[1].children.size(), 9);
+}
+
+/** @short Base subject extraction from RFC 5256 */
+void ImapModelThreadingTest::testBaseSubject()
+{
+    QFETCH(QString, subject);
+    QFETCH(QString, baseSubject);
+    QCOMPARE(Imap::Mailbox::LocalSorting::baseSubject(subject), baseSubject);
+}
+
+void ImapModelThreadingTest::testBaseSubject_data()
+{
+    QTest::addColumn<QString>("subject");
+    QTest::addColumn<QString>("baseSubject");
+
+    QTest::newRow("plain") << QStringLiteral("foo") << QStringLiteral("foo");
+    QTest::newRow("whitespace") << QStringLiteral(" foo \t  bar ") << QStringLiteral("foo bar");
+    QTest::newRow("re") << QStringLiteral("Re: foo") << QStringLiteral("foo");
+    QTest::newRow("re-re") << QStringLiteral("RE: re:  foo") << QStringLiteral("foo");
+    QTest::newRow("fw-fwd") << QStringLiteral("Fw: FWD: foo") << QStringLiteral("foo");
+    QTest::newRow("re-with-blob") << QStringLiteral("Re[2]: foo") << QStringLiteral("foo");
+    QTest::newRow("list-tag") << QStringLiteral("[list] Re: foo") << QStringLiteral("foo");
+    QTest::newRow("trailer") << QStringLiteral("foo (fwd) (FWD)") << QStringLiteral("foo");
+    QTest::newRow("fwd-wrapper") << QStringLiteral("[Fwd: Re: foo]") << QStringLiteral("foo");
+    QTest::newRow("only-blob") << QStringLiteral("[foo]") << QStringLiteral("[foo]");
+    QTest::newRow("not-a-leader") << QStringLiteral("Really: foo") << QStringLiteral("Really: foo");
+    QTest::newRow("empty") << QString() << QString();
+}
+
 void ImapModelThreadingTest::testSortingPerformance()
 {
     threadingModel->setUserWantsThreading(false);
@@ -1311,6 +1593,58 @@ void ImapModelThreadingTest::testIncrementalThreading()
     cEmpty();
 }
 
+/** @short New arrivals are moved into their threads without re-building the whole tree */
+void ImapModelThreadingTest::testArrivalsWithoutRelayout()
+{
+    initialMessages(3);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer("* THREAD (1)(2)(3)\r\n" + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2)(3)"));
+    cServer("* 2 FETCH (UID 2 ENVELOPE (NIL \"b\" NIL NIL NIL NIL NIL NIL NIL \"<b@x>\"))\r\n");
+    QPersistentModelIndex msg2 = findItem(QStringLiteral("1"));
+    QVERIFY(msg2.isValid());
+
+    QSignalSpy layoutChanged(threadingModel, SIGNAL(layoutChanged()));
+    QSignalSpy rowsMoved(threadingModel, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    // A reply to the second message arrives, and its envelope is known as soon as its UID
+    cServer("* 4 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 4:* (FLAGS)\r\n"));
+    cServer("* 4 FETCH (UID 4 FLAGS () ENVELOPE (NIL \"Re: b\" NIL NIL NIL NIL NIL NIL \"<b@x>\" \"<d@x>\"))\r\n"
+            + t.last("OK fetch\r\n"));
+    // It is placed right away, and the server is asked for a confirmation
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 4)(3)"));
+    QCOMPARE(rowsMoved.size(), 1);
+    QCOMPARE(threadingModel->rowCount(msg2), 1);
+
+    // The server agrees, so there's nothing else to do
+    cServer("* THREAD (1)(2 4)(3)\r\n" + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 4)(3)"));
+    QCOMPARE(rowsMoved.size(), 1);
+    QVERIFY(layoutChanged.isEmpty());
+
+    // Without the envelope, it's the incremental threading which moves the message
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QStringLiteral("ETHREAD"));
+    injector.injectCapability(QStringLiteral("INCTHREAD"));
+    cServer("* 5 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 5:* (FLAGS)\r\n"));
+    cServer("* 5 FETCH (UID 5 FLAGS ())\r\n" + t.last("OK fetch\r\n"));
+    cClient(t.mk("UID THREAD RETURN (INCTHREAD) REFS utf-8 INTHREAD REFS UID 5:*\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 4)(3)(5)"));
+    cServer("* ESEARCH (TAG \"" + t.last() + "\") UID INCTHREAD 0 (1 5)\r\n");
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1 5)(2 4)(3)"));
+    QCOMPARE(rowsMoved.size(), 2);
+    QVERIFY(layoutChanged.isEmpty());
+    cServer(t.last("OK done\r\n"));
+
+    QVERIFY(msg2.isValid());
+    QCOMPARE(msg2.row(), 1);
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
 /** Test what happens when a thread root ceases to exist while the THREAD response is in flight */
 void ImapModelThreadingTest::testRemovingRootWithThreadingInFlight()
 {
@@ -1459,6 +1793,54 @@ void ImapModelThreadingTest::testFlatThreadDeletionPerformance()
     cEmpty();
 }
 
+/** @short Scrolling, filtering and mass flag updates through the PrettyMsgListModel */
+void ImapModelThreadingTest::testPrettyModelPerformance()
+{
+    using namespace Imap::Mailbox;
+    threadingModel->setUserWantsThreading(false);
+    model->setProperty("trojita-imap-noop-period", 24 * 60 * 60 * 1000);
+
+    const int num = 100000;
+    initialMessages(num);
+
+    PrettyMsgListModel pretty;
+    pretty.setSourceModel(threadingModel);
+    pretty.setHideRead(true);
+    // every tenth message is unread
+    QCOMPARE(pretty.rowCount(), num / 10);
+
+    // scrolling through the filtered list
+    QBENCHMARK {
+        for (int i = 0; i < pretty.rowCount(); ++i) {
+            pretty.index(i, MsgListModel::SUBJECT).data(RoleMessageUid);
+        }
+    }
+
+    bool hideRead = false;
+    QBENCHMARK {
+        pretty.setHideRead(hideRead);
+        hideRead = !hideRead;
+    }
+
+    pretty.setHideRead(true);
+    QCOMPARE(pretty.rowCount(), num / 10);
+
+    // all messages become unread, one by one
+    QByteArray flagUpdates;
+    for (int i = 1; i <= num; ++i) {
+        flagUpdates += "* " + QByteArray::number(i) + " FETCH (FLAGS ())\r\n";
+    }
+    QBENCHMARK_ONCE {
+        cServer(flagUpdates);
+        // the model processes the responses in chunks of 100
+        for (int i = 0; i < num / 100 + 1; ++i) {
+            QCoreApplication::processEvents();
+        }
+    }
+    QCOMPARE(pretty.rowCount(), num);
+    cEmpty();
+}
+
 /** @short Make sure that changes of a yet unsynced message doesn't confuse us */
 void ImapModelThreadingTest::testDataChangedUnknownUid()
 {
@@ -1481,6 +1863,83 @@ void ImapModelThreadingTest::testDataChangedUnknownUid()
     cEmpty();
 }
 
+/** @short A burst of flag changes is reported as one range per parent in the thread tree, plus once per each thread root */
+void ImapModelThreadingTest::testDataChangedRanges()
+{
+    initialMessages(4);
+    QCOMPARE(SOCK->writtenStuff(), t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    SOCK->fakeReading("* THREAD (1)(2 3)(4)\r\n" + t.last("OK thread\r\n"));
+    QCoreApplication::processEvents();
+    QCoreApplication::processEvents();
+    QCOMPARE(QString::fromUtf8(treeToThreading(QModelIndex())), QString::fromUtf8("(1)(2 3)(4)"));
+    QVERIFY(errorSpy->isEmpty());
+
+    QSignalSpy dataChanged(threadingModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+    cServer("* 1 FETCH (FLAGS (x))\r\n* 2 FETCH (FLAGS (x))\r\n* 3 FETCH (FLAGS (x))\r\n* 4 FETCH (FLAGS (x))\r\n");
+    QCoreApplication::processEvents();
+
+    // The top-level messages, the nested one, and its thread root once again
+    QCOMPARE(dataChanged.size(), 3);
+    QModelIndex root2 = threadingModel->index(1, 0);
+    QCOMPARE(dataChanged[0][0].value<QModelIndex>(), threadingModel->index(0, 0));
+    QCOMPARE(dataChanged[0][1].value<QModelIndex>().row(), 2);
+    QCOMPARE(dataChanged[1][0].value<QModelIndex>(), threadingModel->index(0, 0, root2));
+    QCOMPARE(dataChanged[2][0].value<QModelIndex>(), root2);
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
+/** @short The PrettyMsgListModel hides threads with no unread messages and follows the changes incrementally */
+void ImapModelThreadingTest::testPrettyModelFiltering()
+{
+    using namespace Imap::Mailbox;
+    threadingModel->setUserWantsThreading(false);
+    initialMessages(10);
+
+    PrettyMsgListModel pretty;
+    pretty.setSourceModel(threadingModel);
+    QCOMPARE(pretty.rowCount(), 10);
+
+    // Only the ninth message is unread
+    pretty.setHideRead(true);
+    QCOMPARE(pretty.rowCount(), 1);
+    QCOMPARE(pretty.index(0, 0).data(RoleMessageUid).toUInt(), 9u);
+    QPersistentModelIndex msg9 = pretty.index(0, 0);
+    QCOMPARE(pretty.mapToSource(msg9), threadingModel->index(8, 0));
+    QCOMPARE(pretty.mapFromSource(threadingModel->index(8, 0)), QModelIndex(msg9));
+    QVERIFY(!pretty.mapFromSource(threadingModel->index(0, 0)).isValid());
+
+    // A message which becomes unread shows up at its proper place
+    QSignalSpy inserted(&pretty, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    cServer("* 3 FETCH (FLAGS ())\r\n");
+    QCOMPARE(inserted.size(), 1);
+    QCOMPARE(inserted[0][1].toInt(), 0);
+    QCOMPARE(pretty.rowCount(), 2);
+    QCOMPARE(pretty.index(0, 0).data(RoleMessageUid).toUInt(), 3u);
+    QCOMPARE(pretty.index(1, 0).data(RoleMessageUid).toUInt(), 9u);
+    QCOMPARE(msg9.row(), 1);
+
+    // Messages which were unread remain visible after they get marked as read
+    cServer("* 9 FETCH (FLAGS (\\Seen))\r\n");
+    QCOMPARE(pretty.rowCount(), 2);
+
+    // A new arrival is filtered as well
+    cServer("* 11 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 11:* (FLAGS)\r\n"));
+    cServer("* 11 FETCH (UID 11 FLAGS ())\r\n" + t.last("OK fetch\r\n"));
+    QCOMPARE(pretty.rowCount(), 3);
+    QCOMPARE(pretty.index(2, 0).data(RoleMessageUid).toUInt(), 11u);
+    QCOMPARE(pretty.index(2, 0).sibling(2, MsgListModel::SUBJECT).data(RoleMessageUid).toUInt(), 11u);
+
+    // Everything is back when the filter is switched off
+    pretty.setHideRead(false);
+    QCOMPARE(pretty.rowCount(), 11);
+    QCOMPARE(msg9.row(), 8);
+    QCOMPARE(pretty.index(10, 0).data(RoleMessageUid).toUInt(), 11u);
+
+    cEmpty();
+}
+
 /** @short Verify parsing of various ESEARCH return results */
 void ImapModelThreadingTest::testESearchResults()
 {
@@ -42,14 +42,26 @@ private slots:
     void testDynamicSortingContext();
     void testDynamicSearch();
     void testIncrementalThreading();
+    void testArrivalsWithoutRelayout();
     void testRemovingRootWithThreadingInFlight();
     void testMultipleExpunges();
     void testVanishedHierarchyReplacement();
     void testDataChangedUnknownUid();
+    void testDataChangedRanges();
+    void testPrettyModelFiltering();
+    void testLocalThreading();
+    void testLocalThreadingRelinking();
+    void testLocalSorting();
+    void testLocalSortingExpunge();
+    void testThreadChildPool();
+    void testBaseSubject();
+    void testBaseSubject_data();
     void testThreadingPerformance();
+    void testLocalThreadingPerformance();
     void testSortingPerformance();
     void testSearchingPerformance();
     void testFlatThreadDeletionPerformance();
+    void testPrettyModelPerformance();
     void testESearchResults();
 
     void helper_multipleExpunges();
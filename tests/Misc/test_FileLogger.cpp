@@ -0,0 +1,178 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThread>
+#include "test_FileLogger.h"
+#include "Common/ConcurrentRingBuffer.h"
+#include "Common/FileLogger.h"
+#include "Common/LogWriterThread.h"
+
+using namespace Common;
+
+namespace {
+
+class Producer : public QThread
+{
+public:
+    Producer(ConcurrentRingBuffer<int> *buffer, const int count): buffer(buffer), count(count) {}
+
+protected:
+    virtual void run()
+    {
+        for (int i = 0; i < count; ++i) {
+            while (!buffer->tryAppend(i))
+                yieldCurrentThread();
+        }
+    }
+
+private:
+    ConcurrentRingBuffer<int> *buffer;
+    int count;
+};
+
+LogMessage message(const int number)
+{
+    return LogMessage(QDateTime::currentDateTime(), LOG_IO_READ, QStringLiteral("test"),
+                      QStringLiteral("* %1 FETCH (UID %1 FLAGS (\\Seen))\r\n").arg(number, 8, 10, QLatin1Char('0')), 0);
+}
+
+}
+
+/** @short A full buffer rejects new items instead of overwriting the old ones */
+void FileLoggerTest::testRingBufferLimits()
+{
+    ConcurrentRingBuffer<int> buffer(3);
+    QVERIFY(buffer.isEmpty());
+    QVERIFY(buffer.tryAppend(1));
+    QVERIFY(buffer.tryAppend(2));
+    QVERIFY(buffer.tryAppend(3));
+    QVERIFY(!buffer.tryAppend(4));
+    QCOMPARE(buffer.size(), 3);
+    QCOMPARE(buffer.rejectedCount(), quint64(1));
+
+    int item;
+    QVERIFY(buffer.tryTakeFirst(item));
+    QCOMPARE(item, 1);
+    QVERIFY(buffer.tryAppend(5));
+    QVERIFY(buffer.tryTakeFirst(item));
+    QCOMPARE(item, 2);
+    QVERIFY(buffer.tryTakeFirst(item));
+    QCOMPARE(item, 3);
+    QVERIFY(buffer.tryTakeFirst(item));
+    QCOMPARE(item, 5);
+    QVERIFY(!buffer.tryTakeFirst(item));
+    QVERIFY(buffer.isEmpty());
+}
+
+/** @short Items handed over from another thread arrive complete and in order */
+void FileLoggerTest::testRingBufferThreads()
+{
+    const int count = 200000;
+    ConcurrentRingBuffer<int> buffer(64);
+    Producer producer(&buffer, count);
+    producer.start();
+    int expected = 0;
+    int item;
+    while (expected < count) {
+        if (buffer.tryTakeFirst(item)) {
+            QCOMPARE(item, expected);
+            ++expected;
+        } else {
+            QThread::yieldCurrentThread();
+        }
+    }
+    producer.wait();
+    QVERIFY(buffer.isEmpty());
+}
+
+/** @short Everything gets written by the time the logging is switched off, and the files are rotated */
+void FileLoggerTest::testWriteAndRotate()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QLatin1String("/trojita.log");
+
+    FileLogger logger;
+    logger.setRotation(4096, 2);
+    logger.setFileLogging(true, fileName);
+    const int count = 500;
+    for (int i = 0; i < count; ++i) {
+        logger.slotImapLogged(3, message(i));
+    }
+    logger.setFileLogging(false, QString());
+    QCOMPARE(logger.droppedMessages(), quint64(0));
+
+    QVERIFY(QFile::exists(fileName + QLatin1String(".1")));
+    QVERIFY(QFile::exists(fileName + QLatin1String(".2")));
+    QVERIFY(!QFile::exists(fileName + QLatin1String(".3")));
+
+    QFile newest(fileName);
+    if (newest.size() == 0) {
+        // The rotation happened right after the last write
+        newest.setFileName(fileName + QLatin1String(".1"));
+    }
+    QVERIFY(newest.open(QIODevice::ReadOnly));
+    QList<QByteArray> lines = newest.readAll().split('\n');
+    QVERIFY(lines.size() >= 2);
+    QVERIFY(lines.last().isEmpty());
+    // Each message ends up on a single line; CR and LF get replaced by the visible symbols
+    QVERIFY(lines[lines.size() - 2].contains(QStringLiteral("* %1 FETCH").arg(count - 1, 8, 10, QLatin1Char('0')).toUtf8()));
+    QVERIFY(!lines[lines.size() - 2].contains('\r'));
+
+    QFile oldest(fileName + QLatin1String(".2"));
+    QVERIFY(oldest.open(QIODevice::ReadOnly));
+    QVERIFY(oldest.size() >= 4096);
+    QVERIFY(!oldest.readAll().contains(QStringLiteral("* %1 FETCH").arg(0, 8, 10, QLatin1Char('0')).toUtf8()));
+}
+
+/** @short The compressed log is a gzip stream */
+void FileLoggerTest::testCompression()
+{
+    if (!LogWriterThread::isCompressionSupported())
+        QSKIP("Built without zlib");
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QLatin1String("/trojita.log");
+
+    FileLogger logger;
+    logger.setCompression(true);
+    logger.setFileLogging(true, fileName);
+    for (int i = 0; i < 1000; ++i) {
+        logger.slotImapLogged(1, message(i));
+    }
+    logger.setFileLogging(false, QString());
+
+    QVERIFY(!QFile::exists(fileName));
+    QFile compressed(fileName + QLatin1String(".gz"));
+    QVERIFY(compressed.open(QIODevice::ReadOnly));
+    QByteArray data = compressed.readAll();
+    QVERIFY(data.startsWith("\x1f\x8b"));
+    // The messages are very similar to each other, so they have to compress well
+    QVERIFY(data.size() < 1000 * message(0).message.size() / 4);
+}
+
+QTEST_GUILESS_MAIN(FileLoggerTest)
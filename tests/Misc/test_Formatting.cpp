@@ -72,4 +72,27 @@ void TestFormatting::testAddressEliding_data()
 
 }
 
+/** @short The formatted date must stay the same until the reported expiry */
+void TestFormatting::testPrettyDateExpiry()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+
+    // Anything older than one year is formatted in the same way forever
+    QVERIFY(!UiUtils::Formatting::prettyDateExpiry(now.addYears(-2)).isValid());
+
+    const QDateTime lastWeek = now.addDays(-3);
+    QCOMPARE(UiUtils::Formatting::prettyDateExpiry(lastWeek), lastWeek.addDays(7).addSecs(-15*60));
+
+    const QDateTime lastYear = now.addDays(-30);
+    QCOMPARE(UiUtils::Formatting::prettyDateExpiry(lastYear), lastYear.addYears(1).addSecs(-15*60));
+
+    // Messages from the last hour are "today's" for at least the next five hours
+    const QDateTime recent = now.addSecs(-3600);
+    QVERIFY(UiUtils::Formatting::prettyDateExpiry(recent) >= recent.addSecs(6 * 3600 - 15 * 60));
+
+    const QDateTime future = now.addDays(1);
+    // A message from the future is shown with its full date for as long as it is still in the future, give or take
+    QCOMPARE(UiUtils::Formatting::prettyDateExpiry(future), future.addSecs(-15*60).addMSecs(1));
+}
+
 QTEST_GUILESS_MAIN(TestFormatting)
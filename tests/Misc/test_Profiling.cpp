@@ -0,0 +1,118 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <QStringList>
+#include <QTest>
+#include <QThread>
+#include "test_Profiling.h"
+#include "Common/Profiling.h"
+
+namespace {
+
+/** @short Find the row of the summary() table which describes the given site */
+QStringList summaryRow(const QString &site)
+{
+    Q_FOREACH(const QString &line, Common::Profiling::summary().split(QLatin1Char('\n'))) {
+        QStringList columns = line.split(QLatin1Char('\t'));
+        if (columns.first() == site)
+            return columns;
+    }
+    return QStringList();
+}
+
+void profiledFunction()
+{
+    TROJITA_PROFILE_SCOPE("test: profiledFunction");
+}
+
+class Worker : public QThread
+{
+protected:
+    virtual void run()
+    {
+        for (int i = 0; i < 1000; ++i) {
+            TROJITA_PROFILE_SCOPE("test: threads");
+            TROJITA_PROFILE_COUNT("test: threads, items", 2);
+        }
+    }
+};
+
+}
+
+void ProfilingTest::testSummaryWithoutProfiling()
+{
+    if (Common::Profiling::isEnabled())
+        QSKIP("Built with WITH_PROFILING");
+    QVERIFY(Common::Profiling::summary().contains(QLatin1String("WITH_PROFILING")));
+    // The macros have to compile even when they do nothing
+    TROJITA_PROFILE_SCOPE("test: disabled");
+    TROJITA_PROFILE_COUNT("test: disabled, items", 1);
+}
+
+void ProfilingTest::testScopesAndCounters()
+{
+    if (!Common::Profiling::isEnabled())
+        QSKIP("Built without WITH_PROFILING");
+
+    for (int i = 0; i < 100; ++i)
+        profiledFunction();
+    for (int i = 1; i <= 10; ++i)
+        TROJITA_PROFILE_COUNT("test: bytes", i);
+
+    QStringList row = summaryRow(QStringLiteral("test: profiledFunction"));
+    QCOMPARE(row.size(), 8);
+    QCOMPARE(row[1], QString::number(100));
+
+    row = summaryRow(QStringLiteral("test: bytes"));
+    QCOMPARE(row.size(), 8);
+    QCOMPARE(row[1], QString::number(10));
+    // Pure counters have no timing information
+    QCOMPARE(row[3], QStringLiteral("-"));
+    QCOMPARE(row[7], QString::number(55));
+}
+
+void ProfilingTest::testThreads()
+{
+    if (!Common::Profiling::isEnabled())
+        QSKIP("Built without WITH_PROFILING");
+
+    QList<Worker *> workers;
+    for (int i = 0; i < 4; ++i) {
+        workers << new Worker();
+        workers.last()->start();
+    }
+    Q_FOREACH(Worker *worker, workers) {
+        QVERIFY(worker->wait(10000));
+        delete worker;
+    }
+
+    // Statistics of the already finished threads are still part of the summary
+    QStringList row = summaryRow(QStringLiteral("test: threads"));
+    QCOMPARE(row.size(), 8);
+    QCOMPARE(row[1], QString::number(4000));
+    row = summaryRow(QStringLiteral("test: threads, items"));
+    QCOMPARE(row.size(), 8);
+    QCOMPARE(row[7], QString::number(8000));
+}
+
+QTEST_GUILESS_MAIN(ProfilingTest)
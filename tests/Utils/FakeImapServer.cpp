@@ -0,0 +1,1145 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <functional>
+#include <QDateTime>
+#include <QLocale>
+#include <QTimer>
+#include "FakeImapServer.h"
+#include "Imap/Encoders.h"
+#include "Streams/FakeSocket.h"
+
+namespace {
+
+/** @short Split command arguments on spaces which are not nested in parentheses, brackets or quoted strings */
+QList<QByteArray> splitArguments(const QByteArray &args)
+{
+    QList<QByteArray> res;
+    int depth = 0;
+    bool quoted = false;
+    int start = 0;
+    for (int i = 0; i < args.size(); ++i) {
+        const char c = args[i];
+        if (quoted) {
+            if (c == '\\')
+                ++i;
+            else if (c == '"')
+                quoted = false;
+            continue;
+        }
+        switch (c) {
+        case '"':
+            quoted = true;
+            break;
+        case '(':
+        case '[':
+            ++depth;
+            break;
+        case ')':
+        case ']':
+            --depth;
+            break;
+        case ' ':
+            if (depth == 0) {
+                if (i > start)
+                    res << args.mid(start, i - start);
+                start = i + 1;
+            }
+            break;
+        }
+    }
+    if (start < args.size())
+        res << args.mid(start);
+    return res;
+}
+
+QByteArray unquote(const QByteArray &what)
+{
+    if (what.size() < 2 || !what.startsWith('"') || !what.endsWith('"'))
+        return what;
+    QByteArray res;
+    res.reserve(what.size() - 2);
+    for (int i = 1; i < what.size() - 1; ++i) {
+        if (what[i] == '\\' && i + 1 < what.size() - 1)
+            ++i;
+        res += what[i];
+    }
+    return res;
+}
+
+QByteArray quote(const QByteArray &what)
+{
+    QByteArray res = what;
+    res.replace('\\', "\\\\").replace('"', "\\\"");
+    return '"' + res + '"';
+}
+
+QByteArray stripParentheses(const QByteArray &what)
+{
+    if (what.startsWith('(') && what.endsWith(')'))
+        return what.mid(1, what.size() - 2);
+    return what;
+}
+
+QByteArray join(const QList<QByteArray> &items, const char separator)
+{
+    QByteArray res;
+    for (int i = 0; i < items.size(); ++i) {
+        if (i)
+            res += separator;
+        res += items[i];
+    }
+    return res;
+}
+
+/** @short Make the @arg data available for reading from the @arg socket after @arg msec milliseconds */
+void deliverLater(Streams::FakeSocket *socket, const int msec, const QByteArray &data)
+{
+    // The timer is owned by the socket, so nothing gets delivered when the connection is gone
+    QTimer *timer = new QTimer(socket);
+    timer->setSingleShot(true);
+    QObject::connect(timer, &QTimer::timeout, socket, [socket, timer, data]() {
+        socket->fakeReading(data);
+        timer->deleteLater();
+    });
+    timer->start(msec);
+}
+
+QByteArray literal(const QByteArray &data)
+{
+    return '{' + QByteArray::number(data.size()) + "}\r\n" + data;
+}
+
+bool isSequenceSet(const QByteArray &what)
+{
+    if (what.isEmpty())
+        return false;
+    for (int i = 0; i < what.size(); ++i) {
+        const char c = what[i];
+        if (!(c >= '0' && c <= '9') && c != ':' && c != ',' && c != '*')
+            return false;
+    }
+    return true;
+}
+
+/** @short A cheap and deterministic random number generator (xorshift32) */
+class Random
+{
+public:
+    explicit Random(const quint32 seed): m_state(seed ? seed : 0x2545f491) {}
+    quint32 state() const
+    {
+        return m_state;
+    }
+    quint32 next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+    /** @short Return true with the given probability in percent */
+    bool percent(const int chance)
+    {
+        return static_cast<int>(next() % 100) < chance;
+    }
+private:
+    quint32 m_state;
+};
+
+/** @short Length of one line of the synthesized message bodies, including the CRLF */
+const int BODY_LINE_LENGTH = 72;
+
+/** @short Approximate size of the synthesized headers which is not counted towards the body */
+const uint HEADER_SIZE = 400;
+
+const int MAX_OPEN_THREADS = 20;
+
+uint bodySize(const uint totalSize)
+{
+    return totalSize > 2 * HEADER_SIZE ? totalSize - HEADER_SIZE : totalSize / 2 + 1;
+}
+
+QDateTime messageDate(const uint uid)
+{
+    return QDateTime(QDate(2014, 1, 1), QTime(0, 0), Qt::UTC).addSecs(static_cast<qint64>(uid) * 97);
+}
+
+void renderThread(const QVector<QVector<int> > &children, const QVector<uint> &ids, int node, QByteArray &out)
+{
+    out += QByteArray::number(ids[node]);
+    while (children[node].size() == 1) {
+        node = children[node].first();
+        out += ' ' + QByteArray::number(ids[node]);
+    }
+    if (children[node].size() > 1) {
+        out += ' ';
+        Q_FOREACH(const int child, children[node]) {
+            out += '(';
+            renderThread(children, ids, child, out);
+            out += ')';
+        }
+    }
+}
+
+}
+
+FakeImapServer::MailboxOptions::MailboxOptions():
+    messageCount(0), uidValidity(666), uidGapPercent(0), seenPercent(80), flaggedPercent(5), answeredPercent(10),
+    averageThreadSize(1), minSize(1000), maxSize(20000), seed(0)
+{
+}
+
+FakeImapServer::Connection::Connection():
+    literalRemaining(0), readOnly(false), condstore(false), qresync(false)
+{
+}
+
+FakeImapServer::FakeImapServer(): m_totalCommands(0), m_latency(0)
+{
+    m_capabilities << QStringLiteral("IMAP4rev1") << QStringLiteral("LITERAL+") << QStringLiteral("ID")
+                   << QStringLiteral("ENABLE") << QStringLiteral("NAMESPACE") << QStringLiteral("UIDPLUS")
+                   << QStringLiteral("IDLE") << QStringLiteral("ESEARCH") << QStringLiteral("CONDSTORE")
+                   << QStringLiteral("QRESYNC") << QStringLiteral("THREAD=REFS") << QStringLiteral("THREAD=REFERENCES")
+                   << QStringLiteral("UNSELECT") << QStringLiteral("COMPRESS=DEFLATE");
+}
+
+FakeImapServer::~FakeImapServer()
+{
+}
+
+Streams::Socket *FakeImapServer::create()
+{
+    Streams::FakeSocket *socket = new Streams::FakeSocket(Imap::CONN_STATE_CONNECTED_PRETLS_PRECAPS);
+    m_connections[socket] = Connection();
+    connect(socket, &Streams::FakeSocket::dataWritten, this, &FakeImapServer::slotDataWritten, Qt::QueuedConnection);
+    connect(socket, &QObject::destroyed, this, &FakeImapServer::slotSocketDestroyed);
+    // The greeting has to arrive only after the socket got a chance to announce that it's connected
+    deliverLater(socket, m_latency, "* OK [" + capabilityLine() + "] FakeImapServer ready\r\n");
+    return socket;
+}
+
+void FakeImapServer::setProxySettings(const Streams::ProxySettings proxySettings, const QString &protocolTag)
+{
+    Q_UNUSED(proxySettings);
+    Q_UNUSED(protocolTag);
+}
+
+void FakeImapServer::addMailbox(const QString &name, const MailboxOptions &options)
+{
+    Mailbox mailbox;
+    mailbox.options = options;
+    mailbox.randomState = Random(options.seed).state();
+    mailbox.highestModSeq = 0;
+    mailbox.uidNext = 1;
+    generateMessages(mailbox, static_cast<int>(options.messageCount));
+    mailbox.highestModSeq = qMax<quint64>(1, mailbox.highestModSeq);
+    m_mailboxes[name] = mailbox;
+}
+
+/** @short Append @arg count messages to the end of the mailbox */
+void FakeImapServer::generateMessages(Mailbox &mailbox, const int count)
+{
+    const MailboxOptions &options = mailbox.options;
+    const int first = mailbox.uids.size();
+    mailbox.uids.reserve(first + count);
+    mailbox.flags.reserve(first + count);
+    mailbox.sizes.reserve(first + count);
+    mailbox.threadParents.reserve(first + count);
+    mailbox.modSeqs.reserve(first + count);
+
+    Random random(mailbox.randomState);
+    uint uid = mailbox.uidNext - 1;
+    for (int i = first; i < first + count; ++i) {
+        uid += 1;
+        if (options.uidGapPercent > 0 && random.percent(options.uidGapPercent))
+            uid += 1 + random.next() % 5;
+        mailbox.uids << uid;
+
+        quint8 flags = 0;
+        if (random.percent(options.seenPercent))
+            flags |= FLAG_SEEN;
+        if (random.percent(options.flaggedPercent))
+            flags |= FLAG_FLAGGED;
+        if (random.percent(options.answeredPercent))
+            flags |= FLAG_ANSWERED;
+        mailbox.flags << flags;
+
+        uint size = options.minSize;
+        if (options.maxSize > options.minSize)
+            size += random.next() % (options.maxSize - options.minSize + 1);
+        mailbox.sizes << size;
+
+        // Replies go into one of the recently started threads; that's how a mailing list looks like
+        int parent = -1;
+        if (options.averageThreadSize > 1 && !mailbox.openThreads.isEmpty()
+                && random.next() % static_cast<quint32>(options.averageThreadSize) != 0) {
+            QVector<int> &thread = mailbox.openThreads[random.next() % mailbox.openThreads.size()];
+            parent = thread[random.next() % thread.size()];
+            thread << i;
+        } else if (options.averageThreadSize > 1) {
+            mailbox.openThreads << (QVector<int>() << i);
+            if (mailbox.openThreads.size() > MAX_OPEN_THREADS)
+                mailbox.openThreads.removeFirst();
+        }
+        mailbox.threadParents << parent;
+        mailbox.modSeqs << ++mailbox.highestModSeq;
+    }
+    mailbox.uidNext = uid + 1;
+    mailbox.randomState = random.state();
+}
+
+void FakeImapServer::appendMessages(const QString &mailbox, const int count)
+{
+    Mailbox &m = m_mailboxes[mailbox];
+    const int first = m.uids.size();
+    generateMessages(m, count);
+    // Each arrival is announced on its own, just like when a busy server delivers mail one message at a time
+    QByteArray notification;
+    for (int i = first; i < m.uids.size(); ++i) {
+        notification += "* " + QByteArray::number(i + 1) + " EXISTS\r\n";
+    }
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        if (it->selected == mailbox)
+            reply(it.key(), notification);
+    }
+}
+
+void FakeImapServer::expungeMessages(const QString &mailbox, const QVector<int> &offsets)
+{
+    Mailbox &m = m_mailboxes[mailbox];
+    const int count = m.uids.size();
+    QVector<bool> removed(count, false);
+    Q_FOREACH(const int offset, offsets) {
+        removed[offset] = true;
+    }
+
+    ++m.highestModSeq;
+    QVector<uint> vanished;
+    QVector<int> newOffsets(count, -1);
+    Mailbox survivors = m;
+    survivors.uids.clear();
+    survivors.flags.clear();
+    survivors.sizes.clear();
+    survivors.threadParents.clear();
+    survivors.modSeqs.clear();
+    survivors.openThreads.clear();
+    for (int i = 0; i < count; ++i) {
+        if (removed[i]) {
+            vanished << m.uids[i];
+            survivors.vanished << qMakePair(m.highestModSeq, m.uids[i]);
+            continue;
+        }
+        // Replies to an expunged message now reply to its closest surviving ancestor
+        int parent = m.threadParents[i];
+        while (parent != -1 && removed[parent])
+            parent = m.threadParents[parent];
+        newOffsets[i] = survivors.uids.size();
+        survivors.uids << m.uids[i];
+        survivors.flags << m.flags[i];
+        survivors.sizes << m.sizes[i];
+        survivors.threadParents << (parent == -1 ? -1 : newOffsets[parent]);
+        survivors.modSeqs << m.modSeqs[i];
+    }
+    m = survivors;
+
+    QByteArray expunges;
+    for (int i = count - 1; i >= 0; --i) {
+        if (removed[i])
+            expunges += "* " + QByteArray::number(i + 1) + " EXPUNGE\r\n";
+    }
+    QByteArray vanishedResponse;
+    if (!vanished.isEmpty())
+        vanishedResponse = "* VANISHED " + compressUids(vanished) + "\r\n";
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        if (it->selected == mailbox)
+            reply(it.key(), it->qresync ? vanishedResponse : expunges);
+    }
+}
+
+void FakeImapServer::setCapabilities(const QStringList &capabilities)
+{
+    m_capabilities = capabilities;
+}
+
+QStringList FakeImapServer::capabilities() const
+{
+    return m_capabilities;
+}
+
+void FakeImapServer::setLatency(const int msec)
+{
+    m_latency = msec;
+}
+
+int FakeImapServer::messageCount(const QString &mailbox) const
+{
+    return m_mailboxes.value(mailbox).uids.size();
+}
+
+uint FakeImapServer::uidAt(const QString &mailbox, const int offset) const
+{
+    return m_mailboxes.value(mailbox).uids[offset];
+}
+
+int FakeImapServer::unreadCount(const QString &mailbox) const
+{
+    const QVector<quint8> flags = m_mailboxes.value(mailbox).flags;
+    return static_cast<int>(std::count_if(flags.constBegin(), flags.constEnd(), [](const quint8 f) { return !(f & FLAG_SEEN); }));
+}
+
+int FakeImapServer::threadRootCount(const QString &mailbox) const
+{
+    return m_mailboxes.value(mailbox).threadParents.count(-1);
+}
+
+QString FakeImapServer::subjectAt(const QString &mailbox, const int offset) const
+{
+    return QString::fromUtf8(subject(m_mailboxes.value(mailbox), offset));
+}
+
+void FakeImapServer::toggleSeen(const QString &mailbox, const int offset)
+{
+    Mailbox &m = m_mailboxes[mailbox];
+    m.flags[offset] ^= FLAG_SEEN;
+    m.modSeqs[offset] = ++m.highestModSeq;
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        if (it->selected != mailbox)
+            continue;
+        QByteArray notification = "* " + QByteArray::number(offset + 1) + " FETCH (";
+        // RFC 7162 requires the UID in each unsolicited FETCH once QRESYNC is enabled
+        if (it->qresync)
+            notification += "UID " + QByteArray::number(m.uids[offset]) + ' ';
+        notification += "FLAGS (" + flagsToString(m.flags[offset]) + ')';
+        if (it->condstore)
+            notification += " MODSEQ (" + QByteArray::number(m.modSeqs[offset]) + ')';
+        notification += ")\r\n";
+        reply(it.key(), notification);
+    }
+}
+
+int FakeImapServer::commandCount() const
+{
+    return m_totalCommands;
+}
+
+int FakeImapServer::commandCount(const QByteArray &command) const
+{
+    return m_commandCounts.value(command);
+}
+
+void FakeImapServer::resetCommandCount()
+{
+    m_totalCommands = 0;
+    m_commandCounts.clear();
+}
+
+void FakeImapServer::slotSocketDestroyed(QObject *socket)
+{
+    // Only the address is used, the object is already gone at this point
+    m_connections.remove(static_cast<Streams::FakeSocket *>(socket));
+}
+
+void FakeImapServer::slotDataWritten()
+{
+    Streams::FakeSocket *socket = qobject_cast<Streams::FakeSocket *>(sender());
+    if (!socket)
+        return;
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end())
+        return;
+    QByteArray data = socket->writtenStuff();
+    if (data.isEmpty())
+        return;
+    // TLS and compression are only faked by the FakeSocket which leaves these markers in the stream
+    data.replace("[*** STARTTLS ***]", QByteArray()).replace("[*** DEFLATE ***]", QByteArray())
+            .replace("[*** close ***]", QByteArray());
+    it->input += data;
+    processInput(socket, *it);
+}
+
+/** @short Split the client's data into commands, taking care of literals */
+void FakeImapServer::processInput(Streams::FakeSocket *socket, Connection &connection)
+{
+    while (true) {
+        if (connection.literalRemaining > 0) {
+            if (connection.input.size() < connection.literalRemaining)
+                return;
+            // Literals get converted into quoted strings, so that the argument parsing is simple
+            connection.command += quote(connection.input.left(connection.literalRemaining));
+            connection.input.remove(0, connection.literalRemaining);
+            connection.literalRemaining = 0;
+            continue;
+        }
+
+        int eol = connection.input.indexOf("\r\n");
+        if (eol == -1)
+            return;
+        QByteArray line = connection.input.left(eol);
+        connection.input.remove(0, eol + 2);
+
+        if (line.endsWith('}')) {
+            int brace = line.lastIndexOf('{');
+            bool nonSynchronizing = line.endsWith("+}");
+            bool ok;
+            int size = line.mid(brace + 1, line.size() - brace - (nonSynchronizing ? 3 : 2)).toInt(&ok);
+            if (brace != -1 && ok) {
+                connection.command += line.left(brace);
+                connection.literalRemaining = size;
+                if (!nonSynchronizing)
+                    reply(socket, "+ Ready for literal data\r\n");
+                if (size == 0)
+                    connection.command += "\"\"";
+                continue;
+            }
+        }
+
+        connection.command += line;
+        QByteArray command = connection.command;
+        connection.command.clear();
+        handleCommand(socket, connection, command);
+    }
+}
+
+void FakeImapServer::handleCommand(Streams::FakeSocket *socket, Connection &connection, const QByteArray &line)
+{
+    if (!connection.idleTag.isEmpty()) {
+        QByteArray tag = connection.idleTag;
+        connection.idleTag.clear();
+        if (line.toUpper() == "DONE")
+            reply(socket, tag + " OK IDLE terminated\r\n");
+        else
+            reply(socket, tag + " BAD Expected DONE\r\n");
+        return;
+    }
+
+    int space = line.indexOf(' ');
+    if (space == -1) {
+        reply(socket, "* BAD Missing command\r\n");
+        return;
+    }
+    const QByteArray tag = line.left(space);
+    QByteArray rest = line.mid(space + 1);
+    bool uid = false;
+    if (rest.toUpper().startsWith("UID ")) {
+        uid = true;
+        rest = rest.mid(4);
+    }
+    space = rest.indexOf(' ');
+    const QByteArray verb = (space == -1 ? rest : rest.left(space)).toUpper();
+    const QByteArray args = space == -1 ? QByteArray() : rest.mid(space + 1);
+
+    ++m_totalCommands;
+    ++m_commandCounts[uid ? QByteArray("UID " + verb) : verb];
+
+    Mailbox *mailbox = 0;
+    if (!connection.selected.isEmpty() && m_mailboxes.contains(connection.selected))
+        mailbox = &m_mailboxes[connection.selected];
+
+    QByteArray response;
+    if (verb == "CAPABILITY") {
+        response = "* " + capabilityLine() + "\r\n" + tag + " OK Capabilities follow\r\n";
+    } else if (verb == "LOGIN" || verb == "AUTHENTICATE") {
+        response = tag + " OK [" + capabilityLine() + "] Logged in\r\n";
+    } else if (verb == "NOOP" || verb == "CHECK") {
+        response = tag + " OK Done\r\n";
+    } else if (verb == "LOGOUT") {
+        response = "* BYE See you\r\n" + tag + " OK Logged out\r\n";
+    } else if (verb == "ID") {
+        response = "* ID NIL\r\n" + tag + " OK ID done\r\n";
+    } else if (verb == "ENABLE") {
+        QByteArray enabled;
+        Q_FOREACH(const QByteArray &extension, splitArguments(args)) {
+            if (!m_capabilities.contains(QString::fromUtf8(extension.toUpper())))
+                continue;
+            if (extension.toUpper() == "QRESYNC")
+                connection.qresync = true;
+            enabled += ' ' + extension.toUpper();
+        }
+        response = "* ENABLED" + enabled + "\r\n" + tag + " OK Enabled\r\n";
+    } else if (verb == "NAMESPACE") {
+        response = "* NAMESPACE ((\"\" \"/\")) NIL NIL\r\n" + tag + " OK Namespaces follow\r\n";
+    } else if (verb == "COMPRESS") {
+        response = tag + " OK DEFLATE active\r\n";
+    } else if (verb == "LIST" || verb == "LSUB") {
+        response = handleList(tag, verb, args);
+    } else if (verb == "STATUS") {
+        response = handleStatus(tag, args);
+    } else if (verb == "SELECT" || verb == "EXAMINE") {
+        response = handleSelect(connection, tag, verb, args);
+    } else if (verb == "CLOSE" || verb == "UNSELECT") {
+        connection.selected.clear();
+        response = tag + " OK Closed\r\n";
+    } else if (verb == "IDLE") {
+        connection.idleTag = tag;
+        response = "+ idling\r\n";
+    } else if (verb == "SEARCH" || verb == "FETCH" || verb == "STORE" || verb == "THREAD") {
+        if (!mailbox) {
+            response = tag + " BAD No mailbox selected\r\n";
+        } else if (verb == "SEARCH") {
+            response = handleSearch(*mailbox, tag, uid, args);
+        } else if (verb == "FETCH") {
+            response = handleFetch(connection, *mailbox, tag, uid, args);
+        } else if (verb == "STORE") {
+            if (connection.readOnly)
+                response = tag + " NO Mailbox is read-only\r\n";
+            else
+                response = handleStore(connection, *mailbox, tag, uid, args);
+        } else {
+            response = handleThread(*mailbox, tag, uid, args);
+        }
+    } else {
+        response = tag + " BAD Command not supported by FakeImapServer\r\n";
+    }
+    reply(socket, response);
+}
+
+void FakeImapServer::reply(Streams::FakeSocket *socket, const QByteArray &data)
+{
+    if (m_latency <= 0) {
+        socket->fakeReading(data);
+        return;
+    }
+    deliverLater(socket, m_latency, data);
+}
+
+QByteArray FakeImapServer::capabilityLine() const
+{
+    return "CAPABILITY " + m_capabilities.join(QStringLiteral(" ")).toUtf8();
+}
+
+QByteArray FakeImapServer::handleList(const QByteArray &tag, const QByteArray &verb, const QByteArray &args)
+{
+    QList<QByteArray> items = splitArguments(args);
+    if (items.size() < 2)
+        return tag + " BAD Expected reference and pattern\r\n";
+    const QString pattern = Imap::decodeImapFolderName(unquote(items[0]) + unquote(items[1]));
+
+    QByteArray response;
+    if (pattern.isEmpty()) {
+        response += "* " + verb + " (\\Noselect) \"/\" \"\"\r\n";
+    } else {
+        for (auto it = m_mailboxes.constBegin(); it != m_mailboxes.constEnd(); ++it) {
+            if (!matchesPattern(it.key(), pattern))
+                continue;
+            const QString prefix = it.key() + QLatin1Char('/');
+            auto next = it + 1;
+            bool hasChildren = next != m_mailboxes.constEnd() && next.key().startsWith(prefix);
+            response += "* " + verb + (hasChildren ? " (\\HasChildren)" : " (\\HasNoChildren)") + " \"/\" "
+                    + quote(Imap::encodeImapFolderName(it.key())) + "\r\n";
+        }
+    }
+    return response + tag + " OK List completed\r\n";
+}
+
+QByteArray FakeImapServer::handleStatus(const QByteArray &tag, const QByteArray &args)
+{
+    QList<QByteArray> items = splitArguments(args);
+    if (items.size() != 2)
+        return tag + " BAD Expected mailbox and status items\r\n";
+    const QString name = Imap::decodeImapFolderName(unquote(items[0]));
+    if (!m_mailboxes.contains(name))
+        return tag + " NO Mailbox does not exist\r\n";
+    const Mailbox &mailbox = m_mailboxes[name];
+
+    QList<QByteArray> attributes;
+    Q_FOREACH(const QByteArray &item, splitArguments(stripParentheses(items[1]))) {
+        const QByteArray upper = item.toUpper();
+        if (upper == "MESSAGES")
+            attributes << upper + ' ' + QByteArray::number(mailbox.uids.size());
+        else if (upper == "RECENT")
+            attributes << upper + " 0";
+        else if (upper == "UNSEEN")
+            attributes << upper + ' ' + QByteArray::number(unreadCount(name));
+        else if (upper == "UIDNEXT")
+            attributes << upper + ' ' + QByteArray::number(mailbox.uidNext);
+        else if (upper == "UIDVALIDITY")
+            attributes << upper + ' ' + QByteArray::number(mailbox.options.uidValidity);
+        else if (upper == "HIGHESTMODSEQ")
+            attributes << upper + ' ' + QByteArray::number(mailbox.highestModSeq);
+    }
+    return "* STATUS " + quote(Imap::encodeImapFolderName(name)) + " (" + join(attributes, ' ') + ")\r\n"
+            + tag + " OK Status completed\r\n";
+}
+
+QByteArray FakeImapServer::handleSelect(Connection &connection, const QByteArray &tag, const QByteArray &verb, const QByteArray &args)
+{
+    QList<QByteArray> items = splitArguments(args);
+    if (items.isEmpty())
+        return tag + " BAD Expected mailbox name\r\n";
+    const QString name = Imap::decodeImapFolderName(unquote(items[0]));
+    connection.selected.clear();
+    if (!m_mailboxes.contains(name))
+        return tag + " NO Mailbox does not exist\r\n";
+    connection.selected = name;
+    connection.readOnly = verb == "EXAMINE";
+    connection.condstore = connection.qresync;
+    const Mailbox &mailbox = m_mailboxes[name];
+
+    // Parameters are either (CONDSTORE) or (QRESYNC (uidvalidity modseq [known-uids [seq-match]]))
+    QList<QByteArray> qresyncParams;
+    if (items.size() > 1) {
+        QList<QByteArray> params = splitArguments(stripParentheses(items[1]));
+        for (int i = 0; i < params.size(); ++i) {
+            const QByteArray param = params[i].toUpper();
+            if (param == "CONDSTORE") {
+                connection.condstore = true;
+            } else if (param == "QRESYNC" && i + 1 < params.size()) {
+                if (!connection.qresync)
+                    return tag + " BAD QRESYNC has not been enabled\r\n";
+                connection.condstore = true;
+                qresyncParams = splitArguments(stripParentheses(params[++i]));
+            }
+        }
+    }
+
+    QByteArray response = "* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n"
+            "* OK [PERMANENTFLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft \\*)] Flags permitted\r\n"
+            "* " + QByteArray::number(mailbox.uids.size()) + " EXISTS\r\n"
+            "* 0 RECENT\r\n"
+            "* OK [UIDVALIDITY " + QByteArray::number(mailbox.options.uidValidity) + "] UIDs valid\r\n"
+            "* OK [UIDNEXT " + QByteArray::number(mailbox.uidNext) + "] Predicted next UID\r\n";
+    if (m_capabilities.contains(QStringLiteral("CONDSTORE")) || m_capabilities.contains(QStringLiteral("QRESYNC")))
+        response += "* OK [HIGHESTMODSEQ " + QByteArray::number(mailbox.highestModSeq) + "] Highest\r\n";
+
+    if (qresyncParams.size() >= 2 && qresyncParams[0].toUInt() == mailbox.options.uidValidity) {
+        const quint64 knownModSeq = qresyncParams[1].toULongLong();
+        QVector<uint> vanished;
+        for (auto it = mailbox.vanished.constBegin(); it != mailbox.vanished.constEnd(); ++it) {
+            if (it->first > knownModSeq)
+                vanished << it->second;
+        }
+        if (!vanished.isEmpty()) {
+            std::sort(vanished.begin(), vanished.end());
+            response += "* VANISHED (EARLIER) " + compressUids(vanished) + "\r\n";
+        }
+        for (int i = 0; i < mailbox.uids.size(); ++i) {
+            if (mailbox.modSeqs[i] <= knownModSeq)
+                continue;
+            response += "* " + QByteArray::number(i + 1) + " FETCH (UID " + QByteArray::number(mailbox.uids[i])
+                    + " FLAGS (" + flagsToString(mailbox.flags[i]) + ") MODSEQ ("
+                    + QByteArray::number(mailbox.modSeqs[i]) + "))\r\n";
+        }
+    }
+
+    return response + tag + (connection.readOnly ? " OK [READ-ONLY] " : " OK [READ-WRITE] ") + "Selected\r\n";
+}
+
+QByteArray FakeImapServer::handleSearch(Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args)
+{
+    QList<QByteArray> items = splitArguments(args);
+    bool extended = false;
+    if (!items.isEmpty() && items.first().toUpper() == "RETURN") {
+        extended = true;
+        items.removeFirst();
+        if (!items.isEmpty())
+            items.removeFirst();
+    }
+    if (items.size() >= 2 && items.first().toUpper() == "CHARSET") {
+        items.removeFirst();
+        items.removeFirst();
+    }
+
+    // Only the criteria which are used during the mailbox synchronization are understood, anything else matches all
+    QVector<int> offsets;
+    if (items.size() == 2 && items[0].toUpper() == "UID" && isSequenceSet(items[1])) {
+        offsets = resolveSet(mailbox, items[1], true);
+    } else if (items.size() == 1 && isSequenceSet(items[0])) {
+        offsets = resolveSet(mailbox, items[0], false);
+    } else {
+        offsets.resize(mailbox.uids.size());
+        for (int i = 0; i < offsets.size(); ++i)
+            offsets[i] = i;
+    }
+
+    QVector<uint> results;
+    results.reserve(offsets.size());
+    Q_FOREACH(const int offset, offsets) {
+        results << (uid ? mailbox.uids[offset] : static_cast<uint>(offset + 1));
+    }
+
+    QByteArray response;
+    if (extended) {
+        response = "* ESEARCH (TAG " + quote(tag) + ")" + (uid ? " UID" : "");
+        if (!results.isEmpty())
+            response += " ALL " + compressUids(results);
+        response += "\r\n";
+    } else {
+        response = "* SEARCH";
+        response.reserve(results.size() * 8 + 16);
+        Q_FOREACH(const uint number, results) {
+            response += ' ' + QByteArray::number(number);
+        }
+        response += "\r\n";
+    }
+    return response + tag + " OK Search completed\r\n";
+}
+
+QByteArray FakeImapServer::handleFetch(Connection &connection, Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args)
+{
+    QList<QByteArray> items = splitArguments(args);
+    if (items.size() < 2)
+        return tag + " BAD Expected sequence set and fetch items\r\n";
+
+    QList<QByteArray> fetchItems;
+    Q_FOREACH(const QByteArray &item, splitArguments(stripParentheses(items[1]))) {
+        fetchItems << item.toUpper();
+    }
+    if (uid && !fetchItems.contains("UID"))
+        fetchItems.prepend("UID");
+
+    bool hasChangedSince = false;
+    quint64 changedSince = 0;
+    if (items.size() > 2) {
+        QList<QByteArray> modifiers = splitArguments(stripParentheses(items[2]));
+        for (int i = 0; i + 1 < modifiers.size(); ++i) {
+            if (modifiers[i].toUpper() == "CHANGEDSINCE") {
+                hasChangedSince = true;
+                changedSince = modifiers[i + 1].toULongLong();
+            }
+        }
+    }
+    if (hasChangedSince || fetchItems.contains("MODSEQ"))
+        connection.condstore = true;
+    if (connection.condstore && fetchItems.contains("FLAGS") && !fetchItems.contains("MODSEQ"))
+        fetchItems << "MODSEQ";
+
+    const QVector<int> offsets = resolveSet(mailbox, items[0], uid);
+    QByteArray response;
+    Q_FOREACH(const int offset, offsets) {
+        if (hasChangedSince && mailbox.modSeqs[offset] <= changedSince)
+            continue;
+        QList<QByteArray> data;
+        Q_FOREACH(const QByteArray &item, fetchItems) {
+            data << fetchItem(mailbox, offset, item);
+        }
+        response += "* " + QByteArray::number(offset + 1) + " FETCH (" + join(data, ' ') + ")\r\n";
+    }
+    return response + tag + " OK Fetch completed\r\n";
+}
+
+QByteArray FakeImapServer::handleStore(Connection &connection, Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args)
+{
+    QList<QByteArray> items = splitArguments(args);
+    if (items.size() >= 2 && items[1].startsWith('('))
+        items.removeAt(1); // UNCHANGEDSINCE is always satisfied
+    if (items.size() < 3)
+        return tag + " BAD Expected sequence set, operation and flags\r\n";
+
+    QByteArray operation = items[1].toUpper();
+    const bool silent = operation.endsWith(".SILENT");
+    if (silent)
+        operation.chop(7);
+    quint8 flags = 0;
+    Q_FOREACH(const QByteArray &flag, splitArguments(stripParentheses(items[2]))) {
+        const QByteArray upper = flag.toUpper();
+        if (upper == "\\SEEN")
+            flags |= FLAG_SEEN;
+        else if (upper == "\\FLAGGED")
+            flags |= FLAG_FLAGGED;
+        else if (upper == "\\ANSWERED")
+            flags |= FLAG_ANSWERED;
+        else if (upper == "\\DELETED")
+            flags |= FLAG_DELETED;
+    }
+
+    QByteArray response;
+    Q_FOREACH(const int offset, resolveSet(mailbox, items[0], uid)) {
+        quint8 updated = mailbox.flags[offset];
+        if (operation == "+FLAGS")
+            updated |= flags;
+        else if (operation == "-FLAGS")
+            updated &= ~flags;
+        else if (operation == "FLAGS")
+            updated = flags;
+        else
+            return tag + " BAD Unknown STORE operation\r\n";
+        if (updated != mailbox.flags[offset]) {
+            mailbox.flags[offset] = updated;
+            mailbox.modSeqs[offset] = ++mailbox.highestModSeq;
+        }
+        if (silent)
+            continue;
+        response += "* " + QByteArray::number(offset + 1) + " FETCH (";
+        if (uid)
+            response += "UID " + QByteArray::number(mailbox.uids[offset]) + ' ';
+        response += "FLAGS (" + flagsToString(updated) + ')';
+        if (connection.condstore)
+            response += " MODSEQ (" + QByteArray::number(mailbox.modSeqs[offset]) + ')';
+        response += ")\r\n";
+    }
+    return response + tag + " OK Store completed\r\n";
+}
+
+QByteArray FakeImapServer::handleThread(Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args)
+{
+    QList<QByteArray> items = splitArguments(args);
+    if (items.size() < 3)
+        return tag + " BAD Expected algorithm, charset and search criteria\r\n";
+    const QByteArray algorithm = items[0].toUpper();
+    if (!m_capabilities.contains(QStringLiteral("THREAD=") + QString::fromUtf8(algorithm)))
+        return tag + " BAD Unsupported threading algorithm\r\n";
+
+    // The search criteria are ignored, the whole mailbox is always threaded
+    const int count = mailbox.uids.size();
+    QVector<QVector<int> > children(count);
+    QVector<uint> ids(count);
+    for (int i = 0; i < count; ++i) {
+        ids[i] = uid ? mailbox.uids[i] : static_cast<uint>(i + 1);
+        if (mailbox.threadParents[i] != -1)
+            children[mailbox.threadParents[i]] << i;
+    }
+
+    QByteArray response = "* THREAD ";
+    for (int i = 0; i < count; ++i) {
+        if (mailbox.threadParents[i] != -1)
+            continue;
+        response += '(';
+        renderThread(children, ids, i, response);
+        response += ')';
+    }
+    return response + "\r\n" + tag + " OK Thread completed\r\n";
+}
+
+QByteArray FakeImapServer::fetchItem(const Mailbox &mailbox, const int offset, const QByteArray &item) const
+{
+    if (item == "UID")
+        return "UID " + QByteArray::number(mailbox.uids[offset]);
+    if (item == "FLAGS")
+        return "FLAGS (" + flagsToString(mailbox.flags[offset]) + ')';
+    if (item == "MODSEQ")
+        return "MODSEQ (" + QByteArray::number(mailbox.modSeqs[offset]) + ')';
+    if (item == "INTERNALDATE")
+        return "INTERNALDATE \"" + internalDate(mailbox, offset) + '"';
+    if (item == "RFC822.SIZE")
+        return "RFC822.SIZE " + QByteArray::number(mailbox.sizes[offset]);
+    if (item == "ENVELOPE")
+        return "ENVELOPE " + envelope(mailbox, offset);
+    if (item == "BODYSTRUCTURE" || item == "BODY")
+        return item + ' ' + bodyStructure(mailbox, offset);
+
+    int bracket = item.indexOf('[');
+    if (bracket == -1 || !item.contains(']'))
+        return item + " NIL";
+    QByteArray name = item.left(bracket);
+    if (name.endsWith(".PEEK"))
+        name.chop(5);
+    if (name != "BODY" && name != "BINARY")
+        return item + " NIL";
+    const QByteArray section = item.mid(bracket + 1, item.lastIndexOf(']') - bracket - 1);
+    const QByteArray key = name + '[' + section + ']';
+
+    QByteArray data;
+    if (section.isEmpty()) {
+        data = headers(mailbox, offset) + bodyText(mailbox, offset);
+    } else if (section == "HEADER") {
+        data = headers(mailbox, offset);
+    } else if (section == "TEXT" || section == "1") {
+        data = bodyText(mailbox, offset);
+    } else if (section == "1.MIME" || section == "MIME") {
+        data = "Content-Type: text/plain; charset=us-ascii\r\n\r\n";
+    } else if (section.startsWith("HEADER.FIELDS (") || section.startsWith("HEADER.FIELDS.NOT (")) {
+        const bool negated = section.startsWith("HEADER.FIELDS.NOT");
+        QList<QByteArray> fields = splitArguments(stripParentheses(section.mid(section.indexOf('('))));
+        Q_FOREACH(const QByteArray &header, headers(mailbox, offset).split('\n')) {
+            int colon = header.indexOf(':');
+            if (colon == -1)
+                continue;
+            if (fields.contains(header.left(colon).toUpper()) != negated)
+                data += header + '\n';
+        }
+        data += "\r\n";
+    } else {
+        return key + " NIL";
+    }
+    return key + ' ' + literal(data);
+}
+
+QByteArray FakeImapServer::messageId(const Mailbox &mailbox, const int offset) const
+{
+    return '<' + QByteArray::number(mailbox.uids[offset]) + '.' + QByteArray::number(mailbox.options.uidValidity)
+            + "@fake.example.org>";
+}
+
+QByteArray FakeImapServer::internalDate(const Mailbox &mailbox, const int offset) const
+{
+    return QLocale::c().toString(messageDate(mailbox.uids[offset]), QStringLiteral("dd-MMM-yyyy hh:mm:ss")).toUtf8()
+            + " +0000";
+}
+
+QByteArray FakeImapServer::subject(const Mailbox &mailbox, const int offset) const
+{
+    int root = offset;
+    while (mailbox.threadParents[root] != -1)
+        root = mailbox.threadParents[root];
+    return (root == offset ? "Message " : "Re: Message ") + QByteArray::number(mailbox.uids[root]);
+}
+
+QByteArray FakeImapServer::envelope(const Mailbox &mailbox, const int offset) const
+{
+    const uint uid = mailbox.uids[offset];
+    const QByteArray date = QLocale::c().toString(messageDate(uid), QStringLiteral("ddd, dd MMM yyyy hh:mm:ss")).toUtf8()
+            + " +0000";
+    const QByteArray user = QByteArray::number((uid * 2654435761u) % 50);
+    const QByteArray from = "((\"User " + user + "\" NIL \"user" + user + "\" \"fake.example.org\"))";
+    const int parent = mailbox.threadParents[offset];
+    return "(" + quote(date) + ' ' + quote(subject(mailbox, offset)) + ' ' + from + ' ' + from + ' ' + from
+            + " ((NIL NIL \"me\" \"fake.example.org\")) NIL NIL "
+            + (parent == -1 ? QByteArray("NIL") : quote(messageId(mailbox, parent))) + ' '
+            + quote(messageId(mailbox, offset)) + ')';
+}
+
+QByteArray FakeImapServer::bodyStructure(const Mailbox &mailbox, const int offset) const
+{
+    const uint size = bodySize(mailbox.sizes[offset]);
+    const uint lines = (size + BODY_LINE_LENGTH - 1) / BODY_LINE_LENGTH;
+    return "(\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL \"7bit\" " + QByteArray::number(size) + ' '
+            + QByteArray::number(lines) + " NIL NIL NIL NIL)";
+}
+
+QByteArray FakeImapServer::headers(const Mailbox &mailbox, const int offset) const
+{
+    const QByteArray user = QByteArray::number((mailbox.uids[offset] * 2654435761u) % 50);
+    QByteArray res = "Message-ID: " + messageId(mailbox, offset) + "\r\n"
+            "Date: " + QLocale::c().toString(messageDate(mailbox.uids[offset]),
+                                              QStringLiteral("ddd, dd MMM yyyy hh:mm:ss")).toUtf8() + " +0000\r\n"
+            "From: User " + user + " <user" + user + "@fake.example.org>\r\n"
+            "To: me@fake.example.org\r\n"
+            "Subject: " + subject(mailbox, offset) + "\r\n";
+    int parent = mailbox.threadParents[offset];
+    if (parent != -1) {
+        res += "In-Reply-To: " + messageId(mailbox, parent) + "\r\n";
+        QList<QByteArray> references;
+        for (int i = 0; parent != -1 && i < 10; ++i) {
+            references.prepend(messageId(mailbox, parent));
+            parent = mailbox.threadParents[parent];
+        }
+        res += "References: " + join(references, ' ') + "\r\n";
+    }
+    res += "MIME-Version: 1.0\r\nContent-Type: text/plain; charset=us-ascii\r\n\r\n";
+    return res;
+}
+
+QByteArray FakeImapServer::bodyText(const Mailbox &mailbox, const int offset) const
+{
+    const int size = static_cast<int>(bodySize(mailbox.sizes[offset]));
+    QByteArray line = "Message " + QByteArray::number(mailbox.uids[offset]) + ": ";
+    line = line.leftJustified(BODY_LINE_LENGTH - 2, 'x') + "\r\n";
+    QByteArray res;
+    res.reserve(size);
+    while (res.size() < size)
+        res += line;
+    res.truncate(size);
+    return res;
+}
+
+/** @short Convert a sequence set into a sorted list of offsets of matching messages */
+QVector<int> FakeImapServer::resolveSet(const Mailbox &mailbox, const QByteArray &set, const bool uid) const
+{
+    QVector<int> res;
+    if (mailbox.uids.isEmpty())
+        return res;
+    const uint star = uid ? mailbox.uids.last() : static_cast<uint>(mailbox.uids.size());
+    Q_FOREACH(const QByteArray &range, set.split(',')) {
+        int colon = range.indexOf(':');
+        const QByteArray first = colon == -1 ? range : range.left(colon);
+        const QByteArray last = colon == -1 ? range : range.mid(colon + 1);
+        uint low = first == "*" ? star : first.toUInt();
+        uint high = last == "*" ? star : last.toUInt();
+        if (low > high)
+            std::swap(low, high);
+        if (uid) {
+            auto begin = std::lower_bound(mailbox.uids.constBegin(), mailbox.uids.constEnd(), low);
+            auto end = std::upper_bound(mailbox.uids.constBegin(), mailbox.uids.constEnd(), high);
+            for (auto it = begin; it < end; ++it)
+                res << static_cast<int>(it - mailbox.uids.constBegin());
+        } else {
+            low = qMax(low, 1u);
+            high = qMin(high, star);
+            for (uint seq = low; seq <= high; ++seq)
+                res << static_cast<int>(seq - 1);
+        }
+    }
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+QByteArray FakeImapServer::flagsToString(const quint8 flags)
+{
+    QList<QByteArray> res;
+    if (flags & FLAG_SEEN)
+        res << "\\Seen";
+    if (flags & FLAG_FLAGGED)
+        res << "\\Flagged";
+    if (flags & FLAG_ANSWERED)
+        res << "\\Answered";
+    if (flags & FLAG_DELETED)
+        res << "\\Deleted";
+    return join(res, ' ');
+}
+
+/** @short Format a sorted list of numbers as a compact sequence set */
+QByteArray FakeImapServer::compressUids(const QVector<uint> &uids)
+{
+    QByteArray res;
+    int i = 0;
+    while (i < uids.size()) {
+        int j = i;
+        while (j + 1 < uids.size() && uids[j + 1] == uids[j] + 1)
+            ++j;
+        if (!res.isEmpty())
+            res += ',';
+        res += QByteArray::number(uids[i]);
+        if (j > i)
+            res += ':' + QByteArray::number(uids[j]);
+        i = j + 1;
+    }
+    return res;
+}
+
+bool FakeImapServer::matchesPattern(const QString &name, const QString &pattern)
+{
+    // A straightforward backtracking matcher for the LIST wildcards, where "%" does not match the hierarchy delimiter
+    std::function<bool(int, int)> match = [&](int i, int j) -> bool {
+        while (j < pattern.size()) {
+            const QChar c = pattern[j];
+            if (c == QLatin1Char('*') || c == QLatin1Char('%')) {
+                for (int k = i; k <= name.size(); ++k) {
+                    if (match(k, j + 1))
+                        return true;
+                    if (k < name.size() && c == QLatin1Char('%') && name[k] == QLatin1Char('/'))
+                        return false;
+                }
+                return false;
+            }
+            if (i >= name.size() || name[i] != c)
+                return false;
+            ++i;
+            ++j;
+        }
+        return i == name.size();
+    };
+    return match(0, 0);
+}
@@ -0,0 +1,202 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TEST_FAKE_IMAP_SERVER
+#define TEST_FAKE_IMAP_SERVER
+
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QStringList>
+#include <QVector>
+#include "Streams/SocketFactory.h"
+
+namespace Streams {
+class FakeSocket;
+}
+
+/** @short A scriptable stand-in for a real IMAP server
+
+This is a SocketFactory which hands out FakeSocket instances and answers whatever the client
+writes into them. Unlike the line-by-line scripting through cServer() and cClient(), the server
+actually understands a reasonable subset of IMAP4rev1 along with CONDSTORE, QRESYNC, ESEARCH,
+THREAD and COMPRESS, which makes it suitable for end-to-end tests and benchmarks which involve
+the real TaskFactory and mailboxes of any size.
+
+The mailboxes are synthesized from a MailboxOptions description. The generator is deterministic,
+so the same options always produce the same messages, flags and threads.
+*/
+class FakeImapServer : public Streams::SocketFactory
+{
+    Q_OBJECT
+public:
+    /** @short How to synthesize the contents of a mailbox */
+    struct MailboxOptions {
+        /** @short Number of messages in the mailbox */
+        uint messageCount;
+        uint uidValidity;
+        /** @short Percentage of UIDs which get skipped, as if they belonged to already expunged messages */
+        int uidGapPercent;
+        int seenPercent;
+        int flaggedPercent;
+        int answeredPercent;
+        /** @short Average number of messages in a thread; one means no replies at all */
+        int averageThreadSize;
+        /** @short Smallest RFC822.SIZE of a message */
+        uint minSize;
+        /** @short Largest RFC822.SIZE of a message */
+        uint maxSize;
+        /** @short Seed of the random number generator */
+        quint32 seed;
+
+        MailboxOptions();
+    };
+
+    FakeImapServer();
+    virtual ~FakeImapServer();
+
+    virtual Streams::Socket *create();
+    virtual void setProxySettings(const Streams::ProxySettings proxySettings, const QString &protocolTag);
+
+    /** @short Create a mailbox called @arg name and fill it according to the @arg options
+
+    The hierarchy delimiter is always a slash.
+    */
+    void addMailbox(const QString &name, const MailboxOptions &options);
+    void setCapabilities(const QStringList &capabilities);
+    QStringList capabilities() const;
+    /** @short Delay each response by @arg msec milliseconds */
+    void setLatency(const int msec);
+
+    /** @short Number of messages in the mailbox */
+    int messageCount(const QString &mailbox) const;
+    /** @short UID of the message at the zero-based @arg offset */
+    uint uidAt(const QString &mailbox, const int offset) const;
+    /** @short Number of messages without the \Seen flag */
+    int unreadCount(const QString &mailbox) const;
+    /** @short Number of messages which do not reply to any other message */
+    int threadRootCount(const QString &mailbox) const;
+    /** @short Subject of the message at the zero-based @arg offset */
+    QString subjectAt(const QString &mailbox, const int offset) const;
+    /** @short Change flags of the message at the zero-based @arg offset, as if done by some other client
+
+    The clients which have the mailbox selected get an unsolicited FETCH with the new flags.
+    */
+    void toggleSeen(const QString &mailbox, const int offset);
+    /** @short Deliver @arg count new messages and announce each of them to the clients which have the mailbox open */
+    void appendMessages(const QString &mailbox, const int count);
+    /** @short Remove messages at the given zero-based @arg offsets, notifying the clients through EXPUNGE or VANISHED */
+    void expungeMessages(const QString &mailbox, const QVector<int> &offsets);
+
+    /** @short Total number of commands which the server has processed so far */
+    int commandCount() const;
+    /** @short How many times was the given command, such as "UID FETCH", received */
+    int commandCount(const QByteArray &command) const;
+    /** @short Forget the command statistics */
+    void resetCommandCount();
+
+private slots:
+    void slotDataWritten();
+    void slotSocketDestroyed(QObject *socket);
+
+private:
+    enum {
+        FLAG_SEEN = 1 << 0,
+        FLAG_FLAGGED = 1 << 1,
+        FLAG_ANSWERED = 1 << 2,
+        FLAG_DELETED = 1 << 3
+    };
+
+    struct Mailbox {
+        MailboxOptions options;
+        /** @short UIDs of messages, sorted */
+        QVector<uint> uids;
+        QVector<quint8> flags;
+        QVector<uint> sizes;
+        /** @short Offset of the message this one replies to, or -1 for thread roots */
+        QVector<int> threadParents;
+        QVector<quint64> modSeqs;
+        quint64 highestModSeq;
+        uint uidNext;
+        /** @short State of the random number generator for messages which arrive later */
+        quint32 randomState;
+        /** @short Threads which are still receiving replies */
+        QList<QVector<int> > openThreads;
+        /** @short UIDs of the expunged messages along with the MODSEQ of their removal */
+        QVector<QPair<quint64, uint> > vanished;
+    };
+
+    struct Connection {
+        /** @short Data written by the client which have not been processed yet */
+        QByteArray input;
+        /** @short Command which is being assembled from a line with a literal */
+        QByteArray command;
+        /** @short Number of octets which are still missing from a literal */
+        int literalRemaining;
+        /** @short Tag of the IDLE command in progress */
+        QByteArray idleTag;
+        QString selected;
+        bool readOnly;
+        bool condstore;
+        bool qresync;
+
+        Connection();
+    };
+
+    void generateMessages(Mailbox &mailbox, const int count);
+    void processInput(Streams::FakeSocket *socket, Connection &connection);
+    void handleCommand(Streams::FakeSocket *socket, Connection &connection, const QByteArray &line);
+    void reply(Streams::FakeSocket *socket, const QByteArray &data);
+
+    QByteArray handleList(const QByteArray &tag, const QByteArray &verb, const QByteArray &args);
+    QByteArray handleStatus(const QByteArray &tag, const QByteArray &args);
+    QByteArray handleSelect(Connection &connection, const QByteArray &tag, const QByteArray &verb, const QByteArray &args);
+    QByteArray handleSearch(Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args);
+    QByteArray handleFetch(Connection &connection, Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args);
+    QByteArray handleStore(Connection &connection, Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args);
+    QByteArray handleThread(Mailbox &mailbox, const QByteArray &tag, const bool uid, const QByteArray &args);
+
+    QByteArray fetchItem(const Mailbox &mailbox, const int offset, const QByteArray &item) const;
+    QByteArray envelope(const Mailbox &mailbox, const int offset) const;
+    QByteArray bodyStructure(const Mailbox &mailbox, const int offset) const;
+    QByteArray headers(const Mailbox &mailbox, const int offset) const;
+    QByteArray bodyText(const Mailbox &mailbox, const int offset) const;
+    QByteArray messageId(const Mailbox &mailbox, const int offset) const;
+    QByteArray internalDate(const Mailbox &mailbox, const int offset) const;
+    QByteArray subject(const Mailbox &mailbox, const int offset) const;
+    QByteArray capabilityLine() const;
+
+    QVector<int> resolveSet(const Mailbox &mailbox, const QByteArray &set, const bool uid) const;
+    static QByteArray flagsToString(const quint8 flags);
+    static QByteArray compressUids(const QVector<uint> &uids);
+    static bool matchesPattern(const QString &name, const QString &pattern);
+
+    QMap<QString, Mailbox> m_mailboxes;
+    QHash<Streams::FakeSocket *, Connection> m_connections;
+    QStringList m_capabilities;
+    QHash<QByteArray, int> m_commandCounts;
+    int m_totalCommands;
+    int m_latency;
+};
+
+#endif
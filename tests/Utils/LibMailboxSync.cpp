@@ -49,7 +49,8 @@ ExpectSingleErrorHere::~ExpectSingleErrorHere()
 }
 
 LibMailboxSync::LibMailboxSync(): model(0), msgListModel(0), threadingModel(0), factory(0), taskFactoryUnsafe(0),
-    errorSpy(0), netErrorSpy(0), m_verbose(false), m_expectsError(false), m_fakeListCommand(true)
+    errorSpy(0), netErrorSpy(0), m_verbose(false), m_expectsError(false), m_fakeListCommand(true),
+    m_dataChangedCoalescingData(false)
 {
     m_verbose = qgetenv("TROJITA_IMAP_DEBUG") == QByteArray("1");
 }
@@ -91,6 +92,12 @@ void LibMailboxSync::init()
     }
     model = new Imap::Mailbox::Model(this, cache, Imap::Mailbox::SocketFactoryPtr(factory), std::move(taskFactory));
     model->setObjectName(QStringLiteral("imapModel"));
+    // Too slow for the real use, but this is what makes the incrementally maintained message counts trustworthy
+    model->setProperty("trojita-imap-check-message-counts", true);
+    if (m_dataChangedCoalescingData) {
+        QFETCH_GLOBAL(bool, coalesceDataChanged);
+        model->setDataChangedCoalescing(coalesceDataChanged);
+    }
     setupLogging();
 
     msgListModel = new Imap::Mailbox::MsgListModel(this, model);
@@ -119,6 +126,11 @@ void LibMailboxSync::modelSignalsError(const QString &message)
 
 void LibMailboxSync::modelLogged(uint parserId, const Common::LogMessage &message)
 {
+    if (message.source == QLatin1String("TreeItemMsgList::checkMessageCountsConsistency")) {
+        qDebug() << message.message;
+        QFAIL("The message counts are out of sync with the messages");
+    }
+
     if (!m_verbose)
         return;
 
@@ -186,6 +198,18 @@ void LibMailboxSync::initTestCase()
     netErrorSpy = 0;
 }
 
+/** @short Run each test twice, with the dataChanged() of messages merged into ranges and with one signal per message
+
+Call this from the initTestCase_data() of the test.
+*/
+void LibMailboxSync::helperDataChangedCoalescingData()
+{
+    QTest::addColumn<bool>("coalesceDataChanged");
+    QTest::newRow("coalesced") << true;
+    QTest::newRow("per-message") << false;
+    m_dataChangedCoalescingData = true;
+}
+
 /** @short Helper: simulate sync of mailbox A that contains some messages from an empty state */
 void LibMailboxSync::helperSyncAWithMessagesEmptyState()
 {
@@ -713,7 +737,7 @@ char *toString(const Imap::Mailbox::AbstractCache::MessageDataBundle &bundle)
     QString buf;
     QDebug d(&buf);
     d << "UID:" << bundle.uid << "Envelope:" << bundle.envelope << "size:" << bundle.size <<
-         "bodystruct:" << bundle.serializedBodyStructure;
+         "bodystruct:" << bundle.serializedBodyStructure << "attachments:" << bundle.attachments;
     return qstrdup(buf.toUtf8().constData());
 }
 
@@ -98,6 +98,7 @@ protected:
     QByteArray helperCreateTrivialEnvelope(const uint seq, const uint uid, const QString &subject, const QString &from, const QString &bodyStructure);
 
     void helperInitialListing();
+    void helperDataChangedCoalescingData();
     void initialMessages(const uint exists);
     void justKeepTask();
     void checkNoTasks();
@@ -118,6 +119,7 @@ protected:
     bool m_verbose;
     bool m_expectsError;
     bool m_fakeListCommand;
+    bool m_dataChangedCoalescingData;
 
     friend class ExpectSingleErrorHere;
 };
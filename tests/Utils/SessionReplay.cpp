@@ -0,0 +1,339 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <limits>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSslCertificate>
+#include <QSslError>
+#include <QTest>
+#include "SessionReplay.h"
+#include "LibMailboxSync.h"
+#include "Imap/Encoders.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/Model.h"
+#include "Streams/FakeSocket.h"
+#include "Streams/SocketFactory.h"
+
+using namespace Imap::Mailbox;
+
+namespace {
+
+/** @short Is this a command tagged by the Parser, as opposed to a literal continuation or the DONE? */
+bool isTagged(const QByteArray &command, int &tagEnd)
+{
+    tagEnd = command.indexOf(' ');
+    if (tagEnd < 2 || command[0] != 'y')
+        return false;
+    for (int i = 1; i < tagEnd; ++i) {
+        if (command[i] < '0' || command[i] > '9')
+            return false;
+    }
+    return true;
+}
+
+/** @short Read an atom or a quoted string starting at @arg pos and skip the following space */
+QByteArray readAstring(const QByteArray &line, int &pos)
+{
+    QByteArray res;
+    if (pos < line.size() && line[pos] == '"') {
+        for (++pos; pos < line.size() && line[pos] != '"'; ++pos) {
+            if (line[pos] == '\\' && pos + 1 < line.size())
+                ++pos;
+            res += line[pos];
+        }
+        ++pos;
+    } else {
+        while (pos < line.size() && line[pos] != ' ' && line[pos] != '\r' && line[pos] != '(')
+            res += line[pos++];
+    }
+    if (pos < line.size() && line[pos] == ' ')
+        ++pos;
+    return res;
+}
+
+/** @short Skip the tag and return the name of the command, including the UID prefix */
+QByteArray readVerb(const QByteArray &command, int &pos)
+{
+    pos = command.indexOf(' ') + 1;
+    QByteArray verb = readAstring(command, pos).toUpper();
+    if (verb == "UID")
+        verb += ' ' + readAstring(command, pos).toUpper();
+    return verb;
+}
+
+uint sequenceNumber(const QByteArray &item)
+{
+    return item == "*" ? std::numeric_limits<uint>::max() : item.toUInt();
+}
+
+bool uidInSequence(const uint uid, const QByteArray &sequence)
+{
+    if (!uid)
+        return false;
+    Q_FOREACH(const QByteArray &item, sequence.split(',')) {
+        int colon = item.indexOf(':');
+        if (colon == -1) {
+            if (sequenceNumber(item) == uid)
+                return true;
+        } else {
+            uint a = sequenceNumber(item.left(colon));
+            uint b = sequenceNumber(item.mid(colon + 1));
+            if (uid >= qMin(a, b) && uid <= qMax(a, b))
+                return true;
+        }
+    }
+    return false;
+}
+
+}
+
+SessionReplay::SessionReplay(QObject *parent, Model *model, Streams::FakeSocketFactory *factory,
+                             const QVector<SessionTraceRecord> &records):
+    QObject(parent), m_model(model), m_factory(factory), m_replayedRecords(0), m_idleWaitTime(0), m_commandTimeout(5000)
+{
+    if (records.isEmpty())
+        return;
+    const uint parserId = records.first().parserId;
+    Q_FOREACH(const SessionTraceRecord &record, records) {
+        if (record.parserId != parserId) {
+            m_error = QStringLiteral("The trace contains traffic of more than one connection (parsers %1 and %2), "
+                                     "but only a single connection can be replayed")
+                    .arg(QString::number(parserId), QString::number(record.parserId));
+            return;
+        }
+    }
+    m_records = records;
+}
+
+bool SessionReplay::run()
+{
+    if (!m_error.isEmpty())
+        return false;
+    if (m_records.isEmpty()) {
+        m_error = QStringLiteral("The trace is empty");
+        return false;
+    }
+
+    Q_FOREACH(const SessionTraceRecord &record, m_records) {
+        int pos;
+        if (record.direction == SessionTraceRecord::CLIENT_TO_SERVER && readVerb(record.data, pos) == "STARTTLS") {
+            m_factory->setStartTlsRequired(true);
+            break;
+        }
+    }
+    connect(m_model, &Model::needsSslDecision, this,
+            [this](const QList<QSslCertificate> &certificates, const QList<QSslError> &sslErrors) {
+        m_model->setSslPolicy(certificates, sslErrors, true);
+    });
+    m_model->setImapUser(QStringLiteral("replay"));
+    m_model->setImapPassword(QStringLiteral("replay"));
+    LibMailboxSync::setModelNetworkPolicy(m_model, NETWORK_ONLINE);
+    // Asking for the list of mailboxes is what makes the Model connect
+    m_model->rowCount(QModelIndex());
+
+    for (auto it = m_records.constBegin(); it != m_records.constEnd(); ++it) {
+        if (it->direction == SessionTraceRecord::SERVER_TO_CLIENT) {
+            for (int i = 0; !m_socket && i < 10; ++i) {
+                QCoreApplication::processEvents();
+                collectWrittenData();
+            }
+            if (!m_socket) {
+                m_error = QStringLiteral("The Model has not connected to the server");
+                return false;
+            }
+            m_socket->fakeReading(it->data);
+        } else {
+            int pos;
+            const QByteArray verb = readVerb(it->data, pos);
+            if (verb == "SELECT" || verb == "EXAMINE")
+                m_selectedMailbox = Imap::decodeImapFolderName(readAstring(it->data, pos));
+            switch (waitForCommand(it->data)) {
+            case CommandMatch::MATCHED:
+                break;
+            case CommandMatch::PENDING:
+                m_error = QStringLiteral("Record #%1: the Model did not send %2")
+                        .arg(QString::number(m_replayedRecords), QString::fromUtf8(it->data.trimmed()));
+                return false;
+            case CommandMatch::MISMATCH:
+                m_error = QStringLiteral("Record #%1: expected %2, but the Model sent %3")
+                        .arg(QString::number(m_replayedRecords), QString::fromUtf8(it->data.trimmed()),
+                             QString::fromUtf8(m_written.left(m_written.indexOf('\n')).trimmed()));
+                return false;
+            }
+        }
+        ++m_replayedRecords;
+    }
+
+    // Let the Model process whatever has been fed into it
+    for (int i = 0; i < 10; ++i)
+        QCoreApplication::processEvents();
+    return true;
+}
+
+SessionReplay::CommandMatch SessionReplay::waitForCommand(const QByteArray &command)
+{
+    // At first, give the Model a chance to send the command on its own
+    for (int i = 0; i < 10; ++i) {
+        CommandMatch match = consumeCommand(command);
+        if (match != CommandMatch::PENDING)
+            return match;
+        QCoreApplication::processEvents();
+    }
+
+    stimulate(command);
+    for (int i = 0; i < 10; ++i) {
+        CommandMatch match = consumeCommand(command);
+        if (match != CommandMatch::PENDING)
+            return match;
+        QCoreApplication::processEvents();
+    }
+
+    // Some commands, like the IDLE, are only sent after a timer expires
+    QElapsedTimer timer;
+    timer.start();
+    CommandMatch match = CommandMatch::PENDING;
+    while (match == CommandMatch::PENDING && timer.elapsed() < m_commandTimeout) {
+        QTest::qWait(10);
+        match = consumeCommand(command);
+    }
+    m_idleWaitTime += timer.elapsed();
+    return match;
+}
+
+/** @short Compare the oldest data sent by the Model which were not matched yet with the recorded @arg command */
+SessionReplay::CommandMatch SessionReplay::consumeCommand(const QByteArray &command)
+{
+    collectWrittenData();
+    if (m_written.isEmpty())
+        return CommandMatch::PENDING;
+
+    if (command == "[LOGIN command goes here]") {
+        // This is what the Parser reports instead of the credentials
+        const int end = m_written.indexOf('\n');
+        if (end == -1)
+            return CommandMatch::PENDING;
+        int pos;
+        if (readVerb(m_written.left(end + 1), pos) != "LOGIN")
+            return CommandMatch::MISMATCH;
+        m_written = m_written.mid(end + 1);
+        return CommandMatch::MATCHED;
+    }
+
+    QByteArray expected = command;
+    QByteArray actual = m_written;
+    int expectedTagEnd;
+    if (isTagged(expected, expectedTagEnd)) {
+        int actualTagEnd;
+        if (!isTagged(actual, actualTagEnd))
+            return CommandMatch::MISMATCH;
+        // The replayed session need not start with the same tag as the recorded one
+        expected = expected.mid(expectedTagEnd);
+        actual = actual.mid(actualTagEnd);
+    }
+
+    if (!actual.startsWith(expected))
+        return expected.startsWith(actual) ? CommandMatch::PENDING : CommandMatch::MISMATCH;
+    m_written = actual.mid(expected.size());
+    return CommandMatch::MATCHED;
+}
+
+void SessionReplay::collectWrittenData()
+{
+    if (!m_socket)
+        m_socket = qobject_cast<Streams::FakeSocket *>(m_factory->lastSocket());
+    if (!m_socket)
+        return;
+
+    QByteArray data = m_socket->writtenStuff();
+    // The FakeSocket marks the negotiation of TLS and compression in the stream of data
+    data.replace("[*** STARTTLS ***]", QByteArray());
+    data.replace("[*** DEFLATE ***]", QByteArray());
+    data.replace("[*** close ***]", QByteArray());
+    m_written += data;
+}
+
+void SessionReplay::stimulate(const QByteArray &command)
+{
+    int pos;
+    const QByteArray verb = readVerb(command, pos);
+
+    if (verb == "SELECT" || verb == "EXAMINE") {
+        QModelIndex mailbox = findMailbox(Imap::decodeImapFolderName(readAstring(command, pos)));
+        if (mailbox.isValid())
+            m_model->rowCount(m_model->index(0, 0, mailbox));
+    } else if (verb == "LIST") {
+        // skip the reference name
+        readAstring(command, pos);
+        QByteArray pattern = readAstring(command, pos);
+        if (!pattern.endsWith('%'))
+            return;
+        // get rid of the wildcard and of the hierarchy separator
+        pattern.chop(pattern.size() > 1 ? 2 : 1);
+        if (pattern.isEmpty()) {
+            m_model->rowCount(QModelIndex());
+        } else {
+            QModelIndex parent = findMailbox(Imap::decodeImapFolderName(pattern));
+            if (parent.isValid())
+                m_model->rowCount(parent);
+        }
+    } else if (verb == "UID FETCH" && command.contains("ENVELOPE")) {
+        const QByteArray sequence = readAstring(command, pos);
+        QModelIndex mailbox = findMailbox(m_selectedMailbox);
+        if (!mailbox.isValid())
+            return;
+        QModelIndex list = m_model->index(0, 0, mailbox);
+        for (int i = 0; i < m_model->rowCount(list); ++i) {
+            QModelIndex message = m_model->index(i, 0, list);
+            if (uidInSequence(message.data(RoleMessageUid).toUInt(), sequence))
+                message.data(RoleMessageSubject);
+        }
+    }
+}
+
+/** @short Find a mailbox by its name, descending only into mailboxes which are on the way to it */
+QModelIndex SessionReplay::findMailbox(const QString &name)
+{
+    if (name.isEmpty())
+        return QModelIndex();
+
+    QModelIndex parent;
+    while (true) {
+        QModelIndex next;
+        // The first row is the list of messages, child mailboxes follow
+        for (int i = 1; i < m_model->rowCount(parent); ++i) {
+            QModelIndex mailbox = m_model->index(i, 0, parent);
+            const QString mailboxName = mailbox.data(RoleMailboxName).toString();
+            if (mailboxName == name)
+                return mailbox;
+            const QString separator = mailbox.data(RoleMailboxSeparator).toString();
+            if (!separator.isEmpty() && name.startsWith(mailboxName + separator)) {
+                next = mailbox;
+                break;
+            }
+        }
+        if (!next.isValid())
+            return QModelIndex();
+        parent = next;
+    }
+}
@@ -0,0 +1,102 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TEST_SESSION_REPLAY
+#define TEST_SESSION_REPLAY
+
+#include <QModelIndex>
+#include <QPointer>
+#include <QVector>
+#include "Imap/Model/SessionTrace.h"
+
+namespace Imap {
+namespace Mailbox {
+class Model;
+}
+}
+
+namespace Streams {
+class FakeSocket;
+class FakeSocketFactory;
+}
+
+/** @short Feed a recorded IMAP session back into a real Model
+
+Only traces of a single connection can be replayed. The records of several parsers would have to be spread over several
+sockets, so run() fails right away for such traces and errorString() says why. The server's data are pushed into the
+FakeSocket as soon as the Model has sent the command which preceded them in the original session, without honoring the
+recorded delays.
+Each command which the Model sends has to be the same as the recorded one, in the same order. Only the tags may differ,
+as they are assigned by the Parser, and any LOGIN matches the recorded one because the trace does not contain the
+credentials. The replay fails as soon as the Model sends anything else.
+
+Some commands were caused by the user in the original session, and the Model won't send them on its own. The replay
+therefore mimics what the user has most likely done: it opens the mailbox for SELECT and EXAMINE, asks for child mailboxes
+for LIST, and for UID FETCH of the message metadata it asks for the subject of the affected messages.
+*/
+class SessionReplay : public QObject
+{
+    Q_OBJECT
+public:
+    SessionReplay(QObject *parent, Imap::Mailbox::Model *model, Streams::FakeSocketFactory *factory,
+                  const QVector<Imap::Mailbox::SessionTraceRecord> &records);
+
+    /** @short Replay the whole session, return false if the Model did not follow the recorded conversation */
+    bool run();
+
+    QString errorString() const { return m_error; }
+    /** @short Number of records which were successfully replayed */
+    int replayedRecords() const { return m_replayedRecords; }
+    /** @short Time spent waiting for commands which the Model sends from a timer, in milliseconds */
+    qint64 idleWaitTime() const { return m_idleWaitTime; }
+    /** @short How long to wait for a command which the Model did not send immediately */
+    void setCommandTimeout(const int msec) { m_commandTimeout = msec; }
+
+private:
+    /** @short Result of comparing what the Model has sent with the recorded command */
+    enum class CommandMatch {
+        MATCHED, /**< @short The command was sent and it is gone from the m_written */
+        PENDING, /**< @short Nothing or just a part of the command was sent so far */
+        MISMATCH /**< @short The Model has sent something else */
+    };
+
+    CommandMatch waitForCommand(const QByteArray &command);
+    CommandMatch consumeCommand(const QByteArray &command);
+    void stimulate(const QByteArray &command);
+    void collectWrittenData();
+    QModelIndex findMailbox(const QString &name);
+
+    Imap::Mailbox::Model *m_model;
+    Streams::FakeSocketFactory *m_factory;
+    QPointer<Streams::FakeSocket> m_socket;
+    QVector<Imap::Mailbox::SessionTraceRecord> m_records;
+    /** @short Data sent by the Model which were not matched against the trace yet */
+    QByteArray m_written;
+    QString m_selectedMailbox;
+    QString m_error;
+    int m_replayedRecords;
+    qint64 m_idleWaitTime;
+    int m_commandTimeout;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** @short Replay a recorded IMAP session into a fresh Model and report how expensive that was
+
+The trace is produced by running Trojita with the --record-imap-session option. The Model starts with an empty in-memory
+cache, so the replay goes through the complete synchronization which happened in the recorded session.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+#include "Common/MetaTypes.h"
+#include "Imap/Model/MemoryCache.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Model/SessionTrace.h"
+#include "Imap/Model/TaskFactory.h"
+#include "Streams/SocketFactory.h"
+#include "SessionReplay.h"
+
+static std::atomic<quint64> allocationCount(0);
+
+void *operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+namespace {
+
+struct ResourceUsage {
+    /** @short User and system CPU time in milliseconds, or -1 if not known */
+    qint64 cpuTime;
+    /** @short Peak resident set size in kilobytes, or -1 if not known */
+    qint64 peakRss;
+
+    static ResourceUsage current()
+    {
+        ResourceUsage res = {-1, -1};
+#ifdef Q_OS_UNIX
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            res.cpuTime = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+                    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+#ifdef Q_OS_MAC
+            res.peakRss = usage.ru_maxrss / 1024;
+#else
+            res.peakRss = usage.ru_maxrss;
+#endif
+        }
+#endif
+        return res;
+    }
+};
+
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    Common::registerMetaTypes();
+
+    QTextStream qOut(stdout, QIODevice::WriteOnly);
+    QTextStream qErr(stderr, QIODevice::WriteOnly);
+
+    if (app.arguments().size() != 2) {
+        qErr << "Usage: " << app.arguments().at(0) << " <trace-file>" << endl;
+        return 1;
+    }
+
+    QFile file(app.arguments().at(1));
+    if (!file.open(QIODevice::ReadOnly)) {
+        qErr << "Cannot open " << file.fileName() << ": " << file.errorString() << endl;
+        return 1;
+    }
+    QVector<Imap::Mailbox::SessionTraceRecord> records;
+    Imap::Mailbox::SessionTraceReader reader(&file);
+    Imap::Mailbox::SessionTraceRecord record;
+    while (reader.readNext(record))
+        records << record;
+    if (!reader.errorString().isNull()) {
+        qErr << file.fileName() << ": " << reader.errorString() << endl;
+        return 1;
+    }
+
+    auto factory = new Streams::FakeSocketFactory(Imap::CONN_STATE_CONNECTED_PRETLS_PRECAPS);
+    Imap::Mailbox::Model *model = new Imap::Mailbox::Model(&app, new Imap::Mailbox::MemoryCache(&app),
+                                                           Imap::Mailbox::SocketFactoryPtr(factory),
+                                                           Imap::Mailbox::TaskFactoryPtr(new Imap::Mailbox::TaskFactory()));
+    SessionReplay replay(&app, model, factory, records);
+
+    const ResourceUsage before = ResourceUsage::current();
+    const quint64 allocationsBefore = allocationCount;
+    QElapsedTimer wallTime;
+    wallTime.start();
+    const bool ok = replay.run();
+    const qint64 elapsed = wallTime.elapsed();
+    const quint64 allocations = allocationCount - allocationsBefore;
+    const ResourceUsage after = ResourceUsage::current();
+
+    qOut << "Replayed records: " << replay.replayedRecords() << " of " << records.size() << endl;
+    qOut << "Wall time: " << elapsed << " ms (of which " << replay.idleWaitTime() << " ms waiting for timers)" << endl;
+    if (after.cpuTime >= 0)
+        qOut << "CPU time: " << after.cpuTime - before.cpuTime << " ms" << endl;
+    qOut << "Allocations: " << allocations << endl;
+    if (after.peakRss >= 0)
+        qOut << "Peak RSS: " << after.peakRss << " kB" << endl;
+
+    if (!ok) {
+        qErr << "Replay failed: " << replay.errorString() << endl;
+        return 2;
+    }
+    return 0;
+}